@@ -0,0 +1,304 @@
+/***********************************************************************************************************************
+ *
+ * Copyright (c) 2015, ABB Schweiz AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that
+ * the following conditions are met:
+ *
+ *    * Redistributions of source code must retain the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer in the documentation
+ *      and/or other materials provided with the
+ *      distribution.
+ *    * Neither the name of ABB nor the names of its
+ *      contributors may be used to endorse or promote
+ *      products derived from this software without
+ *      specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***********************************************************************************************************************
+ */
+
+// Benchmark of the quintic and the septic spline methods, over a trajectory with many short segments.
+//
+// The smoothness is measured as the largest jerk jump at the segment boundaries, and the cost as the time to
+// update and evaluate the interpolator. The septic spline method uses minimum snap jerks at the interior points.
+//
+// The benchmark fails if the septic spline method doesn't remove the jerk jumps, or if its cost is more than
+// MAX_COST_RATIO times the quintic spline method's cost.
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <boost/chrono.hpp>
+
+#include "abb_libegm/egm_interpolator.h"
+
+using namespace abb::egm;
+using namespace abb::egm::wrapper::trajectory;
+
+namespace
+{
+/**
+ * \brief Number of joints in the benchmark's trajectory.
+ */
+const int JOINTS = 6;
+
+/**
+ * \brief Number of points in the benchmark's trajectory.
+ */
+const int POINTS = 200;
+
+/**
+ * \brief Number of times to interpolate the trajectory, when measuring the cost.
+ */
+const int REPETITIONS = 50;
+
+/**
+ * \brief Sample time [s] used when evaluating the interpolator.
+ */
+const double SAMPLE_TIME = 0.004;
+
+/**
+ * \brief Largest allowed jerk jump [degrees/s^3] at the segment boundaries, for the septic spline method.
+ */
+const double MAX_SEPTIC_JERK_JUMP = 1e-6;
+
+/**
+ * \brief Largest allowed ratio between the septic and the quintic spline methods' costs.
+ */
+const double MAX_COST_RATIO = 3.0;
+
+/**
+ * \brief Struct for containing the results of one spline method.
+ */
+struct Result
+{
+  Result() : max_jerk_jump(0.0), max_jerk(0.0), nanoseconds_per_sample(0.0) {}
+
+  double max_jerk_jump;
+  double max_jerk;
+  double nanoseconds_per_sample;
+};
+
+/**
+ * \brief Create the benchmark's trajectory (sampled from a sum of sines, with uneven segment durations).
+ *
+ * \param p_points for containing the points.
+ */
+void createTrajectory(std::vector<PointGoal>* p_points)
+{
+  double t = 0.0;
+
+  for (int i = 0; i < POINTS; ++i)
+  {
+    PointGoal point;
+    point.set_duration(0.05 + 0.03*(i % 5));
+    t += point.duration();
+
+    for (int j = 0; j < JOINTS; ++j)
+    {
+      double w1 = 1.0 + 0.3*j;
+      double w2 = 4.0 + 0.7*j;
+
+      point.mutable_robot()->mutable_joints()->mutable_position()->add_values(
+        30.0*std::sin(w1*t) + 5.0*std::sin(w2*t));
+      point.mutable_robot()->mutable_joints()->mutable_velocity()->add_values(
+        30.0*w1*std::cos(w1*t) + 5.0*w2*std::cos(w2*t));
+      point.mutable_robot()->mutable_joints()->mutable_acceleration()->add_values(
+        -30.0*w1*w1*std::sin(w1*t) - 5.0*w2*w2*std::sin(w2*t));
+      point.mutable_robot()->mutable_joints()->mutable_jerk()->add_values(0.0);
+    }
+
+    p_points->push_back(point);
+  }
+}
+
+/**
+ * \brief Set the interior points' jerks, in the same way as the trajectory interface's jerk estimation.
+ *
+ * \param p_points for the points.
+ */
+void estimateJerks(std::vector<PointGoal>* p_points)
+{
+  for (size_t i = 1; i + 1 < p_points->size(); ++i)
+  {
+    const PointGoal& start = (*p_points)[i - 1];
+    const PointGoal& next = (*p_points)[i + 1];
+    PointGoal& middle = (*p_points)[i];
+
+    for (int j = 0; j < JOINTS; ++j)
+    {
+      EGMInterpolator::BoundaryValues start_values(start.robot().joints().position().values(j),
+                                                   start.robot().joints().velocity().values(j),
+                                                   start.robot().joints().acceleration().values(j),
+                                                   start.robot().joints().jerk().values(j));
+
+      EGMInterpolator::BoundaryValues middle_values(middle.robot().joints().position().values(j),
+                                                    middle.robot().joints().velocity().values(j),
+                                                    middle.robot().joints().acceleration().values(j));
+
+      EGMInterpolator::BoundaryValues goal_values(next.robot().joints().position().values(j),
+                                                  next.robot().joints().velocity().values(j),
+                                                  next.robot().joints().acceleration().values(j));
+
+      double jerk = EGMInterpolator::calculateMinimumSnapJerk(start_values,
+                                                              middle_values,
+                                                              goal_values,
+                                                              middle.duration(),
+                                                              next.duration());
+
+      middle.mutable_robot()->mutable_joints()->mutable_jerk()->set_values(j, jerk);
+    }
+  }
+}
+
+/**
+ * \brief Interpolate the trajectory, and measure the smoothness and the cost.
+ *
+ * \param points containing the points.
+ * \param spline_method specifying the spline method to use.
+ *
+ * \return Result containing the results.
+ */
+Result run(const std::vector<PointGoal>& points, const TrajectoryConfiguration::SplineMethod spline_method)
+{
+  Result result;
+  EGMInterpolator interpolator;
+  EGMInterpolator::Conditions conditions;
+  conditions.mode = EGMJoint;
+  conditions.operation = EGMInterpolator::Normal;
+  conditions.spline_method = spline_method;
+
+  PointGoal output = points.front();
+
+  // Measure the smoothness (i.e. evaluate the jerks at both ends of each segment).
+  std::vector<double> previous_jerks(JOINTS, 0.0);
+
+  for (size_t i = 1; i < points.size(); ++i)
+  {
+    conditions.duration = points[i].duration();
+    interpolator.update(points[i - 1], points[i], conditions);
+
+    interpolator.evaluate(&output, SAMPLE_TIME, 0.0);
+    for (int j = 0; j < JOINTS && i > 1; ++j)
+    {
+      double jerk = output.robot().joints().jerk().values(j);
+      result.max_jerk_jump = std::max(result.max_jerk_jump, std::abs(jerk - previous_jerks[j]));
+    }
+
+    for (double t = 0.0; t < conditions.duration; t += SAMPLE_TIME)
+    {
+      interpolator.evaluate(&output, SAMPLE_TIME, t);
+      for (int j = 0; j < JOINTS; ++j)
+      {
+        result.max_jerk = std::max(result.max_jerk, std::abs(output.robot().joints().jerk().values(j)));
+      }
+    }
+
+    interpolator.evaluate(&output, SAMPLE_TIME, conditions.duration);
+    for (int j = 0; j < JOINTS; ++j)
+    {
+      previous_jerks[j] = output.robot().joints().jerk().values(j);
+    }
+  }
+
+  // Measure the cost (i.e. the same work as the trajectory interface does, one update per segment).
+  unsigned int samples = 0;
+  boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+
+  for (int r = 0; r < REPETITIONS; ++r)
+  {
+    for (size_t i = 1; i < points.size(); ++i)
+    {
+      conditions.duration = points[i].duration();
+      interpolator.update(points[i - 1], points[i], conditions);
+
+      for (double t = SAMPLE_TIME; t <= conditions.duration; t += SAMPLE_TIME)
+      {
+        interpolator.evaluate(&output, SAMPLE_TIME, t);
+        ++samples;
+      }
+    }
+  }
+
+  boost::chrono::nanoseconds elapsed = boost::chrono::steady_clock::now() - start;
+  result.nanoseconds_per_sample = ((double) elapsed.count()) / samples;
+
+  return result;
+}
+
+/**
+ * \brief Print a result.
+ *
+ * \param name specifying the name of the spline method.
+ * \param result containing the result.
+ */
+void print(const char* name, const Result& result)
+{
+  std::cout << std::left << std::setw(20) << name
+            << std::right << std::setw(16) << result.max_jerk_jump
+            << std::setw(16) << result.max_jerk
+            << std::setw(16) << result.nanoseconds_per_sample << "\n";
+}
+} // end anonymous namespace
+
+int main()
+{
+  std::vector<PointGoal> points;
+  createTrajectory(&points);
+
+  Result quintic = run(points, TrajectoryConfiguration::Quintic);
+  Result septic_zero_jerk = run(points, TrajectoryConfiguration::Septic);
+
+  estimateJerks(&points);
+  Result septic = run(points, TrajectoryConfiguration::Septic);
+
+  std::cout << std::left << std::setw(20) << "method"
+            << std::right << std::setw(16) << "max jerk jump"
+            << std::setw(16) << "max |jerk|"
+            << std::setw(16) << "ns/sample" << "\n";
+  print("quintic", quintic);
+  print("septic (zero jerk)", septic_zero_jerk);
+  print("septic (min snap)", septic);
+
+  bool ok = true;
+
+  if (septic.max_jerk_jump > MAX_SEPTIC_JERK_JUMP || septic.max_jerk_jump >= quintic.max_jerk_jump)
+  {
+    std::cerr << "FAILED: The septic spline method has jerk jumps at the segment boundaries\n";
+    ok = false;
+  }
+
+  if (septic.max_jerk >= septic_zero_jerk.max_jerk)
+  {
+    std::cerr << "FAILED: The minimum snap jerks don't lower the peak jerk, compared to zero jerks\n";
+    ok = false;
+  }
+
+  if (septic.nanoseconds_per_sample > MAX_COST_RATIO*quintic.nanoseconds_per_sample)
+  {
+    std::cerr << "FAILED: The septic spline method costs more than " << MAX_COST_RATIO << " times the quintic\n";
+    ok = false;
+  }
+
+  return (ok ? 0 : 1);
+}
@@ -0,0 +1,275 @@
+/***********************************************************************************************************************
+ *
+ * Copyright (c) 2015, ABB Schweiz AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that
+ * the following conditions are met:
+ *
+ *    * Redistributions of source code must retain the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer in the documentation
+ *      and/or other materials provided with the
+ *      distribution.
+ *    * Neither the name of ABB nor the names of its
+ *      contributors may be used to endorse or promote
+ *      products derived from this software without
+ *      specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***********************************************************************************************************************
+ */
+
+// Benchmark of the pre-warming of the interface's working set, under a noisy-neighbour load.
+//
+// A simulated robot controller exchanges messages with a trajectory interface every 4 [ms] (over the loopback
+// interface), while a low-priority thread continuously sweeps a large buffer (i.e. it evicts the interface's state
+// from the CPU caches in between the messages). The round-trip times are measured with, and without, pre-warming,
+// in alternating rounds (i.e. so that slow drifts in the machine's load affect both equally).
+//
+// The benchmark fails if the 99th percentile round-trip time with pre-warming exceeds MAX_P99_RATIO times the
+// round-trip time without it. The ratio allows for the measurement noise on shared (e.g. virtualized) machines.
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <boost/atomic.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/chrono.hpp>
+#include <boost/thread.hpp>
+
+#include "abb_libegm/egm_trajectory_interface.h"
+
+#include "egm_robot_controller_simulator.h"
+
+using namespace abb::egm;
+using abb::egm::simulation::RobotControllerSimulator;
+
+namespace
+{
+/**
+ * \brief Number of messages exchanged before the round-trip times are measured.
+ */
+const unsigned int WARMUP_MESSAGES = 100;
+
+/**
+ * \brief Number of messages exchanged, in each round, while the round-trip times are measured.
+ */
+const unsigned int MEASURED_MESSAGES = 500;
+
+/**
+ * \brief Number of rounds with, and without, pre-warming.
+ */
+const int ROUNDS = 3;
+
+/**
+ * \brief The robot controller's sample time [ms].
+ */
+const int SAMPLE_TIME_MS = 4;
+
+/**
+ * \brief The pre-warming lead time [us].
+ */
+const unsigned int PREWARM_LEAD_TIME_US = 200;
+
+/**
+ * \brief Size [bytes] of the buffer swept by the noisy neighbour (i.e. larger than the CPU caches).
+ */
+const size_t NOISE_BUFFER_SIZE = 64*1024*1024;
+
+/**
+ * \brief Largest allowed ratio between the 99th percentile round-trip times with, and without, pre-warming.
+ */
+const double MAX_P99_RATIO = 1.25;
+
+/**
+ * \brief Struct for containing the results of one run.
+ */
+struct Result
+{
+  Result() : median_us(0.0), p99_us(0.0), max_us(0.0) {}
+
+  double median_us;
+  double p99_us;
+  double max_us;
+};
+
+/**
+ * \brief Sweep a large buffer until stopped (i.e. a noisy neighbour, which evicts other threads' cached data).
+ *
+ * Note: The thread is given the lowest scheduling priority (if supported), so that it only runs when the other
+ *       threads are idle (i.e. in between the messages), and never delays the callbacks themselves.
+ *
+ * \param p_stop for a flag indicating if the sweeping should stop.
+ */
+void runNoisyNeighbour(boost::atomic<bool>* p_stop)
+{
+#ifdef __linux__
+  sched_param parameters;
+  parameters.sched_priority = 0;
+  pthread_setschedparam(pthread_self(), SCHED_IDLE, &parameters);
+#endif
+
+  std::vector<char> buffer(NOISE_BUFFER_SIZE);
+
+  for (unsigned char value = 0; !p_stop->load(); ++value)
+  {
+    for (size_t i = 0; i < buffer.size() && !p_stop->load(boost::memory_order_relaxed); i += 64)
+    {
+      buffer[i] = (char) value;
+    }
+  }
+}
+
+/**
+ * \brief Create a long trajectory (i.e. so that the interface executes trajectory points during the whole run).
+ *
+ * \return wrapper::trajectory::TrajectoryGoal containing the trajectory.
+ */
+wrapper::trajectory::TrajectoryGoal createTrajectory()
+{
+  wrapper::trajectory::TrajectoryGoal trajectory;
+
+  for (int i = 0; i < 2000; ++i)
+  {
+    wrapper::trajectory::PointGoal* p_point = trajectory.add_points();
+    p_point->set_duration(0.1);
+
+    for (int j = 0; j < 6; ++j)
+    {
+      p_point->mutable_robot()->mutable_joints()->mutable_position()->add_values(10.0*((i % 2) ? 1.0 : -1.0));
+    }
+  }
+
+  return trajectory;
+}
+
+/**
+ * \brief Run a trajectory interface, under the noisy-neighbour load, and measure the round-trip times.
+ *
+ * \param port_number specifying the interface's port number.
+ * \param prewarm_lead_time specifying the pre-warming lead time [us] (zero disables the pre-warming).
+ * \param p_round_trips for containing the measured round-trip times [us].
+ */
+void run(const unsigned short port_number, const unsigned int prewarm_lead_time, std::vector<double>* p_round_trips)
+{
+  TrajectoryConfiguration configuration;
+  configuration.base.prewarm_lead_time = prewarm_lead_time;
+
+  boost::asio::io_service io_service;
+  EGMTrajectoryInterface interface(io_service, port_number, configuration);
+  interface.addTrajectory(createTrajectory());
+
+  boost::thread thread(boost::bind(&boost::asio::io_service::run, &io_service));
+  RobotControllerSimulator simulator(port_number);
+
+  boost::atomic<bool> stop(false);
+  boost::thread noisy_neighbour(boost::bind(&runNoisyNeighbour, &stop));
+
+  boost::chrono::steady_clock::time_point next = boost::chrono::steady_clock::now();
+
+  for (unsigned int i = 0; i < WARMUP_MESSAGES + MEASURED_MESSAGES; ++i)
+  {
+    next += boost::chrono::milliseconds(SAMPLE_TIME_MS);
+    boost::this_thread::sleep_until(next);
+
+    boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+    simulator.exchange();
+    boost::chrono::nanoseconds elapsed = boost::chrono::steady_clock::now() - start;
+
+    if (i >= WARMUP_MESSAGES)
+    {
+      p_round_trips->push_back(elapsed.count()*1.0e-3);
+    }
+  }
+
+  stop = true;
+  noisy_neighbour.join();
+  io_service.stop();
+  thread.join();
+}
+
+/**
+ * \brief Summarize round-trip times.
+ *
+ * \param round_trips containing the round-trip times [us].
+ *
+ * \return Result containing the results.
+ */
+Result summarize(std::vector<double> round_trips)
+{
+  std::sort(round_trips.begin(), round_trips.end());
+
+  Result result;
+  result.median_us = round_trips[round_trips.size() / 2];
+  result.p99_us = round_trips[(round_trips.size()*99) / 100];
+  result.max_us = round_trips.back();
+
+  return result;
+}
+
+/**
+ * \brief Print a result.
+ *
+ * \param name specifying the name of the run.
+ * \param result containing the result.
+ */
+void print(const char* name, const Result& result)
+{
+  std::cout << std::left << std::setw(24) << name
+            << std::right << std::setw(12) << result.median_us
+            << std::setw(12) << result.p99_us
+            << std::setw(12) << result.max_us << "\n";
+}
+} // end anonymous namespace
+
+int main()
+{
+  std::cout << std::left << std::setw(24) << "run"
+            << std::right << std::setw(12) << "median [us]"
+            << std::setw(12) << "p99 [us]"
+            << std::setw(12) << "max [us]" << "\n";
+
+  std::vector<double> cold_round_trips;
+  std::vector<double> warm_round_trips;
+
+  for (int i = 0; i < ROUNDS; ++i)
+  {
+    run(6660, 0, &cold_round_trips);
+    run(6661, PREWARM_LEAD_TIME_US, &warm_round_trips);
+  }
+
+  Result cold = summarize(cold_round_trips);
+  Result warm = summarize(warm_round_trips);
+  print("without pre-warming", cold);
+  print("with pre-warming", warm);
+
+  if (warm.p99_us > MAX_P99_RATIO*cold.p99_us)
+  {
+    std::cerr << "FAILED: The pre-warming increases the 99th percentile round-trip time\n";
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,238 @@
+/***********************************************************************************************************************
+ *
+ * Copyright (c) 2015, ABB Schweiz AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that
+ * the following conditions are met:
+ *
+ *    * Redistributions of source code must retain the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer in the documentation
+ *      and/or other materials provided with the
+ *      distribution.
+ *    * Neither the name of ABB nor the names of its
+ *      contributors may be used to endorse or promote
+ *      products derived from this software without
+ *      specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***********************************************************************************************************************
+ */
+
+// Benchmark of the reply construction, with reply patching versus serializing every reply.
+//
+// The replies are constructed for a static hold (i.e. only the sequence number changes) and for a moving robot
+// (i.e. all joint positions change in every reply). Every patched reply is also compared with the serialized one.
+//
+// The benchmark fails if any patched reply differs from the serialized reply (or is empty). With the --check-cost
+// argument (only passed for optimized builds, since the costs of unoptimized builds say little), it also fails if
+// patching costs more than MAX_COST_RATIO times serializing during the static hold.
+
+#include <iomanip>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <boost/chrono.hpp>
+
+#include "abb_libegm/egm_codec.h"
+
+#include "egm_robot_controller_simulator.h"
+
+using namespace abb::egm;
+using abb::egm::simulation::serializeRobotMessage;
+
+namespace
+{
+/**
+ * \brief Number of replies constructed for each case.
+ */
+const unsigned int REPLIES = 200000;
+
+/**
+ * \brief Largest allowed ratio between the patching and the serializing costs, during the static hold.
+ */
+const double MAX_COST_RATIO = 1.0;
+
+/**
+ * \brief Struct for containing the results of one case.
+ */
+struct Result
+{
+  Result() : mismatches(0), patching_ns(0.0), serializing_ns(0.0) {}
+
+  unsigned int mismatches;
+  double patching_ns;
+  double serializing_ns;
+};
+
+/**
+ * \brief The simulated joint positions [degrees] (i.e. the robot stands still at zero).
+ */
+const double POSITIONS[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+
+/**
+ * \brief Construct replies, and measure the cost of the reply construction.
+ *
+ * \param inputs containing the (already parsed) inputs, after the session's first message.
+ * \param p_outputs for the outputs (prepared with the session's first message).
+ * \param configuration specifying the configuration to use.
+ * \param moving indicating if the joint positions should change in every reply or not.
+ * \param p_replies for containing the constructed replies (empty if only the cost is measured).
+ *
+ * \return double containing the cost [ns/reply].
+ */
+double run(const InputContainer& inputs,
+           OutputContainer* p_outputs,
+           const BaseConfiguration& configuration,
+           const bool moving,
+           std::string* p_replies)
+{
+  boost::chrono::nanoseconds elapsed(0);
+
+  for (unsigned int i = 0; i < REPLIES; ++i)
+  {
+    p_outputs->prepareOutputs(inputs);
+
+    if (moving)
+    {
+      wrapper::Joints* p_position = p_outputs->current.mutable_robot()->mutable_joints()->mutable_position();
+      for (int j = 0; j < p_position->values_size(); ++j)
+      {
+        p_position->set_values(j, 0.001*i + j);
+      }
+    }
+
+    boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+    p_outputs->constructReply(configuration);
+    elapsed += boost::chrono::steady_clock::now() - start;
+
+    if (p_replies)
+    {
+      p_replies[i] = p_outputs->reply();
+    }
+
+    p_outputs->updatePrevious();
+  }
+
+  return ((double) elapsed.count()) / REPLIES;
+}
+
+/**
+ * \brief Run one case, with and without reply patching.
+ *
+ * \param moving indicating if the joint positions should change in every reply or not.
+ * \param p_replies for scratch storage of the serialized replies (REPLIES elements).
+ *
+ * \return Result containing the result.
+ */
+Result runCase(const bool moving, std::string* p_replies)
+{
+  Result result;
+
+  // Parse the session's first message (which prepares the outputs' shape), followed by a second message.
+  InputContainer inputs;
+  std::string first = serializeRobotMessage(0, POSITIONS);
+  std::string second = serializeRobotMessage(1, POSITIONS);
+  inputs.parseFromArray(first.data(), (int) first.size());
+  inputs.extractParsedInformation(Six);
+
+  OutputContainer patching_outputs;
+  OutputContainer serializing_outputs;
+  patching_outputs.prepareOutputs(inputs);
+  serializing_outputs.prepareOutputs(inputs);
+
+  inputs.updatePrevious();
+  inputs.parseFromArray(second.data(), (int) second.size());
+  inputs.extractParsedInformation(Six);
+
+  BaseConfiguration patching;
+  patching.use_reply_patching = true;
+  BaseConfiguration serializing;
+  serializing.use_reply_patching = false;
+
+  // Check the replies (outside of the measurements, since storing the replies also costs).
+  {
+    OutputContainer patching_check(patching_outputs);
+    OutputContainer serializing_check(serializing_outputs);
+    std::string* p_patched = new std::string[REPLIES];
+
+    run(inputs, &serializing_check, serializing, moving, p_replies);
+    run(inputs, &patching_check, patching, moving, p_patched);
+
+    for (unsigned int i = 0; i < REPLIES; ++i)
+    {
+      result.mismatches += (p_replies[i].empty() || p_patched[i] != p_replies[i] ? 1 : 0);
+    }
+
+    delete[] p_patched;
+  }
+
+  result.serializing_ns = run(inputs, &serializing_outputs, serializing, moving, 0);
+  result.patching_ns = run(inputs, &patching_outputs, patching, moving, 0);
+
+  return result;
+}
+
+/**
+ * \brief Print a result.
+ *
+ * \param name specifying the name of the case.
+ * \param result containing the result.
+ */
+void print(const char* name, const Result& result)
+{
+  std::cout << std::left << std::setw(16) << name
+            << std::right << std::setw(16) << result.serializing_ns
+            << std::setw(16) << result.patching_ns
+            << std::setw(16) << result.mismatches << "\n";
+}
+} // end anonymous namespace
+
+int main(int argc, char** argv)
+{
+  bool check_cost = (argc > 1 && std::strcmp(argv[1], "--check-cost") == 0);
+
+  std::string* p_replies = new std::string[REPLIES];
+  Result hold = runCase(false, p_replies);
+  Result moving = runCase(true, p_replies);
+  delete[] p_replies;
+
+  std::cout << std::left << std::setw(16) << "case"
+            << std::right << std::setw(16) << "serialize ns"
+            << std::setw(16) << "patch ns"
+            << std::setw(16) << "mismatches" << "\n";
+  print("static hold", hold);
+  print("moving", moving);
+
+  bool ok = true;
+
+  if (hold.mismatches > 0 || moving.mismatches > 0)
+  {
+    std::cerr << "FAILED: Patched replies differ from the serialized replies\n";
+    ok = false;
+  }
+
+  if (check_cost && hold.patching_ns > MAX_COST_RATIO*hold.serializing_ns)
+  {
+    std::cerr << "FAILED: Patching costs more than " << MAX_COST_RATIO << " times serializing, during a static hold\n";
+    ok = false;
+  }
+
+  return (ok ? 0 : 1);
+}
@@ -0,0 +1,451 @@
+/***********************************************************************************************************************
+ *
+ * Copyright (c) 2015, ABB Schweiz AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that
+ * the following conditions are met:
+ *
+ *    * Redistributions of source code must retain the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer in the documentation
+ *      and/or other materials provided with the
+ *      distribution.
+ *    * Neither the name of ABB nor the names of its
+ *      contributors may be used to endorse or promote
+ *      products derived from this software without
+ *      specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***********************************************************************************************************************
+ */
+
+// Stress benchmark of how the trajectory motion's execution time per EGM message scales with the workload.
+//
+// A simulated robot controller steps a socket-free stepper (i.e. only the message processing is timed), while a
+// user thread concurrently polls the execution progress and periodically overrides (i.e. retires) the executed
+// trajectories with new ones. Each kind of workload is measured at a small and at a large size: trajectory length,
+// long runs of already reached points (i.e. MAX_REACHED_POINTS_PER_CYCLE is hit each cycle), and the number of
+// queued trajectories.
+//
+// The benchmark fails if the 99th percentile tick at the large size exceeds MAX_SCALING_RATIO times the tick at the
+// small size, i.e. the tick must not grow with the workload (regardless of the machine's absolute speed). The
+// ticks are measured as wall time, or as thread CPU time on single-core machines (where the user thread otherwise
+// preempts the steps).
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/chrono.hpp>
+#include <boost/thread.hpp>
+
+#include "abb_libegm/egm_stepper.h"
+
+#include "egm_robot_controller_simulator.h"
+
+using namespace abb::egm;
+using abb::egm::simulation::serializeRobotMessage;
+
+namespace
+{
+/**
+ * \brief Smallest number of measured steps for each workload.
+ */
+const unsigned int MIN_STEPS = 2000;
+
+/**
+ * \brief Smallest number of overrides made by the user thread, while each workload is measured.
+ */
+const unsigned int MIN_OVERRIDES = 5;
+
+/**
+ * \brief Pause [us] between the steps (i.e. shorter than the robot controller's 4 [ms] sample time, to keep the
+ *        benchmark short, but long enough for the user thread to run in between).
+ */
+const int STEP_PAUSE_US = 250;
+
+/**
+ * \brief Period [ms] between the user thread's progress polls.
+ */
+const int POLL_PERIOD_MS = 1;
+
+/**
+ * \brief Number of progress polls between the user thread's overrides.
+ */
+const unsigned int POLLS_PER_OVERRIDE = 20;
+
+/**
+ * \brief Largest allowed ratio between the 99th percentile ticks at the large and the small workload sizes.
+ */
+const double MAX_SCALING_RATIO = 4.0;
+
+/**
+ * \brief Struct for containing a workload, i.e. a trajectory that is queued a number of times.
+ */
+struct Workload
+{
+  Workload() : copies(1) {}
+
+  wrapper::trajectory::TrajectoryGoal trajectory;
+  int copies;
+};
+
+/**
+ * \brief Struct for containing the results of one workload.
+ */
+struct Result
+{
+  Result() : median_us(0.0), p99_us(0.0), max_us(0.0), cpu_p99_us(0.0), polls(0), overrides(0) {}
+
+  double median_us;
+  double p99_us;
+  double max_us;
+  double cpu_p99_us;
+  unsigned int polls;
+  unsigned int overrides;
+};
+
+/**
+ * \brief Create a workload.
+ *
+ * \param points specifying the number of points in the trajectory.
+ * \param duration specifying each point's duration [s].
+ * \param reach indicating if the points are at the start position with reach conditions (i.e. already reached).
+ * \param copies specifying the number of times the trajectory is queued.
+ *
+ * \return Workload containing the workload.
+ */
+Workload createWorkload(const int points, const double duration, const bool reach, const int copies)
+{
+  Workload workload;
+  workload.copies = copies;
+
+  for (int i = 0; i < points; ++i)
+  {
+    wrapper::trajectory::PointGoal* p_point = workload.trajectory.add_points();
+    p_point->set_duration(duration);
+    p_point->set_reach(reach);
+
+    for (int j = 0; j < 6; ++j)
+    {
+      p_point->mutable_robot()->mutable_joints()->mutable_position()->add_values(reach ? 0.0 : 0.001*(i % 1000));
+    }
+  }
+
+  return workload;
+}
+
+/**
+ * \brief Apply a workload, by overriding any existing trajectories and queueing the remaining copies.
+ *
+ * \param p_motion for the trajectory motion.
+ * \param workload containing the workload.
+ */
+void apply(TrajectoryMotion* p_motion, const Workload& workload)
+{
+  p_motion->addTrajectory(workload.trajectory, true);
+
+  for (int i = 1; i < workload.copies; ++i)
+  {
+    p_motion->addTrajectory(workload.trajectory, false);
+  }
+}
+
+/**
+ * \brief Class for a user thread, which polls the execution progress and periodically reapplies a workload.
+ */
+class User
+{
+public:
+  /**
+   * \brief A constructor (the thread is started directly).
+   *
+   * \param p_motion for the trajectory motion.
+   * \param workload containing the workload to reapply.
+   */
+  User(TrajectoryMotion* p_motion, const Workload& workload)
+  :
+  p_motion_(p_motion),
+  workload_(workload),
+  stop_(false),
+  polls_(0),
+  overrides_(0),
+  thread_(boost::bind(&User::run, this))
+  {}
+
+  /**
+   * \brief Stop the thread.
+   */
+  void stop()
+  {
+    stop_.store(true);
+    thread_.join();
+  }
+
+  /**
+   * \brief Retrieve the number of progress polls.
+   *
+   * \return unsigned int containing the number of polls.
+   */
+  unsigned int polls() const { return polls_.load(); }
+
+  /**
+   * \brief Retrieve the number of overrides.
+   *
+   * \return unsigned int containing the number of overrides.
+   */
+  unsigned int overrides() const { return overrides_.load(); }
+
+private:
+  /**
+   * \brief Run the user's loop.
+   */
+  void run()
+  {
+    wrapper::trajectory::ExecutionProgress progress;
+
+    while (!stop_.load())
+    {
+      boost::this_thread::sleep_for(boost::chrono::milliseconds(POLL_PERIOD_MS));
+
+      p_motion_->retrieveExecutionProgress(&progress);
+
+      if (++polls_ % POLLS_PER_OVERRIDE == 0)
+      {
+        apply(p_motion_, workload_);
+        ++overrides_;
+      }
+    }
+  }
+
+  /**
+   * \brief The trajectory motion.
+   */
+  TrajectoryMotion* p_motion_;
+
+  /**
+   * \brief The workload to reapply.
+   */
+  const Workload& workload_;
+
+  /**
+   * \brief Flag indicating if the thread should stop.
+   */
+  boost::atomic<bool> stop_;
+
+  /**
+   * \brief The number of progress polls.
+   */
+  boost::atomic<unsigned int> polls_;
+
+  /**
+   * \brief The number of overrides.
+   */
+  boost::atomic<unsigned int> overrides_;
+
+  /**
+   * \brief The user's thread.
+   */
+  boost::thread thread_;
+};
+
+/**
+ * \brief Step a stepper once, and let the simulated joint positions follow the reply's references.
+ *
+ * \param p_stepper for the stepper.
+ * \param sequence_number specifying the message's sequence number.
+ * \param positions for the simulated joint positions [degrees].
+ * \param p_wall_us for the step's wall time [us] (optional).
+ * \param p_cpu_us for the step's thread CPU time [us] (optional).
+ *
+ * \return bool indicating if a valid reply was constructed or not.
+ */
+bool stepOnce(EGMStepper* p_stepper,
+              const unsigned int sequence_number,
+              double positions[6],
+              double* p_wall_us = 0,
+              double* p_cpu_us = 0)
+{
+  std::string data = serializeRobotMessage(sequence_number, positions);
+
+  boost::chrono::thread_clock::time_point cpu_start = boost::chrono::thread_clock::now();
+  boost::chrono::steady_clock::time_point wall_start = boost::chrono::steady_clock::now();
+  const std::string& reply = p_stepper->step(data.data(), (int) data.size());
+  boost::chrono::nanoseconds wall = boost::chrono::steady_clock::now() - wall_start;
+  boost::chrono::nanoseconds cpu = boost::chrono::thread_clock::now() - cpu_start;
+
+  if (p_wall_us)
+  {
+    *p_wall_us = wall.count()*1.0e-3;
+  }
+
+  if (p_cpu_us)
+  {
+    *p_cpu_us = cpu.count()*1.0e-3;
+  }
+
+  EgmSensor sensor;
+  bool result = (!reply.empty() && sensor.ParseFromString(reply));
+
+  for (int i = 0; result && i < 6 && i < sensor.planned().joints().joints_size(); ++i)
+  {
+    positions[i] = sensor.planned().joints().joints(i);
+  }
+
+  return result;
+}
+
+/**
+ * \brief Execute a workload (until the user thread has reapplied it MIN_OVERRIDES times), and measure the ticks.
+ *
+ * \param workload containing the workload.
+ *
+ * \return Result containing the results.
+ */
+Result measure(const Workload& workload)
+{
+  EGMStepper stepper;
+  double positions[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+  unsigned int sequence_number = 0;
+
+  // Trajectories are only accepted once a session has started.
+  stepOnce(&stepper, sequence_number++, positions);
+  apply(&stepper.trajectoryMotion(), workload);
+
+  std::vector<double> wall_ticks;
+  std::vector<double> cpu_ticks;
+  wall_ticks.reserve(MIN_STEPS);
+  cpu_ticks.reserve(MIN_STEPS);
+
+  User user(&stepper.trajectoryMotion(), workload);
+
+  while (wall_ticks.size() < MIN_STEPS || user.overrides() < MIN_OVERRIDES)
+  {
+    double wall_us = 0.0;
+    double cpu_us = 0.0;
+
+    if (!stepOnce(&stepper, sequence_number++, positions, &wall_us, &cpu_us))
+    {
+      std::cerr << "No reply constructed\n";
+    }
+
+    wall_ticks.push_back(wall_us);
+    cpu_ticks.push_back(cpu_us);
+
+    boost::this_thread::sleep_for(boost::chrono::microseconds(STEP_PAUSE_US));
+  }
+
+  user.stop();
+
+  std::sort(wall_ticks.begin(), wall_ticks.end());
+  std::sort(cpu_ticks.begin(), cpu_ticks.end());
+
+  Result result;
+  result.median_us = wall_ticks[wall_ticks.size() / 2];
+  result.p99_us = wall_ticks[(wall_ticks.size()*99) / 100];
+  result.max_us = wall_ticks.back();
+  result.cpu_p99_us = cpu_ticks[(cpu_ticks.size()*99) / 100];
+  result.polls = user.polls();
+  result.overrides = user.overrides();
+
+  return result;
+}
+
+/**
+ * \brief Print a result.
+ *
+ * \param name specifying the name of the workload.
+ * \param result containing the result.
+ */
+void print(const char* name, const Result& result)
+{
+  std::cout << std::left << std::setw(32) << name
+            << std::right << std::setw(12) << result.median_us
+            << std::setw(12) << result.p99_us
+            << std::setw(12) << result.max_us
+            << std::setw(14) << result.cpu_p99_us
+            << std::setw(8) << result.polls
+            << std::setw(10) << result.overrides << "\n";
+}
+
+/**
+ * \brief Measure a kind of workload at a small and at a large size, and check how the tick scales.
+ *
+ * \param name specifying the name of the workload kind.
+ * \param small containing the small workload.
+ * \param large containing the large workload.
+ *
+ * \return bool indicating if the tick scales within the bound or not.
+ */
+bool check(const char* name, const Workload& small, const Workload& large)
+{
+  Result small_result = measure(small);
+  Result large_result = measure(large);
+
+  std::string small_name(name);
+  std::string large_name(name);
+  small_name += " (small)";
+  large_name += " (large)";
+  print(small_name.c_str(), small_result);
+  print(large_name.c_str(), large_result);
+
+  // Note: On single-core machines, the user thread preempts the steps (i.e. the wall time is not the steps' cost).
+  bool use_cpu_time = (boost::thread::hardware_concurrency() <= 1);
+  double small_tick = (use_cpu_time ? small_result.cpu_p99_us : small_result.p99_us);
+  double large_tick = (use_cpu_time ? large_result.cpu_p99_us : large_result.p99_us);
+  double ratio = large_tick / std::max(small_tick, 1.0);
+
+  if (ratio > MAX_SCALING_RATIO)
+  {
+    std::cerr << "FAILED: " << name << " tick grows " << ratio << " times with the workload size (bound "
+              << MAX_SCALING_RATIO << ")\n";
+    return false;
+  }
+
+  return true;
+}
+} // end anonymous namespace
+
+int main()
+{
+  std::cout << std::left << std::setw(32) << "workload"
+            << std::right << std::setw(12) << "median [us]"
+            << std::setw(12) << "p99 [us]"
+            << std::setw(12) << "max [us]"
+            << std::setw(14) << "cpu p99 [us]"
+            << std::setw(8) << "polls"
+            << std::setw(10) << "overrides" << "\n";
+
+  bool ok = check("trajectory length",
+                  createWorkload(1000, 0.004, false, 1),
+                  createWorkload(200000, 0.004, false, 1));
+
+  ok = check("reached points",
+             createWorkload(1000, 0.1, true, 1),
+             createWorkload(100000, 0.1, true, 1)) && ok;
+
+  ok = check("queued trajectories",
+             createWorkload(50, 0.004, false, 20),
+             createWorkload(50, 0.004, false, 2000)) && ok;
+
+  return (ok ? 0 : 1);
+}
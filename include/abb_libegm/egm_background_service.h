@@ -0,0 +1,438 @@
+/***********************************************************************************************************************
+ *
+ * Copyright (c) 2015, ABB Schweiz AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that
+ * the following conditions are met:
+ *
+ *    * Redistributions of source code must retain the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer in the documentation
+ *      and/or other materials provided with the
+ *      distribution.
+ *    * Neither the name of ABB nor the names of its
+ *      contributors may be used to endorse or promote
+ *      products derived from this software without
+ *      specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***********************************************************************************************************************
+ */
+#ifndef EGM_BACKGROUND_SERVICE_H
+#define EGM_BACKGROUND_SERVICE_H
+
+#include <deque>
+#include <list>
+#include <map>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace abb
+{
+namespace egm
+{
+/**
+ * \brief Struct for the background service's configuration.
+ */
+struct BackgroundServiceConfiguration
+{
+  /**
+   * \brief Default constructor.
+   */
+  BackgroundServiceConfiguration()
+  :
+  number_of_workers(2),
+  max_queued_jobs(1024),
+  tick_time(0.01),
+  pin_workers(false)
+  {}
+
+  /**
+   * \brief The number of worker threads (limited to [1, MAX_NUMBER_OF_WORKERS]).
+   */
+  unsigned int number_of_workers;
+
+  /**
+   * \brief The max number of queued jobs (i.e. further jobs are rejected until the queues have been drained).
+   */
+  unsigned int max_queued_jobs;
+
+  /**
+   * \brief The timer wheel's tick time [s] (i.e. the resolution of all timers).
+   */
+  double tick_time;
+
+  /**
+   * \brief Flag indicating if each worker thread should be pinned to a CPU core (only supported on Linux).
+   */
+  bool pin_workers;
+};
+
+/**
+ * \brief Class for running the library's background work (e.g. periodic log flushing), outside of the EGM callbacks.
+ *
+ * The service consists of:
+ * - A bounded pool of worker threads, where each worker has its own job queue. Idle workers steal jobs from
+ *   the other workers' queues.
+ * - A hierarchical timer wheel (driven by one timer thread), which hands expired timers over to the workers.
+ *   Each tick only visits the expiring slot (and occasionally cascades a slot from a higher level), so the cost
+ *   of advancing the wheel doesn't grow with the number of pending timers.
+ *
+ * The threads are started when the service is constructed, and they are stopped when the service is shut down
+ * (or destroyed). Queued jobs are run before the workers are stopped, but pending timers are discarded.
+ *
+ * Note: All interfaces share one process-wide service (see getShared()), which is started on first use.
+ */
+class BackgroundService
+{
+public:
+  /**
+   * \brief Type for a background job.
+   */
+  typedef boost::function<void()> Job;
+
+  /**
+   * \brief Type for identifying a scheduled timer (zero is never used, and indicates a failed scheduling).
+   */
+  typedef unsigned long long TimerId;
+
+  /**
+   * \brief A constructor.
+   *
+   * \param configuration specifying the service's configuration.
+   */
+  BackgroundService(const BackgroundServiceConfiguration& configuration = BackgroundServiceConfiguration());
+
+  /**
+   * \brief A destructor.
+   */
+  ~BackgroundService();
+
+  /**
+   * \brief Submit a job, to be run as soon as possible by one of the workers.
+   *
+   * Note: Exceptions thrown by a job are caught, and discarded, by the worker.
+   *
+   * \param job specifying the job to run.
+   *
+   * \return bool indicating if the job was accepted or not (i.e. not if the service is shut down or full).
+   */
+  bool submit(const Job& job);
+
+  /**
+   * \brief Schedule a job, to be run by one of the workers after a delay (and optionally repeated periodically).
+   *
+   * Note: A periodic job is never run concurrently with itself. I.e. an expiration is skipped if the previous
+   *       run hasn't finished yet.
+   *
+   * \param job specifying the job to run.
+   * \param delay specifying the delay [s] until the first run (rounded up to whole ticks).
+   * \param period specifying the period [s] between repeated runs (zero means that the job is only run once).
+   *
+   * \return TimerId for identifying the timer (zero if the service is shut down).
+   */
+  TimerId schedule(const Job& job, const double delay, const double period = 0.0);
+
+  /**
+   * \brief Cancel a scheduled timer.
+   *
+   * If the timer's job is currently running (in another thread), then this waits until it has finished.
+   * I.e. the job won't access anything after this has returned.
+   *
+   * \param id specifying the timer to cancel.
+   *
+   * \return bool indicating if the timer was canceled or not (i.e. not if it has already expired, or is unknown).
+   */
+  bool cancel(const TimerId id);
+
+  /**
+   * \brief Shut down the service (i.e. run the queued jobs, discard all timers and stop the threads).
+   *
+   * Note: Must not be called from one of the service's own jobs.
+   */
+  void shutdown();
+
+  /**
+   * \brief Checks if the service is running or not (i.e. not if it has been shut down).
+   *
+   * \return bool indicating if the service is running.
+   */
+  bool isRunning();
+
+  /**
+   * \brief Retrieve the number of worker threads.
+   *
+   * \return unsigned int containing the number of workers.
+   */
+  unsigned int getNumberOfWorkers() const;
+
+  /**
+   * \brief Retrieve the process-wide service (which is shared by all interfaces).
+   *
+   * The service is constructed, with the most recently configured configuration, on first use.
+   *
+   * \return BackgroundService& reference to the shared service.
+   */
+  static BackgroundService& getShared();
+
+  /**
+   * \brief Configure the process-wide service.
+   *
+   * \param configuration specifying the service's configuration.
+   *
+   * \return bool indicating if the configuration was used or not (i.e. not if the service has already been started).
+   */
+  static bool configureShared(const BackgroundServiceConfiguration& configuration);
+
+  /**
+   * \brief Static constant for the max number of worker threads.
+   */
+  static const unsigned int MAX_NUMBER_OF_WORKERS = 16;
+
+private:
+  /**
+   * \brief Struct for a worker's job queue.
+   */
+  struct Worker
+  {
+    /**
+     * \brief Mutex for protecting the queue.
+     */
+    boost::mutex mutex;
+
+    /**
+     * \brief The queued jobs (the owner takes from the back, and thieves take from the front).
+     */
+    std::deque<Job> jobs;
+  };
+
+  /**
+   * \brief Struct for a scheduled timer.
+   */
+  struct Timer
+  {
+    /**
+     * \brief Default constructor.
+     */
+    Timer() : id(0), expiry(0), period(0), canceled(false), running(false) {}
+
+    /**
+     * \brief The timer's identifier.
+     */
+    TimerId id;
+
+    /**
+     * \brief The job to run, when the timer expires.
+     */
+    Job job;
+
+    /**
+     * \brief The tick, when the timer expires.
+     */
+    unsigned long long expiry;
+
+    /**
+     * \brief The period [ticks] between repeated runs (zero means that the timer only expires once).
+     */
+    unsigned long long period;
+
+    /**
+     * \brief Flag indicating if the timer has been canceled (or has expired for the last time).
+     */
+    bool canceled;
+
+    /**
+     * \brief Flag indicating if the timer's job is currently running.
+     */
+    bool running;
+
+    /**
+     * \brief The thread that runs the timer's job (only valid while running).
+     */
+    boost::thread::id runner;
+  };
+
+  /**
+   * \brief Type for a timer wheel slot.
+   */
+  typedef std::list<boost::shared_ptr<Timer> > Slot;
+
+  /**
+   * \brief Run a worker thread.
+   *
+   * \param index specifying the worker's index.
+   */
+  void runWorker(const unsigned int index);
+
+  /**
+   * \brief Take a job from the worker's own queue, or steal one from another worker's queue.
+   *
+   * \param index specifying the worker's index.
+   * \param p_job for containing the job.
+   *
+   * \return bool indicating if a job was taken or not.
+   */
+  bool takeJob(const unsigned int index, Job* p_job);
+
+  /**
+   * \brief Run the timer thread (i.e. advance the timer wheel, one tick at the time).
+   */
+  void runTimers();
+
+  /**
+   * \brief Advance the timer wheel one tick, and collect the expired timers.
+   *
+   * Note: Requires that the timer mutex is locked.
+   *
+   * \param p_expired for containing the expired timers.
+   */
+  void advance(std::vector<boost::shared_ptr<Timer> >* p_expired);
+
+  /**
+   * \brief Insert a timer into the timer wheel, based on its expiry.
+   *
+   * Note: Requires that the timer mutex is locked.
+   *
+   * \param p_timer specifying the timer to insert.
+   */
+  void insert(const boost::shared_ptr<Timer>& p_timer);
+
+  /**
+   * \brief Run an expired timer's job (in a worker thread).
+   *
+   * \param p_timer specifying the timer.
+   */
+  void runTimer(const boost::shared_ptr<Timer>& p_timer);
+
+  /**
+   * \brief Convert a duration to ticks (rounded up).
+   *
+   * \param duration specifying the duration [s].
+   *
+   * \return unsigned long long containing the number of ticks.
+   */
+  unsigned long long toTicks(const double duration) const;
+
+  /**
+   * \brief Static constant for the number of bits per timer wheel level (i.e. 64 slots per level).
+   */
+  static const unsigned int WHEEL_BITS = 6;
+
+  /**
+   * \brief Static constant for the number of timer wheel levels.
+   *
+   * Note: With the default tick time (10 ms), the wheel covers about 46 hours. Timers beyond that are kept in
+   *       the top level, and are cascaded down until they expire.
+   */
+  static const unsigned int WHEEL_LEVELS = 4;
+
+  /**
+   * \brief Static constant for the number of slots per timer wheel level.
+   */
+  static const unsigned int WHEEL_SLOTS = 1 << WHEEL_BITS;
+
+  /**
+   * \brief The service's configuration.
+   */
+  BackgroundServiceConfiguration configuration_;
+
+  /**
+   * \brief The workers' job queues.
+   */
+  std::vector<boost::shared_ptr<Worker> > workers_;
+
+  /**
+   * \brief The worker threads and the timer thread.
+   */
+  boost::thread_group threads_;
+
+  /**
+   * \brief Mutex for protecting the pool's state (i.e. the number of queued jobs and the stop flag).
+   */
+  boost::mutex pool_mutex_;
+
+  /**
+   * \brief Condition variable for waking idle workers.
+   */
+  boost::condition_variable pool_condition_;
+
+  /**
+   * \brief The number of queued jobs (in all queues).
+   */
+  unsigned int queued_jobs_;
+
+  /**
+   * \brief Index of the next worker to receive a job submitted from outside the pool.
+   */
+  unsigned int next_worker_;
+
+  /**
+   * \brief Flag indicating if the service is stopping (or has been stopped).
+   */
+  bool stopping_;
+
+  /**
+   * \brief Mutex for serializing shut downs.
+   */
+  boost::mutex shutdown_mutex_;
+
+  /**
+   * \brief Mutex for protecting the timer wheel and the timers.
+   */
+  boost::mutex timer_mutex_;
+
+  /**
+   * \brief Condition variable for waking the timer thread, and for waiting on running timer jobs.
+   */
+  boost::condition_variable timer_condition_;
+
+  /**
+   * \brief The timer wheel (WHEEL_LEVELS levels with WHEEL_SLOTS slots each).
+   */
+  std::vector<Slot> wheel_;
+
+  /**
+   * \brief The scheduled timers.
+   */
+  std::map<TimerId, boost::shared_ptr<Timer> > timers_;
+
+  /**
+   * \brief The timer wheel's current tick.
+   */
+  unsigned long long current_tick_;
+
+  /**
+   * \brief The most recently used timer identifier.
+   */
+  TimerId last_timer_id_;
+
+  /**
+   * \brief Flag indicating if the timer thread is stopping (or has been stopped).
+   */
+  bool timers_stopping_;
+};
+
+} // end namespace egm
+} // end namespace abb
+
+#endif // EGM_BACKGROUND_SERVICE_H
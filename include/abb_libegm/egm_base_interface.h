@@ -37,13 +37,20 @@
 #ifndef EGM_BASE_INTERFACE_H
 #define EGM_BASE_INTERFACE_H
 
+#include <vector>
+
 #include <boost/thread.hpp>
 
-#include "egm.pb.h"         // Generated by Google Protocol Buffer compiler protoc
-#include "egm_wrapper.pb.h" // Generated by Google Protocol Buffer compiler protoc
+#include "egm.pb.h"                 // Generated by Google Protocol Buffer compiler protoc
+#include "egm_wrapper.pb.h"         // Generated by Google Protocol Buffer compiler protoc
+#include "egm_wrapper_session.pb.h" // Generated by Google Protocol Buffer compiler protoc
 
+#include "egm_background_service.h"
+#include "egm_clock_alignment.h"
+#include "egm_codec.h"
 #include "egm_common.h"
 #include "egm_logger.h"
+#include "egm_metrics.h"
 #include "egm_udp_server.h"
 
 namespace abb
@@ -61,6 +68,16 @@ namespace egm
 class EGMBaseInterface : public AbstractUDPServerInterface
 {
 public:
+  /**
+   * \brief The container for the inputs (i.e. a core library class, also accessible via the interface).
+   */
+  typedef abb::egm::InputContainer InputContainer;
+
+  /**
+   * \brief The container for the outputs (i.e. a core library class, also accessible via the interface).
+   */
+  typedef abb::egm::OutputContainer OutputContainer;
+
   /**
    * \brief A constructor.
    *
@@ -72,6 +89,11 @@ public:
                    const unsigned short port_number,
                    const BaseConfiguration& configuration = BaseConfiguration());
 
+  /**
+   * \brief A destructor.
+   */
+  virtual ~EGMBaseInterface();
+
   /**
    * \brief Checks if the underlying server was successfully initialized or not.
    *
@@ -101,6 +123,58 @@ public:
    */
   wrapper::Status getStatus();
 
+  /**
+   * \brief Retrieve the metrics collected while processing messages (e.g. per-stage allocation counts).
+   *
+   * \return Metrics containing a snapshot of the collected metrics.
+   */
+  Metrics getMetrics();
+
+  /**
+   * \brief Enable, or disable, sampling of hardware counters (e.g. cache misses and context switches) per stage.
+   *
+   * Note: Only supported on Linux, and the kernel's settings (i.e. perf_event_paranoid) may limit which counters
+   *       can be opened. The opened counters are indicated in the metrics.
+   *
+   * \param enable indicating if the counters should be sampled or not.
+   *
+   * \return bool indicating if hardware counters are supported on the platform or not.
+   */
+  bool enableHardwareCounters(const bool enable);
+
+  /**
+   * \brief Retrieve the estimated alignment between the robot controller's clock and the host's steady clock.
+   *
+   * The alignment is continuously estimated from each received message's feedback time and receive time
+   * (see the ClockAlignment class), and it is kept between EGM communication sessions.
+   *
+   * \return ClockEstimate containing the estimate.
+   */
+  ClockEstimate getClockEstimate();
+
+  /**
+   * \brief Convert a time on the robot controller's clock, to the corresponding time on the host's steady clock.
+   *
+   * Note: The estimated alignment includes the typical transfer delay, i.e. a message's feedback time is converted
+   *       to the time when the message is typically received.
+   *
+   * \param controller_time specifying the time on the robot controller's clock.
+   * \param p_host_time for containing the time on the host's clock.
+   *
+   * \return bool indicating if the time was converted or not (e.g. no clock data has been received yet).
+   */
+  bool convertControllerTime(const wrapper::Clock& controller_time, boost::asio::steady_timer::time_point* p_host_time);
+
+  /**
+   * \brief Convert a time on the host's steady clock, to the corresponding time on the robot controller's clock.
+   *
+   * \param host_time specifying the time on the host's clock.
+   * \param p_controller_time for containing the time on the robot controller's clock.
+   *
+   * \return bool indicating if the time was converted or not (e.g. no clock data has been received yet).
+   */
+  bool convertHostTime(const boost::asio::steady_timer::time_point& host_time, wrapper::Clock* p_controller_time);
+
   /**
    * \brief Retrieve the interface's current configuration.
    *
@@ -115,270 +189,46 @@ public:
    */
   void setConfiguration(const BaseConfiguration& configuration);
 
-protected:
   /**
-   * \brief Class for containing inputs from a UDP server.
+   * \brief Hand over the active EGM communication session to another process (e.g. during a hot restart).
+   *
+   * The message processing is suspended, and then the UDP socket and the session state are passed to the other
+   * process, which must be waiting in adoptSession(...). Messages that arrive during the handover are left
+   * in the socket, for the other process to process.
+   *
+   * Note: If the handover succeeds, then the interface stays suspended (i.e. the process is expected to exit).
+   *       Otherwise, the message processing is resumed. Only supported on POSIX systems.
+   *
+   * \param path specifying the Unix domain socket path, which the other process is listening on.
+   * \param timeout_ms specifying the max time [ms] to wait for the handover.
+   *
+   * \return bool indicating if the session was handed over or not.
    */
-  class InputContainer
-  {
-  public:
-    /**
-     * \brief Default constructor.
-     */
-    InputContainer();
-
-    /**
-     * \brief Parse an array, into an abb::egm::EgmRobot message.
-     *
-     * \param data containing the serialized array received from the robot controller.
-     * \param bytes_transferred for the number of bytes received.
-     *
-     * \return bool indicating if the parsing was successful or not.
-     */
-    bool parseFromArray(const char* data, const int bytes_transferred);
-
-    /**
-     * \brief Extract the parsed information.
-     *
-     * \param axes specifying the number of axes of the robot.
-     *
-     * \return bool indicating if the extraction was successful or not.
-     */
-    bool extractParsedInformation(const RobotAxes& axes);
-
-    /**
-     * \brief Update the previous inputs with the current inputs.
-     */
-    void updatePrevious();
-
-    /**
-     * \brief Retrieve the initial inputs (i.e initial robot controller outputs).
-     *
-     * \return Input with the initial inputs.
-     */
-    const wrapper::Input& initial() const { return initial_; };
-
-    /**
-     * \brief Retrieve the current inputs (i.e. current robot controller outputs).
-     *
-     * \return Input with the current inputs.
-     */
-    const wrapper::Input& current() const { return current_; };
-
-    /**
-     * \brief Retrieve the previous inputs (i.e. previous robot controller outputs).
-     *
-     * \return Input with the previous inputs.
-     */
-    const wrapper::Input& previous() const { return previous_; };
-
-    /**
-     * \brief Retrieve the estimated sample time [s].
-     *
-     * \return double containing the estimation.
-     */
-    double estimatedSampleTime() const { return estimated_sample_time_; };
-
-    /**
-     * \brief Retrieve a flag, indicating if the received message was the first in a communication session.
-     *
-     * \return bool indicating if it was the first message or not.
-     */
-    bool isFirstMessage() const { return first_message_; };
-
-    /**
-     * \brief Check if the robot controller's states are ok.
-     *
-     * I.e. motors are on, RAPID is running and EGM is running.
-     *
-     * \return bool indicating if the state are ok or not.
-     */
-    bool statesOk() const;
-
-  private:
-    /**
-     * \brief Detect RobotWare and EGM protocol versions from a received EGM message.
-     *
-     * Note: Only a rough version detection is possible based on whether certain fields are present or not.
-     */
-    void detectRWAndEGMVersions();
-
-    /**
-     * \brief Estimate the sample time.
-     *
-     * \return double containing the estimation.
-     */
-    double estimateSampleTime();
-
-    /**
-     * \brief Estimate the joint and the Cartesian velocities.
-     *
-     * \return bool indicating if the estimation was successful or not.
-     */
-    bool estimateAllVelocities();
-
-    /**
-     * \brief Container for the "raw" EGM robot message.
-     */
-    EgmRobot egm_robot_;
-
-    /**
-     * \brief Container for the initial inputs, extracted from the EGM robot message.
-     */
-    wrapper::Input initial_;
-
-    /**
-     * \brief Container for the current inputs, extracted from the EGM robot message.
-     */
-    wrapper::Input current_;
-
-    /**
-     * \brief Container for the previous inputs, extracted from the EGM robot message.
-     */
-    wrapper::Input previous_;
-
-    /**
-     * \brief Flag indicating if new data has been received.
-     */
-    bool has_new_data_;
-
-    /**
-     * \brief Flag indicating if the interface's callback has been called before or not.
-     */
-    bool first_call_;
-
-    /**
-     * \brief Flag indicating if the received message was the first in a communication session or not.
-     */
-    bool first_message_;
-
-    /**
-     * \brief The estimated sample time [s].
-     */
-    double estimated_sample_time_;
-  };
+  bool handoffSession(const std::string& path, const unsigned int timeout_ms);
 
   /**
-   * \brief Class for containing outputs to a UDP server.
+   * \brief Adopt an EGM communication session, handed over by another process with handoffSession(...).
+   *
+   * The other process is only acknowledged after the socket has been adopted and the session state restored.
+   * The state is verified before the socket is adopted, and it is only restored afterwards (i.e. the interface's
+   * state is left untouched if the state or the socket is rejected). Otherwise, the handover is rejected and the
+   * other process continues to serve the session.
+   *
+   * Note: The interface's own UDP socket (if it could be bound at all) is replaced by the received socket,
+   *       and the interface should be configured in the same way as in the other process. If the acknowledgement
+   *       can't be sent (i.e. the other process has timed out and resumed the session), then the interface stays
+   *       suspended. If the interface's own socket couldn't be bound, then the io service has no pending work
+   *       until the socket has been adopted (i.e. make sure that the io service is running after this method
+   *       has returned).
+   *
+   * \param path specifying the Unix domain socket path to listen on.
+   * \param timeout_ms specifying the max time [ms] to wait for the other process.
+   *
+   * \return bool indicating if the socket was adopted and the session state restored or not.
    */
-  class OutputContainer
-  {
-  public:
-    /**
-     * \brief Default constructor.
-     */
-    OutputContainer();
-
-    /**
-     * \brief Prepare the outputs.
-     *
-     * \param inputs containing the inputs.
-     */
-    void prepareOutputs(const InputContainer& inputs);
-
-    /**
-     * \brief Generate demo outputs.
-     *
-     * \param inputs containing the inputs from the robot controller.
-     */
-    void generateDemoOutputs(const InputContainer& inputs);
-
-    /**
-     * \brief Construct the reply string.
-     *
-     * \param configuration containing the current configurations for the interface.
-     */
-    void constructReply(const BaseConfiguration& configuration);
-
-    /**
-     * \brief Update the previous outputs with the current outputs.
-     */
-    void updatePrevious();
-
-    /**
-     * \brief Retrieve the previous outputs sent to the robot controller.
-     *
-     * \return Output with the previous outputs.
-     */
-    const wrapper::Output& previous() const { return previous_; };
-
-    /**
-     * \brief Retrieve the current sequence_number.
-     *
-     * \return unsigned int containing the sequence number.
-     */
-    unsigned int sequenceNumber() const { return sequence_number_; };
-
-    /**
-     * \brief Retrieve the reply string, serialized from the current references.
-     *
-     * \return string& containing the reply.
-     */
-    const std::string& reply() const { return reply_; };
-
-    /**
-     * \brief Clear the reply content.
-     */
-    void clearReply() { reply_.clear(); };
-
-    /**
-     * \brief Container for the current outputs to send to the robot controller.
-     */
-    wrapper::Output current;
-
-  private:
-    /**
-     * \brief Generate demo quaternion outputs.
-     *
-     * \param inputs containing the inputs from the robot controller.
-     * \param t for the interpolation parameter [0 <= t <= 1].
-     */
-    void generateDemoQuaternions(const InputContainer& inputs, const double t);
-
-    /**
-     * \brief Construct the header.
-     */
-    void constructHeader();
-
-    /**
-     * \brief Construct the joint body.
-     *
-     * \param configuration containing the current configurations for the interface.
-     *
-     * \return bool indicating if the construction was successful or not.
-     */
-    bool constructJointBody(const BaseConfiguration& configuration);
-
-    /**
-     * \brief Construct the Cartesian body.
-     *
-     * \param configuration containing the current configurations for the interface.
-     *
-     * \return bool indicating if the construction was successful or not.
-     */
-    bool constructCartesianBody(const BaseConfiguration& configuration);
-
-    /**
-     * \brief Container for the actual EGM sensor message.
-     */
-    EgmSensor egm_sensor_;
-
-    /**
-     * \brief Container for the previous outputs sent to the robot controller.
-     */
-    wrapper::Output previous_;
-
-    /**
-     * \brief The sequance number, in the current communication session.
-     */
-    unsigned int sequence_number_;
-
-    /**
-     * \brief Container for the reply string.
-     */
-    std::string reply_;
-  };
+  bool adoptSession(const std::string& path, const unsigned int timeout_ms);
 
+protected:
   /**
    * \brief Struct for containing data regarding an active EGM communication session.
    */
@@ -456,6 +306,54 @@ protected:
    */
   bool initializeCallback(const UDPServerData& server_data);
 
+  /**
+   * \brief Update the clock alignment with the most recently extracted inputs.
+   *
+   * \param server_data containing the UDP server's callback data (i.e. the receive time).
+   */
+  void updateClockAlignment(const UDPServerData& server_data);
+
+  /**
+   * \brief Store the state needed to continue the session in another process.
+   *
+   * Note: Called while the message processing is suspended. Derived classes can extend the stored state.
+   *
+   * \param p_snapshot for storing the state.
+   */
+  virtual void storeSession(wrapper::session::SessionSnapshot* p_snapshot);
+
+  /**
+   * \brief Verify that a session, handed over from another process, can be restored (without changing any state).
+   *
+   * Note: Called before the received socket is adopted. Derived classes can extend the verification.
+   *
+   * \param snapshot containing the state.
+   *
+   * \return bool indicating if the state can be restored or not (e.g. not if no message had been received before
+   *         the state was stored).
+   */
+  virtual bool verifySession(const wrapper::session::SessionSnapshot& snapshot);
+
+  /**
+   * \brief Restore the state of a session, handed over from another process.
+   *
+   * Note: Called while the message processing is suspended, after the received socket has been adopted (i.e. only
+   *       for verified snapshots). Derived classes can extend the restored state.
+   *
+   * \param snapshot containing the state.
+   *
+   * \return bool indicating if the state was restored or not (e.g. not if no message had been received before the
+   *         state was stored).
+   */
+  virtual bool restoreSession(const wrapper::session::SessionSnapshot& snapshot);
+
+  /**
+   * \brief Pre-warm the interface's working set (called shortly before the next message is predicted to arrive).
+   *
+   * Note: Called by the UDP server's thread. Derived classes can extend the pre-warmed state.
+   */
+  virtual void prewarm();
+
   /**
    * \brief Static constant wait time [ms] used when determining if a connection has been established or not.
    *
@@ -463,6 +361,11 @@ protected:
    */
   static const unsigned int WAIT_TIME_MS = 100;
 
+  /**
+   * \brief Static constant period [s] for flushing the log file (by the process-wide background service).
+   */
+  static const double LOG_FLUSH_PERIOD;
+
   /**
    * \brief Container for the inputs, to the interface, from the UDP server.
    */
@@ -483,11 +386,26 @@ protected:
    */
   boost::shared_ptr<EGMLogger> p_logger_;
 
+  /**
+   * \brief Background timer for periodically flushing the log file (zero if not scheduled).
+   */
+  BackgroundService::TimerId log_flush_timer_;
+
   /**
    * \brief The interface's configuration.
    */
   BaseConfigurationContainer configuration_;
 
+  /**
+   * \brief Collector for the metrics of the interface's stages.
+   */
+  MetricsCollector metrics_;
+
+  /**
+   * \brief Alignment between the robot controller's clock and the host's steady clock.
+   */
+  ClockAlignment clock_alignment_;
+
   /**
    * \brief Server for managing the communication with the robot controller.
    */
@@ -502,6 +420,13 @@ private:
    * \return string& containing the reply.
    */
   const std::string& callback(const UDPServerData& server_data);
+
+  /**
+   * \brief Retrieve the lead time [us], before each predicted message arrival, for pre-warming.
+   *
+   * \return unsigned int containing the lead time (zero means no pre-warming).
+   */
+  unsigned int prewarmLeadTime();
 };
 
 } // end namespace egm
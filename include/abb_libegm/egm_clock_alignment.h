@@ -0,0 +1,306 @@
+/***********************************************************************************************************************
+ *
+ * Copyright (c) 2015, ABB Schweiz AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that
+ * the following conditions are met:
+ *
+ *    * Redistributions of source code must retain the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer in the documentation
+ *      and/or other materials provided with the
+ *      distribution.
+ *    * Neither the name of ABB nor the names of its
+ *      contributors may be used to endorse or promote
+ *      products derived from this software without
+ *      specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***********************************************************************************************************************
+ */
+
+
+#ifndef EGM_CLOCK_ALIGNMENT_H
+#define EGM_CLOCK_ALIGNMENT_H
+
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace abb
+{
+namespace egm
+{
+/**
+ * \brief Struct for containing an estimated relation between the robot controller's clock and a host clock.
+ *
+ * The relation is modelled as: host_time = controller_time + offset + skew*(controller_time - reference).
+ */
+struct ClockEstimate
+{
+  /**
+   * \brief Default constructor.
+   */
+  ClockEstimate()
+  :
+  valid(false),
+  reference(0.0),
+  offset(0.0),
+  skew(0.0),
+  deviation(0.0),
+  samples(0),
+  outliers(0),
+  resets(0)
+  {}
+
+  /**
+   * \brief Flag indicating if the estimate is valid (i.e. if any samples have been used).
+   */
+  bool valid;
+
+  /**
+   * \brief The robot controller time [s] that the offset refers to (i.e. the most recently used sample).
+   */
+  double reference;
+
+  /**
+   * \brief The estimated offset [s] from the robot controller's clock to the host clock, at the reference time.
+   *
+   * Note: The offset includes the typical transfer delay (i.e. from the robot controller's send time to the host's
+   *       receive time), since the delay can't be separated from the offset with one-way time stamps.
+   */
+  double offset;
+
+  /**
+   * \brief The estimated skew [s/s] (e.g. 1.0e-6 means that the host clock gains 1 us per robot controller second).
+   */
+  double skew;
+
+  /**
+   * \brief The mean absolute deviation [s] of the used samples, from the estimate (e.g. the receive time jitter).
+   */
+  double deviation;
+
+  /**
+   * \brief The number of used samples (since the latest reset).
+   */
+  unsigned int samples;
+
+  /**
+   * \brief The number of rejected samples (i.e. outliers).
+   */
+  unsigned int outliers;
+
+  /**
+   * \brief The number of resets (e.g. because the robot controller's clock jumped).
+   */
+  unsigned int resets;
+};
+
+/**
+ * \brief Class for continuously aligning the robot controller's clock with a host clock (e.g. the steady clock).
+ *
+ * Each sample pairs a robot controller time stamp (e.g. the feedback time of an EGM message) with the host time
+ * when it was received. The offset and skew are estimated with an exponentially weighted linear regression,
+ * which is updated in constant time per sample. Samples that deviate much more than the typical deviation
+ * (e.g. messages that were delayed by the network or the scheduler) are rejected.
+ *
+ * Note: The estimate is reset if the robot controller's clock goes backwards, or if many consecutive samples
+ *       are rejected (i.e. if either clock has jumped).
+ */
+class ClockAlignment
+{
+public:
+  /**
+   * \brief A constructor.
+   *
+   * \param time_constant specifying the time constant [s] for forgetting old samples.
+   * \param outlier_threshold specifying the max deviation, as a multiple of the mean absolute deviation.
+   */
+  ClockAlignment(const double time_constant = 10.0, const double outlier_threshold = 4.0);
+
+  /**
+   * \brief Update the estimate with a new sample.
+   *
+   * \param controller_time specifying the robot controller time [s].
+   * \param host_time specifying the host time [s], when the robot controller time was received.
+   *
+   * \return bool indicating if the sample was used or not (i.e. not if it was rejected as an outlier).
+   */
+  bool update(const double controller_time, const double host_time);
+
+  /**
+   * \brief Reset the estimate (i.e. forget all samples).
+   */
+  void reset();
+
+  /**
+   * \brief Convert a robot controller time to the corresponding host time.
+   *
+   * \param controller_time specifying the robot controller time [s].
+   * \param p_host_time for containing the host time [s].
+   *
+   * \return bool indicating if the time was converted or not (i.e. not if there is no valid estimate).
+   */
+  bool toHostTime(const double controller_time, double* p_host_time) const;
+
+  /**
+   * \brief Convert a host time to the corresponding robot controller time.
+   *
+   * \param host_time specifying the host time [s].
+   * \param p_controller_time for containing the robot controller time [s].
+   *
+   * \return bool indicating if the time was converted or not (i.e. not if there is no valid estimate).
+   */
+  bool toControllerTime(const double host_time, double* p_controller_time) const;
+
+  /**
+   * \brief Retrieve the current estimate.
+   *
+   * \return ClockEstimate containing the estimate.
+   */
+  ClockEstimate getEstimate() const;
+
+private:
+  /**
+   * \brief Retrieve the estimated offset at a specific time (relative to the reference).
+   *
+   * Note: Requires that the mutex is locked.
+   *
+   * \param x specifying the robot controller time [s], relative to the reference.
+   *
+   * \return double containing the offset [s].
+   */
+  double offsetAt(const double x) const;
+
+  /**
+   * \brief Reset the regression (i.e. without counting it as a reset).
+   *
+   * Note: Requires that the mutex is locked.
+   */
+  void clear();
+
+  /**
+   * \brief Static constant for the number of samples, before outliers are rejected.
+   */
+  static const unsigned int MIN_SAMPLES = 20;
+
+  /**
+   * \brief Static constant for the number of consecutive outliers, which causes a reset.
+   */
+  static const unsigned int MAX_CONSECUTIVE_OUTLIERS = 50;
+
+  /**
+   * \brief Static constant for the min deviation [s] used for rejecting outliers (i.e. below the clocks' resolution).
+   */
+  static const double MIN_DEVIATION;
+
+  /**
+   * \brief Static constant for the min variance [s^2] of the sample times, before the skew is estimated.
+   */
+  static const double MIN_TIME_VARIANCE;
+
+  /**
+   * \brief Static constant for the max absolute skew [s/s] (i.e. the estimate is saturated).
+   */
+  static const double MAX_SKEW;
+
+  /**
+   * \brief The time constant [s] for forgetting old samples.
+   */
+  const double time_constant_;
+
+  /**
+   * \brief The max deviation, as a multiple of the mean absolute deviation.
+   */
+  const double outlier_threshold_;
+
+  /**
+   * \brief The robot controller time [s] of the first sample (since the latest reset), which times are relative to.
+   */
+  double reference_;
+
+  /**
+   * \brief The robot controller time [s] of the most recently used sample.
+   */
+  double previous_;
+
+  /**
+   * \brief The accumulated (decaying) sample weight.
+   */
+  double weight_;
+
+  /**
+   * \brief The weighted mean of the sample times [s] (relative to the reference).
+   */
+  double mean_time_;
+
+  /**
+   * \brief The weighted mean of the sample offsets [s].
+   */
+  double mean_offset_;
+
+  /**
+   * \brief The weighted sum of the squared sample time deviations [s^2].
+   */
+  double time_variance_;
+
+  /**
+   * \brief The weighted sum of the sample time and offset deviation products [s^2].
+   */
+  double covariance_;
+
+  /**
+   * \brief The estimated skew [s/s].
+   */
+  double skew_;
+
+  /**
+   * \brief The mean absolute deviation [s] of the used samples.
+   */
+  double deviation_;
+
+  /**
+   * \brief The number of used samples (since the latest reset).
+   */
+  unsigned int samples_;
+
+  /**
+   * \brief The number of consecutive outliers.
+   */
+  unsigned int consecutive_outliers_;
+
+  /**
+   * \brief The number of rejected samples.
+   */
+  unsigned int outliers_;
+
+  /**
+   * \brief The number of resets.
+   */
+  unsigned int resets_;
+
+  /**
+   * \brief Mutex for protecting the estimate.
+   */
+  mutable boost::mutex mutex_;
+};
+
+} // end namespace egm
+} // end namespace abb
+
+#endif // EGM_CLOCK_ALIGNMENT_H
@@ -0,0 +1,508 @@
+/***********************************************************************************************************************
+ *
+ * Copyright (c) 2015, ABB Schweiz AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that
+ * the following conditions are met:
+ *
+ *    * Redistributions of source code must retain the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer in the documentation
+ *      and/or other materials provided with the
+ *      distribution.
+ *    * Neither the name of ABB nor the names of its
+ *      contributors may be used to endorse or promote
+ *      products derived from this software without
+ *      specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***********************************************************************************************************************
+ */
+
+#ifndef EGM_CODEC_H
+#define EGM_CODEC_H
+
+#include <string>
+#include <vector>
+
+#include "egm.pb.h"                 // Generated by Google Protocol Buffer compiler protoc
+#include "egm_wrapper.pb.h"         // Generated by Google Protocol Buffer compiler protoc
+#include "egm_wrapper_session.pb.h" // Generated by Google Protocol Buffer compiler protoc
+
+#include "egm_common.h"
+
+namespace abb
+{
+namespace egm
+{
+/**
+ * \brief Class for containing inputs, i.e. the EGM robot messages received from the robot controller.
+ *
+ * Note: The class is independent of the transport (e.g. it is used both by the UDP based interfaces,
+ *       and by the EGMStepper class for stepping without any sockets).
+ */
+class InputContainer
+{
+public:
+  /**
+   * \brief Default constructor.
+   */
+  InputContainer();
+
+  /**
+   * \brief Parse an array, into an abb::egm::EgmRobot message.
+   *
+   * \param data containing the serialized array received from the robot controller.
+   * \param bytes_transferred for the number of bytes received.
+   *
+   * \return bool indicating if the parsing was successful or not.
+   */
+  bool parseFromArray(const char* data, const int bytes_transferred);
+
+  /**
+   * \brief Extract the parsed information.
+   *
+   * \param axes specifying the number of axes of the robot.
+   *
+   * \return bool indicating if the extraction was successful or not.
+   */
+  bool extractParsedInformation(const RobotAxes& axes);
+
+  /**
+   * \brief Update the previous inputs with the current inputs.
+   */
+  void updatePrevious();
+
+  /**
+   * \brief Retrieve the initial inputs (i.e initial robot controller outputs).
+   *
+   * \return Input with the initial inputs.
+   */
+  const wrapper::Input& initial() const { return initial_; };
+
+  /**
+   * \brief Retrieve the current inputs (i.e. current robot controller outputs).
+   *
+   * \return Input with the current inputs.
+   */
+  const wrapper::Input& current() const { return current_; };
+
+  /**
+   * \brief Retrieve the previous inputs (i.e. previous robot controller outputs).
+   *
+   * \return Input with the previous inputs.
+   */
+  const wrapper::Input& previous() const { return previous_; };
+
+  /**
+   * \brief Retrieve the estimated sample time [s].
+   *
+   * \return double containing the estimation.
+   */
+  double estimatedSampleTime() const { return estimated_sample_time_; };
+
+  /**
+   * \brief Retrieve the sample time [s] measured with the robot controller's clock.
+   *
+   * Note: Unlike the estimated sample time, the measurement is neither rounded nor limited.
+   *       I.e. it includes any jitter and any lost messages.
+   *
+   * \return double containing the measurement (zero if the robot controller's clock is unavailable).
+   */
+  double measuredSampleTime() const { return measured_sample_time_; };
+
+  /**
+   * \brief Retrieve a flag, indicating if the received message was the first in a communication session.
+   *
+   * \return bool indicating if it was the first message or not.
+   */
+  bool isFirstMessage() const { return first_message_; };
+
+  /**
+   * \brief Check if the robot controller's states are ok.
+   *
+   * I.e. motors are on, RAPID is running and EGM is running.
+   *
+   * \return bool indicating if the state are ok or not.
+   */
+  bool statesOk() const;
+
+  /**
+   * \brief Store the inputs needed to continue the session in another process.
+   *
+   * \param p_snapshot for storing the inputs.
+   */
+  void storeSession(wrapper::session::BaseSnapshot* p_snapshot) const;
+
+  /**
+   * \brief Pre-warm the inputs (i.e. touch their memory, before the next message arrives).
+   */
+  void prewarm() const;
+
+  /**
+   * \brief Restore the inputs of a session, handed over from another process.
+   *
+   * Note: The next received message is then treated as a continuation of the session.
+   *
+   * \param snapshot containing the inputs.
+   */
+  void restoreSession(const wrapper::session::BaseSnapshot& snapshot);
+
+private:
+  /**
+   * \brief Detect RobotWare and EGM protocol versions from a received EGM message.
+   *
+   * Note: Only a rough version detection is possible based on whether certain fields are present or not.
+   */
+  void detectRWAndEGMVersions();
+
+  /**
+   * \brief Estimate the sample time.
+   *
+   * Note: The exact difference of the robot controller's clock is also stored as the measured sample time.
+   *
+   * \return double containing the estimation.
+   */
+  double estimateSampleTime();
+
+  /**
+   * \brief Estimate the joint and the Cartesian velocities.
+   *
+   * \return bool indicating if the estimation was successful or not.
+   */
+  bool estimateAllVelocities();
+
+  /**
+   * \brief Container for the "raw" EGM robot message.
+   */
+  EgmRobot egm_robot_;
+
+  /**
+   * \brief Container for the initial inputs, extracted from the EGM robot message.
+   */
+  wrapper::Input initial_;
+
+  /**
+   * \brief Container for the current inputs, extracted from the EGM robot message.
+   */
+  wrapper::Input current_;
+
+  /**
+   * \brief Container for the previous inputs, extracted from the EGM robot message.
+   */
+  wrapper::Input previous_;
+
+  /**
+   * \brief Flag indicating if new data has been received.
+   */
+  bool has_new_data_;
+
+  /**
+   * \brief Flag indicating if the interface's callback has been called before or not.
+   */
+  bool first_call_;
+
+  /**
+   * \brief Flag indicating if the received message was the first in a communication session or not.
+   */
+  bool first_message_;
+
+  /**
+   * \brief The estimated sample time [s].
+   */
+  double estimated_sample_time_;
+
+  /**
+   * \brief The sample time [s] measured with the robot controller's clock.
+   */
+  double measured_sample_time_;
+};
+
+/**
+ * \brief Class for containing outputs, i.e. the EGM sensor messages to reply to the robot controller with.
+ */
+class OutputContainer
+{
+public:
+  /**
+   * \brief Default constructor.
+   */
+  OutputContainer();
+
+  /**
+   * \brief Prepare the outputs.
+   *
+   * \param inputs containing the inputs.
+   */
+  void prepareOutputs(const InputContainer& inputs);
+
+  /**
+   * \brief Generate demo outputs.
+   *
+   * \param inputs containing the inputs from the robot controller.
+   */
+  void generateDemoOutputs(const InputContainer& inputs);
+
+  /**
+   * \brief Construct the reply string.
+   *
+   * \param configuration containing the current configurations for the interface.
+   */
+  void constructReply(const BaseConfiguration& configuration);
+
+  /**
+   * \brief Update the previous outputs with the current outputs.
+   */
+  void updatePrevious();
+
+  /**
+   * \brief Retrieve the previous outputs sent to the robot controller.
+   *
+   * \return Output with the previous outputs.
+   */
+  const wrapper::Output& previous() const { return previous_; };
+
+  /**
+   * \brief Retrieve the current sequence_number.
+   *
+   * \return unsigned int containing the sequence number.
+   */
+  unsigned int sequenceNumber() const { return sequence_number_; };
+
+  /**
+   * \brief Retrieve the reply string, serialized from the current references.
+   *
+   * \return string& containing the reply.
+   */
+  const std::string& reply() const { return reply_; };
+
+  /**
+   * \brief Clear the reply content.
+   */
+  void clearReply() { reply_.clear(); reply_template_.invalidate(); };
+
+  /**
+   * \brief Store the outputs needed to continue the session in another process.
+   *
+   * \param p_snapshot for storing the outputs.
+   */
+  void storeSession(wrapper::session::BaseSnapshot* p_snapshot) const;
+
+  /**
+   * \brief Pre-warm the outputs (i.e. touch their memory, and the reply buffer, before the next message arrives).
+   */
+  void prewarm() const;
+
+  /**
+   * \brief Restore the outputs of a session, handed over from another process.
+   *
+   * \param snapshot containing the outputs.
+   */
+  void restoreSession(const wrapper::session::BaseSnapshot& snapshot);
+
+  /**
+   * \brief Container for the current outputs to send to the robot controller.
+   */
+  wrapper::Output current;
+
+private:
+  /**
+   * \brief Generate demo quaternion outputs.
+   *
+   * \param inputs containing the inputs from the robot controller.
+   * \param t for the interpolation parameter [0 <= t <= 1].
+   */
+  void generateDemoQuaternions(const InputContainer& inputs, const double t);
+
+  /**
+   * \brief Construct the header.
+   */
+  void constructHeader();
+
+  /**
+   * \brief Construct the joint body.
+   *
+   * \param configuration containing the current configurations for the interface.
+   *
+   * \return bool indicating if the construction was successful or not.
+   */
+  bool constructJointBody(const BaseConfiguration& configuration);
+
+  /**
+   * \brief Construct the Cartesian body.
+   *
+   * \param configuration containing the current configurations for the interface.
+   *
+   * \return bool indicating if the construction was successful or not.
+   */
+  bool constructCartesianBody(const BaseConfiguration& configuration);
+
+  /**
+   * \brief Class for patching a serialized reply in place (i.e. instead of constructing and serializing the EGM
+   *        sensor message).
+   *
+   * The template records the layout of a serialized reply: The byte offsets of all double fields (which are
+   * always encoded as fixed 64 bits), and of the sequence number. The next reply can then be produced straight from
+   * the outputs, by only overwriting the values that have changed, as long as the outputs' shape (i.e. which fields
+   * are constructed, and the number of repeated values) and the sequence number's encoded length are the same.
+   */
+  class ReplyTemplate
+  {
+  public:
+    /**
+     * \brief Default constructor.
+     */
+    ReplyTemplate() : valid_(false), seqno_offset_(0), seqno_length_(0) {}
+
+    /**
+     * \brief Record the layout of a serialized reply.
+     *
+     * \param outputs containing the outputs that the EGM sensor message was constructed from.
+     * \param configuration containing the configurations that the EGM sensor message was constructed with.
+     * \param egm_sensor containing the EGM sensor message.
+     * \param reply containing the EGM sensor message serialized.
+     */
+    void build(const wrapper::Output& outputs,
+               const BaseConfiguration& configuration,
+               const EgmSensor& egm_sensor,
+               const std::string& reply);
+
+    /**
+     * \brief Patch a reply, serialized from the template's previous outputs, with new outputs.
+     *
+     * \param outputs containing the new outputs.
+     * \param configuration containing the current configurations for the interface.
+     * \param sequence_number specifying the new sequence number.
+     * \param p_reply for the reply to patch.
+     *
+     * \return bool indicating if the reply was patched or not (i.e. not if it has to be serialized instead).
+     */
+    bool patch(const wrapper::Output& outputs,
+               const BaseConfiguration& configuration,
+               const unsigned int sequence_number,
+               std::string* p_reply);
+
+    /**
+     * \brief Invalidate the template (e.g. when the reply has been cleared).
+     */
+    void invalidate() { valid_ = false; };
+
+    /**
+     * \brief Check if the template is valid (i.e. if the latest reply may have been patched).
+     *
+     * \return bool indicating if the template is valid.
+     */
+    bool isValid() const { return valid_; };
+
+  private:
+    /**
+     * \brief Gather the shape, and the double values (in the EGM sensor message's serialization order), of outputs.
+     *
+     * \param outputs containing the outputs.
+     * \param configuration containing the current configurations for the interface.
+     * \param p_shape for containing the shape.
+     * \param p_values for containing the values.
+     *
+     * \return bool indicating if the outputs can be patched or not (e.g. not if they contain NaN values).
+     */
+    static bool gather(const wrapper::Output& outputs,
+                       const BaseConfiguration& configuration,
+                       std::vector<int>* p_shape,
+                       std::vector<double>* p_values);
+
+    /**
+     * \brief Collect the double values (in serialization order) of an EGM sensor message.
+     *
+     * \param egm_sensor containing the EGM sensor message.
+     * \param p_values for containing the values.
+     *
+     * \return bool indicating if the message can be patched or not (e.g. not if it contains time stamps).
+     */
+    static bool collect(const EgmSensor& egm_sensor, std::vector<double>* p_values);
+
+    /**
+     * \brief Flag indicating if the template is valid.
+     */
+    bool valid_;
+
+    /**
+     * \brief The shape of the template's outputs.
+     */
+    std::vector<int> shape_;
+
+    /**
+     * \brief The template's double values (in serialization order).
+     */
+    std::vector<double> values_;
+
+    /**
+     * \brief The byte offsets of the double values, in the serialized reply.
+     */
+    std::vector<size_t> offsets_;
+
+    /**
+     * \brief Scratch container for new outputs' shape (to avoid allocations).
+     */
+    std::vector<int> new_shape_;
+
+    /**
+     * \brief Scratch container for new outputs' double values (to avoid allocations).
+     */
+    std::vector<double> new_values_;
+
+    /**
+     * \brief The byte offset of the sequence number, in the serialized reply.
+     */
+    size_t seqno_offset_;
+
+    /**
+     * \brief The encoded length [bytes] of the sequence number, in the serialized reply.
+     */
+    size_t seqno_length_;
+  };
+
+  /**
+   * \brief Container for the actual EGM sensor message.
+   */
+  EgmSensor egm_sensor_;
+
+  /**
+   * \brief Container for the previous outputs sent to the robot controller.
+   */
+  wrapper::Output previous_;
+
+  /**
+   * \brief The sequance number, in the current communication session.
+   */
+  unsigned int sequence_number_;
+
+  /**
+   * \brief Container for the reply string.
+   */
+  std::string reply_;
+
+  /**
+   * \brief Template for patching the reply string in place.
+   */
+  ReplyTemplate reply_template_;
+};
+
+} // end namespace egm
+} // end namespace abb
+
+#endif // EGM_CODEC_H
@@ -144,7 +144,9 @@ struct BaseConfiguration
   use_demo_outputs(false),
   use_velocity_outputs(false),
   use_logging(false),
-  max_logging_duration(60.0)
+  max_logging_duration(60.0),
+  prewarm_lead_time(0),
+  use_reply_patching(false)
   {}
 
   /**
@@ -178,6 +180,29 @@ struct BaseConfiguration
    * \brief Maximum duration [s] to log data.
    */
   double max_logging_duration;
+
+  /**
+   * \brief Lead time [us], before each predicted message arrival, for pre-warming the interface's working set.
+   *
+   * The next arrival is predicted from the measured message period. Shortly before it, the interface touches its
+   * hot state (e.g. inputs, outputs, reply buffer and the next trajectory point). I.e. so each callback starts with
+   * the state in the CPU caches, even if other work on the same core has evicted it in between the messages.
+   *
+   * Note: Zero disables the pre-warming. The lead time should cover the timer's wake-up latency (e.g. 200-500 [us]).
+   */
+  unsigned int prewarm_lead_time;
+
+  /**
+   * \brief Flag indicating if the replies should be patched in place, instead of being serialized every time.
+   *
+   * The previous reply is kept as a template, and only the values that have changed (and the sequence number) are
+   * overwritten, straight from the outputs (i.e. the EGM sensor message isn't constructed). E.g. during static holds,
+   * then only the sequence number is updated. The reply is constructed and serialized as usual whenever the
+   * message's shape changes (e.g. if velocity outputs are added).
+   *
+   * Note: The produced replies are identical to serialized replies.
+   */
+  bool use_reply_patching;
 };
 
 /**
@@ -204,16 +229,32 @@ struct TrajectoryConfiguration
    * |  |-- Start and goal velocities.
    * |
    * |--Quintic:
+   * |  |-- Start and goal positions.
+   * |  |-- Start and goal velocities.
+   * |  |-- Start and goal accelerations.
+   * |
+   * |--Septic:
    *    |-- Start and goal positions.
    *    |-- Start and goal velocities.
    *    |-- Start and goal accelerations.
+   *    |-- Start and goal jerks.
    */
   enum SplineMethod
   {
-    Linear, ///< \brief Use a first degree polynomial.
-    Square, ///< \brief Use a second degree polynomial.
-    Cubic,  ///< \brief Use a third degree polynomial
-    Quintic ///< \brief Use a fifth degree polynomial.
+    Linear,  ///< \brief Use a first degree polynomial.
+    Square,  ///< \brief Use a second degree polynomial.
+    Cubic,   ///< \brief Use a third degree polynomial
+    Quintic, ///< \brief Use a fifth degree polynomial.
+    Septic   ///< \brief Use a seventh degree polynomial (i.e. continuous jerk between trajectory points).
+  };
+
+  /**
+   * \brief Enum for the available time bases, used for advancing the trajectory time.
+   */
+  enum TimeBase
+  {
+    SampleTime,     ///< \brief Advance with the estimated sample time (i.e. whole milliseconds each message).
+    ControllerClock ///< \brief Advance with the robot controller's clock (i.e. including jitter and lost messages).
   };
 
   /**
@@ -224,7 +265,24 @@ struct TrajectoryConfiguration
   TrajectoryConfiguration(const BaseConfiguration& base_configuration = BaseConfiguration())
   :
   base(base_configuration),
-  spline_method(Quintic)
+  spline_method(Quintic),
+  estimate_jerk(false),
+  time_base(SampleTime),
+  max_queued_points(0),
+  max_queued_bytes(0),
+  compact_storage(false),
+  retract_history_size(200),
+  seek_history_size(10000),
+  use_speed_governor(false),
+  speed_governor_joint_tolerance(0.5),
+  speed_governor_position_tolerance(1.0),
+  speed_governor_rate(0.5),
+  correction_hold_time(0.1),
+  correction_fade_time(0.1),
+  correction_joint_rate(10.0),
+  correction_position_rate(50.0),
+  correction_joint_velocity_rate(100.0),
+  correction_linear_velocity_rate(500.0)
   {}
 
   /**
@@ -236,6 +294,127 @@ struct TrajectoryConfiguration
    * \brief Value specifying which spline method to use in the interpolation.
    */
   SplineMethod spline_method;
+
+  /**
+   * \brief Flag indicating if goal jerks should be estimated, for points that have no specified jerks.
+   *
+   * Note: Only used by the septic spline method. The jerk at an interior point is chosen to minimize the integrated
+   *       squared snap of the current and the next queued segment (with the outer jerks of the two segments fixed).
+   *       Points without a specified duration, and the last point in a trajectory, use zero jerk.
+   */
+  bool estimate_jerk;
+
+  /**
+   * \brief Value specifying which time base to use for advancing the trajectory time.
+   *
+   * Note: With the controller clock, any time overshoot at the end of a trajectory point is carried over to the
+   *       next point. I.e. long trajectories finish on time according to the robot controller. The sample time is
+   *       used as fallback, if the robot controller's clock is unavailable (e.g. RobotWare versions before 6.07).
+   *       Each time step is clamped to a few estimated sample times, so only a bounded remainder of a large clock
+   *       step (e.g. after lost messages) is carried over.
+   */
+  TimeBase time_base;
+
+  /**
+   * \brief The maximum number of trajectory points that can be queued (zero means no limit).
+   *
+   * Note: Includes the points remaining in the currently active trajectory.
+   */
+  unsigned int max_queued_points;
+
+  /**
+   * \brief The maximum memory [bytes] that queued trajectory points can use (zero means no limit).
+   *
+   * Note: Includes the points remaining in the currently active trajectory.
+   */
+  size_t max_queued_bytes;
+
+  /**
+   * \brief Flag indicating if queued trajectory points should be stored in a compact form.
+   *
+   * The points' values are stored in single precision (except the durations), and positions are stored relative to
+   * the start of their segment (every 64th point is kept in full precision, as a segment start). This typically
+   * reduces the used memory 4-8 times. The added error is at most 2^-24 (about 6e-8) times each stored value's
+   * magnitude, where a position's magnitude is its distance from the segment start. E.g. about 6e-6 [degrees] for
+   * a position 100 [degrees] away from its segment start. The points are decoded (to full precision messages) when
+   * they are used for interpolation.
+   *
+   * Note: Joint fields with more than 255 values are truncated.
+   */
+  bool compact_storage;
+
+  /**
+   * \brief The number of recently executed trajectory segments to keep, for retracting along the executed path.
+   *
+   * Note: Zero disables the history (i.e. retracts are not possible).
+   */
+  unsigned int retract_history_size;
+
+  /**
+   * \brief The number of executed points to keep, in each trajectory, for seeking backwards (older points are
+   *        released while the trajectory is executed).
+   *
+   * Note: The points are released in blocks of 64, so up to 63 further executed points can be kept. The kept points
+   *       don't count towards the queue limits. Zero means that only the remaining points can be sought.
+   */
+  unsigned int seek_history_size;
+
+  /**
+   * \brief Flag indicating if the speed governor should be used.
+   *
+   * The governor continuously scales the trajectory time (between 1.0 and 5.0 times slower), to keep the
+   * tracking error (between the references and the robot's feedback) within the tolerances below.
+   * Unlike updating the duration factor, the scaling is applied smoothly without any ramp down.
+   */
+  bool use_speed_governor;
+
+  /**
+   * \brief The speed governor's tracking error tolerance for joint goals [degrees].
+   */
+  double speed_governor_joint_tolerance;
+
+  /**
+   * \brief The speed governor's tracking error tolerance for Cartesian goals [mm].
+   */
+  double speed_governor_position_tolerance;
+
+  /**
+   * \brief The speed governor's max rate of change of the time scale [1/s].
+   */
+  double speed_governor_rate;
+
+  /**
+   * \brief The time [s] that a correction is fully applied, after it was set.
+   *
+   * Note: Corrections are expected to be set continuously (e.g. by a sensor loop). An old correction is first held,
+   *       and then faded out linearly (during the fade time below), so that a stalled sensor loop stops correcting.
+   */
+  double correction_hold_time;
+
+  /**
+   * \brief The time [s] that a correction is faded out during, after the hold time.
+   */
+  double correction_fade_time;
+
+  /**
+   * \brief The max rate of change of the applied joint position offsets [degrees/s] (zero means no limit).
+   */
+  double correction_joint_rate;
+
+  /**
+   * \brief The max rate of change of the applied Cartesian position offsets [mm/s] (zero means no limit).
+   */
+  double correction_position_rate;
+
+  /**
+   * \brief The max rate of change of the applied joint velocity offsets [degrees/s^2] (zero means no limit).
+   */
+  double correction_joint_velocity_rate;
+
+  /**
+   * \brief The max rate of change of the applied Cartesian linear velocity offsets [mm/s^2] (zero means no limit).
+   */
+  double correction_linear_velocity_rate;
 };
 
 } // end namespace egm
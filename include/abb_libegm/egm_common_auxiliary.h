@@ -493,6 +493,14 @@ bool verify(const wrapper::CartesianPose& pose);
  */
 bool verify(const wrapper::CartesianVelocity& velocity);
 
+/**
+ * \brief Touch a memory region (i.e. read one byte per cache line), to bring it into the CPU caches.
+ *
+ * \param p_data for the start of the region.
+ * \param bytes specifying the region's size.
+ */
+void touch(const void* p_data, const size_t bytes);
+
 } // end namespace egm
 } // end namespace abb
 
@@ -51,7 +51,7 @@ namespace egm
  * \brief Class for managing interpolations.
  *
  * The used approaches, depending on the conditions, are:
- * - 5th (or lower) degree spline polynomials.
+ * - 7th (or lower) degree spline polynomials.
  * - Slerp interpolation.
  * - Ramping in or ramping down values.
  *
@@ -116,6 +116,74 @@ public:
     TrajectoryConfiguration::SplineMethod spline_method;
   };
 
+  /**
+   * \brief Struct for containing the boundary values of one axis, at a trajectory point.
+   */
+  struct BoundaryValues
+  {
+    /**
+     * \brief A constructor.
+     *
+     * \param position specifying the position.
+     * \param velocity specifying the velocity.
+     * \param acceleration specifying the acceleration.
+     * \param jerk specifying the jerk.
+     */
+    BoundaryValues(const double position = 0.0,
+                   const double velocity = 0.0,
+                   const double acceleration = 0.0,
+                   const double jerk = 0.0)
+    :
+    position(position),
+    velocity(velocity),
+    acceleration(acceleration),
+    jerk(jerk)
+    {}
+
+    /**
+     * \brief The position.
+     */
+    double position;
+
+    /**
+     * \brief The velocity.
+     */
+    double velocity;
+
+    /**
+     * \brief The acceleration.
+     */
+    double acceleration;
+
+    /**
+     * \brief The jerk.
+     */
+    double jerk;
+  };
+
+  /**
+   * \brief Calculate the jerk at an interior point, which minimizes the snap of the two adjacent septic segments.
+   *
+   * The septic spline coefficients are linear in the boundary jerk, so the integrated squared snap (over both
+   * segments) is a quadratic function of the interior point's jerk. Its minimum is found in closed form.
+   *
+   * Note: The optimization is local, i.e. it only considers the segment before and the segment after the point
+   *       (with fixed jerks at their outer ends). It doesn't solve for all interior jerks of a trajectory at once.
+   *
+   * \param start specifying the values at the first segment's start.
+   * \param middle specifying the values at the interior point (the jerk is ignored).
+   * \param goal specifying the values at the second segment's goal.
+   * \param first_duration specifying the first segment's duration [s].
+   * \param second_duration specifying the second segment's duration [s].
+   *
+   * \return double containing the jerk (zero if any of the durations isn't positive).
+   */
+  static double calculateMinimumSnapJerk(const BoundaryValues& start,
+                                         const BoundaryValues& middle,
+                                         const BoundaryValues& goal,
+                                         const double first_duration,
+                                         const double second_duration);
+
   /**
    * \brief Update the interpolator for upcoming calculations. E.g. used after a new goal has been chosen.
    *
@@ -136,6 +204,11 @@ public:
    */
   void evaluate(wrapper::trajectory::PointGoal* p_output, const double sample_time, double t);
 
+  /**
+   * \brief Pre-warm the interpolator (i.e. touch the spline coefficients, before they are evaluated next time).
+   */
+  void prewarm() const;
+
   /**
    * \brief Retrive the valid duration [s] for the current interpolation session.
    *
@@ -146,6 +219,16 @@ public:
     return conditions_.duration;
   }
 
+  /**
+   * \brief Retrive the operation for the current interpolation session.
+   *
+   * \return Operation containing the operation.
+   */
+  Operation getOperation()
+  {
+    return conditions_.operation;
+  }
+
 private:
   /**
    * \brief Enum for specifying which Cartesian axis to consider in the spline polynomials.
@@ -174,9 +257,11 @@ private:
     alfa(0.0),
     d_alfa(0.0),
     dd_alfa(0.0),
+    ddd_alfa(0.0),
     beta(0.0),
     d_beta(0.0),
     dd_beta(0.0),
+    ddd_beta(0.0),
     spline_method(conditions.spline_method),
     do_ramp_down(conditions.operation == RampDown),
     ramp_down_factor(conditions.ramp_down_factor)
@@ -224,6 +309,11 @@ private:
      */
     double dd_alfa;
 
+    /**
+     * \brief The start jerk.
+     */
+    double ddd_alfa;
+
     /**
      * \param The goal position.
      */
@@ -239,6 +329,11 @@ private:
      */
     double dd_beta;
 
+    /**
+     * \param The goal jerk.
+     */
+    double ddd_beta;
+
     /**
      * \brief Specifies which spline method to use.
      */
@@ -258,9 +353,11 @@ private:
   };
 
   /**
-   * \brief Class for a spline interpolation polynomial of degree 5 or lower.
+   * \brief Class for a spline interpolation polynomial of degree 7 or lower.
    *
-   * I.e. A + B*t + C*t^2 + D*t^3 + E*t^4 + F*t^5.
+   * I.e. A + B*t + C*t^2 + D*t^3 + E*t^4 + F*t^5 + G*t^6 + H*t^7.
+   *
+   * Note: The polynomial is evaluated with Horner's method, so higher degrees only add a few multiplications.
    */
   class SplinePolynomial
   {
@@ -268,7 +365,7 @@ private:
     /**
      * \brief Default constructor.
      */
-    SplinePolynomial() : a_(0.0), b_(0.0), c_(0.0), d_(0.0), e_(0.0), f_(0.0) {}
+    SplinePolynomial() : a_(0.0), b_(0.0), c_(0.0), d_(0.0), e_(0.0), f_(0.0), g_(0.0), h_(0.0) {}
 
     /**
      * \brief Update the polynomial's coefficients.
@@ -295,6 +392,21 @@ private:
      */
     void evaluate(wrapper::trajectory::CartesianGoal* p_output, const Axis axis, const double t);
 
+    /**
+     * \brief Retrieve the coefficients of the polynomial's snap (i.e. fourth derivative).
+     *
+     * I.e. the snap is p[0] + p[1]*t + p[2]*t^2 + p[3]*t^3.
+     *
+     * \param p_coefficients for containing the four coefficients.
+     */
+    void getSnapCoefficients(double* p_coefficients) const
+    {
+      p_coefficients[0] = 24.0*e_;
+      p_coefficients[1] = 120.0*f_;
+      p_coefficients[2] = 360.0*g_;
+      p_coefficients[3] = 840.0*h_;
+    }
+
   private:
     /**
      * \brief Calculate the position.
@@ -305,7 +417,7 @@ private:
      */
     double calculatePosition(const double t)
     {
-      return a_ + b_*t + c_*std::pow(t, 2) + d_*std::pow(t, 3) + e_*std::pow(t, 4) + f_*std::pow(t, 5);
+      return a_ + t*(b_ + t*(c_ + t*(d_ + t*(e_ + t*(f_ + t*(g_ + t*h_))))));
     }
 
     /**
@@ -317,7 +429,7 @@ private:
      */
     double calculateVelocity(const double t)
     {
-      return b_ + 2.0*c_*t + 3.0*d_*std::pow(t, 2) + 4.0*e_*std::pow(t, 3) + 5.0*f_*std::pow(t, 4);
+      return b_ + t*(2.0*c_ + t*(3.0*d_ + t*(4.0*e_ + t*(5.0*f_ + t*(6.0*g_ + t*7.0*h_)))));
     }
 
     /**
@@ -329,7 +441,19 @@ private:
      */
     double calculateAcceleration(const double t)
     {
-      return 2.0*c_ + 6.0*d_*t + 12.0*e_*std::pow(t, 2) + 20.0*f_*std::pow(t, 3);
+      return 2.0*c_ + t*(6.0*d_ + t*(12.0*e_ + t*(20.0*f_ + t*(30.0*g_ + t*42.0*h_))));
+    }
+
+    /**
+     * \brief Calculate the jerk.
+     *
+     * \param t for the time instance [s] to calculate at.
+     *
+     * \return double containing the calculated jerk.
+     */
+    double calculateJerk(const double t)
+    {
+      return 6.0*d_ + t*(24.0*e_ + t*(60.0*f_ + t*(120.0*g_ + t*210.0*h_)));
     }
 
     /**
@@ -361,6 +485,16 @@ private:
      * \brief Coefficient F.
      */
     double f_;
+
+    /**
+     * \brief Coefficient G.
+     */
+    double g_;
+
+    /**
+     * \brief Coefficient H.
+     */
+    double h_;
   };
 
   /**
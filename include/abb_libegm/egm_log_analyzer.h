@@ -0,0 +1,449 @@
+/***********************************************************************************************************************
+ *
+ * Copyright (c) 2015, ABB Schweiz AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that
+ * the following conditions are met:
+ *
+ *    * Redistributions of source code must retain the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer in the documentation
+ *      and/or other materials provided with the
+ *      distribution.
+ *    * Neither the name of ABB nor the names of its
+ *      contributors may be used to endorse or promote
+ *      products derived from this software without
+ *      specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***********************************************************************************************************************
+ */
+
+#ifndef EGM_LOG_ANALYZER_H
+#define EGM_LOG_ANALYZER_H
+
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/array.hpp>
+
+namespace abb
+{
+namespace egm
+{
+/**
+ * \brief Class for offline analysis of CSV log files, written by the EGMLogger class.
+ *
+ * The class provides behavior for:
+ * - Building a time index of a log file, for fast seeking into long logs.
+ * - Extracting time ranges from a log file.
+ * - Computing per-axis tracking error, velocity and timing jitter statistics, over many log files in parallel.
+ *
+ * Without a time index, a time range's start is found by a binary search over the file's byte offsets (i.e. only
+ * a few rows are read), since the rows are logged in time order.
+ *
+ * Note: The analysis assumes the default EGMLogger headers. I.e. a time stamp column followed by blocks of robot
+ *       feedback, robot planned and sensor reference values.
+ *
+ * Note: Standard threads (and mutexes) are used, so that the analyzer is part of the core library (i.e. it doesn't
+ *       depend on any compiled Boost libraries).
+ */
+class EGMLogAnalyzer
+{
+public:
+  /**
+   * \brief Struct for accumulating statistics of a signal.
+   */
+  struct Statistics
+  {
+    /**
+     * \brief Default constructor.
+     */
+    Statistics()
+    :
+    count(0),
+    sum(0.0),
+    sum_of_squares(0.0),
+    max_absolute(0.0)
+    {}
+
+    /**
+     * \brief Add a sample to the statistics.
+     *
+     * \param value containing the sample to add.
+     */
+    void add(const double value);
+
+    /**
+     * \brief Merge another set of statistics into this set.
+     *
+     * \param other containing the statistics to merge.
+     */
+    void merge(const Statistics& other);
+
+    /**
+     * \brief Calculate the mean value.
+     *
+     * \return double containing the mean value (zero if no samples have been added).
+     */
+    double mean() const;
+
+    /**
+     * \brief Calculate the root mean square value.
+     *
+     * \return double containing the root mean square value (zero if no samples have been added).
+     */
+    double rms() const;
+
+    /**
+     * \brief Calculate the standard deviation.
+     *
+     * \return double containing the standard deviation (zero if less than two samples have been added).
+     */
+    double standardDeviation() const;
+
+    /**
+     * \brief The number of samples.
+     */
+    unsigned int count;
+
+    /**
+     * \brief The sum of all samples.
+     */
+    double sum;
+
+    /**
+     * \brief The sum of all squared samples.
+     */
+    double sum_of_squares;
+
+    /**
+     * \brief The maximum absolute sample value.
+     */
+    double max_absolute;
+  };
+
+  /**
+   * \brief Struct for containing the analysis summary of one log file.
+   */
+  struct Summary
+  {
+    /**
+     * \brief Default constructor.
+     */
+    Summary()
+    :
+    success(false),
+    number_of_rows(0),
+    start_time(0.0),
+    end_time(0.0),
+    number_of_gaps(0)
+    {}
+
+    /**
+     * \brief The analyzed log file.
+     */
+    std::string filename;
+
+    /**
+     * \brief Flag indicating if the analysis succeeded or not.
+     */
+    bool success;
+
+    /**
+     * \brief The number of analyzed rows.
+     */
+    unsigned int number_of_rows;
+
+    /**
+     * \brief Time stamp [ms] of the first analyzed row.
+     */
+    double start_time;
+
+    /**
+     * \brief Time stamp [ms] of the last analyzed row.
+     */
+    double end_time;
+
+    /**
+     * \brief Statistics for the time [ms] between consecutive rows (i.e. the timing jitter).
+     */
+    Statistics sample_time;
+
+    /**
+     * \brief The number of gaps, i.e. rows that were received more than 1.5 nominal sample times after the previous.
+     */
+    unsigned int number_of_gaps;
+
+    /**
+     * \brief Statistics for the joint tracking errors [degrees] (i.e. sensor references minus robot feedback).
+     */
+    boost::array<Statistics, 12> joint_tracking_errors;
+
+    /**
+     * \brief Statistics for the Cartesian position tracking errors [mm] (i.e. sensor references minus robot feedback).
+     */
+    boost::array<Statistics, 3> cartesian_tracking_errors;
+
+    /**
+     * \brief Statistics for the joint feedback velocities [degrees/s].
+     */
+    boost::array<Statistics, 12> joint_velocities;
+
+    /**
+     * \brief Statistics for the Cartesian linear feedback velocities [mm/s].
+     */
+    boost::array<Statistics, 3> cartesian_velocities;
+  };
+
+  /**
+   * \brief Class for a time index of a log file, used for seeking into the file.
+   */
+  class TimeIndex
+  {
+  public:
+    /**
+     * \brief Default constructor.
+     */
+    TimeIndex() : number_of_rows_(0) {}
+
+    /**
+     * \brief Build the index for a log file.
+     *
+     * \param filename specifying the log file to index.
+     *
+     * \return bool indicating if the index was successfully built or not.
+     */
+    bool build(const std::string& filename);
+
+    /**
+     * \brief Find the file position to start reading from, for finding rows at or after a time stamp.
+     *
+     * \param time_stamp specifying the time stamp [ms] to seek to.
+     *
+     * \return std::streampos containing the position of an indexed row at or before the time stamp.
+     */
+    std::streampos seek(const double time_stamp) const;
+
+    /**
+     * \brief Retrieve the number of rows in the indexed log file.
+     *
+     * \return unsigned int containing the number of rows.
+     */
+    unsigned int numberOfRows() const { return number_of_rows_; };
+
+  private:
+    /**
+     * \brief Struct for an entry in the index.
+     */
+    struct Entry
+    {
+      /**
+       * \brief The time stamp [ms] of the indexed row.
+       */
+      double time_stamp;
+
+      /**
+       * \brief The position of the indexed row in the log file.
+       */
+      std::streampos position;
+    };
+
+    /**
+     * \brief Compare an entry's time stamp with a time stamp (used when searching the index).
+     *
+     * \param time_stamp for the time stamp to compare with.
+     * \param entry for the entry to compare.
+     *
+     * \return bool indicating if the time stamp is less than the entry's time stamp.
+     */
+    static bool compare(const double time_stamp, const Entry& entry) { return time_stamp < entry.time_stamp; };
+
+    /**
+     * \brief Static constant for the number of rows between each index entry.
+     */
+    static const unsigned int STRIDE = 256;
+
+    /**
+     * \brief The number of rows in the indexed log file.
+     */
+    unsigned int number_of_rows_;
+
+    /**
+     * \brief Container for the index entries (sorted in time).
+     */
+    std::vector<Entry> entries_;
+  };
+
+  /**
+   * \brief A constructor.
+   *
+   * \param nominal_sample_time specifying the nominal sample time [s] (used for detecting gaps).
+   */
+  EGMLogAnalyzer(const double nominal_sample_time = 0.004);
+
+  /**
+   * \brief Analyze a single log file, optionally limited to a time range.
+   *
+   * \param filename specifying the log file to analyze.
+   * \param start_time specifying the time stamp [ms] to start the analysis at.
+   * \param end_time specifying the time stamp [ms] to end the analysis at (a negative value means the end of the log).
+   * \param p_index specifying an optional time index of the log file (used to seek to the start time, instead of a
+   *                binary search in the file).
+   *
+   * \return Summary containing the analysis summary.
+   */
+  Summary analyze(const std::string& filename,
+                  const double start_time = 0.0,
+                  const double end_time = -1.0,
+                  const TimeIndex* p_index = 0) const;
+
+  /**
+   * \brief Analyze several log files in parallel.
+   *
+   * \param filenames specifying the log files to analyze.
+   * \param number_of_threads specifying the number of worker threads (zero means one per hardware thread).
+   *
+   * \return std::vector<Summary> containing the analysis summaries (in the same order as the filenames).
+   */
+  std::vector<Summary> analyze(const std::vector<std::string>& filenames, unsigned int number_of_threads = 0) const;
+
+  /**
+   * \brief Extract a time range from a log file, into another CSV file (including the header).
+   *
+   * \param filename specifying the log file to extract from.
+   * \param output_filename specifying the CSV file to write to.
+   * \param start_time specifying the time stamp [ms] to start the extraction at.
+   * \param end_time specifying the time stamp [ms] to end the extraction at.
+   * \param p_index for an optional, prebuilt, time index of the log file (used for seeking to the start time, instead
+   *                of a binary search in the file).
+   *
+   * \return unsigned int containing the number of extracted rows.
+   */
+  unsigned int extract(const std::string& filename,
+                       const std::string& output_filename,
+                       const double start_time,
+                       const double end_time,
+                       const TimeIndex* p_index = 0) const;
+
+  /**
+   * \brief Write a compact summary (one line per log file) to a stream.
+   *
+   * \param stream for the stream to write to.
+   * \param summaries containing the summaries to write.
+   */
+  static void writeSummaries(std::ostream& stream, const std::vector<Summary>& summaries);
+
+private:
+  /**
+   * \brief Static constant for the column of the time stamps.
+   */
+  static const size_t TIME_STAMP_COLUMN = 0;
+
+  /**
+   * \brief Static constant for the first column of the robot feedback block.
+   */
+  static const size_t FEEDBACK_COLUMN = 1;
+
+  /**
+   * \brief Static constant for the first column of the sensor references block.
+   */
+  static const size_t REFERENCES_COLUMN = 81;
+
+  /**
+   * \brief Static constant for the offset, within a block, to the joint velocities.
+   */
+  static const size_t JOINT_VELOCITY_OFFSET = 12;
+
+  /**
+   * \brief Static constant for the offset, within a block, to the Cartesian positions.
+   */
+  static const size_t CARTESIAN_POSITION_OFFSET = 24;
+
+  /**
+   * \brief Static constant for the offset, within a block, to the Cartesian linear velocities.
+   */
+  static const size_t CARTESIAN_VELOCITY_OFFSET = 34;
+
+  /**
+   * \brief Static constant for the number of columns in a row (with the default headers).
+   */
+  static const size_t NUMBER_OF_COLUMNS = 121;
+
+  /**
+   * \brief Parse a row, from a log file, into a container of values.
+   *
+   * \param line containing the row to parse.
+   * \param p_values for containing the parsed values.
+   *
+   * \return bool indicating if the parsing was successful or not.
+   */
+  static bool parseRow(const std::string& line, std::vector<double>* p_values);
+
+  /**
+   * \brief Seek to a row at or before a time stamp, in an opened log file (after its header has been read).
+   *
+   * The seek uses the time index, if one is given. Otherwise, the rows are binary searched by their byte offsets.
+   *
+   * \param p_file for the log file.
+   * \param time_stamp specifying the time stamp [ms] to seek to.
+   * \param p_index specifying an optional time index of the log file.
+   */
+  static void seek(std::ifstream* p_file, const double time_stamp, const TimeIndex* p_index);
+
+  /**
+   * \brief Binary search the rows of an opened log file, by their byte offsets.
+   *
+   * \param p_file for the log file.
+   * \param time_stamp specifying the time stamp [ms] to search for.
+   *
+   * \return std::streampos containing the position of a row before the time stamp (or the first row's position).
+   */
+  static std::streampos search(std::ifstream* p_file, const double time_stamp);
+
+  /**
+   * \brief Static constant for the byte range [bytes] below which the binary search stops (i.e. the remaining rows
+   *        are read sequentially).
+   */
+  static const std::streamoff SEARCH_RANGE = 64*1024;
+
+  /**
+   * \brief Worker method, for analyzing log files in parallel.
+   *
+   * \param p_filenames specifying the log files to analyze.
+   * \param p_summaries for containing the analysis summaries.
+   * \param p_next_index for the index of the next log file to analyze (shared between the workers).
+   * \param p_mutex for protecting the index of the next log file.
+   */
+  void analyzeWorker(const std::vector<std::string>* p_filenames,
+                     std::vector<Summary>* p_summaries,
+                     size_t* p_next_index,
+                     std::mutex* p_mutex) const;
+
+  /**
+   * \brief The nominal sample time [s].
+   */
+  double nominal_sample_time_;
+};
+
+} // end namespace egm
+} // end namespace abb
+
+#endif // EGM_LOG_ANALYZER_H
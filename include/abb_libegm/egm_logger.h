@@ -37,7 +37,11 @@
 #ifndef EGM_LOGGER_H
 #define EGM_LOGGER_H
 
+#include <cstddef>
 #include <fstream>
+#include <string>
+
+#include <boost/thread/mutex.hpp>
 
 #include "egm_wrapper.pb.h" // Generated by Google Protocol Buffer compiler protoc
 
@@ -47,6 +51,17 @@ namespace egm
 {
 /**
  * \brief Class for logging EGM messages into CSV formatted file.
+ *
+ * The log is double buffered: Each message is formatted outside of any lock, and then appended to the pending
+ * buffer under a short lock. A flush swaps the pending buffer under the lock, and writes it to the file outside
+ * of the lock (i.e. the thread adding messages is never blocked by the file I/O).
+ *
+ * The messages are formatted into a fixed size buffer, and the pending buffer is capped (with the buffers reserved
+ * up front), so adding messages never allocates. Messages that don't fit (e.g. if the flushes fall behind) are
+ * dropped and counted.
+ *
+ * Note: The messages must be added from one thread, while the log can be flushed (e.g. periodically by a background
+ *       service) from any thread.
  */
 class EGMLogger
 {
@@ -65,10 +80,15 @@ public:
   ~EGMLogger();
 
   /**
-   * \brief Flush the stream object.
+   * \brief Flush the log (i.e. write the pending messages to the log file).
    */
   void flush();
 
+  /**
+   * \brief End the current log event (i.e. message), and append it to the pending messages (without flushing).
+   */
+  void endMessage();
+
   /**
    * \brief Add header data to the log stream.
    *
@@ -108,6 +128,13 @@ public:
    */
   double calculateTimeLogged(const double sample_time);
 
+  /**
+   * \brief Retrieve the number of dropped messages (i.e. that didn't fit in the pending buffer).
+   *
+   * \return unsigned int containing the number of dropped messages.
+   */
+  unsigned int droppedMessages();
+
 private:
   /**
    * \brief Add mock values for missing joint data to the log stream.
@@ -118,15 +145,83 @@ private:
    */
   void addMockJoints(const bool robot, const size_t robot_size, const size_t external_size);
 
+  /**
+   * \brief Format a value into the current message.
+   *
+   * \param value containing the value to format.
+   * \param separator specifying the separator to add after the value.
+   */
+  void append(const double value, const char* separator = ",");
+
+  /**
+   * \brief Format a time stamp into the current message.
+   *
+   * \param value containing the time stamp to format.
+   * \param separator specifying the separator to add after the value.
+   */
+  void append(const unsigned int value, const char* separator = ",");
+
+  /**
+   * \brief Static constant for the size of the buffer for formatting a message [bytes].
+   *
+   * Note: A message with the default headers is below 2 kB (with six significant digits per value).
+   */
+  static const size_t MESSAGE_BUFFER_SIZE = 4096;
+
+  /**
+   * \brief Static constant for the max size of the pending buffer [bytes] (i.e. a few flush periods of messages).
+   */
+  static const size_t MAX_PENDING_BYTES = 1 << 20;
+
   /**
    * \brief The number of logged messages.
    */
   unsigned int number_of_logged_messages_;
 
   /**
-   * \brief Stream object for logging data.
+   * \brief The number of dropped messages (i.e. that didn't fit in the pending buffer).
+   */
+  unsigned int number_of_dropped_messages_;
+
+  /**
+   * \brief Buffer for formatting the current message (only used by the thread adding the messages).
+   */
+  char message_buffer_[MESSAGE_BUFFER_SIZE];
+
+  /**
+   * \brief The length of the current message [bytes].
+   */
+  size_t message_length_;
+
+  /**
+   * \brief Flag indicating if the current message has been truncated (i.e. it didn't fit in the message buffer).
+   */
+  bool message_truncated_;
+
+  /**
+   * \brief Buffer for the ended messages, which are waiting to be written to the log file.
+   */
+  std::string pending_buffer_;
+
+  /**
+   * \brief Buffer for the messages being written to the log file (swapped with the pending buffer when flushing).
+   */
+  std::string writing_buffer_;
+
+  /**
+   * \brief Stream object for the log file.
    */
   std::ofstream log_stream_;
+
+  /**
+   * \brief Mutex for protecting the pending buffer.
+   */
+  boost::mutex mutex_;
+
+  /**
+   * \brief Mutex for serializing the flushes (i.e. protecting the writing buffer and the stream object).
+   */
+  boost::mutex flush_mutex_;
 };
 
 } // end namespace egm
@@ -0,0 +1,507 @@
+/***********************************************************************************************************************
+ *
+ * Copyright (c) 2015, ABB Schweiz AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that
+ * the following conditions are met:
+ *
+ *    * Redistributions of source code must retain the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer in the documentation
+ *      and/or other materials provided with the
+ *      distribution.
+ *    * Neither the name of ABB nor the names of its
+ *      contributors may be used to endorse or promote
+ *      products derived from this software without
+ *      specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***********************************************************************************************************************
+ */
+
+#ifndef EGM_METRICS_H
+#define EGM_METRICS_H
+
+#include <boost/array.hpp>
+#include <boost/atomic.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace abb
+{
+namespace egm
+{
+/**
+ * \brief Struct for containing metrics, collected while an EGM interface processes messages.
+ *
+ * Note: Allocation metrics are only collected if the library has been built with the
+ *       ABB_LIBEGM_ALLOCATION_PROFILING option. Otherwise all allocation counters remain zero.
+ *       Hardware counters are only collected if they have been enabled (only supported on Linux).
+ *       If neither is the case, then profiling is inactive and no metrics are collected at all.
+ */
+struct Metrics
+{
+  /**
+   * \brief Enum for the stages that metrics are collected for.
+   */
+  enum Stage
+  {
+    Parse,           ///< \brief Parsing of the received message.
+    Extract,         ///< \brief Extraction of the parsed information, and preparation of the outputs.
+    Generate,        ///< \brief Generation of the outputs (e.g. demo, trajectory or external controller outputs).
+    Log,             ///< \brief Logging of the inputs and outputs.
+    Reply,           ///< \brief Construction of the reply message.
+    Queue,           ///< \brief User interaction with queued data (e.g. adding trajectories).
+    NUMBER_OF_STAGES ///< \brief The number of stages.
+  };
+
+  /**
+   * \brief Enum for the hardware (and kernel software) counters, that are sampled for each stage.
+   */
+  enum HardwareCounter
+  {
+    Instructions,                ///< \brief Retired instructions.
+    Cycles,                      ///< \brief CPU cycles.
+    CacheMisses,                 ///< \brief Last level cache misses.
+    ContextSwitches,             ///< \brief Context switches (e.g. preemptions).
+    PageFaults,                  ///< \brief Page faults.
+    NUMBER_OF_HARDWARE_COUNTERS  ///< \brief The number of hardware counters.
+  };
+
+  /**
+   * \brief Struct for containing the metrics of a stage.
+   */
+  struct StageMetrics
+  {
+    /**
+     * \brief Default constructor.
+     */
+    StageMetrics()
+    :
+    calls(0),
+    allocations(0),
+    deallocations(0),
+    allocated_bytes(0),
+    sampled_calls(0)
+    {
+      hardware_counters.assign(0);
+    }
+
+    /**
+     * \brief Merge another set of stage metrics into this set.
+     *
+     * \param other containing the metrics to merge.
+     */
+    void merge(const StageMetrics& other)
+    {
+      calls += other.calls;
+      allocations += other.allocations;
+      deallocations += other.deallocations;
+      allocated_bytes += other.allocated_bytes;
+      sampled_calls += other.sampled_calls;
+
+      for (size_t i = 0; i < hardware_counters.size(); ++i)
+      {
+        hardware_counters[i] += other.hardware_counters[i];
+      }
+    }
+
+    /**
+     * \brief The number of times the stage has been executed.
+     */
+    unsigned long long calls;
+
+    /**
+     * \brief The number of allocations made during the stage.
+     */
+    unsigned long long allocations;
+
+    /**
+     * \brief The number of deallocations made during the stage.
+     */
+    unsigned long long deallocations;
+
+    /**
+     * \brief The number of bytes allocated during the stage.
+     */
+    unsigned long long allocated_bytes;
+
+    /**
+     * \brief The number of times the stage has been executed, with the hardware counters sampled.
+     *
+     * Note: Divide the hardware counters with this, to get the per-execution averages.
+     */
+    unsigned long long sampled_calls;
+
+    /**
+     * \brief The hardware counters accumulated during the stage's sampled executions.
+     *
+     * Note: Inside callbacks, these are the shares attributed to the stage (see MetricsCollector::StageScope).
+     */
+    boost::array<unsigned long long, NUMBER_OF_HARDWARE_COUNTERS> hardware_counters;
+  };
+
+  /**
+   * \brief Default constructor.
+   */
+  Metrics()
+  :
+  callbacks(0),
+  allocating_callbacks(0),
+  last_callback_allocations(0)
+  {
+    available_hardware_counters.assign(false);
+  }
+
+  /**
+   * \brief The number of processed callbacks.
+   */
+  unsigned long long callbacks;
+
+  /**
+   * \brief The number of processed callbacks that made at least one allocation.
+   *
+   * Note: Can e.g. be used to verify that the steady-state callbacks are free from allocations.
+   */
+  unsigned long long allocating_callbacks;
+
+  /**
+   * \brief The number of allocations made during the most recent callback.
+   */
+  unsigned long long last_callback_allocations;
+
+  /**
+   * \brief The metrics for each stage.
+   */
+  boost::array<StageMetrics, NUMBER_OF_STAGES> stages;
+
+  /**
+   * \brief Flags indicating which hardware counters could be opened (e.g. depending on the kernel's settings).
+   */
+  boost::array<bool, NUMBER_OF_HARDWARE_COUNTERS> available_hardware_counters;
+};
+
+/**
+ * \brief Class for collecting metrics, from the EGM communication loop as well as from user threads.
+ *
+ * Metrics are only collected while profiling is active, i.e. if the library has been built with allocation
+ * profiling, or if hardware counters have been enabled. Otherwise the scopes do nothing.
+ *
+ * Inside a callback, the stages' metrics are recorded (without locking) in the callback scope, and they are
+ * published once, when the callback ends, via a lock-free triple buffer. Stages outside any callback (e.g. user
+ * threads adding trajectories) are reported under the collector's mutex.
+ */
+class MetricsCollector
+{
+public:
+  class CallbackScope;
+
+  /**
+   * \brief Class for scoping a stage, i.e. metrics are collected for the stage during the scope's lifetime.
+   *
+   * Note: Scopes can be nested, and then the innermost scope's stage collects the allocation metrics. Inside a
+   *       callback, a stage only measures its elapsed time, and the callback's hardware counts are attributed to its
+   *       stages in proportion to their elapsed times (i.e. an outer scope's share includes inner scopes). Outside
+   *       any callback, the hardware counters are sampled when the scope starts and ends.
+   */
+  class StageScope
+  {
+  public:
+    /**
+     * \brief A constructor.
+     *
+     * \param collector for the collector to report the stage's metrics to.
+     * \param stage specifying the stage.
+     */
+    StageScope(MetricsCollector& collector, const Metrics::Stage stage);
+
+    /**
+     * \brief Destructor (records, or reports, the collected metrics).
+     */
+    ~StageScope();
+
+  private:
+    /**
+     * \brief The collector to report the metrics to.
+     */
+    MetricsCollector& collector_;
+
+    /**
+     * \brief The scoped stage.
+     */
+    const Metrics::Stage stage_;
+
+    /**
+     * \brief The enclosing callback scope (on the same thread), if any.
+     */
+    CallbackScope* p_callback_;
+
+    /**
+     * \brief The metrics to record to (i.e. the callback's metrics for the stage, or the local metrics).
+     */
+    Metrics::StageMetrics* p_metrics_;
+
+    /**
+     * \brief The metrics collected during the scope, if it isn't inside a callback.
+     */
+    Metrics::StageMetrics local_;
+
+    /**
+     * \brief The metrics of any enclosing scope (on the same thread).
+     */
+    Metrics::StageMetrics* p_previous_;
+
+    /**
+     * \brief Flag indicating if the hardware counters were sampled when the scope started.
+     */
+    bool sampled_;
+
+    /**
+     * \brief The hardware counters sampled when the scope started.
+     */
+    boost::array<unsigned long long, Metrics::NUMBER_OF_HARDWARE_COUNTERS> start_counters_;
+
+    /**
+     * \brief Flag indicating if the scope's elapsed time is measured (i.e. for attributing the callback's counts).
+     */
+    bool timed_;
+
+    /**
+     * \brief The time [ns] when the scope started (on a monotonic clock).
+     */
+    unsigned long long start_time_;
+  };
+
+  /**
+   * \brief Class for scoping a callback, i.e. used to count callbacks and to record the stages' metrics.
+   *
+   * Note: If hardware counters are sampled, then they are read (as one group) only when the scope starts and ends.
+   */
+  class CallbackScope
+  {
+  public:
+    /**
+     * \brief A constructor.
+     *
+     * \param collector for the collector to report to.
+     */
+    CallbackScope(MetricsCollector& collector);
+
+    /**
+     * \brief Destructor (publishes the callback's metrics).
+     */
+    ~CallbackScope();
+
+  private:
+    friend class StageScope;
+    friend class MetricsCollector;
+
+    /**
+     * \brief Attribute the callback's hardware counts to its stages (in proportion to the stages' elapsed times).
+     *
+     * \param end_counters containing the hardware counters sampled when the scope ended.
+     */
+    void attributeCounters(const boost::array<unsigned long long, Metrics::NUMBER_OF_HARDWARE_COUNTERS>& end_counters);
+
+    /**
+     * \brief The collector to report to.
+     */
+    MetricsCollector& collector_;
+
+    /**
+     * \brief Flag indicating if profiling is active for the callback.
+     */
+    bool active_;
+
+    /**
+     * \brief Flag indicating if hardware counters should be sampled during the callback.
+     */
+    bool sample_counters_;
+
+    /**
+     * \brief The enclosing callback scope (on the same thread), if any.
+     */
+    CallbackScope* p_previous_;
+
+    /**
+     * \brief The number of allocations counted on the current thread, when the scope was created.
+     */
+    unsigned long long start_allocations_;
+
+    /**
+     * \brief The metrics recorded for each stage during the callback.
+     */
+    boost::array<Metrics::StageMetrics, Metrics::NUMBER_OF_STAGES> stages_;
+
+    /**
+     * \brief Flag indicating if the hardware counters were sampled when the scope started.
+     */
+    bool sampled_;
+
+    /**
+     * \brief The hardware counters sampled when the scope started.
+     */
+    boost::array<unsigned long long, Metrics::NUMBER_OF_HARDWARE_COUNTERS> start_counters_;
+
+    /**
+     * \brief The elapsed time [ns] of each stage during the callback (used for attributing the hardware counts).
+     */
+    boost::array<unsigned long long, Metrics::NUMBER_OF_STAGES> stage_times_;
+  };
+
+  /**
+   * \brief Default constructor.
+   */
+  MetricsCollector();
+
+  /**
+   * \brief Retrieve a snapshot of the collected metrics.
+   *
+   * \return Metrics containing the snapshot.
+   */
+  Metrics getMetrics();
+
+  /**
+   * \brief Reset the collected metrics.
+   */
+  void resetMetrics();
+
+  /**
+   * \brief Check if the library has been built with allocation profiling.
+   *
+   * \return bool indicating if allocations are profiled or not.
+   */
+  static bool allocationProfilingEnabled();
+
+  /**
+   * \brief Enable, or disable, sampling of hardware counters for each stage (via Linux's perf_event_open).
+   *
+   * Note: The counters are opened, as one group, the first time a thread executes a callback (or a stage) after
+   *       they have been enabled. Sampling then costs one read of the group when each callback starts and ends,
+   *       and the stages inside a callback only read a monotonic clock (see the stage scope).
+   *
+   * \param enable indicating if the counters should be sampled or not.
+   *
+   * \return bool indicating if hardware counters are supported on the platform or not.
+   */
+  bool enableHardwareCounters(const bool enable);
+
+private:
+  /**
+   * \brief Sample the current thread's hardware counters (they are opened, and reported, on the first attempt).
+   *
+   * \param p_counters for containing the counter values.
+   *
+   * \return bool indicating if the counters were sampled or not.
+   */
+  bool sampleCounters(boost::array<unsigned long long, Metrics::NUMBER_OF_HARDWARE_COUNTERS>* p_counters);
+
+  /**
+   * \brief Check if profiling is active (i.e. if any metrics should be collected).
+   *
+   * \return bool indicating if profiling is active or not.
+   */
+  bool profilingActive() const;
+
+  /**
+   * \brief Publish a callback's metrics (only called by the thread that executes the callbacks).
+   *
+   * \param callback containing the callback's metrics.
+   * \param allocations specifying the number of allocations made during the callback.
+   */
+  void publish(const CallbackScope& callback, const unsigned long long allocations);
+
+  /**
+   * \brief Report the metrics collected for a stage, outside any callback.
+   *
+   * \param stage specifying the stage.
+   * \param metrics containing the collected metrics.
+   */
+  void report(const Metrics::Stage stage, const Metrics::StageMetrics& metrics);
+
+  /**
+   * \brief Report which hardware counters could be opened (by a thread).
+   *
+   * \param available containing flags for the opened counters.
+   */
+  void reportAvailableCounters(const boost::array<bool, Metrics::NUMBER_OF_HARDWARE_COUNTERS>& available);
+
+  /**
+   * \brief Retrieve the most recently published callback metrics (the mutex is assumed to be locked).
+   *
+   * \return const Metrics& containing the published metrics.
+   */
+  const Metrics& latestPublished();
+
+  /**
+   * \brief Flag bit, in the triple buffer's middle index, indicating that the middle buffer has been published.
+   */
+  static const int FRESH = 4;
+
+  /**
+   * \brief The metrics accumulated over all callbacks (only accessed by the thread that executes the callbacks).
+   */
+  Metrics totals_;
+
+  /**
+   * \brief Triple buffer for publishing the accumulated callback metrics, from the callbacks to the readers.
+   */
+  boost::array<Metrics, 3> buffers_;
+
+  /**
+   * \brief Index of the buffer that the callbacks write to (only accessed by the thread that executes callbacks).
+   */
+  int back_;
+
+  /**
+   * \brief Index of the buffer that the readers read from (protected by the mutex).
+   */
+  int front_;
+
+  /**
+   * \brief Index of the buffer between the callbacks and the readers (possibly with the FRESH flag set).
+   */
+  boost::atomic<int> middle_;
+
+  /**
+   * \brief The published callback metrics at the most recent reset (protected by the mutex).
+   */
+  Metrics baseline_;
+
+  /**
+   * \brief The metrics reported outside any callback, and the available hardware counters (protected by the mutex).
+   */
+  Metrics metrics_;
+
+  /**
+   * \brief Mutex for protecting the readers' data, and the metrics reported outside any callback.
+   */
+  boost::mutex mutex_;
+
+  /**
+   * \brief Flag indicating if hardware counters should be sampled.
+   *
+   * Note: Atomic, since it is checked (without locking) each time a callback or a stage starts.
+   */
+  boost::atomic<bool> hardware_counters_enabled_;
+};
+
+} // end namespace egm
+} // end namespace abb
+
+#endif // EGM_METRICS_H
@@ -0,0 +1,135 @@
+/***********************************************************************************************************************
+ *
+ * Copyright (c) 2015, ABB Schweiz AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that
+ * the following conditions are met:
+ *
+ *    * Redistributions of source code must retain the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer in the documentation
+ *      and/or other materials provided with the
+ *      distribution.
+ *    * Neither the name of ABB nor the names of its
+ *      contributors may be used to endorse or promote
+ *      products derived from this software without
+ *      specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***********************************************************************************************************************
+ */
+
+#ifndef EGM_SESSION_HANDOFF_H
+#define EGM_SESSION_HANDOFF_H
+
+#include <string>
+
+namespace abb
+{
+namespace egm
+{
+/**
+ * \brief Class for handing over an EGM communication session to another process (e.g. during a hot restart).
+ *
+ * The session is transferred over a Unix domain socket, where:
+ * - The UDP socket is passed as a file descriptor (i.e. the same socket continues to be used).
+ * - The serialized session state is passed as a length-prefixed payload.
+ *
+ * EGM messages that arrive during the handover are kept in the UDP socket's receive buffer, and they
+ * are processed by the receiving process after it has adopted the socket.
+ *
+ * Note: Only supported on POSIX systems. On other systems, all the methods fail.
+ */
+class EGMSessionHandoff
+{
+public:
+  /**
+   * \brief Send a session to a process waiting in receive(...).
+   *
+   * \param path specifying the Unix domain socket path, which the receiving process is listening on.
+   * \param socket_handle for the native UDP socket handle to pass.
+   * \param state containing the serialized session state.
+   * \param timeout_ms specifying the max time [ms] to wait for the transfer.
+   *
+   * \return bool indicating if the session was sent or not.
+   */
+  static bool send(const std::string& path,
+                   const int socket_handle,
+                   const std::string& state,
+                   const unsigned int timeout_ms);
+
+  /**
+   * \brief Wait for, and receive, a session sent by another process with send(...).
+   *
+   * Note: The transfer is not acknowledged yet (i.e. the sending process keeps waiting, with its message processing
+   *       suspended). If a session is received, then exactly one of accept(...) or reject(...) must be called with
+   *       the connection, after the receiving process has (or hasn't) taken over the session.
+   *
+   * Note: The socket file is only accessible by the owner, and connections from processes running as other users
+   *       are dropped.
+   *
+   * \param path specifying the Unix domain socket path to listen on (any existing file is replaced).
+   * \param p_connection for storing the connection to the sending process.
+   * \param p_socket_handle for storing the received native UDP socket handle.
+   * \param p_state for storing the received serialized session state.
+   * \param timeout_ms specifying the max time [ms] to wait for the transfer.
+   *
+   * \return bool indicating if a session was received or not.
+   */
+  static bool receive(const std::string& path,
+                      int* p_connection,
+                      int* p_socket_handle,
+                      std::string* p_state,
+                      const unsigned int timeout_ms);
+
+  /**
+   * \brief Acknowledge a received session (i.e. the receiving process has taken over the session), and close
+   *        the connection.
+   *
+   * \param connection for the connection to the sending process.
+   * \param timeout_ms specifying the max time [ms] to wait for the acknowledgement to be sent.
+   *
+   * \return bool indicating if the acknowledgement was sent or not (if not, then the sending process has given up
+   *         on the transfer, and it continues to serve the session itself).
+   */
+  static bool accept(const int connection, const unsigned int timeout_ms);
+
+  /**
+   * \brief Reject a received session (i.e. the sending process continues to serve it), and close the connection.
+   *
+   * \param connection for the connection to the sending process.
+   * \param socket_handle for the received native UDP socket handle, which is closed (ignored if negative).
+   */
+  static void reject(const int connection, const int socket_handle);
+
+private:
+  /**
+   * \brief Static constant for identifying the handover messages.
+   */
+  static const unsigned int MAGIC = 0x45474d48;
+
+  /**
+   * \brief Static constant for the max size [bytes] of a serialized session state.
+   */
+  static const unsigned int MAX_STATE_SIZE = 256*1024*1024;
+};
+
+} // end namespace egm
+} // end namespace abb
+
+#endif // EGM_SESSION_HANDOFF_H
@@ -0,0 +1,187 @@
+/***********************************************************************************************************************
+ *
+ * Copyright (c) 2015, ABB Schweiz AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that
+ * the following conditions are met:
+ *
+ *    * Redistributions of source code must retain the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer in the documentation
+ *      and/or other materials provided with the
+ *      distribution.
+ *    * Neither the name of ABB nor the names of its
+ *      contributors may be used to endorse or promote
+ *      products derived from this software without
+ *      specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***********************************************************************************************************************
+ */
+
+#ifndef EGM_STEPPER_H
+#define EGM_STEPPER_H
+
+#include <string>
+
+#include "egm_wrapper.pb.h" // Generated by Google Protocol Buffer compiler protoc
+
+#include "egm_codec.h"
+#include "egm_common.h"
+#include "egm_trajectory_motion.h"
+
+namespace abb
+{
+namespace egm
+{
+/**
+ * \brief Class for stepping the EGM message processing, without any sockets or threads.
+ *
+ * Each step takes a serialized EGM robot message (i.e. as received from the robot controller), and returns the
+ * serialized EGM sensor message to reply with. The steps go through the same codec and trajectory motion logic
+ * as the UDP based interfaces, so e.g. offline planners, simulators and analysis tools can use it directly.
+ *
+ * The steps only depend on the stepped messages (i.e. not on the host's clock), so they are reproducible. Hence,
+ * corrections set via trajectoryMotion() are timed on the robot controller's clock (i.e. the time [s] of the
+ * messages' feedback time stamps).
+ *
+ * Note: The class is not thread-safe, except for the trajectory motion's user interaction methods.
+ */
+class EGMStepper
+{
+public:
+  /**
+   * \brief A constructor.
+   *
+   * \param configuration for the stepper's configuration.
+   */
+  EGMStepper(const TrajectoryConfiguration& configuration = TrajectoryConfiguration());
+
+  /**
+   * \brief Step with trajectory motion, i.e. the outputs are generated from the trajectory motion's goals.
+   *
+   * \param p_data containing the serialized EGM robot message.
+   * \param bytes_transferred for the number of bytes in the message.
+   *
+   * \return string& containing the reply (empty if the message couldn't be processed).
+   */
+  const std::string& step(const char* p_data, const int bytes_transferred);
+
+  /**
+   * \brief Step with external outputs (i.e. in the same way as the controller interface's external control loop).
+   *
+   * Note: The outputs are only used if the robot controller's states are ok, or if it is the first message. And only
+   *       the present outputs are used (e.g. the Cartesian outputs are kept if only joint outputs are present).
+   *
+   * \param p_data containing the serialized EGM robot message.
+   * \param bytes_transferred for the number of bytes in the message.
+   * \param outputs containing the outputs to send to the robot controller.
+   *
+   * \return string& containing the reply (empty if the message couldn't be processed).
+   */
+  const std::string& step(const char* p_data, const int bytes_transferred, const wrapper::Output& outputs);
+
+  /**
+   * \brief Retrieve the inputs extracted in the most recent step.
+   *
+   * \return InputContainer& containing the inputs.
+   */
+  const InputContainer& inputs() const { return inputs_; };
+
+  /**
+   * \brief Retrieve the outputs constructed in the most recent step.
+   *
+   * \return OutputContainer& containing the outputs.
+   */
+  const OutputContainer& outputs() const { return outputs_; };
+
+  /**
+   * \brief Retrieve the trajectory motion (e.g. for adding trajectories, or for stopping the execution).
+   *
+   * Note: Queues retired by the steps are only released by the trajectory motion's user interaction methods (e.g.
+   *       when adding trajectories, or by reclaiming the retired queues), i.e. never by the steps themselves.
+   *
+   * \return TrajectoryMotion& for the trajectory motion.
+   */
+  TrajectoryMotion& trajectoryMotion() { return trajectory_motion_; };
+
+  /**
+   * \brief Retrieve the stepper's current configuration.
+   *
+   * \return TrajectoryConfiguration containing the current configuration.
+   */
+  const TrajectoryConfiguration& getConfiguration() const { return update_; };
+
+  /**
+   * \brief Update the stepper's configuration (update is only applied for new EGM communication sessions).
+   *
+   * \param configuration containing the new configuration.
+   */
+  void setConfiguration(const TrajectoryConfiguration& configuration);
+
+private:
+  /**
+   * \brief Initialize a step, by parsing and extracting the message, and by preparing the outputs.
+   *
+   * \param p_data containing the serialized EGM robot message.
+   * \param bytes_transferred for the number of bytes in the message.
+   *
+   * \return bool indicating if the initialization succeeded or not.
+   */
+  bool initializeStep(const char* p_data, const int bytes_transferred);
+
+  /**
+   * \brief Finalize a step, by constructing the reply and by preparing for the next step.
+   */
+  void finalizeStep();
+
+  /**
+   * \brief The active configuration.
+   */
+  TrajectoryConfiguration active_;
+
+  /**
+   * \brief The configuration update.
+   */
+  TrajectoryConfiguration update_;
+
+  /**
+   * \brief Flag indicating if the active configuration should be updated.
+   */
+  bool has_pending_update_;
+
+  /**
+   * \brief Container for the inputs, from the robot controller.
+   */
+  InputContainer inputs_;
+
+  /**
+   * \brief Container for the outputs, to the robot controller.
+   */
+  OutputContainer outputs_;
+
+  /**
+   * \brief The trajectory motion data.
+   */
+  TrajectoryMotion trajectory_motion_;
+};
+
+} // end namespace egm
+} // end namespace abb
+
+#endif // EGM_STEPPER_H
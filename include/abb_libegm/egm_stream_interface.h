@@ -0,0 +1,557 @@
+/***********************************************************************************************************************
+ *
+ * Copyright (c) 2015, ABB Schweiz AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that
+ * the following conditions are met:
+ *
+ *    * Redistributions of source code must retain the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer in the documentation
+ *      and/or other materials provided with the
+ *      distribution.
+ *    * Neither the name of ABB nor the names of its
+ *      contributors may be used to endorse or promote
+ *      products derived from this software without
+ *      specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***********************************************************************************************************************
+ */
+
+#ifndef EGM_STREAM_INTERFACE_H
+#define EGM_STREAM_INTERFACE_H
+
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/array.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "egm_udp_server.h"
+
+namespace abb
+{
+namespace egm
+{
+/**
+ * \brief Struct for containing a position from a position stream (e.g. the feedback or the planned position).
+ */
+struct StreamPosition
+{
+  /**
+   * \brief The max number of robot joints, or external joints, that are recorded (further values are dropped).
+   */
+  enum { MAX_JOINTS = 6 };
+
+  /**
+   * \brief Default constructor.
+   */
+  StreamPosition()
+  :
+  robot_joints_size(0),
+  external_joints_size(0),
+  has_cartesian(false),
+  has_time(false),
+  time(0.0)
+  {
+    robot_joints.fill(0.0);
+    external_joints.fill(0.0);
+    position.fill(0.0);
+    quaternion.fill(0.0);
+  }
+
+  /**
+   * \brief Reset the position (i.e. mark all fields as not present).
+   */
+  void reset()
+  {
+    robot_joints_size = 0;
+    external_joints_size = 0;
+    has_cartesian = false;
+    has_time = false;
+  }
+
+  /**
+   * \brief The number of robot joint values.
+   */
+  unsigned int robot_joints_size;
+
+  /**
+   * \brief The robot joint values [degrees].
+   */
+  boost::array<double, MAX_JOINTS> robot_joints;
+
+  /**
+   * \brief The number of external joint values.
+   */
+  unsigned int external_joints_size;
+
+  /**
+   * \brief The external joint values [degrees or mm].
+   */
+  boost::array<double, MAX_JOINTS> external_joints;
+
+  /**
+   * \brief Flag indicating if the Cartesian pose is present.
+   */
+  bool has_cartesian;
+
+  /**
+   * \brief The Cartesian position [mm] (x, y and z).
+   */
+  boost::array<double, 3> position;
+
+  /**
+   * \brief The Cartesian orientation, as a quaternion (u0, u1, u2 and u3).
+   */
+  boost::array<double, 4> quaternion;
+
+  /**
+   * \brief Flag indicating if the time is present.
+   */
+  bool has_time;
+
+  /**
+   * \brief The robot controller's time [s] for the position.
+   */
+  double time;
+};
+
+/**
+ * \brief Struct for containing a sample from a position stream (i.e. the fields that are recorded from a message).
+ */
+struct StreamSample
+{
+  /**
+   * \brief Default constructor.
+   */
+  StreamSample()
+  :
+  sequence_number(0),
+  time_stamp(0)
+  {}
+
+  /**
+   * \brief Reset the sample (i.e. clear the header fields, and mark all position fields as not present).
+   */
+  void reset()
+  {
+    sequence_number = 0;
+    time_stamp = 0;
+    feedback.reset();
+    planned.reset();
+  }
+
+  /**
+   * \brief The message's sequence number.
+   */
+  boost::uint32_t sequence_number;
+
+  /**
+   * \brief The message's time stamp [ms] (i.e. the robot controller's send time).
+   */
+  boost::uint32_t time_stamp;
+
+  /**
+   * \brief The feedback position.
+   */
+  StreamPosition feedback;
+
+  /**
+   * \brief The planned position.
+   */
+  StreamPosition planned;
+};
+
+/**
+ * \brief Abstract class for a sink, which receives batches of stream samples (e.g. for recording them).
+ *
+ * Note: A sink that is shared between interfaces, which are operated by several threads, needs to be thread safe.
+ */
+class AbstractStreamSink
+{
+public:
+  /**
+   * \brief A destructor.
+   */
+  virtual ~AbstractStreamSink() {}
+
+  /**
+   * \brief Write a batch of samples.
+   *
+   * \param port_number for the port that the samples were received on (i.e. identifies the stream).
+   * \param p_samples for the first sample in the batch.
+   * \param number_of_samples in the batch.
+   */
+  virtual void write(const unsigned short port_number,
+                     const StreamSample* p_samples,
+                     const size_t number_of_samples) = 0;
+};
+
+/**
+ * \brief Class for a sink that writes stream samples to a binary file.
+ *
+ * Each sample is written as a record (in the host's byte order) with:
+ * - The port number (uint16), the sequence number (uint32) and the time stamp (uint32).
+ * - The feedback position, followed by the planned position. Each position is written as: The number of robot
+ *   joints (uint8), the number of external joints (uint8), flags (uint8, bit 0: Cartesian pose, bit 1: time),
+ *   the robot joints, the external joints, the Cartesian position and quaternion (if present) and the time
+ *   (if present). All values are written as doubles.
+ */
+class StreamFileSink : public AbstractStreamSink
+{
+public:
+  /**
+   * \brief A constructor.
+   *
+   * \param filename specifying the file's name (any existing file is replaced).
+   */
+  StreamFileSink(const std::string& filename);
+
+  /**
+   * \brief A destructor.
+   */
+  ~StreamFileSink();
+
+  /**
+   * \brief Check if the file was successfully opened or not.
+   *
+   * \return bool indicating if the file is open.
+   */
+  bool isOpen();
+
+  /**
+   * \brief Write a batch of samples to the file.
+   *
+   * \param port_number for the port that the samples were received on.
+   * \param p_samples for the first sample in the batch.
+   * \param number_of_samples in the batch.
+   */
+  void write(const unsigned short port_number, const StreamSample* p_samples, const size_t number_of_samples);
+
+private:
+  /**
+   * \brief Encode a position into the record buffer.
+   *
+   * \param position to encode.
+   */
+  void encode(const StreamPosition& position);
+
+  /**
+   * \brief Encode a value into the record buffer.
+   *
+   * \param value to encode.
+   */
+  template <typename T>
+  void encode(const T value)
+  {
+    const char* p_bytes = reinterpret_cast<const char*>(&value);
+    buffer_.insert(buffer_.end(), p_bytes, p_bytes + sizeof(T));
+  }
+
+  /**
+   * \brief Buffer for encoding a batch of records (i.e. the batch is written to the file at once).
+   */
+  std::vector<char> buffer_;
+
+  /**
+   * \brief Stream object for the file.
+   */
+  std::ofstream file_stream_;
+
+  /**
+   * \brief Mutex for protecting the file (i.e. the sink can be shared between interfaces).
+   */
+  boost::mutex mutex_;
+};
+
+/**
+ * \brief Class for a receive-only EGM interface, for recording position streams from robot controllers.
+ *
+ * The class provides behavior for:
+ * - Receiving messages from a UDP server, without sending any replies (i.e. no control state is kept).
+ * - Parsing only the header, feedback and planned fields of the messages (any other fields are skipped).
+ * - Collecting the parsed samples into batches, which are written to a sink by the process-wide background
+ *   service (i.e. the sink's I/O is kept out of the UDP server's thread).
+ *
+ * The interface is lightweight, so that many streams can be handled by a single thread operating the io service.
+ */
+class EGMStreamInterface : public AbstractUDPServerInterface
+{
+public:
+  /**
+   * \brief Struct for containing statistics about a stream.
+   */
+  struct Statistics
+  {
+    /**
+     * \brief Default constructor.
+     */
+    Statistics()
+    :
+    received_messages(0),
+    invalid_messages(0),
+    missed_messages(0),
+    written_samples(0)
+    {}
+
+    /**
+     * \brief The number of received messages.
+     */
+    unsigned long long received_messages;
+
+    /**
+     * \brief The number of messages that could not be parsed.
+     */
+    unsigned long long invalid_messages;
+
+    /**
+     * \brief The number of missed messages (i.e. gaps in the sequence numbers).
+     */
+    unsigned long long missed_messages;
+
+    /**
+     * \brief The number of samples written to the sink.
+     */
+    unsigned long long written_samples;
+  };
+
+  /**
+   * \brief A constructor.
+   *
+   * \param io_service for operating boost asio's asynchronous functions.
+   * \param port_number for the server's UDP socket.
+   * \param p_sink for the sink to write the samples to (not owned by the interface).
+   * \param batch_size specifying the number of samples to collect, before they are written to the sink.
+   */
+  EGMStreamInterface(boost::asio::io_service& io_service,
+                     const unsigned short port_number,
+                     AbstractStreamSink* p_sink,
+                     const size_t batch_size = 100);
+
+  /**
+   * \brief A destructor (any remaining samples are written to the sink).
+   */
+  ~EGMStreamInterface();
+
+  /**
+   * \brief Checks if the underlying server was successfully initialized or not.
+   *
+   * \return bool indicating if the underlying server was successfully initialized or not.
+   */
+  bool isInitialized();
+
+  /**
+   * \brief Write any collected samples to the sink, without waiting for the batch to be full.
+   *
+   * Note: The samples are written by the calling thread, after any batches that are waiting for the background service.
+   */
+  void flush();
+
+  /**
+   * \brief Retrieve the stream's statistics.
+   *
+   * \return Statistics containing the statistics.
+   */
+  Statistics getStatistics();
+
+private:
+  /**
+   * \brief Handle callback requests from an UDP server (i.e. parse and collect a sample, but never reply).
+   *
+   * \param server_data containing the UDP server's callback data.
+   *
+   * \return string& containing an empty reply.
+   */
+  const std::string& callback(const UDPServerData& server_data);
+
+  /**
+   * \brief Class for writing handed over batches to a sink, in the order they were handed over.
+   *
+   * Note: The writer is shared with the background service's jobs, so that it outlives any pending jobs. The batches'
+   *       storage is reused, so nothing is allocated per batch once the writer has caught up.
+   */
+  class BatchWriter
+  {
+  public:
+    /**
+     * \brief A constructor.
+     *
+     * \param port_number for the port that the samples are received on.
+     * \param p_sink for the sink to write the samples to (not owned by the writer).
+     */
+    BatchWriter(const unsigned short port_number, AbstractStreamSink* p_sink)
+    :
+    port_number_(port_number),
+    p_sink_(p_sink),
+    written_samples_(0)
+    {}
+
+    /**
+     * \brief Hand over a batch, to be written by the next call to the write method.
+     *
+     * \param p_batch for the batch (it is swapped with a spare batch, of the same size).
+     * \param number_of_samples in the batch.
+     */
+    void handOver(std::vector<StreamSample>* p_batch, const size_t number_of_samples);
+
+    /**
+     * \brief Write all handed over batches to the sink.
+     */
+    void write();
+
+    /**
+     * \brief Detach the writer from the sink (i.e. any later handed over batches are discarded).
+     */
+    void detach();
+
+    /**
+     * \brief Retrieve the number of samples written to the sink.
+     *
+     * \return unsigned long long containing the number of samples.
+     */
+    unsigned long long writtenSamples();
+
+  private:
+    /**
+     * \brief Struct for a handed over batch.
+     */
+    struct Batch
+    {
+      /**
+       * \brief Default constructor.
+       */
+      Batch() : number_of_samples(0) {}
+
+      /**
+       * \brief The batch's samples (only the first number_of_samples are valid).
+       */
+      std::vector<StreamSample> samples;
+
+      /**
+       * \brief The number of valid samples.
+       */
+      size_t number_of_samples;
+    };
+
+    /**
+     * \brief The port number of the server's UDP socket.
+     */
+    const unsigned short port_number_;
+
+    /**
+     * \brief The sink to write the samples to (null once detached).
+     */
+    AbstractStreamSink* p_sink_;
+
+    /**
+     * \brief The handed over batches, which are waiting to be written (oldest first).
+     */
+    std::deque<Batch> pending_;
+
+    /**
+     * \brief Spare batches, for swapping with the handed over batches.
+     */
+    std::vector<std::vector<StreamSample> > spares_;
+
+    /**
+     * \brief The batch that is currently written.
+     */
+    Batch writing_;
+
+    /**
+     * \brief The number of samples written to the sink.
+     */
+    unsigned long long written_samples_;
+
+    /**
+     * \brief Mutex for protecting the pending batches, the spare batches and the number of written samples.
+     */
+    boost::mutex queue_mutex_;
+
+    /**
+     * \brief Mutex for serializing the writes (i.e. the batches are written in order, and one at the time).
+     */
+    boost::mutex write_mutex_;
+  };
+
+  /**
+   * \brief Hand over the collected samples, to be written to the sink by the background service.
+   *
+   * Note: The mutex is assumed to be locked. The samples are written directly instead, if the background service
+   *       doesn't accept the job (e.g. if it has been shut down).
+   */
+  void handOverBatch();
+
+  /**
+   * \brief The writer of the collected batches.
+   */
+  boost::shared_ptr<BatchWriter> p_writer_;
+
+  /**
+   * \brief The collected samples (only the first number_of_samples_ are valid).
+   */
+  std::vector<StreamSample> batch_;
+
+  /**
+   * \brief The number of collected samples.
+   */
+  size_t number_of_samples_;
+
+  /**
+   * \brief Flag indicating if any message has been received (i.e. if the previous sequence number is valid).
+   */
+  bool has_sequence_number_;
+
+  /**
+   * \brief The previous message's sequence number.
+   */
+  boost::uint32_t sequence_number_;
+
+  /**
+   * \brief The stream's statistics (except for the number of written samples, which is counted by the writer).
+   */
+  Statistics statistics_;
+
+  /**
+   * \brief An empty reply (i.e. the UDP server doesn't send anything).
+   */
+  const std::string empty_reply_;
+
+  /**
+   * \brief Mutex for protecting the batch and the statistics.
+   */
+  boost::mutex mutex_;
+
+  /**
+   * \brief Server for managing the communication with the robot controller.
+   *
+   * Note: Declared last, so that it is destroyed first (i.e. no callbacks occur while the interface is destroyed).
+   */
+  UDPServer udp_server_;
+};
+
+} // end namespace egm
+} // end namespace abb
+
+#endif // EGM_STREAM_INTERFACE_H
@@ -0,0 +1,2315 @@
+/***********************************************************************************************************************
+ *
+ * Copyright (c) 2015, ABB Schweiz AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that
+ * the following conditions are met:
+ *
+ *    * Redistributions of source code must retain the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer in the documentation
+ *      and/or other materials provided with the
+ *      distribution.
+ *    * Neither the name of ABB nor the names of its
+ *      contributors may be used to endorse or promote
+ *      products derived from this software without
+ *      specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***********************************************************************************************************************
+ */
+
+#ifndef EGM_TRAJECTORY_MOTION_H
+#define EGM_TRAJECTORY_MOTION_H
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/circular_buffer.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include "egm_wrapper_trajectory.pb.h" // Generated by Google Protocol Buffer compiler protoc
+#include "egm_wrapper_session.pb.h"    // Generated by Google Protocol Buffer compiler protoc
+
+#include "egm_codec.h"
+#include "egm_common.h"
+#include "egm_interpolator.h"
+
+namespace abb
+{
+namespace egm
+{
+/**
+ * \brief Struct for containing the usage of the trajectory queues (i.e. the sum over all attached trajectories).
+ */
+struct QueueUsage
+{
+  /**
+   * \brief Default constructor.
+   */
+  QueueUsage() : points(0), bytes(0) {}
+
+  /**
+   * \brief The number of queued points.
+   */
+  size_t points;
+
+  /**
+   * \brief The memory [bytes] used by the queued points.
+   */
+  size_t bytes;
+};
+
+/**
+ * \brief Class for managing the points, in a trajectory, that the robot should pass through.
+ *
+ * The points are either stored as point messages, or in a compact form (see the compact storage configuration).
+ * Compact points are decoded when they are retrieved (or peeked at), so the storage form is not visible outside.
+ *
+ * Retrieved points are kept in the storage (a cursor indicates the next point), so that the execution can be
+ * moved to any stored point (see the seek method) without the trajectory being added again. Only the most recently
+ * retrieved points are kept (see the seek history), so the storage of a long trajectory doesn't grow while executing.
+ */
+class Trajectory
+{
+public:
+  /**
+   * \brief A constructor.
+   *
+   * \param compact indicating if the points should be stored in the compact form.
+   * \param seek_history specifying the number of executed points to keep for seeking (older ones are released).
+   */
+  Trajectory(const bool compact = false, const size_t seek_history = 0);
+
+  /**
+   * \brief A constructor.
+   *
+   * param trajectory for a trajectory to parse.
+   * \param compact indicating if the points should be stored in the compact form.
+   * \param seek_history specifying the number of executed points to keep for seeking (older ones are released).
+   */
+  Trajectory(const wrapper::trajectory::TrajectoryGoal& trajectory,
+             const bool compact = false,
+             const size_t seek_history = 0);
+
+  /**
+   * \brief Add a point to the front of the queue (e.g. to put back a partially executed point).
+   *
+   * Note: Only one point can be added to the front (i.e. it replaces any previous front point).
+   *
+   * \param point to store.
+   */
+  void addTrajectoryPointFront(const wrapper::trajectory::PointGoal& point);
+
+  /**
+   * \brief Add a point to the back of the queue.
+   *
+   * \param point to store.
+   */
+  void addTrajectoryPointBack(const wrapper::trajectory::PointGoal& point);
+
+  /**
+   * \brief Retrive a point from the queue.
+   *
+   * \param p_point for storing the retrived point.
+   *
+   * \return bool indicating if a point was retrived or not.
+   */
+  bool retriveNextTrajectoryPoint(wrapper::trajectory::PointGoal* p_point);
+
+  /**
+   * \brief Remove the next point from the queue, without retrieving it (e.g. if it has already been peeked at).
+   */
+  void dropNextTrajectoryPoint();
+
+  /**
+   * \brief Peek at the next point in the queue, without removing it.
+   *
+   * \return const wrapper::trajectory::PointGoal* to the next point (null if the queue is empty).
+   */
+  const wrapper::trajectory::PointGoal* peekNextTrajectoryPoint() const;
+
+  /**
+   * \brief Copy the whole queue to a trajectory container.
+   *
+   * \param p_trajectory for containing the queue.
+   */
+  void copyTo(wrapper::trajectory::TrajectoryGoal* p_trajectory);
+
+  /**
+   * \brief Copy the queue's start time and front point (if any) to a trajectory container.
+   *
+   * Note: The cost is independent of the trajectory's length.
+   *
+   * \param p_trajectory for containing the start time and the front point.
+   */
+  void copyFrontTo(wrapper::trajectory::TrajectoryGoal* p_trajectory) const;
+
+  /**
+   * \brief Append the stored points, from a specific index, to a trajectory container.
+   *
+   * Note: Can be called by any thread, concurrently with the EGM communication loop retrieving points (i.e. the
+   *       stored points are guarded by their own mutex, which the loop never waits for). Already released points
+   *       are skipped.
+   *
+   * \param index specifying the first stored point's index (in the trajectory, as it was added).
+   * \param p_trajectory for containing the points.
+   */
+  void copyStoredTo(const size_t index, wrapper::trajectory::TrajectoryGoal* p_trajectory) const;
+
+  /**
+   * \brief Move the queue's front to a stored point, which is approached with a specific duration.
+   *
+   * I.e. the point is placed in the front of the queue (with the approach duration), followed by the stored points
+   * after it. The cost is independent of the trajectory's length.
+   *
+   * Note: Only the remaining points, and the kept executed points (see the seek history), are stored.
+   *
+   * \param index specifying the stored point's index (in the trajectory, as it was added).
+   * \param duration specifying the approach duration [s].
+   *
+   * \return bool indicating if the queue was moved or not (i.e. not if the point isn't stored).
+   */
+  bool seek(const size_t index, const double duration);
+
+  /**
+   * \brief Find the index of the first stored point that is reached at, or after, a specific trajectory time.
+   *
+   * Note: The trajectory time is the sum of the point durations (points without a duration count as zero),
+   *       starting from the trajectory's start. The duration factor is not included.
+   *
+   * \param time specifying the trajectory time [s].
+   * \param p_index for containing the found index.
+   *
+   * \return bool indicating if an index was found or not (i.e. not if the time is after the trajectory's end, or if
+   *         the found point has been released).
+   */
+  bool findIndex(const double time, size_t* p_index) const;
+
+  /**
+   * \brief Retrive the index of the most recently retrieved point (in the trajectory, as it was added).
+   *
+   * \return size_t containing the index.
+   */
+  size_t currentIndex() const
+  {
+    return current_index_;
+  }
+
+  /**
+   * \brief Retrive the index of the next stored point to retrieve (in the trajectory, as it was added).
+   *
+   * \return size_t containing the index.
+   */
+  size_t nextIndex() const
+  {
+    return cursor_;
+  }
+
+  /**
+   * \brief Retrive the number of points in the queue.
+   *
+   * \return size_t indicating the number of points in the queue.
+   */
+  size_t size()
+  {
+    return storedEnd() - cursor_ + (has_front_point_ ? 1 : 0);
+  }
+
+  /**
+   * \brief Retrive the memory [bytes] used by the points in the queue (i.e. the points that remain to be retrieved).
+   *
+   * The memory is kept as a running count (updated when points are added and retrieved), so the cost is constant.
+   *
+   * Note: For point messages, the memory is the space used by the messages (as reported by Protocol Buffers).
+   *       For compact points, the memory is the space used by the headers and the encoded values. Each point also
+   *       counts its entries in the bookkeeping containers, and the trajectory counts its own object, its shared
+   *       pointer control block and its slot in a queue. The count is an approximation, since the allocators'
+   *       own bookkeeping and the containers' unused capacity are not included.
+   *
+   * \return size_t indicating the used memory.
+   */
+  size_t bytes() const;
+
+  /**
+   * \brief Attach the trajectory to a queue usage (i.e. any change of the trajectory's usage is added to it).
+   *
+   * Note: The queue usage must be protected by the same mutex as the trajectory.
+   *
+   * \param p_usage for the queue usage.
+   */
+  void attach(QueueUsage* p_usage);
+
+  /**
+   * \brief Detach the trajectory from its queue usage (i.e. the trajectory's usage is removed from it).
+   */
+  void detach();
+
+  /**
+   * \brief Check if the trajectory has a scheduled start.
+   *
+   * \return bool indicating if the trajectory has a scheduled start.
+   */
+  bool hasStartTime() const
+  {
+    return has_start_time_;
+  }
+
+  /**
+   * \brief Retrieve the trajectory's scheduled start.
+   *
+   * \return double containing the scheduled start [s] (on the robot controller's clock).
+   */
+  double startTime() const
+  {
+    return start_time_;
+  }
+
+  /**
+   * \brief Clear the trajectory's scheduled start (e.g. when the trajectory has been started).
+   */
+  void clearStartTime()
+  {
+    has_start_time_ = false;
+  }
+
+private:
+  /**
+   * \brief Struct for containing the header of a point in the compact form (32 bytes, without any padding).
+   *
+   * The point's values are stored (in order) in the shared value container.
+   */
+  struct CompactPoint
+  {
+    /**
+     * \brief Bit flags, indicating which of the point's fields are present.
+     */
+    boost::uint64_t flags;
+
+    /**
+     * \brief The point's duration [s] (kept in full precision, since the durations are accumulated).
+     */
+    double duration;
+
+    /**
+     * \brief The position of the point's first encoded value (in the shared value container).
+     */
+    size_t first_value;
+
+    /**
+     * \brief The number of values in each of the point's joint fields (robot first, then external axes).
+     */
+    unsigned char joint_counts[8];
+  };
+
+  /**
+   * \brief Encode a point into the compact form (relative to the start of the point's segment).
+   *
+   * Note: The encoded values are placed in the encoding buffer.
+   *
+   * \param point to encode.
+   * \param segment_start for the start of the point's segment.
+   * \param p_compact for containing the encoded point's header.
+   */
+  void encodePoint(const wrapper::trajectory::PointGoal& point,
+                   const wrapper::trajectory::PointGoal& segment_start,
+                   CompactPoint* p_compact);
+
+  /**
+   * \brief Decode a stored point from the compact form.
+   *
+   * \param index specifying the stored point's index (in the trajectory, as it was added).
+   * \param p_point for containing the decoded point.
+   */
+  void decodePoint(const size_t index, wrapper::trajectory::PointGoal* p_point) const;
+
+  /**
+   * \brief Retrieve the index after the last stored point (in the trajectory, as it was added).
+   *
+   * \return size_t containing the index.
+   */
+  size_t storedEnd() const
+  {
+    return released_points_ + (compact_ ? compact_points_.size() : points_.size());
+  }
+
+  /**
+   * \brief Release the oldest executed points, in blocks of one segment, that are outside of the seek history.
+   *
+   * Note: Each release has a constant cost (independent of the trajectory's length). The release is postponed if
+   *       the stored points are being copied by another thread (i.e. the storage mutex is only tried).
+   */
+  void releaseExecutedPoints();
+
+  /**
+   * \brief Update the attached queue usage, with any change of the trajectory's usage since the last update.
+   */
+  void updateUsage();
+
+  /**
+   * \brief Flag indicating if the points are stored in the compact form.
+   */
+  bool compact_;
+
+  /**
+   * \brief Container for the points in the trajectory (if not using the compact form).
+   */
+  std::deque<wrapper::trajectory::PointGoal> points_;
+
+  /**
+   * \brief Container for the headers of the points in the trajectory (if using the compact form).
+   */
+  std::deque<CompactPoint> compact_points_;
+
+  /**
+   * \brief Container for the encoded values of the points in the trajectory (if using the compact form).
+   */
+  std::deque<float> compact_values_;
+
+  /**
+   * \brief The trajectory time [s] that each stored point is reached at (i.e. the accumulated point durations).
+   */
+  std::deque<double> reach_times_;
+
+  /**
+   * \brief Mutex for protecting the stored points against being released (or added) while they are copied.
+   *
+   * Note: The stored points are only changed by the thread owning the trajectory, so that thread can read them
+   *       without locking. Other threads must lock it while reading the stored points.
+   */
+  mutable boost::mutex storage_mutex_;
+
+  /**
+   * \brief The number of executed points to keep for seeking.
+   */
+  size_t seek_history_;
+
+  /**
+   * \brief The number of released points (i.e. the index of the first stored point).
+   */
+  size_t released_points_;
+
+  /**
+   * \brief The number of released encoded values (i.e. the position of the first stored value, if using the
+   *        compact form).
+   */
+  size_t released_values_;
+
+  /**
+   * \brief The trajectory time [s] that the last released point is reached at.
+   */
+  double released_reach_time_;
+
+  /**
+   * \brief The memory [bytes] used by the released points, accumulated up to and including the last one.
+   */
+  size_t released_bytes_;
+
+  /**
+   * \brief Index of the next stored point to retrieve (in the trajectory, as it was added).
+   */
+  size_t cursor_;
+
+  /**
+   * \brief Point added to the front of the queue (retrieved before the stored point at the cursor).
+   */
+  wrapper::trajectory::PointGoal front_point_;
+
+  /**
+   * \brief Flag indicating if the queue has a front point.
+   */
+  bool has_front_point_;
+
+  /**
+   * \brief Index of the stored point that the front point corresponds to.
+   */
+  size_t front_index_;
+
+  /**
+   * \brief Index of the most recently retrieved point.
+   */
+  size_t current_index_;
+
+  /**
+   * \brief Static constant for the number of stored points in a segment (if using the compact form).
+   */
+  static const size_t SEGMENT_LENGTH = 64;
+
+  /**
+   * \brief Container for the first point of each segment (kept in full precision), which the position values of
+   *        the segment's points are encoded relative to (if using the compact form).
+   */
+  std::deque<wrapper::trajectory::PointGoal> segment_starts_;
+
+  /**
+   * \brief Buffer for encoding values, before they are added to the value container.
+   */
+  std::vector<float> encoding_buffer_;
+
+  /**
+   * \brief Decoded copy of the next point (only used for peeking at points in the compact form).
+   */
+  mutable wrapper::trajectory::PointGoal peeked_point_;
+
+  /**
+   * \brief Flag indicating if the decoded copy of the next point is valid.
+   */
+  mutable bool has_peeked_point_;
+
+  /**
+   * \brief Flag indicating if the trajectory has a scheduled start.
+   */
+  bool has_start_time_;
+
+  /**
+   * \brief The scheduled start [s] (on the robot controller's clock).
+   */
+  double start_time_;
+
+  /**
+   * \brief The memory [bytes] used by the stored points, accumulated up to and including each stored point.
+   */
+  std::deque<size_t> accumulated_bytes_;
+
+  /**
+   * \brief The memory [bytes] used by the front point.
+   */
+  size_t front_point_bytes_;
+
+  /**
+   * \brief The attached queue usage (null if not attached).
+   */
+  QueueUsage* p_usage_;
+
+  /**
+   * \brief The number of points last added to the attached queue usage.
+   */
+  size_t reported_points_;
+
+  /**
+   * \brief The memory [bytes] last added to the attached queue usage.
+   */
+  size_t reported_bytes_;
+};
+
+/**
+ * \brief Class for managing trajectory motion data, between an external user and the EGM communication loop.
+ */
+class TrajectoryMotion
+{
+public:
+  /**
+   * \brief A constructor.
+   *
+   * \param configurations specifying the interface's initial configurations.
+   */
+  TrajectoryMotion(const TrajectoryConfiguration& configurations)
+  :
+  DURATION_FACTOR_MIN(1.0),
+  DURATION_FACTOR_MAX(5.0),
+  MAX_REACHED_POINTS_PER_CYCLE(8),
+  MAX_TIME_STEP_FACTOR(2.5),
+  SPEED_GOVERNOR_RELEASE_RATIO(0.5),
+  RETIRED_QUEUE_SLOTS(8),
+  configurations_(configurations),
+  motion_step_(configurations),
+  executed_segments_(configurations.retract_history_size),
+  motion_time_(0.0),
+  speed_scale_(1.0),
+  has_prefetched_goal_(false),
+  p_prefetched_trajectory_(0),
+  prefetched_points_(0),
+  prefetched_duration_factor_(1.0),
+  time_(0.0)
+  {
+    // Note: The slots are allocated up front, so retiring a queue (in the EGM communication loop) doesn't allocate.
+    trajectories_.retired_queues.resize(RETIRED_QUEUE_SLOTS);
+  }
+
+  /**
+   * \brief Update the interface's configurations.
+   *
+   * \param configurations specifying the interface's new configurations.
+   */
+  void updateConfigurations(const TrajectoryConfiguration& configurations)
+  {
+    boost::lock_guard<boost::mutex> lock(data_.mutex);
+    configurations_ = configurations;
+    motion_step_.updateConfigurations(configurations);
+    has_prefetched_goal_ = false;
+
+    // Note: Any reduction of the history capacity drops the oldest segments.
+    if (executed_segments_.capacity() != configurations.retract_history_size)
+    {
+      executed_segments_.rset_capacity(configurations.retract_history_size);
+    }
+  }
+
+  /**
+   * \brief Generate outputs, based on the current goal and e.g. the use of spline interpolation.
+   *
+   * Note: The time is only used for the corrections (i.e. it must be on the same clock as the corrections' times).
+   *       It is passed in by the owner, so that e.g. a stepper can use the robot controller's message timestamps
+   *       (i.e. reproducible), while an interface uses the messages' arrival times on the host's steady clock.
+   *
+   * \param p_outputs for containing the outputs.
+   * \param inputs containing the inputs from the robot controller.
+   * \param time specifying the current time [s] (on the corrections' clock).
+   */
+  void generateOutputs(wrapper::Output* p_outputs, const InputContainer& inputs, const double time);
+
+  /**
+   * \brief Add a trajectory to the execution queue.
+   *
+   * \param trajectory containing the trajectory to add.
+   * \param override_trajectories indicating if all pending trajectories should be overridden (i.e. removed).
+   *
+   * \return bool indicating if the interface accepted the command or not.
+   */
+  bool addTrajectory(const wrapper::trajectory::TrajectoryGoal& trajectory, const bool override_trajectories);
+
+  /**
+   * \brief Stop the trajectory motion execution.
+   *
+   * Note: A resume normally needs to be ordered for execution to start again.
+   *
+   * \param discard_trajectories indicating if all pending trajectories should be discarded (i.e. removed).
+   *
+   * \return bool indicating if the interface accepted the command or not.
+   */
+  bool stopTrajectory(const bool discard_trajectories);
+
+  /**
+   * \brief Resume the trajectory motion execution (after a stop has occurred).
+   *
+   * \return bool indicating if the interface accepted the command or not.
+   */
+  bool resumeTrajectory();
+
+  /**
+   * \brief Retract along the recently executed path.
+   *
+   * \param duration specifying the executed time [s] to retract.
+   *
+   * \return bool indicating if the interface accepted the command or not.
+   */
+  bool retractTrajectory(const double duration);
+
+  /**
+   * \brief Move the trajectory execution to a specific point, in the current trajectory.
+   *
+   * \param index specifying the point's index.
+   * \param duration specifying the approach duration [s].
+   *
+   * \return bool indicating if the interface accepted the command or not.
+   */
+  bool seekTrajectory(const size_t index, const double duration);
+
+  /**
+   * \brief Move the trajectory execution to a specific time, in the current trajectory.
+   *
+   * \param time specifying the trajectory time [s].
+   * \param duration specifying the approach duration [s].
+   *
+   * \return bool indicating if the interface accepted the command or not.
+   */
+  bool seekTrajectoryTime(const double time, const double duration);
+
+  /**
+   * \brief Update the duration scaling factor for trajectory goals.
+   *
+   * Note: Only values between 1.0 and 5.0 will be considered. E.g. if the factor is 2.0,
+   *       then the remaining duration will be doubled. As will all upcoming goal durations.
+   *
+   * \param factor containing the new scale factor.
+   *
+   * \return bool indicating if the interface accepted the command or not.
+   */
+  bool updateDurationFactor(double factor);
+
+  /**
+   * \brief Set a correction to superimpose on the outputs.
+   *
+   * Note: Doesn't lock the trajectory motion data (i.e. never waits for the EGM communication loop).
+   *
+   * \param correction containing the correction.
+   * \param time specifying when the correction was set [s] (on the same clock as the times passed to
+   *             generateOutputs(...)).
+   *
+   * \return bool indicating if the correction was accepted or not (e.g. not if it contains invalid values).
+   */
+  bool setCorrection(const wrapper::trajectory::Correction& correction, const double time);
+
+  /**
+   * \brief Start to follow a static goal.
+   *
+   * Note: Any current trajectory motions will be stopped before starting to follow the static goal.
+   *
+   * \param discard_trajectories indicating if all pending trajectories should be discarded (i.e. removed).
+   *
+   * \return bool indicating if the interface accepted the command or not.
+   */
+  bool startStaticGoal(const bool discard_trajectories);
+
+  /**
+   * \brief Set a static position goal to follow.
+   *
+   * \param position_goal containing the static position goal to follow.
+   * \param fast_transition indicating if a fast transition should be done. I.e. skip ramp out of current goal.
+   *
+   * \return bool indicating if the interface accepted the command or not.
+   */
+  bool setStaticGoal(const wrapper::trajectory::StaticPositionGoal& position_goal, const bool fast_transition);
+
+  /**
+   * \brief Set a static velocity goal to follow.
+   *
+   * \param velocity_goal containing the static velocity goal to follow.
+   * \param fast_transition indicating if a fast transition should be done. I.e. skip ramp out of current goal.
+   *
+   * \return bool indicating if the interface accepted the command or not.
+   */
+  bool setStaticGoal(const wrapper::trajectory::StaticVelocityGoal& velocity_goal, const bool fast_transition);
+
+  /**
+   * \brief Finish following a static goal.
+   *
+   * \param resume indicating if normal trajectory motion execution should be resumed automatically.
+   *
+   * \return bool indicating if the interface accepted the command or not.
+   */
+  bool finishStaticGoal(const bool resume);
+
+  /**
+   * \brief Retrieve an execution progress from the trajectory interface.
+   *
+   * \param p_progress for containing the execution progress.
+   *
+   * \return bool indicating if the execution progress has been recently updated or not.
+   */
+  bool retrieveExecutionProgress(wrapper::trajectory::ExecutionProgress* p_progress);
+
+  /**
+   * \brief Release the trajectory queues that have been retired (i.e. cleared or discarded) by the EGM communication
+   *        loop.
+   *
+   * The loop only moves retired queues into preallocated slots, so freeing their points is left to users. The
+   * slots are also reclaimed when trajectories are added, and when sessions are restored. Owners should call this
+   * periodically from a non real-time thread (e.g. via a background service), in case neither happens.
+   */
+  void reclaimRetiredQueues();
+
+  /**
+   * \brief Store the trajectories needed to continue the motion in another process.
+   *
+   * Note: The remaining part of any active goal is stored first in the first trajectory.
+   *
+   * \param p_snapshot for storing the trajectories.
+   */
+  void storeSession(wrapper::session::TrajectorySnapshot* p_snapshot);
+
+  /**
+   * \brief Restore the trajectories of a session, handed over from another process (replaces any queued ones).
+   *
+   * \param snapshot containing the trajectories.
+   */
+  void restoreSession(const wrapper::session::TrajectorySnapshot& snapshot);
+
+  /**
+   * \brief Pre-warm the trajectory motion data (i.e. touch the motion step and the next trajectory point).
+   *
+   * Note: Skipped if the data is currently locked (e.g. by a user adding trajectories).
+   */
+  void prewarm();
+
+  /**
+   * \brief Prefetch the next trajectory segment, if the current segment ends in the next cycle.
+   *
+   * I.e. the next goal, interpolator and controller are prepared ahead of time, and then only swapped in at the
+   * segment boundary (so that the boundary cycle costs about the same as any other cycle).
+   *
+   * Note: Skipped if the data is currently locked, or if the next segment depends on the next cycle's feedback
+   *       (e.g. reach conditions and estimated durations).
+   */
+  void prefetchNextGoal();
+
+private:
+  /**
+   * \brief Enum for the different execution states the interface can handle.
+   */
+  enum States
+  {
+    Normal,    ///< \brief Retrieve goals from the current trajectory.
+    RampDown,  ///< \brief Ramp down the current velocity references.
+    StaticGoal ///< \brief Follow either static position or velocity goals.
+  };
+
+  /**
+   * \brief Enum for the different execution sub states the interface can handle.
+   */
+  enum SubStates
+  {
+    None,    ///< \brief The current state has no active sub state.
+    Running, ///< \brief The current state has a running sub state.
+    Finished ///< \brief The current state has finished a sub state.
+  };
+
+  /**
+   * \brief Container for decision data, used to decide what to do during execution of trajectory motions.
+   */
+  struct DecisionData
+  {
+    /**
+     * \brief Container for pending events.
+     */
+    struct PendingEvents
+    {
+      /**
+       * \brief Default constructor.
+       */
+      PendingEvents()
+      :
+      do_stop(false),
+      do_resume(false),
+      do_discard(false),
+      do_ramp_down(false),
+      do_static_goal_start(false),
+      do_static_goal_fast_update(false),
+      do_static_position_goal_update(false),
+      do_static_velocity_goal_update(false),
+      do_static_goal_finish(false),
+      do_duration_factor_update(false),
+      duration_factor(1.0),
+      do_retract(false),
+      retract_duration(0.0),
+      do_seek(false)
+      {};
+
+      /**
+       * \brief Flag indicating if the current velocities should be completely ramped out.
+       */
+      bool do_stop;
+
+      /**
+       * \brief Flag indicating if the execution should resume after a complete stop has occurred.
+       */
+      bool do_resume;
+
+      /**
+       * \brief Flag indicating if the current trajectories should be discarded.
+       */
+      bool do_discard;
+
+      /**
+       * \brief Flag indicating if the current motion's velocity should be ramped down.
+       */
+      bool do_ramp_down;
+
+      /**
+       * \brief Flag indicating if static goal execution should be started.
+       */
+      bool do_static_goal_start;
+
+      /**
+       * \brief Flag indicating if the static goal should be updated fast.
+       */
+      bool do_static_goal_fast_update;
+
+      /**
+       * \brief Flag indicating if the static position goal should be updated.
+       */
+      bool do_static_position_goal_update;
+
+      /**
+       * \brief Flag indicating if the static velocity goal should be updated.
+       */
+      bool do_static_velocity_goal_update;
+
+      /**
+       * \brief Flag indicating if the static goal execution should be finished.
+       */
+      bool do_static_goal_finish;
+
+      /**
+       * \brief The pending static position goal to follow.
+       */
+      wrapper::trajectory::StaticPositionGoal static_position_goal;
+
+      /**
+      * \brief The pending static velocity goal to follow.
+      */
+      wrapper::trajectory::StaticVelocityGoal static_velocity_goal;
+
+      /**
+       * \brief Flag indicating if the duration scale factor should be updated.
+       */
+      bool do_duration_factor_update;
+
+      /**
+       * \brief The pending duration scale factor update.
+       */
+      double duration_factor;
+
+      /**
+       * \brief Flag indicating if a retract along the executed path should be started.
+       */
+      bool do_retract;
+
+      /**
+       * \brief The pending retract's duration [s] (i.e. the executed time to retract).
+       */
+      double retract_duration;
+
+      /**
+       * \brief The pending retract's trajectory (allocated by the user, so that the retract is only filled in by the
+       *        EGM communication loop).
+       */
+      boost::shared_ptr<Trajectory> p_retract;
+
+      /**
+       * \brief Flag indicating if the current goal should be replaced, by the seeked point in the current trajectory.
+       */
+      bool do_seek;
+    };
+
+    /**
+     * \brief Default constructor.
+     */
+    DecisionData()
+    :
+    has_new_goal(false),
+    has_active_goal(false),
+    has_pending_reached_points(false),
+    is_retracting(false),
+    rejected_trajectories(0),
+    has_start_offset(false),
+    start_offset(0.0)
+    {}
+
+    /**
+     * \brief Flag indicating if there is a new goal.
+     *
+     * Note: A new goal implies that the interpolator should be updated (e.g. calculation of coefficients).
+     */
+    bool has_new_goal;
+
+    /**
+     * \brief Flag indicating if there is an active goal.
+     */
+    bool has_active_goal;
+
+    /**
+     * \brief The pending events for the trajectory motion execution.
+     */
+    PendingEvents pending_events;
+
+    /**
+     * \brief Flag indicating if already reached points remain to be skipped (i.e. the skip limit was hit).
+     */
+    bool has_pending_reached_points;
+
+    /**
+     * \brief Flag indicating if a retract is being executed (i.e. the executed segments are not recorded).
+     */
+    bool is_retracting;
+
+    /**
+     * \brief The number of trajectories that has been rejected, because of the queue limits.
+     */
+    unsigned int rejected_trajectories;
+
+    /**
+     * \brief Flag indicating if a new goal is a scheduled start (i.e. it should start at the start offset).
+     */
+    bool has_start_offset;
+
+    /**
+     * \brief The time [s] passed since a scheduled start (negative if the start occurs within the next cycle).
+     */
+    double start_offset;
+
+    /**
+     * \brief Mutex for protecting the data.
+     */
+    boost::mutex mutex;
+  };
+
+  /**
+   * \brief Container for trajectory data. E.g. trajectory queues, and the currently active trajectory.
+   */
+  struct TrajectoryContainer
+  {
+    /**
+     * \brief Queue for storing trajectories to execute.
+     */
+    std::deque<boost::shared_ptr<Trajectory> > primary_queue;
+
+    /**
+     * \brief Queue for temporary storing trajectories to execute (e.g. during a discard trajectories event).
+     */
+    std::deque<boost::shared_ptr<Trajectory> > temporary_queue;
+
+    /**
+     * \brief The currently active trajectory.
+     */
+    boost::shared_ptr<Trajectory> p_current;
+
+    /**
+     * \brief The usage of the queues and the currently active trajectory (which are all attached to it).
+     */
+    QueueUsage usage;
+
+    /**
+     * \brief Default constructor.
+     */
+    TrajectoryContainer() : retired_count(0) {}
+
+    /**
+     * \brief Preallocated slots for queues that have been cleared or discarded by the EGM communication loop.
+     *
+     * Note: The queues are only swapped into the slots by the communication loop (i.e. without allocating, and
+     *       without detaching the trajectories from the queue usage). They are detached and released by user threads
+     *       (i.e. the time to free the points is spent outside the loop).
+     */
+    std::vector<std::deque<boost::shared_ptr<Trajectory> > > retired_queues;
+
+    /**
+     * \brief The number of used retired queue slots.
+     */
+    size_t retired_count;
+
+    /**
+     * \brief Mutex for protecting the data.
+     */
+    boost::mutex mutex;
+  };
+
+  /**
+   * \brief Class for managing the interface's internal states.
+   */
+  class StateManager
+  {
+  public:
+    /**
+     * \brief Default constructor.
+     */
+    StateManager()
+    :
+    has_pending_state_(false),
+    current_state_(Normal),
+    current_sub_state_(None),
+    pending_state_(Normal),
+    pending_sub_state_(None)
+    {}
+
+    /**
+     * \brief Activate the state manager.
+     */
+    void activateStateManager()
+    {
+      current_state_ = Normal;
+      current_sub_state_ = Running;
+    }
+
+    /**
+     * \brief Reset the state manager.
+     */
+    void resetStateManager()
+    {
+      current_state_ = Normal;
+      current_sub_state_ = None;
+      pending_state_ = Normal;
+      pending_sub_state_ = None;
+      has_pending_state_ = false;
+    }
+
+    /**
+     * \brief Get the current state.
+     */
+    States getState()
+    {
+      return current_state_;
+    }
+
+    /**
+     * \brief Get the current sub state.
+     */
+    SubStates getSubState()
+    {
+      return current_sub_state_;
+    }
+
+    /**
+     * \brief Set the desired pending state and sub state.
+     *
+     * \param desired_state specifying the desired state.
+     * \param desired_sub_state specifying the desired sub state.
+     */
+    void setPendingState(const States& desired_state, const SubStates& desired_sub_state);
+
+    /**
+     * \brief Update the state and sub state.
+     */
+    void updateState()
+    {
+      if (has_pending_state_)
+      {
+        current_state_ = pending_state_;
+        current_sub_state_ = pending_sub_state_;
+        has_pending_state_ = false;
+      }
+    }
+
+    /**
+     * \brief Verify the interface's current state and sub state.
+     *
+     * \param state specifying the state to verify.
+     * \param sub_state specifying the sub state to verify.
+     *
+     * \return bool indicating if the state and sub state has been verified.
+     */
+    bool verifyState(const States& state, const SubStates& sub_state)
+    {
+      return (current_state_ == state && current_sub_state_ == sub_state);
+    }
+
+    /**
+     * \brief Maps the interface's current internal state to an execution progress state.
+     *
+     * The interface can be in any of the following states:
+     * - Undefined state (should never occur).
+     * - Normal state (references are generated from trajectories specified by a user).
+     * - Ramp down state (ramping down any current references).
+     * - Static goal state (references are generated from a single goal point specified by a user).
+     *
+     * \return ExecutionProgress_State with the execution progress state.
+     */
+    wrapper::trajectory::ExecutionProgress_State mapState();
+
+    /**
+     * \brief Maps the interface's current internal sub state to an execution progress sub state.
+     *
+     * The interface can be in any of the following sub states (depending on the current state):
+     * - None sub state (the current state is not active yet).
+     * - Running sub state (the current state is running).
+     * - Finished sub state (the current state has finished).
+     *
+     * \return ExecutionProgress_SubState with the execution progress sub state.
+     */
+    wrapper::trajectory::ExecutionProgress_SubState mapSubState();
+
+  private:
+    /**
+     * \brief Flag indicating if there are any pending state change.
+     */
+    bool has_pending_state_;
+
+    /**
+     * \brief The current state.
+     */
+    States current_state_;
+
+    /**
+     * \brief The current sub state.
+     */
+    SubStates current_sub_state_;
+
+    /**
+     * \brief The pending state.
+     */
+    States pending_state_;
+
+    /**
+     * \brief The pending sub state.
+     */
+    SubStates pending_sub_state_;
+  };
+
+  /**
+   * \brief Class for managing motion step data.
+   */
+  class MotionStep
+  {
+  public:
+    /**
+     * \brief Container for process data, used for processing motion steps.
+     */
+    struct ProcessData
+    {
+      /**
+       * \brief Default constructor.
+       */
+      ProcessData()
+      :
+      mode(EGMJoint),
+      time_passed(0.0),
+      estimated_sample_time(Constants::RobotController::LOWEST_SAMPLE_TIME),
+      time_step(Constants::RobotController::LOWEST_SAMPLE_TIME),
+      duration_factor(1.0)
+      {}
+
+      /**
+       * \brief The assumed active EGM mode.
+       */
+      EGMModes mode;
+
+      /**
+       * \brief The time passed for the current goal execution.
+       */
+      double time_passed;
+
+      /**
+       * \brief The estimated sample time.
+       */
+      double estimated_sample_time;
+
+      /**
+       * \brief The time step [s] to advance the goal execution with (depends on the configured time base).
+       */
+      double time_step;
+
+      /**
+       * \brief A scaling factor for the goal duration.
+       */
+      double duration_factor;
+
+      /**
+       * \brief Container for the current robot feedback values.
+       */
+      wrapper::Feedback feedback;
+    };
+
+    /**
+     * \brief A constructor.
+     *
+     * \param configurations specifying the trajectory interface's initial configurations.
+     */
+    MotionStep(const TrajectoryConfiguration& configurations)
+    :
+    CONDITION(0.005),
+    RAMP_DOWN_STOP_DURATION(1.0),
+    STATIC_GOAL_DURATION(5.0),
+    STATIC_GOAL_DURATION_SHORT(0.1),
+    condition_met_(true),
+    configurations_(configurations),
+    p_interpolator_(&interpolators_[0]),
+    p_next_interpolator_(&interpolators_[1])
+    {}
+
+    /**
+     * \brief Update the interface's configurations.
+     *
+     * \param configurations specifying the interface's new configurations.
+     */
+    void updateConfigurations(const TrajectoryConfiguration& configurations)
+    {
+      configurations_ = configurations;
+    }
+
+    /**
+     * \brief Reset the motion step data.
+     */
+    void resetMotionStep();
+
+    /**
+     * \brief Prepare for a normal goal.
+     *
+     * \param last_point indicating if it is the last point in the current trajectory.
+     * \param p_next_point for the next point in the current trajectory (used for estimating goal jerks, if any).
+     */
+    void prepareNormalGoal(const bool last_point, const wrapper::trajectory::PointGoal* p_next_point = 0);
+
+    /**
+     * \brief Prepare for a ramp down goal.
+     *
+     * \param do_stop indicating if a stop should be performed.
+     */
+    void prepareRampDownGoal(const bool do_stop);
+
+    /**
+     * \brief Prepare for a static position goal.
+     *
+     * \param position_goal containing the static goal to follow.
+     * \param fast_transition indicating if a fast transition should be done.
+     */
+    void prepareStaticGoal(const wrapper::trajectory::StaticPositionGoal& position_goal, const bool fast_transition);
+
+    /**
+     * \brief Prepare for a static velocity goal.
+     *
+     * \param velocity_goal containing the static goal to follow.
+     * \param fast_transition indicating if a fast transition should be done.
+     */
+    void prepareStaticGoal(const wrapper::trajectory::StaticVelocityGoal& velocity_goal, const bool fast_transition);
+
+    /**
+     * \brief Check if the goal conditions has been met.
+     *
+     * \return bool indicating if the goal condition has been met or not.
+     */
+    bool conditionMet();
+
+    /**
+     * \brief Check if the interpolation duration has been reached.
+     *
+     * \return bool indicating if the interpolation duration has been reached or not.
+     */
+    bool interpolationDurationReached()
+    {
+      return ((p_interpolator_->getDuration() - data.time_passed) <
+              0.5*Constants::RobotController::LOWEST_SAMPLE_TIME);
+    }
+
+    /**
+     * \brief Update the interpolator according to the specified internal goal.
+     *
+     * E.g. used after a new point has been activated in a trajectory.
+     */
+    void updateInterpolator()
+    {
+      data.time_passed = carryOverTime();
+      interpolation.set_reach(internal_goal.reach());
+      interpolation.set_duration(interpolator_conditions_.duration);
+      p_interpolator_->update(interpolation, internal_goal, interpolator_conditions_);
+    }
+
+    /**
+     * \brief Store a copy of the current goal as the next goal, but with a new external goal point.
+     *
+     * Note: The next goal can then be prepared ahead of its activation, by swapping it in temporarily.
+     *
+     * \param point containing the new external goal point.
+     */
+    void storeNextGoal(const wrapper::trajectory::PointGoal& point);
+
+    /**
+     * \brief Swap the current goal with the next goal (including the goals' interpolators).
+     */
+    void swapNextGoal();
+
+    /**
+     * \brief Activate the next goal (i.e. a goal that has been prepared ahead of its activation).
+     */
+    void activateNextGoal();
+
+    /**
+     * \brief Scale the interpolation's velocities (e.g. to convert from trajectory time to real time).
+     *
+     * \param factor specifying the scale factor.
+     */
+    void scaleVelocities(const double factor);
+
+    /**
+     * \brief Pre-warm the motion step (i.e. touch the goals and the interpolator, before the next message).
+     */
+    void prewarm() const;
+
+    /**
+     * \brief Evaluate the interpolator (at the next time instance).
+     */
+    void evaluateInterpolator()
+    {
+      data.time_passed += data.time_step;
+      p_interpolator_->evaluate(&interpolation, data.time_step, data.time_passed);
+    }
+
+    /**
+     * \brief Data used during the processing of motion steps.
+     */
+    ProcessData data;
+
+    /**
+     * \brief The internal goal point (updated with the data present in the external goal point).
+     */
+    wrapper::trajectory::PointGoal internal_goal;
+
+    /**
+     * \brief The external goal point (retrieved from external user input).
+     */
+    wrapper::trajectory::PointGoal external_goal;
+
+    /**
+     * \brief The interpolation (i.e. reference point to the robot controller).
+     */
+    wrapper::trajectory::PointGoal interpolation;
+
+  private:
+    /**
+     * \brief Struct for containing a goal, prepared ahead of its activation.
+     */
+    struct NextGoal
+    {
+      /**
+       * \brief Default constructor.
+       */
+      NextGoal() : mode(EGMJoint) {}
+
+      /**
+       * \brief The next internal goal point.
+       */
+      wrapper::trajectory::PointGoal internal_goal;
+
+      /**
+       * \brief The next external goal point.
+       */
+      wrapper::trajectory::PointGoal external_goal;
+
+      /**
+       * \brief The interpolation, at the start of the next goal.
+       */
+      wrapper::trajectory::PointGoal interpolation;
+
+      /**
+       * \brief Conditions for the next goal's interpolator.
+       */
+      EGMInterpolator::Conditions interpolator_conditions;
+
+      /**
+       * \brief The next goal's EGM mode.
+       */
+      EGMModes mode;
+    };
+
+    /**
+     * \brief Estimate the duration for the internal goal.
+     *
+     * Note: Should only be used if no duration has been specified externally.
+     *
+     * \return double containing the estimation.
+     */
+    double estimateDuration();
+
+    /**
+     * \brief Calculate the time to carry over from the previous interpolation session into the next.
+     *
+     * Note: Only used with the controller clock time base, and only between normal goals that follow directly
+     *       after each other (i.e. time spent waiting for a point to be reached is not carried over).
+     *
+     * \return double containing the time [s] to start the next interpolation session at.
+     */
+    double carryOverTime();
+
+    /**
+     * \brief Reset the jerk values of a point (i.e. set to zero).
+     *
+     * \param p_point for the point to reset.
+     */
+    void resetJerks(wrapper::trajectory::PointGoal* p_point);
+
+    /**
+     * \brief Estimate the internal goal's jerks, by minimizing the snap of the current and the next segment.
+     *
+     * Note: Only used by the septic spline method, and only for goals without any specified jerks.
+     *
+     * \param next_point containing the next point in the current trajectory.
+     */
+    void estimateJerks(const wrapper::trajectory::PointGoal& next_point);
+
+    /**
+     * \brief Estimate the jerks of a joint goal, with the minimum snap of the two adjacent segments.
+     *
+     * \param p_goal for the goal (i.e. the interior point), which also contains the estimated jerks.
+     * \param start containing the values at the start of the current segment.
+     * \param next containing the values at the next point.
+     * \param first_duration specifying the duration [s] of the current segment.
+     * \param second_duration specifying the duration [s] of the next segment.
+     */
+    void estimateJerks(wrapper::trajectory::JointGoal* p_goal,
+                       const wrapper::trajectory::JointGoal& start,
+                       const wrapper::trajectory::JointGoal& next,
+                       const double first_duration,
+                       const double second_duration);
+
+    /**
+     * \brief Estimate the jerks of a Cartesian goal, with the minimum snap of the two adjacent segments.
+     *
+     * \param p_goal for the goal (i.e. the interior point), which also contains the estimated jerks.
+     * \param start containing the values at the start of the current segment.
+     * \param next containing the values at the next point.
+     * \param first_duration specifying the duration [s] of the current segment.
+     * \param second_duration specifying the duration [s] of the next segment.
+     */
+    void estimateJerks(wrapper::trajectory::CartesianGoal* p_goal,
+                       const wrapper::trajectory::CartesianGoal& start,
+                       const wrapper::trajectory::CartesianGoal& next,
+                       const double first_duration,
+                       const double second_duration);
+
+    /**
+     * \brief Check if the conditions has been satisfied for a joint goal.
+     *
+     * \param goal containing the goal.
+     * \param feedback containing the feedback.
+     */
+    void checkConditions(const wrapper::Joints& goal, const wrapper::Joints& feedback);
+
+    /**
+     * \brief Check if the conditions has been satisfied for a Cartesian goal.
+     *
+     * \param goal containing the goal.
+     * \param feedback containing the feedback.
+     */
+    void checkConditions(const wrapper::Cartesian& goal, const wrapper::Cartesian& feedback);
+
+    /**
+     * \brief Check if the conditions has been satisfied for a quaternion goal.
+     *
+     * \param goal containing the goal.
+     * \param feedback containing the feedback.
+     */
+    void checkConditions(const wrapper::Quaternion& goal, const wrapper::Quaternion& feedback);
+
+    /**
+     * \brief Transfer values from an external robot goal to the internal goal.
+     *
+     * \param source containing the values to transfer.
+     */
+    void transfer(const wrapper::trajectory::RobotGoal& source);
+
+    /**
+     * \brief Transfer values from an external external goal to the internal goal.
+     *
+     * \param source containing the values to transfer.
+     */
+    void transfer(const wrapper::trajectory::ExternalGoal& source);
+
+    /**
+     * \brief Transfer values from an external static position goal to the internal goal.
+     *
+     * \param source containing the values to transfer.
+     */
+    void transfer(const wrapper::trajectory::StaticPositionGoal& source);
+
+    /**
+     * \brief Transfer values from an external static velocity goal to the internal goal.
+     *
+     * \param source containing the values to transfer.
+     */
+    void transfer(const wrapper::trajectory::StaticVelocityGoal& source);
+
+    /**
+     * \brief Constant for a condition [degrees or mm] for when a point is considered to be reached.
+     */
+    const double CONDITION;
+
+    /**
+     * \brief Constant for ramp down stop duration [s].
+     */
+    const double RAMP_DOWN_STOP_DURATION;
+
+    /**
+     * \brief Constant for static goal ramp in duration [s].
+     */
+    const double STATIC_GOAL_DURATION;
+
+    /**
+     * \brief Constant for static goal ramp in short duration [s].
+     */
+    const double STATIC_GOAL_DURATION_SHORT;
+
+    /**
+     * \brief Conditions for the interpolator.
+     */
+    EGMInterpolator::Conditions interpolator_conditions_;
+
+    /**
+     * \brief Flag indicating if the joint position and Cartesian pose conditions has been met.
+     */
+    bool condition_met_;
+
+    /**
+     * \brief The trajectory interface's configurations.
+     */
+    TrajectoryConfiguration configurations_;
+
+    /**
+     * \brief The interpolation managers (for the current goal, and for any goal prepared ahead of its activation).
+     */
+    EGMInterpolator interpolators_[2];
+
+    /**
+     * \brief The interpolation manager for the current goal.
+     */
+    EGMInterpolator* p_interpolator_;
+
+    /**
+     * \brief The interpolation manager for the next goal.
+     */
+    EGMInterpolator* p_next_interpolator_;
+
+    /**
+     * \brief The next goal.
+     */
+    NextGoal next_goal_;
+  };
+
+  /**
+   * \brief Class for calculating outputs to send to the robot controller.
+   *
+   * Note: Includes ramp out of velocity, and acceleration, references for reducing risk of overshooting the target.
+   *       This is applied for the normal execution state, and if linear interpolation or if the target is important
+   *       to reach (e.g. last point in a trajectory).
+   */
+  class Controller
+  {
+  public:
+    /**
+     * \brief Default constructor.
+     */
+    Controller()
+    :
+    egm_mode_(EGMJoint),
+    is_normal_state_(false),
+    is_linear_(false),
+    do_velocity_transition_(false),
+    a_(1.0),
+    b_(1.0),
+    k_(1.0)
+    {}
+
+    /**
+     * \brief Update the controller, and prepare for a new motion.
+     *
+     * \param state indicating the current state of the interface.
+     * \param motion_step containing the assumed active EGM mode and initial reference values.
+     * \param configurations containing the current configurations (e.g. active interpolation spline method).
+     */
+    void update(const States state,
+                const MotionStep& motion_step,
+                const TrajectoryConfiguration& configurations);
+
+    /**
+     * \brief Calculate the outputs to the robot controller.
+     *
+     * \param p_outputs for containing the output values.
+     * \param p_motion_step containing the current references and feedback values.
+     */
+    void calculate(wrapper::Output* p_outputs, MotionStep* p_motion_step);
+
+  private:
+    /**
+     * \brief Check if the velocity values should be transitioned. Also ramps out acceleration values if necessary.
+     *
+     * \param p_references for containing the current reference values.
+     */
+    void checkForVelocityTransition(wrapper::trajectory::PointGoal* p_references);
+
+    /**
+     * \brief Calculate the joint output (i.e. positions or velocities).
+     *
+     * \param p_out for containing the output values.
+     * \param p_ref for the current reference values.
+     * \param fdb for the current feedback values.
+     * \param start for the start values.
+     */
+    void calculate(wrapper::Joints* p_out,
+                   wrapper::Joints* p_ref,
+                   const wrapper::Joints& fdb,
+                   const wrapper::Joints& start);
+
+    /**
+     * \brief Calculate the Cartesian output (i.e. positions or linear velocities).
+     *
+     * \param p_out for containing the output values.
+     * \param p_ref for the current reference values.
+     * \param fdb for the current feedback values.
+     * \param start for the start values.
+     */
+    void calculate(wrapper::Cartesian* p_out,
+                   wrapper::Cartesian* p_ref,
+                   const wrapper::Cartesian& fdb,
+                   const wrapper::Cartesian& start);
+
+    /**
+     * \brief Calculate the Euler output (i.e. angular velocities).
+     *
+     * \param p_out for containing the output values.
+     * \param p_ref for the current reference values.
+     * \param fdb for the current feedback values.
+     * \param start for the start values.
+     */
+    void calculate(wrapper::Euler* p_out,
+                   wrapper::Euler* p_ref,
+                   const wrapper::Euler& fdb,
+                   const wrapper::Euler& start);
+
+    /**
+     * \brief Calculate the quaternion output.
+     *
+     * \param p_out for containing the output values.
+     * \param ref for the current reference values.
+     * \param fdb for the current feedback values.
+     */
+    void calculate(wrapper::Quaternion* p_out,
+                   const wrapper::Quaternion& ref,
+                   const wrapper::Quaternion& fdb);
+
+    /**
+     * \brief The assumed active EGM mode.
+     */
+    EGMModes egm_mode_;
+
+    /**
+     * \brief The initial references sent to the robot controller (for the current motion).
+     */
+    wrapper::trajectory::PointGoal initial_references_;
+
+    /**
+     * \brief Flag indicating if the interface is in normal state of not.
+     */
+    bool is_normal_state_;
+
+    /**
+     * \brief Flag indicating if linear interpolation is used or not.
+     */
+    bool is_linear_;
+
+    /**
+     * \brief Flag indicating that a velocity transition should be performed.
+     */
+    bool do_velocity_transition_;
+
+    /**
+     * \brief Ramp factor that goes from 1 -> 0 according to 0.5*cos(pi*x) + 0.5, where x = [0, 1].
+     */
+    double a_;
+
+    /**
+     * \brief Ramp factor that goes from 1 -> 0 according to 0.5*cos(pi*x + pi) + 0.5, where x = [0, 1].
+     */
+    double b_;
+
+    /**
+     * \brief Proportional controller gain.
+     */
+    double k_;
+  };
+
+  /**
+   * \brief Class for superimposing corrections (e.g. from a sensor loop) on the outputs to the robot controller.
+   *
+   * The corrections are passed from the user to the EGM communication loop via a triple buffer. I.e. the loop always
+   * reads the most recently written correction, and it never waits for a user (nor does a user wait for the loop).
+   */
+  class Corrector
+  {
+  public:
+    /**
+     * \brief Default constructor.
+     */
+    Corrector()
+    :
+    middle_(1),
+    back_(2),
+    front_(0),
+    has_front_(false)
+    {}
+
+    /**
+     * \brief Write a new correction (called by users).
+     *
+     * \param correction containing the new correction.
+     * \param time specifying when the correction was set [s] (on the corrections' clock).
+     */
+    void write(const wrapper::trajectory::Correction& correction, const double time);
+
+    /**
+     * \brief Apply the most recent correction to the outputs (called by the EGM communication loop).
+     *
+     * The correction is faded out based on its age, and the rate of change of the applied offsets (both positions
+     * and velocities) is limited (i.e. jumps in the corrections are smoothed).
+     *
+     * \param p_outputs for the outputs to correct.
+     * \param mode specifying the active EGM mode.
+     * \param time specifying the current time [s] (on the corrections' clock).
+     * \param time_step specifying the time step [s] since the previous application.
+     * \param configurations specifying the interface's configurations.
+     */
+    void apply(wrapper::Output* p_outputs,
+               const EGMModes mode,
+               const double time,
+               const double time_step,
+               const TrajectoryConfiguration& configurations);
+
+    /**
+     * \brief Remove the applied offsets from outputs (e.g. held outputs, before the correction is applied again).
+     *
+     * \param p_outputs for the outputs to uncorrect.
+     * \param mode specifying the EGM mode that the correction was applied in.
+     */
+    void remove(wrapper::Output* p_outputs, const EGMModes mode) const;
+
+    /**
+     * \brief Remove the applied position offsets from feedback (i.e. map the feedback to the uncorrected references).
+     *
+     * Note: The feedback lags the outputs (by the round trip to the robot controller), so the removal is only exact
+     *       for a settled correction. The rate limits keep the error small, while a correction changes.
+     *
+     * \param p_feedback for the feedback to map.
+     * \param mode specifying the EGM mode that the correction was applied in.
+     */
+    void remove(wrapper::Feedback* p_feedback, const EGMModes mode) const;
+
+    /**
+     * \brief Reset the applied correction (e.g. when a new EGM communication session has started).
+     */
+    void reset();
+
+    /**
+     * \brief Retrieve the applied correction (i.e. after fading and rate limits).
+     *
+     * \return const wrapper::trajectory::Correction& containing the applied correction.
+     */
+    const wrapper::trajectory::Correction& applied() const
+    {
+      return applied_;
+    }
+
+  private:
+    /**
+     * \brief Struct for a slot in the triple buffer.
+     */
+    struct Slot
+    {
+      /**
+       * \brief Default constructor.
+       */
+      Slot() : time(0.0) {}
+
+      /**
+       * \brief The correction.
+       */
+      wrapper::trajectory::Correction correction;
+
+      /**
+       * \brief The time [s] that the correction was set.
+       */
+      double time;
+    };
+
+    /**
+     * \brief Move applied offsets towards the (faded) target offsets, with a limited change.
+     *
+     * \param p_applied for the applied offsets.
+     * \param target containing the target offsets.
+     * \param factor specifying the target's fade factor.
+     * \param max_change specifying the max change (negative means no limit).
+     */
+    void approach(wrapper::Joints* p_applied,
+                  const wrapper::Joints& target,
+                  const double factor,
+                  const double max_change);
+
+    /**
+     * \brief Move applied offsets towards the (faded) target offsets, with a limited change.
+     *
+     * \param p_applied for the applied offsets.
+     * \param target containing the target offsets.
+     * \param factor specifying the target's fade factor.
+     * \param max_change specifying the max change (negative means no limit).
+     */
+    void approach(wrapper::Cartesian* p_applied,
+                  const wrapper::Cartesian& target,
+                  const double factor,
+                  const double max_change);
+
+    /**
+     * \brief Add offsets to output values (any offsets without a corresponding output value are ignored).
+     *
+     * \param p_out for the output values.
+     * \param offsets containing the offsets.
+     */
+    void add(wrapper::Joints* p_out, const wrapper::Joints& offsets);
+
+    /**
+     * \brief Add offsets to output values (only if the output values are present).
+     *
+     * \param p_out for the output values.
+     * \param offsets containing the offsets.
+     */
+    void add(wrapper::Cartesian* p_out, const wrapper::Cartesian& offsets);
+
+    /**
+     * \brief Subtract offsets from values (any offsets without a corresponding value are ignored).
+     *
+     * \param p_values for the values.
+     * \param offsets containing the offsets.
+     */
+    static void subtract(wrapper::Joints* p_values, const wrapper::Joints& offsets);
+
+    /**
+     * \brief Subtract offsets from values (only if the values are present).
+     *
+     * \param p_values for the values.
+     * \param offsets containing the offsets.
+     */
+    static void subtract(wrapper::Cartesian* p_values, const wrapper::Cartesian& offsets);
+
+    /**
+     * \brief Static constant for the flag (in the middle index) that indicates a newly written slot.
+     */
+    static const unsigned int FRESH = 4;
+
+    /**
+     * \brief Static constant for masking out a slot index (i.e. removing the flag).
+     */
+    static const unsigned int INDEX_MASK = 3;
+
+    /**
+     * \brief The triple buffer's slots.
+     */
+    Slot slots_[3];
+
+    /**
+     * \brief Index of the slot exchanged between the user and the loop (including the fresh flag).
+     */
+    boost::atomic<unsigned int> middle_;
+
+    /**
+     * \brief Index of the slot that users write to.
+     */
+    unsigned int back_;
+
+    /**
+     * \brief Index of the slot that the loop reads from.
+     */
+    unsigned int front_;
+
+    /**
+     * \brief Flag indicating if the loop has read any correction (since the latest reset).
+     */
+    bool has_front_;
+
+    /**
+     * \brief Mutex for serializing users that write corrections (never locked by the loop).
+     */
+    boost::mutex write_mutex_;
+
+    /**
+     * \brief The applied correction.
+     */
+    wrapper::trajectory::Correction applied_;
+  };
+
+  /**
+   * \brief Class for publishing the execution progress, from the EGM communication loop to users.
+   *
+   * The progress is passed via a triple buffer. I.e. users never take the loop's locks (nor does the loop wait for a
+   * user), and the loop's cost only depends on the number of axes. The remaining points of the active trajectory
+   * (i.e. the part that scales with the trajectory's length) are copied by the reading user, from the trajectory's
+   * stored points.
+   */
+  class ProgressPublisher
+  {
+  public:
+    /**
+     * \brief Default constructor.
+     */
+    ProgressPublisher()
+    :
+    middle_(1),
+    back_(2),
+    front_(0)
+    {}
+
+    /**
+     * \brief Retrieve the progress to write, before it is published (called by the loop).
+     *
+     * Note: The slots are reused, so all fields must be written before each publication.
+     *
+     * \return wrapper::trajectory::ExecutionProgress* for the progress to write.
+     */
+    wrapper::trajectory::ExecutionProgress* progress()
+    {
+      return &slots_[back_].progress;
+    }
+
+    /**
+     * \brief Publish the written progress (called by the loop).
+     *
+     * \param p_trajectory for the active trajectory (null if none), whose remaining stored points are read by users.
+     */
+    void publish(const boost::shared_ptr<Trajectory>& p_trajectory);
+
+    /**
+     * \brief Publish an empty progress (e.g. when a new EGM communication session has started).
+     */
+    void reset();
+
+    /**
+     * \brief Read the most recently published progress (called by users).
+     *
+     * \param p_progress for containing the progress.
+     *
+     * \return bool indicating if the progress has been updated since the previous read or not.
+     */
+    bool read(wrapper::trajectory::ExecutionProgress* p_progress);
+
+  private:
+    /**
+     * \brief Struct for a slot in the triple buffer.
+     */
+    struct Slot
+    {
+      /**
+       * \brief Default constructor.
+       */
+      Slot() : next_index(0) {}
+
+      /**
+       * \brief The execution progress (without the active trajectory's remaining stored points).
+       */
+      wrapper::trajectory::ExecutionProgress progress;
+
+      /**
+       * \brief The active trajectory (not owned, i.e. it is only read if it is still alive).
+       */
+      boost::weak_ptr<Trajectory> p_trajectory;
+
+      /**
+       * \brief Index of the active trajectory's next stored point, when the progress was published.
+       */
+      size_t next_index;
+    };
+
+    /**
+     * \brief Static constant for the flag (in the middle index) that indicates a newly published slot.
+     */
+    static const unsigned int FRESH = 4;
+
+    /**
+     * \brief Static constant for masking out a slot index (i.e. removing the flag).
+     */
+    static const unsigned int INDEX_MASK = 3;
+
+    /**
+     * \brief The triple buffer's slots.
+     */
+    Slot slots_[3];
+
+    /**
+     * \brief Index of the slot exchanged between the loop and the users (including the fresh flag).
+     */
+    boost::atomic<unsigned int> middle_;
+
+    /**
+     * \brief Index of the slot that the loop writes to.
+     *
+     * Note: Only accessed while holding the data mutex (i.e. by the loop, or by users resetting the motion).
+     */
+    unsigned int back_;
+
+    /**
+     * \brief Index of the slot that users read from.
+     */
+    unsigned int front_;
+
+    /**
+     * \brief Mutex for serializing users that read the progress (never locked by the loop).
+     */
+    boost::mutex read_mutex_;
+  };
+
+  /**
+   * \brief Prepare the trajectory motion for the new callback.
+   *
+   * \param inputs containing the inputs from the robot controller.
+   * \param time specifying the current time [s] (on the corrections' clock).
+   */
+  void prepare(const InputContainer& inputs, const double time);
+
+  /**
+   * \brief Reset the trajectory motion data.
+   */
+  void resetTrajectoryMotion();
+
+  /**
+   * \brief Process the normal state.
+   */
+  void processNormalState();
+
+  /**
+   * \brief Process the ramp down state.
+   */
+  void processRampDownState();
+
+  /**
+   * \brief Process the static goal state.
+   */
+  void processStaticGoalState();
+
+  /**
+   * \brief Update the current goal, i.e. retrive a new goal point from the currently active trajectory.
+   */
+  void updateNormalGoal();
+
+  /**
+   * \brief Store the current goal, in the front of the currently active trajectory.
+   */
+  void storeNormalGoal();
+
+  /**
+   * \brief Retrieve the number of points, and the memory [bytes] they use, in the trajectory queues.
+   *
+   * Note: The currently active trajectory is included, and the trajectory mutex is assumed to be locked.
+   *       The usage is kept as a running count, so the cost is constant (i.e. no trajectories are traversed).
+   *
+   * \param p_points for storing the number of points.
+   * \param p_bytes for storing the used memory.
+   */
+  void calculateQueueUsage(size_t* p_points, size_t* p_bytes);
+
+  /**
+   * \brief Retire a trajectory queue, i.e. swap it into a retired queue slot (without freeing any points).
+   *
+   * Note: The trajectory mutex is assumed to be locked. If all slots are used (i.e. nothing has reclaimed them),
+   *       then the trajectories are appended to the last slot instead (which may allocate).
+   *
+   * \param p_queue for the queue to retire (it is empty afterwards).
+   */
+  void retireQueue(std::deque<boost::shared_ptr<Trajectory> >* p_queue);
+
+  /**
+   * \brief Take over the retired queues, so they can be released outside the trajectory lock.
+   *
+   * Note: The trajectory mutex is assumed to be locked. The taken trajectories are detached from the queue usage,
+   *       and the emptied slots are replaced by the container's (empty) queues.
+   *
+   * \param p_retired_queues for taking over the retired queues.
+   */
+  void takeRetiredQueues(std::vector<std::deque<boost::shared_ptr<Trajectory> > >* p_retired_queues);
+
+  /**
+   * \brief Struct for containing a recently executed trajectory segment (used for retracting).
+   */
+  struct ExecutedSegment
+  {
+    /**
+     * \brief Default constructor.
+     */
+    ExecutedSegment() : start_time(0.0), duration(0.0) {}
+
+    /**
+     * \brief The state at the segment's start, as a goal for the reversed motion (i.e. with negated velocities).
+     */
+    wrapper::trajectory::PointGoal start;
+
+    /**
+     * \brief The motion time [s] when the segment was started.
+     */
+    double start_time;
+
+    /**
+     * \brief The segment's planned duration [s] (i.e. any time spent waiting after it is not retracted).
+     */
+    double duration;
+  };
+
+  /**
+   * \brief Record the start of a new trajectory segment, into the history of executed segments.
+   *
+   * Note: Reuses the oldest entry's storage when the history is full.
+   */
+  void recordExecutedSegment();
+
+  /**
+   * \brief Check if a trajectory can be started, i.e. if it has no scheduled start or if the start is within
+   *        the current cycle. If so, then the start offset is prepared for the sub-cycle alignment.
+   *
+   * \param p_trajectory for the trajectory to check (its scheduled start is cleared when it is started).
+   *
+   * \return bool indicating if the trajectory can be started or not.
+   */
+  bool checkScheduledStart(Trajectory* p_trajectory);
+
+  /**
+   * \brief Start a retract, by reversing the most recently executed segments into the pending retract trajectory.
+   *
+   * Note: Any current and queued trajectories are discarded.
+   *
+   * \return bool indicating if a retract was started or not (e.g. not if the history is empty).
+   */
+  bool startRetract();
+
+  /**
+   * \brief Find the trajectory that a seek applies to (i.e. the current trajectory, or the first queued trajectory).
+   *
+   * Note: Requires that both the data and the trajectory mutexes are locked.
+   *
+   * \return Trajectory* to the found trajectory (null if there is none, or if a retract is active or pending).
+   */
+  Trajectory* findSeekTarget();
+
+  /**
+   * \brief Move a trajectory's execution to a specific point.
+   *
+   * Note: Requires that both the data and the trajectory mutexes are locked.
+   *
+   * \param p_trajectory for the trajectory (see the find seek target method).
+   * \param index specifying the point's index.
+   * \param duration specifying the approach duration [s].
+   *
+   * \return bool indicating if the seek was done or not.
+   */
+  bool seek(Trajectory* p_trajectory, const size_t index, const double duration);
+
+  /**
+   * \brief Update the speed governor's time scale, based on the current tracking error, and apply it.
+   *
+   * Note: The tracking error is the difference between the robot controller's planned values and its feedback.
+   *       I.e. both include the same (delayed) references and corrections, unlike the most recent references,
+   *       which are ahead of the feedback by the round trip to the robot controller.
+   *
+   * Note: The time scale is only applied to normal goals, and it is released (without any velocity jump)
+   *       when e.g. a ramp down starts.
+   *
+   * \param input containing the current input (with the robot controller's planned values and feedback).
+   */
+  void updateSpeedScale(const wrapper::Input& input);
+
+  /**
+   * \brief Constant for the minimum duration scale factor.
+   */
+  const double DURATION_FACTOR_MIN;
+
+  /**
+   * \brief Constant for the maximum duration scale factor.
+   */
+  const double DURATION_FACTOR_MAX;
+
+  /**
+   * \brief Constant for the maximum number of already reached points that can be skipped in one cycle.
+   *
+   * Note: Any remaining reached points are skipped in the following cycles, while holding the previous goal.
+   */
+  const unsigned int MAX_REACHED_POINTS_PER_CYCLE;
+
+  /**
+   * \brief Constant for the maximum time step, in estimated sample times, with the controller clock time base.
+   *
+   * Note: Larger measured steps (e.g. after lost messages or clock jumps) are clamped, and the excess is dropped.
+   */
+  const double MAX_TIME_STEP_FACTOR;
+
+  /**
+   * \brief Constant for the speed governor's tracking error ratio (error/tolerance), below which it speeds up again.
+   */
+  const double SPEED_GOVERNOR_RELEASE_RATIO;
+
+  /**
+   * \brief Constant for the number of preallocated slots for retired queues.
+   */
+  const size_t RETIRED_QUEUE_SLOTS;
+
+  /**
+   * \brief Data for making decisions during the execution of trajectory motions.
+   */
+  DecisionData data_;
+
+  /**
+   * \brief Manager for the interface's internal states.
+   */
+  StateManager state_manager_;
+
+  /**
+   * \brief Manager for the motion steps, i.e. handle current goal and generating interpolation output.
+   */
+  MotionStep motion_step_;
+
+  /**
+   * \brief Controller for calculating the outputs to send to the robot controller, based on the interpolation results
+   *        and current feedback.
+   */
+  Controller controller_;
+
+  /**
+   * \brief Container for the desired trajectories to follow, and the currently active trajectory.
+   */
+  TrajectoryContainer trajectories_;
+
+  /**
+   * \brief The trajectory interface's configurations.
+   */
+  TrajectoryConfiguration configurations_;
+
+  /**
+   * \brief History of recently executed trajectory segments (oldest first).
+   */
+  boost::circular_buffer<ExecutedSegment> executed_segments_;
+
+  /**
+   * \brief The time [s] spent executing normal goals (used for timing the executed segments).
+   */
+  double motion_time_;
+
+  /**
+   * \brief The speed governor's current time scale (1.0 means no slowdown).
+   */
+  double speed_scale_;
+
+  /**
+   * \brief Flag indicating if the next segment has been prefetched (only valid for the following cycle).
+   */
+  bool has_prefetched_goal_;
+
+  /**
+   * \brief The trajectory that the prefetched segment was taken from.
+   */
+  const Trajectory* p_prefetched_trajectory_;
+
+  /**
+   * \brief The trajectory's number of points, when the segment was prefetched.
+   */
+  size_t prefetched_points_;
+
+  /**
+   * \brief The duration factor, when the segment was prefetched.
+   */
+  double prefetched_duration_factor_;
+
+  /**
+   * \brief Controller prepared for the prefetched segment.
+   */
+  Controller next_controller_;
+
+  /**
+   * \brief Corrector for superimposing user corrections on the outputs.
+   */
+  Corrector corrector_;
+
+  /**
+   * \brief Publisher of the execution progress, to users.
+   */
+  ProgressPublisher progress_publisher_;
+
+  /**
+   * \brief The current callback's time [s] (on the corrections' clock, as passed in by the owner).
+   */
+  double time_;
+};
+
+} // end namespace egm
+} // end namespace abb
+
+#endif // EGM_TRAJECTORY_MOTION_H
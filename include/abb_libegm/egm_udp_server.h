@@ -38,6 +38,10 @@
 #define EGM_UDP_SERVER_H
 
 #include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/type_traits/aligned_storage.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/mutex.hpp>
 
 namespace abb
 {
@@ -71,6 +75,11 @@ struct UDPServerData
    * \brief Bytes transferred to the server.
    */
   int bytes_transferred;
+
+  /**
+   * \brief The time that the data arrived (on the host's steady clock).
+   */
+  boost::asio::steady_timer::time_point arrival;
 };
 
 /**
@@ -92,6 +101,24 @@ private:
    * \return string& containing the reply.
    */
   virtual const std::string& callback(const UDPServerData& data) = 0;
+
+  /**
+   * \brief Retrieve the lead time [us], before each predicted message arrival, for pre-warming.
+   *
+   * \return unsigned int containing the lead time (zero means no pre-warming).
+   */
+  virtual unsigned int prewarmLeadTime() { return 0; }
+
+  /**
+   * \brief Pre-warm the interface's working set (called shortly before a message is predicted to arrive).
+   */
+  virtual void prewarm() {}
+
+  /**
+   * \brief Perform work that has been deferred until after the reply has been sent (e.g. preparations for later
+   *        messages).
+   */
+  virtual void postReply() {}
 };
 
 /**
@@ -125,19 +152,227 @@ public:
    */
   bool isInitialized() const;
 
+  /**
+   * \brief Suspend the processing of received messages.
+   *
+   * When the method returns, no message is being processed. Messages that arrive while the server is
+   * suspended are kept unread in the socket's receive buffer (e.g. for a process that adopts the socket).
+   */
+  void suspend();
+
+  /**
+   * \brief Resume the processing of received messages, after the server has been suspended.
+   */
+  void resume();
+
+  /**
+   * \brief Retrieve the native handle of the server's UDP socket.
+   *
+   * \return int containing the native handle (-1 if the server has no socket).
+   */
+  int nativeHandle();
+
+  /**
+   * \brief Adopt an already bound UDP socket (e.g. passed from another process), which replaces any current socket.
+   *
+   * Note: The server takes ownership of the handle only if it was adopted. The processing of messages stays
+   *       suspended until resume() is called (i.e. any current socket's messages are also left unprocessed).
+   *
+   * \param native_handle for the native handle of the socket to adopt.
+   *
+   * \return bool indicating if the socket was adopted or not.
+   */
+  bool adoptSocket(const int native_handle);
+
 private:
   /**
-   * \brief Start an asynchronous receive.
+   * \brief Class for containing the memory of one asynchronous operation's handler (i.e. reused by each operation).
+   *
+   * Note: Handlers that don't fit (or that are allocated while the memory is in use) fall back to the heap.
+   */
+  class HandlerMemory
+  {
+  public:
+    /**
+     * \brief Default constructor.
+     */
+    HandlerMemory() : in_use_(false) {}
+
+    /**
+     * \brief Allocate memory for a handler.
+     *
+     * \param size specifying the number of bytes.
+     *
+     * \return void* to the allocated memory.
+     */
+    void* allocate(const std::size_t size)
+    {
+      if (!in_use_ && size <= sizeof(storage_))
+      {
+        in_use_ = true;
+        return &storage_;
+      }
+
+      return ::operator new(size);
+    }
+
+    /**
+     * \brief Deallocate memory for a handler.
+     *
+     * \param p for the memory to deallocate.
+     */
+    void deallocate(void* p)
+    {
+      if (p == &storage_)
+      {
+        in_use_ = false;
+      }
+      else
+      {
+        ::operator delete(p);
+      }
+    }
+
+  private:
+    /**
+     * \brief The reused memory.
+     */
+    boost::aligned_storage<512>::type storage_;
+
+    /**
+     * \brief Flag indicating if the memory is in use.
+     */
+    bool in_use_;
+  };
+
+  /**
+   * \brief Class for allocating handler memory, for boost asio's asynchronous operations.
+   */
+  template <typename T>
+  class HandlerAllocator
+  {
+  public:
+    typedef T value_type;
+
+    explicit HandlerAllocator(HandlerMemory& memory) : memory_(memory) {}
+
+    template <typename U>
+    HandlerAllocator(const HandlerAllocator<U>& other) : memory_(other.memory_) {}
+
+    T* allocate(const std::size_t n)
+    {
+      return static_cast<T*>(memory_.allocate(sizeof(T)*n));
+    }
+
+    void deallocate(T* p, const std::size_t)
+    {
+      memory_.deallocate(p);
+    }
+
+    bool operator==(const HandlerAllocator& other) const
+    {
+      return &memory_ == &other.memory_;
+    }
+
+    bool operator!=(const HandlerAllocator& other) const
+    {
+      return &memory_ != &other.memory_;
+    }
+
+  private:
+    template <typename U> friend class HandlerAllocator;
+
+    HandlerMemory& memory_;
+  };
+
+  /**
+   * \brief Class for wrapping a handler, so that boost asio allocates the handler's memory from a handler memory.
+   */
+  template <typename Handler>
+  class AllocatingHandler
+  {
+  public:
+    typedef HandlerAllocator<Handler> allocator_type;
+
+    AllocatingHandler(HandlerMemory& memory, const Handler& handler) : memory_(memory), handler_(handler) {}
+
+    allocator_type get_allocator() const
+    {
+      return allocator_type(memory_);
+    }
+
+    template <typename Arg1>
+    void operator()(const Arg1& arg1)
+    {
+      handler_(arg1);
+    }
+
+    template <typename Arg1, typename Arg2>
+    void operator()(const Arg1& arg1, const Arg2& arg2)
+    {
+      handler_(arg1, arg2);
+    }
+
+  private:
+    HandlerMemory& memory_;
+    Handler handler_;
+  };
+
+  /**
+   * \brief Wrap a handler, so that its memory is allocated from a handler memory.
+   *
+   * \param memory for the handler memory.
+   * \param handler for the handler to wrap.
+   *
+   * \return AllocatingHandler<Handler> containing the wrapped handler.
+   */
+  template <typename Handler>
+  static AllocatingHandler<Handler> makeHandler(HandlerMemory& memory, const Handler& handler)
+  {
+    return AllocatingHandler<Handler>(memory, handler);
+  }
+
+  /**
+   * \brief Start an asynchronous wait for received messages.
+   *
+   * Note: The server mutex is assumed to be locked.
    */
   void startAsynchronousReceive();
 
   /**
-   * \brief Callback for handling an asynchronous receive.
+   * \brief Restart the asynchronous wait for received messages (e.g. after the server has been resumed).
+   */
+  void restartAsynchronousReceive();
+
+  /**
+   * \brief Replace the server's UDP socket (run by the io service, to not interfere with any pending operation).
+   *
+   * \param p_socket for the new socket.
+   */
+  void replaceSocket(boost::shared_ptr<boost::asio::ip::udp::socket> p_socket);
+
+  /**
+   * \brief Callback for handling an asynchronous wait for received messages.
+   *
+   * Note: The message is only read from the socket if the server is not suspended.
+   *
+   * \param error for containing an error code.
+   */
+  void receiveCallback(const boost::system::error_code& error);
+
+  /**
+   * \brief Update the estimated message period, and schedule a pre-warming before the next predicted arrival.
+   *
+   * \param arrival for the current message's arrival time.
+   */
+  void schedulePrewarm(const boost::asio::steady_timer::time_point& arrival);
+
+  /**
+   * \brief Callback for handling a pre-warming timer.
    *
    * \param error for containing an error code.
-   * \param bytes_transferred is the number of bytes received.
    */
-  void receiveCallback(const boost::system::error_code& error, const std::size_t bytes_transferred);
+  void prewarmCallback(const boost::system::error_code& error);
 
   /**
    * \brief Callback for handling an asynchronous send.
@@ -181,6 +416,59 @@ private:
    * \brief Flag indicating if the server was initialized successfully or not.
    */
   bool initialized_;
+
+  /**
+   * \brief The io service operating the server's asynchronous functions.
+   */
+  boost::asio::io_service& io_service_;
+
+  /**
+   * \brief Flag indicating if the processing of received messages has been suspended.
+   */
+  bool suspended_;
+
+  /**
+   * \brief Flag indicating if an asynchronous wait for received messages is pending.
+   */
+  bool receive_pending_;
+
+  /**
+   * \brief Mutex for protecting the server's socket and flags (held while a message is processed).
+   */
+  boost::mutex mutex_;
+
+  /**
+   * \brief Timer for pre-warming before the next predicted message arrival.
+   */
+  boost::asio::steady_timer prewarm_timer_;
+
+  /**
+   * \brief The previous message's arrival time.
+   */
+  boost::asio::steady_timer::time_point last_arrival_;
+
+  /**
+   * \brief The estimated message period [us] (zero if unknown).
+   */
+  double estimated_period_;
+
+  /**
+   * \brief Handler memory for the asynchronous waits for received messages.
+   *
+   * Note: Each kind of operation has its own memory, since they can be pending at the same time. I.e. the
+   *       steady-state message processing doesn't allocate any handler memory from the heap.
+   */
+  HandlerMemory receive_memory_;
+
+  /**
+   * \brief Handler memory for the asynchronous sends.
+   */
+  HandlerMemory send_memory_;
+
+  /**
+   * \brief Handler memory for the pre-warming timer's waits.
+   */
+  HandlerMemory prewarm_memory_;
 };
 
 } // end namespace egm
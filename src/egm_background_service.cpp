@@ -0,0 +1,519 @@
+/***********************************************************************************************************************
+ *
+ * Copyright (c) 2015, ABB Schweiz AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that
+ * the following conditions are met:
+ *
+ *    * Redistributions of source code must retain the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer in the documentation
+ *      and/or other materials provided with the
+ *      distribution.
+ *    * Neither the name of ABB nor the names of its
+ *      contributors may be used to endorse or promote
+ *      products derived from this software without
+ *      specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***********************************************************************************************************************
+ */
+#include <algorithm>
+#include <cmath>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <boost/bind.hpp>
+#include <boost/chrono.hpp>
+#include <boost/thread/lock_guard.hpp>
+
+#include "abb_libegm/egm_background_service.h"
+
+namespace abb
+{
+namespace egm
+{
+/**
+ * \brief The service that the current thread is a worker of (if any).
+ */
+static thread_local const BackgroundService* p_current_service = 0;
+
+/**
+ * \brief The current thread's worker index (only valid if the service pointer is set).
+ */
+static thread_local unsigned int current_worker = 0;
+
+/**
+ * \brief Mutex for protecting the process-wide service's configuration.
+ */
+static boost::mutex shared_mutex;
+
+/**
+ * \brief The process-wide service's configuration.
+ */
+static BackgroundServiceConfiguration shared_configuration;
+
+/**
+ * \brief Flag indicating if the process-wide service has been started.
+ */
+static bool shared_started = false;
+
+
+
+
+/***********************************************************************************************************************
+ * Class definitions: BackgroundService
+ */
+
+/************************************************************
+ * Primary methods
+ */
+
+const unsigned int BackgroundService::MAX_NUMBER_OF_WORKERS;
+const unsigned int BackgroundService::WHEEL_BITS;
+const unsigned int BackgroundService::WHEEL_LEVELS;
+const unsigned int BackgroundService::WHEEL_SLOTS;
+
+BackgroundService::BackgroundService(const BackgroundServiceConfiguration& configuration)
+:
+configuration_(configuration),
+queued_jobs_(0),
+next_worker_(0),
+stopping_(false),
+wheel_(WHEEL_LEVELS*WHEEL_SLOTS),
+current_tick_(0),
+last_timer_id_(0),
+timers_stopping_(false)
+{
+  configuration_.number_of_workers = std::min(std::max(configuration_.number_of_workers, 1u), MAX_NUMBER_OF_WORKERS);
+  configuration_.max_queued_jobs = std::max(configuration_.max_queued_jobs, 1u);
+  configuration_.tick_time = std::max(configuration_.tick_time, 0.001);
+
+  for (unsigned int i = 0; i < configuration_.number_of_workers; ++i)
+  {
+    workers_.push_back(boost::shared_ptr<Worker>(new Worker()));
+  }
+
+  for (unsigned int i = 0; i < configuration_.number_of_workers; ++i)
+  {
+    threads_.create_thread(boost::bind(&BackgroundService::runWorker, this, i));
+  }
+
+  threads_.create_thread(boost::bind(&BackgroundService::runTimers, this));
+}
+
+BackgroundService::~BackgroundService()
+{
+  shutdown();
+}
+
+/************************************************************
+ * Auxiliary methods
+ */
+
+void BackgroundService::runWorker(const unsigned int index)
+{
+  p_current_service = this;
+  current_worker = index;
+
+#ifdef __linux__
+  if (configuration_.pin_workers)
+  {
+    const unsigned int cores = std::max(boost::thread::hardware_concurrency(), 1u);
+
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(index % cores, &cpu_set);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+  }
+#endif
+
+  Job job;
+
+  while (true)
+  {
+    if (takeJob(index, &job))
+    {
+      {
+        boost::lock_guard<boost::mutex> lock(pool_mutex_);
+        --queued_jobs_;
+      }
+
+      try
+      {
+        job();
+      }
+      catch (...)
+      {
+        // A failing job must not stop the worker.
+      }
+
+      job.clear();
+    }
+    else
+    {
+      boost::unique_lock<boost::mutex> lock(pool_mutex_);
+
+      while (queued_jobs_ == 0 && !stopping_)
+      {
+        pool_condition_.wait(lock);
+      }
+
+      // Only stop when all queued jobs have been run.
+      if (queued_jobs_ == 0 && stopping_)
+      {
+        break;
+      }
+    }
+  }
+
+  p_current_service = 0;
+}
+
+bool BackgroundService::takeJob(const unsigned int index, Job* p_job)
+{
+  // Take the most recently queued job from the own queue (it is the most likely to be cached).
+  {
+    Worker& worker = *workers_[index];
+    boost::lock_guard<boost::mutex> lock(worker.mutex);
+
+    if (!worker.jobs.empty())
+    {
+      p_job->swap(worker.jobs.back());
+      worker.jobs.pop_back();
+      return true;
+    }
+  }
+
+  // Otherwise, steal the oldest queued job from one of the other workers.
+  for (unsigned int i = 1; i < workers_.size(); ++i)
+  {
+    Worker& victim = *workers_[(index + i) % workers_.size()];
+    boost::lock_guard<boost::mutex> lock(victim.mutex);
+
+    if (!victim.jobs.empty())
+    {
+      p_job->swap(victim.jobs.front());
+      victim.jobs.pop_front();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void BackgroundService::runTimers()
+{
+  typedef boost::chrono::steady_clock Clock;
+
+  const Clock::time_point start = Clock::now();
+  const Clock::duration tick = boost::chrono::duration_cast<Clock::duration>(
+                                 boost::chrono::duration<double>(configuration_.tick_time));
+
+  std::vector<boost::shared_ptr<Timer> > expired;
+  boost::unique_lock<boost::mutex> lock(timer_mutex_);
+
+  while (!timers_stopping_)
+  {
+    const Clock::time_point next = start + tick*(current_tick_ + 1);
+
+    if (Clock::now() < next)
+    {
+      timer_condition_.wait_until(lock, next);
+      continue;
+    }
+
+    // Advance one tick at the time (i.e. catch up if the thread has been delayed).
+    advance(&expired);
+
+    for (size_t i = 0; i < expired.size(); ++i)
+    {
+      if (expired[i]->period > 0)
+      {
+        expired[i]->expiry += expired[i]->period;
+        insert(expired[i]);
+      }
+      else
+      {
+        timers_.erase(expired[i]->id);
+      }
+    }
+
+    // Hand the expired timers over to the workers.
+    lock.unlock();
+
+    for (size_t i = 0; i < expired.size(); ++i)
+    {
+      submit(boost::bind(&BackgroundService::runTimer, this, expired[i]));
+    }
+
+    expired.clear();
+    lock.lock();
+  }
+}
+
+void BackgroundService::advance(std::vector<boost::shared_ptr<Timer> >* p_expired)
+{
+  ++current_tick_;
+
+  // Cascade the timers of the higher levels' current slots down, whenever the lower level has wrapped around.
+  for (unsigned int level = 1; level < WHEEL_LEVELS; ++level)
+  {
+    const unsigned int shift = WHEEL_BITS*level;
+
+    if ((current_tick_ & ((1ULL << shift) - 1)) != 0)
+    {
+      break;
+    }
+
+    Slot slot;
+    slot.swap(wheel_[level*WHEEL_SLOTS + ((current_tick_ >> shift) & (WHEEL_SLOTS - 1))]);
+
+    for (Slot::iterator i = slot.begin(); i != slot.end(); ++i)
+    {
+      if (!(*i)->canceled)
+      {
+        insert(*i);
+      }
+    }
+  }
+
+  // Collect the timers that expire at the current tick.
+  Slot slot;
+  slot.swap(wheel_[current_tick_ & (WHEEL_SLOTS - 1)]);
+
+  for (Slot::iterator i = slot.begin(); i != slot.end(); ++i)
+  {
+    if (!(*i)->canceled)
+    {
+      p_expired->push_back(*i);
+    }
+  }
+}
+
+void BackgroundService::insert(const boost::shared_ptr<Timer>& p_timer)
+{
+  const unsigned long long delta = (p_timer->expiry > current_tick_ ? p_timer->expiry - current_tick_ : 0);
+
+  unsigned int level = 0;
+  while (level < WHEEL_LEVELS - 1 && delta >= (1ULL << (WHEEL_BITS*(level + 1))))
+  {
+    ++level;
+  }
+
+  // Timers beyond the wheel's range are kept in the top level's last slot (they are re-inserted when cascaded).
+  const unsigned long long range = 1ULL << (WHEEL_BITS*WHEEL_LEVELS);
+  const unsigned long long expiry = (delta < range ? current_tick_ + delta : current_tick_ + range - 1);
+
+  wheel_[level*WHEEL_SLOTS + ((expiry >> (WHEEL_BITS*level)) & (WHEEL_SLOTS - 1))].push_back(p_timer);
+}
+
+void BackgroundService::runTimer(const boost::shared_ptr<Timer>& p_timer)
+{
+  {
+    boost::lock_guard<boost::mutex> lock(timer_mutex_);
+
+    // Skip canceled timers, and don't let a periodic job overlap with itself.
+    if (p_timer->canceled || p_timer->running)
+    {
+      return;
+    }
+
+    p_timer->running = true;
+    p_timer->runner = boost::this_thread::get_id();
+  }
+
+  try
+  {
+    p_timer->job();
+  }
+  catch (...)
+  {
+    // A failing job must not stop the worker.
+  }
+
+  {
+    boost::lock_guard<boost::mutex> lock(timer_mutex_);
+    p_timer->running = false;
+  }
+
+  timer_condition_.notify_all();
+}
+
+unsigned long long BackgroundService::toTicks(const double duration) const
+{
+  return (duration > 0.0 ? static_cast<unsigned long long>(std::ceil(duration/configuration_.tick_time - 1.0e-9)) : 0);
+}
+
+/************************************************************
+ * User interaction methods
+ */
+
+bool BackgroundService::submit(const Job& job)
+{
+  boost::lock_guard<boost::mutex> lock(pool_mutex_);
+
+  if (stopping_ || queued_jobs_ >= configuration_.max_queued_jobs)
+  {
+    return false;
+  }
+
+  // Jobs submitted by a worker are kept in its own queue (idle workers will steal them if needed).
+  unsigned int index = 0;
+
+  if (p_current_service == this)
+  {
+    index = current_worker;
+  }
+  else
+  {
+    index = next_worker_;
+    next_worker_ = (next_worker_ + 1) % workers_.size();
+  }
+
+  {
+    boost::lock_guard<boost::mutex> worker_lock(workers_[index]->mutex);
+    workers_[index]->jobs.push_back(job);
+  }
+
+  ++queued_jobs_;
+  pool_condition_.notify_one();
+
+  return true;
+}
+
+BackgroundService::TimerId BackgroundService::schedule(const Job& job, const double delay, const double period)
+{
+  boost::lock_guard<boost::mutex> lock(timer_mutex_);
+
+  if (timers_stopping_)
+  {
+    return 0;
+  }
+
+  boost::shared_ptr<Timer> p_timer(new Timer());
+  p_timer->id = ++last_timer_id_;
+  p_timer->job = job;
+  p_timer->expiry = current_tick_ + std::max(toTicks(delay), 1ULL);
+  p_timer->period = (period > 0.0 ? std::max(toTicks(period), 1ULL) : 0);
+
+  timers_[p_timer->id] = p_timer;
+  insert(p_timer);
+
+  return p_timer->id;
+}
+
+bool BackgroundService::cancel(const TimerId id)
+{
+  boost::unique_lock<boost::mutex> lock(timer_mutex_);
+
+  std::map<TimerId, boost::shared_ptr<Timer> >::iterator i = timers_.find(id);
+
+  if (i == timers_.end())
+  {
+    return false;
+  }
+
+  // The timer is removed from the wheel when its slot is visited.
+  boost::shared_ptr<Timer> p_timer = i->second;
+  p_timer->canceled = true;
+  timers_.erase(i);
+
+  // Wait for a running job to finish (unless the job is canceling itself).
+  while (p_timer->running && p_timer->runner != boost::this_thread::get_id())
+  {
+    timer_condition_.wait(lock);
+  }
+
+  return true;
+}
+
+void BackgroundService::shutdown()
+{
+  boost::lock_guard<boost::mutex> shutdown_lock(shutdown_mutex_);
+
+  {
+    boost::lock_guard<boost::mutex> lock(timer_mutex_);
+
+    if (!timers_stopping_)
+    {
+      timers_stopping_ = true;
+
+      for (std::map<TimerId, boost::shared_ptr<Timer> >::iterator i = timers_.begin(); i != timers_.end(); ++i)
+      {
+        i->second->canceled = true;
+      }
+
+      timers_.clear();
+      wheel_.assign(WHEEL_LEVELS*WHEEL_SLOTS, Slot());
+    }
+  }
+
+  timer_condition_.notify_all();
+
+  {
+    boost::lock_guard<boost::mutex> lock(pool_mutex_);
+    stopping_ = true;
+  }
+
+  pool_condition_.notify_all();
+
+  // Runs the queued jobs, before the threads are stopped.
+  threads_.join_all();
+}
+
+bool BackgroundService::isRunning()
+{
+  boost::lock_guard<boost::mutex> lock(pool_mutex_);
+  return !stopping_;
+}
+
+unsigned int BackgroundService::getNumberOfWorkers() const
+{
+  return static_cast<unsigned int>(workers_.size());
+}
+
+BackgroundService& BackgroundService::getShared()
+{
+  boost::lock_guard<boost::mutex> lock(shared_mutex);
+
+  static BackgroundService shared(shared_configuration);
+  shared_started = true;
+
+  return shared;
+}
+
+bool BackgroundService::configureShared(const BackgroundServiceConfiguration& configuration)
+{
+  boost::lock_guard<boost::mutex> lock(shared_mutex);
+
+  if (shared_started)
+  {
+    return false;
+  }
+
+  shared_configuration = configuration;
+
+  return true;
+}
+
+} // end namespace egm
+} // end namespace abb
@@ -34,702 +34,47 @@
  ***********************************************************************************************************************
  */
 
-#define _USE_MATH_DEFINES
-
+#include <algorithm>
 #include <cmath>
 #include <sstream>
 
+#include <boost/bind.hpp>
+
 #include "abb_libegm/egm_base_interface.h"
 #include "abb_libegm/egm_common_auxiliary.h"
+#include "abb_libegm/egm_session_handoff.h"
 
 namespace abb
 {
 namespace egm
 {
-/***********************************************************************************************************************
- * Class definitions: EGMBaseInterface::InputContainer
- */
-
-/************************************************************
- * Primary methods
- */
-
-EGMBaseInterface::InputContainer::InputContainer()
-:
-has_new_data_(false),
-first_call_(true),
-first_message_(false),
-estimated_sample_time_(Constants::RobotController::LOWEST_SAMPLE_TIME)
-{};
-
-bool EGMBaseInterface::InputContainer::parseFromArray(const char* data, const int bytes_transferred)
-{
-  has_new_data_ = false;
-
-  if (data)
-  {
-    has_new_data_ = egm_robot_.ParseFromArray(data, bytes_transferred);
-  }
-
-  if (has_new_data_)
-  {
-    first_message_ = (first_call_ || egm_robot_.header().seqno() == 0);
-    first_call_ = false;
-  }
-
-  return has_new_data_;
-}
-
-bool EGMBaseInterface::InputContainer::extractParsedInformation(const RobotAxes& axes)
-{
-  bool success = false;
-
-  detectRWAndEGMVersions();
-
-  if (has_new_data_ &&
-      parse(current_.mutable_header(), egm_robot_.header()) &&
-      parse(current_.mutable_feedback(), egm_robot_.feedback(), axes) &&
-      parse(current_.mutable_planned(), egm_robot_.planned(), axes) &&
-      parse(current_.mutable_status(), egm_robot_))
-  {
-    if (first_message_)
-    {
-      initial_.CopyFrom(current_);
-      previous_.CopyFrom(current_);
-    }
-
-    estimated_sample_time_ = estimateSampleTime();
-    success = estimateAllVelocities();
-
-    has_new_data_ = false;
-  }
-
-  return success;
-}
-
-void EGMBaseInterface::InputContainer::updatePrevious()
-{
-  previous_.CopyFrom(current_);
-}
-
-bool EGMBaseInterface::InputContainer::statesOk() const
+namespace
 {
-  return (current_.status().motor_state() == wrapper::Status_MotorState_MOTORS_ON &&
-          current_.status().rapid_execution_state() == wrapper::Status_RAPIDExecutionState_RAPID_RUNNING &&
-          current_.status().egm_state() == wrapper::Status_EGMState_EGM_RUNNING);
-}
-
-/************************************************************
- * Auxiliary methods
- */
-
-void EGMBaseInterface::InputContainer::detectRWAndEGMVersions()
-{
-  if(has_new_data_)
-  {
-    // Time field was added in RobotWare '6.07', as well as fix of inconsistent units (e.g. radians and degrees).
-    if(egm_robot_.feedback().has_time())
-    {
-      // If time field present:
-      // - RW greater than or equal to '6.07'.
-      // - EGM protocol '1.1' (with consistent units).
-      current_.mutable_header()->set_egm_version(wrapper::Header_EGMVersion_EGM_1_1);
-
-      // Utilization field was added in RobotWare '6.10'.
-      if(egm_robot_.has_utilizationrate())
-      {
-        // If utilization field present:
-        // - RW greater than or equal to '6.10'.
-        current_.mutable_header()->set_rw_version(wrapper::Header_RWVersion_RW_6_10_AND_NEWER);
-      }
-      else
-      {
-        // If utilization field absent:
-        // - RW between '6.07' and '6.09.02'.
-        current_.mutable_header()->set_rw_version(wrapper::Header_RWVersion_RW_BETWEEN_6_07_AND_6_09_02);
-      }
-    }
-    else
-    {
-      // If time field absent:
-      // - RW between '6.0' and '6.06.03'.
-      // - EGM protocol '1.0' (with inconsistent units).
-      current_.mutable_header()->set_rw_version(wrapper::Header_RWVersion_RW_BETWEEN_6_AND_6_06_03);
-      current_.mutable_header()->set_egm_version(wrapper::Header_EGMVersion_EGM_1_0);
-    }
-  }
-  else
-  {
-    current_.mutable_header()->set_rw_version(wrapper::Header_RWVersion_RW_UNKNOWN);
-    current_.mutable_header()->set_egm_version(wrapper::Header_EGMVersion_EGM_UNKNOWN);
-  }
-}
-
-double EGMBaseInterface::InputContainer::estimateSampleTime()
-{
-  double estimate = 0.0;
-
-  if (current_.has_feedback() && previous_.has_feedback() &&
-      current_.feedback().has_time() && previous_.feedback().has_time() &&
-      current_.feedback().time().has_sec() && previous_.feedback().time().has_sec() &&
-      current_.feedback().time().has_usec() && previous_.feedback().time().has_usec())
-  {
-    google::protobuf::uint64 diff_s = (current_.feedback().time().sec() - previous_.feedback().time().sec());
-    google::protobuf::uint64 diff_us = (current_.feedback().time().usec() - previous_.feedback().time().usec());
-    if (diff_s > 0)
-    {
-      diff_us += diff_s*((google::protobuf::uint64) Constants::Conversion::S_TO_US);
-    }
-
-    estimate = std::floor(((double) diff_us) * Constants::Conversion::MS_TO_S) * Constants::Conversion::MS_TO_S;
-  }
-
-  if (estimate < Constants::RobotController::LOWEST_SAMPLE_TIME)
-  {
-    estimate = Constants::RobotController::LOWEST_SAMPLE_TIME;
-  }
-
-  return estimate;
-}
-
-bool EGMBaseInterface::InputContainer::estimateAllVelocities()
-{
-  //---------------------------------------------------------
-  // Feedback
-  //---------------------------------------------------------
-  bool success = estimateVelocities(current_.mutable_feedback()->mutable_robot()->mutable_joints()->mutable_velocity(),
-                                    current_.feedback().robot().joints().position(),
-                                    previous_.feedback().robot().joints().position(),
-                                    estimated_sample_time_);
-
-  if (success)
-  {
-    success = estimateVelocities(current_.mutable_feedback()->mutable_robot()->mutable_cartesian()->mutable_velocity(),
-                                 current_.feedback().robot().cartesian().pose(),
-                                 previous_.feedback().robot().cartesian().pose(),
-                                 estimated_sample_time_);
-  }
-
-  if (success)
-  {
-    success = estimateVelocities(current_.mutable_feedback()->mutable_external()->mutable_joints()->mutable_velocity(),
-                                 current_.feedback().external().joints().position(),
-                                 previous_.feedback().external().joints().position(),
-                                 estimated_sample_time_);
-  }
-
-  //---------------------------------------------------------
-  // Planned
-  //---------------------------------------------------------
-  if (success)
-  {
-    success = estimateVelocities(current_.mutable_planned()->mutable_robot()->mutable_joints()->mutable_velocity(),
-                                 current_.planned().robot().joints().position(),
-                                 previous_.planned().robot().joints().position(),
-                                 estimated_sample_time_);
-  }
-
-  if (success)
-  {
-    success = estimateVelocities(current_.mutable_planned()->mutable_robot()->mutable_cartesian()->mutable_velocity(),
-                                 current_.planned().robot().cartesian().pose(),
-                                 previous_.planned().robot().cartesian().pose(),
-                                 estimated_sample_time_);
-  }
-
-  if (success)
-  {
-    success = estimateVelocities(current_.mutable_planned()->mutable_external()->mutable_joints()->mutable_velocity(),
-                                 current_.planned().external().joints().position(),
-                                 previous_.planned().external().joints().position(),
-                                 estimated_sample_time_);
-  }
-
-  return success;
-}
-
-
-
-
-/***********************************************************************************************************************
- * Class definitions: EGMBaseInterface::OutputContainer
- */
-
-/************************************************************
- * Primary methods
+/**
+ * \brief Convert a clock message to seconds.
+ *
+ * \param clock containing the clock message.
+ *
+ * \return double containing the time [s].
  */
-
-EGMBaseInterface::OutputContainer::OutputContainer() : sequence_number_(0) {}
-
-void EGMBaseInterface::OutputContainer::prepareOutputs(const InputContainer& inputs)
+double toSeconds(const wrapper::Clock& clock)
 {
-  sequence_number_ = (inputs.isFirstMessage() ? 0 : sequence_number_ + 1);
-
-  if (inputs.isFirstMessage())
-  {
-    const wrapper::Feedback& feedback = inputs.current().feedback();
-    wrapper::Robot* p_robot = current.mutable_robot();
-    wrapper::External* p_external = current.mutable_external();
-
-    // Joint positions and Cartesian pose.
-    p_robot->mutable_joints()->mutable_position()->CopyFrom(feedback.robot().joints().position());
-    p_robot->mutable_cartesian()->mutable_pose()->CopyFrom(feedback.robot().cartesian().pose());
-    p_external->mutable_joints()->mutable_position()->CopyFrom(feedback.external().joints().position());
-
-    // Joint velocities.
-    p_robot->mutable_joints()->clear_velocity();
-    for (int i = 0; i < feedback.robot().joints().velocity().values_size(); ++i)
-    {
-      p_robot->mutable_joints()->mutable_velocity()->add_values(0.0);
-    }
-
-    p_external->mutable_joints()->clear_velocity();
-    for (int i = 0; i < feedback.external().joints().velocity().values_size(); ++i)
-    {
-      p_external->mutable_joints()->mutable_velocity()->add_values(0.0);
-    }
-
-    // Cartesian velocities.
-    p_robot->mutable_cartesian()->mutable_velocity()->mutable_linear()->set_x(0.0);
-    p_robot->mutable_cartesian()->mutable_velocity()->mutable_linear()->set_y(0.0);
-    p_robot->mutable_cartesian()->mutable_velocity()->mutable_linear()->set_z(0.0);
-    p_robot->mutable_cartesian()->mutable_velocity()->mutable_angular()->set_x(0.0);
-    p_robot->mutable_cartesian()->mutable_velocity()->mutable_angular()->set_y(0.0);
-    p_robot->mutable_cartesian()->mutable_velocity()->mutable_angular()->set_z(0.0);
-
-    previous_.CopyFrom(current);
-  }
+  return (double) clock.sec() + ((double) clock.usec()) / Constants::Conversion::S_TO_US;
 }
 
-void EGMBaseInterface::OutputContainer::generateDemoOutputs(const InputContainer& inputs)
-{
-  unsigned int seqno = sequence_number_;                         // Current sequence number.
-  const double TS = inputs.estimatedSampleTime();                // Estimated sample time [s].
-  const double RAMP_IN = 3.0;                                    // Ramp in time [s].
-  unsigned int seqno_ramp_in_end = (unsigned int)(RAMP_IN / TS); // Sequence number when the ramp in is finished [-].
-
-  const wrapper::Feedback& initial_fdb = inputs.initial().feedback();
-  const wrapper::Feedback& current_fdb = inputs.current().feedback();
-
-  wrapper::Joints* rob_pos = current.mutable_robot()->mutable_joints()->mutable_position();
-  wrapper::Joints* rob_vel = current.mutable_robot()->mutable_joints()->mutable_velocity();
-  wrapper::Joints* ext_pos = current.mutable_external()->mutable_joints()->mutable_position();
-  wrapper::Joints* ext_vel = current.mutable_external()->mutable_joints()->mutable_velocity();
-  wrapper::CartesianPose* rob_pose = current.mutable_robot()->mutable_cartesian()->mutable_pose();
-
-  //---------------------------------------------------------
-  // Joint space
-  //---------------------------------------------------------
-  double amplitude = 2.0;
-  double a = amplitude / 2.0;
-  double b = M_PI*TS / RAMP_IN;
-
-  double freq = 0.5;
-  double dist = a*std::cos(b*seqno) - a;
-  double speed_dist = -(a*b)*std::sin(b*seqno) / TS;
-  if (seqno > seqno_ramp_in_end + 1)
-  {
-    dist = -2.0*a*cos(b*(seqno - seqno_ramp_in_end)*freq);
-    speed_dist = 2.0*(a*b)*freq*std::sin(b*(seqno - seqno_ramp_in_end)*freq) / TS;
-  }
-
-  // Robot joints.
-  for (int i = 0; i < current_fdb.robot().joints().position().values_size(); ++i)
-  {
-    rob_pos->set_values(i, initial_fdb.robot().joints().position().values(i) + dist);
-  }
-
-  for (int i = 0; i < current_fdb.robot().joints().velocity().values_size(); ++i)
-  {
-    rob_vel->set_values(i, speed_dist);
-  }
-
-  // External joints.
-  for (int i = 0; i < current_fdb.external().joints().position().values_size(); ++i)
-  {
-    ext_pos->set_values(i, initial_fdb.external().joints().position().values(i) + dist);
-  }
-
-  for (int i = 0; i < current_fdb.external().joints().velocity().values_size(); ++i)
-  {
-    ext_vel->set_values(i, speed_dist);
-  }
-
-  //---------------------------------------------------------
-  // Cartesian space
-  //---------------------------------------------------------
-  amplitude = 200.0;
-  a = amplitude / 2.0;
-  b = M_PI*TS;
-  freq = 0.2;
-
-  double x_dist = a*(std::cos(0.25*b*seqno*freq + M_PI) + 1);
-  double y_dist = x_dist;
-  double z_dist = a / 2.0*(std::cos(0.5*b*seqno*freq + 1.5*M_PI));
-
-  rob_pose->mutable_position()->set_x(initial_fdb.robot().cartesian().pose().position().x() + x_dist);
-  rob_pose->mutable_position()->set_y(initial_fdb.robot().cartesian().pose().position().y() + y_dist);
-  rob_pose->mutable_position()->set_z(initial_fdb.robot().cartesian().pose().position().z() + z_dist);
-
-  double t = 0.5*(std::cos(0.25*b*seqno*freq + M_PI) + 1);
-  generateDemoQuaternions(inputs, t);
-
-  // Demo references for including velocity control.
-  //rob_pose->mutable_position()->set_x(current_fdb.robot().cartesian().pose().position().x());
-  //current.mutable_robot()->mutable_cartesian()->mutable_velocity()->mutable_linear->set_x(-10.0);
-
-  // Demo references for only velocity control.
-  // Note: Need to set PosCorrGain to zero in the RAPID instruction.
-  //current.mutable_robot()->mutable_cartesian()->mutable_velocity()->mutable_linear->set_x(-10.0);
-  //current.mutable_robot()->mutable_cartesian()->mutable_velocity()->mutable_linear->set_y(-10.0);
-  //current.mutable_robot()->mutable_cartesian()->mutable_velocity()->mutable_linear->set_z(-10.0);
-  //current.mutable_robot()->mutable_cartesian()->mutable_velocity()->mutable_angular->set_x(4.0);
-}
-
-void EGMBaseInterface::OutputContainer::constructReply(const BaseConfiguration& configuration)
-{
-  constructHeader();
-  bool success = constructJointBody(configuration);
-
-  if (success && configuration.axes != None)
-  {
-    success = constructCartesianBody(configuration);
-  }
-
-  if (success)
-  {
-    success = egm_sensor_.SerializeToString(&reply_);
-  }
-
-  if (!success)
-  {
-    reply_.clear();
-  }
-}
-
-void EGMBaseInterface::OutputContainer::updatePrevious()
-{
-  previous_.CopyFrom(current);
-}
-
-/************************************************************
- * Auxiliary methods
+/**
+ * \brief Convert a time on the host's steady clock to seconds.
+ *
+ * \param time containing the time on the host's clock.
+ *
+ * \return double containing the time [s] (since the clock's epoch).
  */
-
-void EGMBaseInterface::OutputContainer::generateDemoQuaternions(const InputContainer& inputs, const double t)
-{
-  // Quaternion demo using Slerp (spherical linear interpolation).
-  // See for example https://en.wikipedia.org/wiki/Slerp for the equations.
-
-  const wrapper::Feedback& initial = inputs.initial().feedback();
-
-  //---------------------------------------------------------
-  // Setup the initial data and the target.
-  //---------------------------------------------------------
-  double q1_u0 = initial.robot().cartesian().pose().quaternion().u0();
-  double q1_u1 = initial.robot().cartesian().pose().quaternion().u1();
-  double q1_u2 = initial.robot().cartesian().pose().quaternion().u2();
-  double q1_u3 = initial.robot().cartesian().pose().quaternion().u3();
-
-  wrapper::Quaternion q;
-  wrapper::Euler e;
-  e.set_x(-90.0);
-  e.set_y(0.0);
-  e.set_z(180);
-  convert(&q, e);
-
-  if (dotProduct(q, initial.robot().cartesian().pose().quaternion()) < 0.0)
-  {
-    q.set_u0(-q.u0());
-    q.set_u1(-q.u1());
-    q.set_u2(-q.u2());
-    q.set_u3(-q.u3());
-  }
-
-  double q2_u0 = q.u0();
-  double q2_u1 = q.u1();
-  double q2_u2 = q.u2();
-  double q2_u3 = q.u3();
-
-  //---------------------------------------------------------
-  // Calculate the Slerp.
-  //---------------------------------------------------------
-  double dot_prod = q1_u0*q2_u0 + q1_u1*q2_u1 + q1_u2*q2_u2 + q1_u3*q2_u3;
-
-  double omega = acos(dot_prod);
-  double k = 1.0 / sin(omega);
-
-  double a = sin((1 - t)*omega)*k;
-  double b = sin(t*omega)*k;
-
-  double q3_u0 = a*q1_u0 + b*q2_u0;
-  double q3_u1 = a*q1_u1 + b*q2_u1;
-  double q3_u2 = a*q1_u2 + b*q2_u2;
-  double q3_u3 = a*q1_u3 + b*q2_u3;
-
-  //---------------------------------------------------------
-  // Normalize and set the references.
-  //---------------------------------------------------------
-  double norm = sqrt(q3_u0*q3_u0 + q3_u1*q3_u1 + q3_u2*q3_u2 + q3_u3*q3_u3);
-
-  current.mutable_robot()->mutable_cartesian()->mutable_pose()->mutable_quaternion()->set_u0(q3_u0 / norm);
-  current.mutable_robot()->mutable_cartesian()->mutable_pose()->mutable_quaternion()->set_u1(q3_u1 / norm);
-  current.mutable_robot()->mutable_cartesian()->mutable_pose()->mutable_quaternion()->set_u2(q3_u2 / norm);
-  current.mutable_robot()->mutable_cartesian()->mutable_pose()->mutable_quaternion()->set_u3(q3_u3 / norm);
-
-  convert(current.mutable_robot()->mutable_cartesian()->mutable_pose()->mutable_euler(),
-          current.robot().cartesian().pose().quaternion());
-}
-
-void EGMBaseInterface::OutputContainer::constructHeader()
-{
-  egm_sensor_.mutable_header()->set_seqno((google::protobuf::uint32) sequence_number_);
-  egm_sensor_.mutable_header()->set_tm((google::protobuf::uint32) 0);
-  egm_sensor_.mutable_header()->set_mtype(EgmHeader_MessageType_MSGTYPE_CORRECTION);
-}
-
-bool EGMBaseInterface::OutputContainer::constructJointBody(const BaseConfiguration& configuration)
-{
-  bool position_ok = false;
-  bool speed_ok = !configuration.use_velocity_outputs;
-
-  int rob_condition = Constants::RobotController::DEFAULT_NUMBER_OF_ROBOT_JOINTS;
-  int ext_condition = Constants::RobotController::DEFAULT_NUMBER_OF_EXTERNAL_JOINTS;
-
-  if (current.robot().joints().has_position())
-  {
-    // Outputs.
-    const wrapper::Joints& robot_position = current.robot().joints().position();
-    const wrapper::Joints& external_position = current.external().joints().position();
-
-    // Verify that there are no NaN or infinity values.
-    if(!verify(robot_position) || !verify(external_position))
-    {
-      return false;
-    }
-
-    // EGM sensor message.
-    EgmPlanned* planned = egm_sensor_.mutable_planned();
-    planned->clear_joints();
-    planned->clear_externaljoints();
-
-    switch (configuration.axes)
-    {
-      case None:
-      {
-        if (robot_position.values_size() == 0)
-        {
-          for (int i = 0; i < external_position.values_size() && i < ext_condition; ++i)
-          {
-            planned->mutable_externaljoints()->add_joints(external_position.values(i));
-          }
-
-          position_ok = true;
-        }
-      }
-      break;
-
-      case Six:
-      {
-        if (robot_position.values_size() == rob_condition)
-        {
-          for (int i = 0; i < robot_position.values_size(); ++i)
-          {
-            planned->mutable_joints()->add_joints(robot_position.values(i));
-          }
-
-          for (int i = 0; i < external_position.values_size() && i < ext_condition; ++i)
-          {
-            planned->mutable_externaljoints()->add_joints(external_position.values(i));
-          }
-
-          position_ok = true;
-        }
-      }
-      break;
-
-      case Seven:
-      {
-        // If using a seven axes robot (e.g. IRB14000): Map to special case.
-        if (robot_position.values_size() == rob_condition + 1)
-        {
-          planned->mutable_joints()->add_joints(robot_position.values(0));
-          planned->mutable_joints()->add_joints(robot_position.values(1));
-          planned->mutable_joints()->add_joints(robot_position.values(3));
-          planned->mutable_joints()->add_joints(robot_position.values(4));
-          planned->mutable_joints()->add_joints(robot_position.values(5));
-          planned->mutable_joints()->add_joints(robot_position.values(6));
-          planned->mutable_externaljoints()->add_joints(robot_position.values(2));
-
-          for (int i = 0; i < external_position.values_size() && i < ext_condition - 1; ++i)
-          {
-            planned->mutable_externaljoints()->add_joints(external_position.values(i));
-          }
-
-          position_ok = true;
-        }
-      }
-      break;
-    }
-  }
-
-  if (configuration.use_velocity_outputs && current.robot().joints().has_velocity())
-  {
-    // Outputs.
-    const wrapper::Joints& robot_velocity = current.robot().joints().velocity();
-    const wrapper::Joints& external_velocity = current.external().joints().velocity();
-
-    // Verify that there are no NaN or infinity values.
-    if(!verify(robot_velocity) || !verify(external_velocity))
-    {
-      return false;
-    }
-
-    // EGM sensor message.
-    EgmSpeedRef* speed_reference = egm_sensor_.mutable_speedref();
-    speed_reference->clear_joints();
-    speed_reference->clear_externaljoints();
-
-    switch (configuration.axes)
-    {
-      case Six:
-      {
-        if (robot_velocity.values_size() == rob_condition)
-        {
-          for (int i = 0; i < robot_velocity.values_size(); ++i)
-          {
-            speed_reference->mutable_joints()->add_joints(robot_velocity.values(i));
-          }
-
-          for (int i = 0; i < external_velocity.values_size() && i < ext_condition; ++i)
-          {
-            speed_reference->mutable_externaljoints()->add_joints(external_velocity.values(i));
-          }
-
-          speed_ok = true;
-        }
-      }
-      break;
-
-      case Seven:
-      {
-        // If using a seven axes robot (e.g. IRB14000): Map to special case.
-        if (robot_velocity.values_size() == rob_condition + 1)
-        {
-          speed_reference->mutable_joints()->add_joints(robot_velocity.values(0));
-          speed_reference->mutable_joints()->add_joints(robot_velocity.values(1));
-          speed_reference->mutable_joints()->add_joints(robot_velocity.values(3));
-          speed_reference->mutable_joints()->add_joints(robot_velocity.values(4));
-          speed_reference->mutable_joints()->add_joints(robot_velocity.values(5));
-          speed_reference->mutable_joints()->add_joints(robot_velocity.values(6));
-          speed_reference->mutable_externaljoints()->add_joints(robot_velocity.values(2));
-
-          for (int i = 0; i < external_velocity.values_size() && i < ext_condition - 1; ++i)
-          {
-            speed_reference->mutable_externaljoints()->add_joints(external_velocity.values(i));
-          }
-
-          speed_ok = true;
-        }
-      }
-      break;
-    }
-  }
-
-  return (position_ok && speed_ok);
-}
-
-bool EGMBaseInterface::OutputContainer::constructCartesianBody(const BaseConfiguration& configuration)
+double toSeconds(const boost::asio::steady_timer::time_point& time)
 {
-  bool position_ok = false;
-  bool speed_ok = !configuration.use_velocity_outputs;
-
-  if (current.robot().cartesian().has_pose())
-  {
-    // Outputs.
-    const wrapper::CartesianPose& pose = current.robot().cartesian().pose();;
-
-    // Verify that there are no NaN or infinity values.
-    if(!verify(pose))
-    {
-      return false;
-    }
-
-    // EGM sensor message.
-    EgmPlanned* planned = egm_sensor_.mutable_planned();
-    planned->clear_cartesian();
-
-    if (pose.has_position())
-    {
-      planned->mutable_cartesian()->mutable_pos()->set_x(pose.position().x());
-      planned->mutable_cartesian()->mutable_pos()->set_y(pose.position().y());
-      planned->mutable_cartesian()->mutable_pos()->set_z(pose.position().z());
-    }
-
-    if (pose.has_euler())
-    {
-      planned->mutable_cartesian()->mutable_euler()->set_x(pose.euler().x());
-      planned->mutable_cartesian()->mutable_euler()->set_y(pose.euler().y());
-      planned->mutable_cartesian()->mutable_euler()->set_z(pose.euler().z());
-    }
-
-    if (pose.has_quaternion())
-    {
-      planned->mutable_cartesian()->mutable_orient()->set_u0(pose.quaternion().u0());
-      planned->mutable_cartesian()->mutable_orient()->set_u1(pose.quaternion().u1());
-      planned->mutable_cartesian()->mutable_orient()->set_u2(pose.quaternion().u2());
-      planned->mutable_cartesian()->mutable_orient()->set_u3(pose.quaternion().u3());
-    }
-
-    position_ok = true;
-  }
-
-  if (configuration.use_velocity_outputs && current.robot().cartesian().has_velocity())
-  {
-    // References.
-    const wrapper::CartesianVelocity& velocity = current.robot().cartesian().velocity();
-
-    // Verify that there are no NaN or infinity values.
-    if(!verify(velocity))
-    {
-      return false;
-    }
-
-    // EGM sensor message.
-    EgmSpeedRef* speed_reference = egm_sensor_.mutable_speedref();
-    speed_reference->clear_cartesians();
-
-    if (velocity.has_linear())
-    {
-      speed_reference->mutable_cartesians()->add_value(velocity.linear().x());
-      speed_reference->mutable_cartesians()->add_value(velocity.linear().y());
-      speed_reference->mutable_cartesians()->add_value(velocity.linear().z());
-    }
-    else
-    {
-      speed_reference->mutable_cartesians()->add_value(0.0);
-      speed_reference->mutable_cartesians()->add_value(0.0);
-      speed_reference->mutable_cartesians()->add_value(0.0);
-    }
-
-    if (velocity.has_angular())
-    {
-      speed_reference->mutable_cartesians()->add_value(velocity.angular().x());
-      speed_reference->mutable_cartesians()->add_value(velocity.angular().y());
-      speed_reference->mutable_cartesians()->add_value(velocity.angular().z());
-    }
-    else
-    {
-      speed_reference->mutable_cartesians()->add_value(0.0);
-      speed_reference->mutable_cartesians()->add_value(0.0);
-      speed_reference->mutable_cartesians()->add_value(0.0);
-    }
-
-    speed_ok = true;
-  }
-
-  return (position_ok && speed_ok);
+  return ((double) boost::asio::chrono::duration_cast<boost::asio::chrono::microseconds>(
+            time.time_since_epoch()).count()) / Constants::Conversion::S_TO_US;
 }
+} // end anonymous namespace
 
 
 
@@ -738,6 +83,9 @@ bool EGMBaseInterface::OutputContainer::constructCartesianBody(const BaseConfigu
  * Class definitions: EGMBaseInterface
  */
 
+const unsigned int EGMBaseInterface::WAIT_TIME_MS;
+const double EGMBaseInterface::LOG_FLUSH_PERIOD = 0.5;
+
 /************************************************************
  * Primary methods
  */
@@ -747,6 +95,7 @@ EGMBaseInterface::EGMBaseInterface(boost::asio::io_service& io_service,
                                    const BaseConfiguration& configuration)
 :
 udp_server_(io_service, port_number, this),
+log_flush_timer_(0),
 configuration_(configuration)
 {
   if (configuration_.active.use_logging)
@@ -757,8 +106,18 @@ configuration_(configuration)
   }
 }
 
+EGMBaseInterface::~EGMBaseInterface()
+{
+  if (log_flush_timer_ != 0)
+  {
+    BackgroundService::getShared().cancel(log_flush_timer_);
+  }
+}
+
 const std::string& EGMBaseInterface::callback(const UDPServerData& server_data)
 {
+  MetricsCollector::CallbackScope callback_scope(metrics_);
+
   // Initialize the callback by:
   // - Parsing and extracting data from the recieved message.
   // - Updating any pending configuration changes.
@@ -768,21 +127,27 @@ const std::string& EGMBaseInterface::callback(const UDPServerData& server_data)
     // Handle demo execution.
     if (configuration_.active.use_demo_outputs)
     {
+      MetricsCollector::StageScope stage_scope(metrics_, Metrics::Generate);
       outputs_.generateDemoOutputs(inputs_);
     }
 
     // Log inputs and outputs.
     if (configuration_.active.use_logging && p_logger_)
     {
+      MetricsCollector::StageScope stage_scope(metrics_, Metrics::Log);
       logData(inputs_, outputs_, configuration_.active.max_logging_duration);
     }
 
-    // Constuct the reply message.
-    outputs_.constructReply(configuration_.active);
+    {
+      MetricsCollector::StageScope stage_scope(metrics_, Metrics::Reply);
+
+      // Constuct the reply message.
+      outputs_.constructReply(configuration_.active);
 
-    // Prepare for the next callback.
-    inputs_.updatePrevious();
-    outputs_.updatePrevious();
+      // Prepare for the next callback.
+      inputs_.updatePrevious();
+      outputs_.updatePrevious();
+    }
   }
 
   // Return the reply.
@@ -822,8 +187,21 @@ void EGMBaseInterface::logData(const InputContainer& inputs, const OutputContain
     p_logger_->add(output.robot().cartesian().pose());
     p_logger_->add(output.robot().cartesian().velocity(), true);
 
-    // Write to the log file.
-    p_logger_->flush();
+    // End the log event. The log file is flushed periodically by the background service (i.e. outside of the
+    // callback), which is scheduled on the first logged message (when the logger can no longer be replaced).
+    p_logger_->endMessage();
+
+    if (log_flush_timer_ == 0)
+    {
+      log_flush_timer_ = BackgroundService::getShared().schedule(boost::bind(&EGMLogger::flush, p_logger_),
+                                                                  LOG_FLUSH_PERIOD, LOG_FLUSH_PERIOD);
+
+      // Fall back to flushing directly, if the background service has been shut down.
+      if (log_flush_timer_ == 0)
+      {
+        p_logger_->flush();
+      }
+    }
   }
 }
 
@@ -834,6 +212,7 @@ bool EGMBaseInterface::initializeCallback(const UDPServerData& server_data)
   // Parse the recieved message.
   if (server_data.p_data)
   {
+    MetricsCollector::StageScope stage_scope(metrics_, Metrics::Parse);
     success = inputs_.parseFromArray(server_data.p_data, server_data.bytes_transferred);
   }
 
@@ -849,6 +228,8 @@ bool EGMBaseInterface::initializeCallback(const UDPServerData& server_data)
     }
   }
 
+  MetricsCollector::StageScope stage_scope(metrics_, Metrics::Extract);
+
   // Extract information from the parsed message.
   if (success)
   {
@@ -869,6 +250,11 @@ bool EGMBaseInterface::initializeCallback(const UDPServerData& server_data)
         session_data_.status.Clear();
       }
     }
+
+    if (success)
+    {
+      updateClockAlignment(server_data);
+    }
   }
 
   // Prepare the outputs.
@@ -881,6 +267,59 @@ bool EGMBaseInterface::initializeCallback(const UDPServerData& server_data)
   return success;
 }
 
+void EGMBaseInterface::updateClockAlignment(const UDPServerData& server_data)
+{
+  // Note: The feedback time is paired with the receive time (i.e. the alignment includes the transfer delay).
+  if (inputs_.current().feedback().has_time() && server_data.arrival != boost::asio::steady_timer::time_point())
+  {
+    clock_alignment_.update(toSeconds(inputs_.current().feedback().time()), toSeconds(server_data.arrival));
+  }
+}
+
+void EGMBaseInterface::storeSession(wrapper::session::SessionSnapshot* p_snapshot)
+{
+  if (p_snapshot)
+  {
+    inputs_.storeSession(p_snapshot->mutable_base());
+    outputs_.storeSession(p_snapshot->mutable_base());
+  }
+}
+
+bool EGMBaseInterface::verifySession(const wrapper::session::SessionSnapshot& snapshot)
+{
+  // Note: A snapshot stored before any message was received has no session to restore.
+  return snapshot.has_base() && snapshot.base().previous_inputs().has_header();
+}
+
+bool EGMBaseInterface::restoreSession(const wrapper::session::SessionSnapshot& snapshot)
+{
+  bool success = verifySession(snapshot);
+
+  if (success)
+  {
+    inputs_.restoreSession(snapshot.base());
+    outputs_.restoreSession(snapshot.base());
+
+    boost::lock_guard<boost::mutex> lock(session_data_.mutex);
+    session_data_.header.CopyFrom(inputs_.current().header());
+    session_data_.status.CopyFrom(inputs_.current().status());
+  }
+
+  return success;
+}
+
+void EGMBaseInterface::prewarm()
+{
+  inputs_.prewarm();
+  outputs_.prewarm();
+}
+
+unsigned int EGMBaseInterface::prewarmLeadTime()
+{
+  // Note: The active configuration is only accessed by the UDP server's thread.
+  return configuration_.active.prewarm_lead_time;
+}
+
 /************************************************************
  * User interaction methods
  */
@@ -932,6 +371,56 @@ wrapper::Status EGMBaseInterface::getStatus()
   return status;
 };
 
+Metrics EGMBaseInterface::getMetrics()
+{
+  return metrics_.getMetrics();
+}
+
+bool EGMBaseInterface::enableHardwareCounters(const bool enable)
+{
+  return metrics_.enableHardwareCounters(enable);
+}
+
+ClockEstimate EGMBaseInterface::getClockEstimate()
+{
+  return clock_alignment_.getEstimate();
+}
+
+bool EGMBaseInterface::convertControllerTime(const wrapper::Clock& controller_time,
+                                             boost::asio::steady_timer::time_point* p_host_time)
+{
+  double time = 0.0;
+
+  bool success = (p_host_time && clock_alignment_.toHostTime(toSeconds(controller_time), &time));
+
+  if (success)
+  {
+    *p_host_time = boost::asio::steady_timer::time_point(boost::asio::chrono::microseconds(
+                     (long long) std::floor(time*Constants::Conversion::S_TO_US + 0.5)));
+  }
+
+  return success;
+}
+
+bool EGMBaseInterface::convertHostTime(const boost::asio::steady_timer::time_point& host_time,
+                                       wrapper::Clock* p_controller_time)
+{
+  double time = 0.0;
+
+  bool success = (p_controller_time && clock_alignment_.toControllerTime(toSeconds(host_time), &time));
+
+  if (success)
+  {
+    time = std::max(time, 0.0);
+    google::protobuf::uint64 us = (google::protobuf::uint64) (time*Constants::Conversion::S_TO_US + 0.5);
+
+    p_controller_time->set_sec(us / (google::protobuf::uint64) Constants::Conversion::S_TO_US);
+    p_controller_time->set_usec(us % (google::protobuf::uint64) Constants::Conversion::S_TO_US);
+  }
+
+  return success;
+}
+
 BaseConfiguration EGMBaseInterface::getConfiguration()
 {
   boost::lock_guard<boost::mutex> lock(configuration_.mutex);
@@ -947,5 +436,71 @@ void EGMBaseInterface::setConfiguration(const BaseConfiguration& configuration)
   configuration_.has_pending_update = true;
 }
 
+bool EGMBaseInterface::handoffSession(const std::string& path, const unsigned int timeout_ms)
+{
+  wrapper::session::SessionSnapshot snapshot;
+  std::string state;
+
+  // Suspend the message processing, so that the state is stable and new messages are left in the socket.
+  udp_server_.suspend();
+
+  storeSession(&snapshot);
+
+  bool success = snapshot.SerializeToString(&state) &&
+                 EGMSessionHandoff::send(path, udp_server_.nativeHandle(), state, timeout_ms);
+
+  if (!success)
+  {
+    udp_server_.resume();
+  }
+
+  return success;
+}
+
+bool EGMBaseInterface::adoptSession(const std::string& path, const unsigned int timeout_ms)
+{
+  wrapper::session::SessionSnapshot snapshot;
+  std::string state;
+  int connection = -1;
+  int socket_handle = -1;
+
+  if (!EGMSessionHandoff::receive(path, &connection, &socket_handle, &state, timeout_ms))
+  {
+    return false;
+  }
+
+  // Suspend any message processing (on the interface's own socket), while the session is taken over.
+  udp_server_.suspend();
+
+  // Only acknowledge the transfer once the session has been taken over, otherwise the other process resumes it.
+  // Note: The state is verified before the socket is adopted, but it is only restored after the adoption (i.e. a
+  //       rejected socket leaves the interface's own state untouched).
+  if (!(snapshot.ParseFromString(state) && verifySession(snapshot) && udp_server_.adoptSocket(socket_handle)))
+  {
+    EGMSessionHandoff::reject(connection, socket_handle);
+    udp_server_.resume();
+    return false;
+  }
+
+  // Note: The adopted socket is owned by the UDP server, and the interface must stay suspended (i.e. the other
+  //       process resumes the session on its own handle of the same socket).
+  if (!restoreSession(snapshot))
+  {
+    EGMSessionHandoff::reject(connection, -1);
+    return false;
+  }
+
+  // Note: If the acknowledgement can't be sent, then the other process has resumed the session itself, and
+  //       the interface must stay suspended (i.e. the session is never served by both processes).
+  if (!EGMSessionHandoff::accept(connection, timeout_ms))
+  {
+    return false;
+  }
+
+  udp_server_.resume();
+
+  return true;
+}
+
 } // end namespace egm
 } // end namespace abb
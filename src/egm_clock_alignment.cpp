@@ -0,0 +1,220 @@
+/***********************************************************************************************************************
+ *
+ * Copyright (c) 2015, ABB Schweiz AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that
+ * the following conditions are met:
+ *
+ *    * Redistributions of source code must retain the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer in the documentation
+ *      and/or other materials provided with the
+ *      distribution.
+ *    * Neither the name of ABB nor the names of its
+ *      contributors may be used to endorse or promote
+ *      products derived from this software without
+ *      specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***********************************************************************************************************************
+ */
+
+
+#include <algorithm>
+#include <cmath>
+
+#include "abb_libegm/egm_clock_alignment.h"
+
+namespace abb
+{
+namespace egm
+{
+/***********************************************************************************************************************
+ * Class definitions: ClockAlignment
+ */
+
+/************************************************************
+ * Primary methods
+ */
+
+const unsigned int ClockAlignment::MIN_SAMPLES;
+const unsigned int ClockAlignment::MAX_CONSECUTIVE_OUTLIERS;
+const double ClockAlignment::MIN_DEVIATION = 0.0005;
+const double ClockAlignment::MIN_TIME_VARIANCE = 0.01;
+const double ClockAlignment::MAX_SKEW = 0.001;
+
+ClockAlignment::ClockAlignment(const double time_constant, const double outlier_threshold)
+:
+time_constant_(time_constant),
+outlier_threshold_(outlier_threshold),
+outliers_(0),
+resets_(0)
+{
+  clear();
+}
+
+bool ClockAlignment::update(const double controller_time, const double host_time)
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+
+  // Start over if the robot controller's clock has gone backwards (e.g. if the robot controller has restarted).
+  if (samples_ > 0 && controller_time < previous_)
+  {
+    clear();
+    ++resets_;
+  }
+
+  const double y = host_time - controller_time;
+  double residual = (samples_ > 0 ? y - offsetAt(controller_time - reference_) : 0.0);
+
+  // Reject outliers (e.g. delayed messages), once the typical deviation is known. Many consecutive
+  // outliers indicate that one of the clocks has jumped, and then the estimate is started over.
+  if (samples_ >= MIN_SAMPLES && std::abs(residual) > outlier_threshold_*deviation_ + MIN_DEVIATION)
+  {
+    ++outliers_;
+
+    if (++consecutive_outliers_ < MAX_CONSECUTIVE_OUTLIERS)
+    {
+      return false;
+    }
+
+    clear();
+    ++resets_;
+    residual = 0.0;
+  }
+
+  consecutive_outliers_ = 0;
+
+  if (samples_ == 0)
+  {
+    reference_ = controller_time;
+    previous_ = controller_time;
+  }
+
+  // Update the exponentially weighted regression, with old samples decaying over time.
+  const double x = controller_time - reference_;
+  const double decay = std::exp(-(controller_time - previous_) / time_constant_);
+  const double dx = x - mean_time_;
+  const double dy = y - mean_offset_;
+
+  weight_ = decay*weight_ + 1.0;
+  mean_time_ += dx / weight_;
+  mean_offset_ += dy / weight_;
+  time_variance_ = decay*time_variance_ + dx*(x - mean_time_);
+  covariance_ = decay*covariance_ + dx*(y - mean_offset_);
+  deviation_ += (std::abs(residual) - deviation_) / weight_;
+
+  // Note: The skew is only estimated when the samples are spread out enough in time.
+  skew_ = 0.0;
+  if (time_variance_ > MIN_TIME_VARIANCE*weight_)
+  {
+    skew_ = std::max(-MAX_SKEW, std::min(covariance_ / time_variance_, MAX_SKEW));
+  }
+
+  previous_ = controller_time;
+  ++samples_;
+
+  return true;
+}
+
+/************************************************************
+ * User interaction methods
+ */
+
+void ClockAlignment::reset()
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+
+  clear();
+  outliers_ = 0;
+  resets_ = 0;
+}
+
+bool ClockAlignment::toHostTime(const double controller_time, double* p_host_time) const
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+
+  bool result = (p_host_time && samples_ > 0);
+
+  if (result)
+  {
+    *p_host_time = controller_time + offsetAt(controller_time - reference_);
+  }
+
+  return result;
+}
+
+bool ClockAlignment::toControllerTime(const double host_time, double* p_controller_time) const
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+
+  bool result = (p_controller_time && samples_ > 0);
+
+  if (result)
+  {
+    // Invert: host_time = controller_time + mean_offset + skew*(controller_time - reference - mean_time).
+    *p_controller_time = (host_time - mean_offset_ + skew_*(reference_ + mean_time_)) / (1.0 + skew_);
+  }
+
+  return result;
+}
+
+ClockEstimate ClockAlignment::getEstimate() const
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+
+  ClockEstimate estimate;
+
+  estimate.valid = (samples_ > 0);
+  estimate.reference = previous_;
+  estimate.offset = offsetAt(previous_ - reference_);
+  estimate.skew = skew_;
+  estimate.deviation = deviation_;
+  estimate.samples = samples_;
+  estimate.outliers = outliers_;
+  estimate.resets = resets_;
+
+  return estimate;
+}
+
+/************************************************************
+ * Auxiliary methods
+ */
+
+double ClockAlignment::offsetAt(const double x) const
+{
+  return mean_offset_ + skew_*(x - mean_time_);
+}
+
+void ClockAlignment::clear()
+{
+  reference_ = 0.0;
+  previous_ = 0.0;
+  weight_ = 0.0;
+  mean_time_ = 0.0;
+  mean_offset_ = 0.0;
+  time_variance_ = 0.0;
+  covariance_ = 0.0;
+  skew_ = 0.0;
+  deviation_ = 0.0;
+  samples_ = 0;
+  consecutive_outliers_ = 0;
+}
+
+} // end namespace egm
+} // end namespace abb
@@ -0,0 +1,1239 @@
+/***********************************************************************************************************************
+ *
+ * Copyright (c) 2015, ABB Schweiz AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that
+ * the following conditions are met:
+ *
+ *    * Redistributions of source code must retain the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer in the documentation
+ *      and/or other materials provided with the
+ *      distribution.
+ *    * Neither the name of ABB nor the names of its
+ *      contributors may be used to endorse or promote
+ *      products derived from this software without
+ *      specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***********************************************************************************************************************
+ */
+
+#define _USE_MATH_DEFINES
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "abb_libegm/egm_codec.h"
+#include "abb_libegm/egm_common_auxiliary.h"
+
+namespace abb
+{
+namespace egm
+{
+namespace
+{
+/**
+ * \brief Read a varint from a serialized message.
+ *
+ * \param data containing the serialized message.
+ * \param end specifying the end of the readable bytes.
+ * \param p_position for the position to read from (moved to after the varint).
+ * \param p_value for containing the value.
+ *
+ * \return bool indicating if the varint was read or not.
+ */
+bool readVarint(const std::string& data, const size_t end, size_t* p_position, google::protobuf::uint64* p_value)
+{
+  *p_value = 0;
+
+  for (unsigned int shift = 0; *p_position < end && shift < 64; shift += 7)
+  {
+    const google::protobuf::uint8 byte = static_cast<google::protobuf::uint8>(data[(*p_position)++]);
+    *p_value |= static_cast<google::protobuf::uint64>(byte & 0x7F) << shift;
+
+    if ((byte & 0x80) == 0)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * \brief Encode a varint.
+ *
+ * \param value to encode.
+ * \param p_buffer for containing the encoded bytes (at least 5 bytes).
+ *
+ * \return size_t containing the number of encoded bytes.
+ */
+size_t encodeVarint(google::protobuf::uint32 value, google::protobuf::uint8* p_buffer)
+{
+  size_t length = 0;
+
+  while (value >= 0x80)
+  {
+    p_buffer[length++] = static_cast<google::protobuf::uint8>(value | 0x80);
+    value >>= 7;
+  }
+
+  p_buffer[length++] = static_cast<google::protobuf::uint8>(value);
+
+  return length;
+}
+
+/**
+ * \brief Scan a serialized EGM sensor message for the positions of its double values, and its sequence number.
+ *
+ * Note: All length delimited fields, in EGM sensor messages, are sub-messages.
+ *
+ * \param data containing the serialized message.
+ * \param begin specifying the start of the (sub-)message.
+ * \param end specifying the end of the (sub-)message.
+ * \param depth specifying the message depth (zero for the top message).
+ * \param header indicating if the (sub-)message is the header.
+ * \param p_offsets for containing the double values' byte offsets.
+ * \param p_seqno_offset for containing the sequence number's byte offset.
+ * \param p_seqno_length for containing the sequence number's encoded length.
+ *
+ * \return bool indicating if the scan succeeded or not.
+ */
+bool scanReply(const std::string& data,
+               const size_t begin,
+               const size_t end,
+               const unsigned int depth,
+               const bool header,
+               std::vector<size_t>* p_offsets,
+               size_t* p_seqno_offset,
+               size_t* p_seqno_length)
+{
+  size_t position = begin;
+  google::protobuf::uint64 key = 0;
+  google::protobuf::uint64 value = 0;
+
+  while (position < end)
+  {
+    if (!readVarint(data, end, &position, &key))
+    {
+      return false;
+    }
+
+    const google::protobuf::uint64 field = key >> 3;
+
+    switch (key & 0x7)
+    {
+      case 0: // Varint.
+      {
+        const size_t start = position;
+
+        if (!readVarint(data, end, &position, &value))
+        {
+          return false;
+        }
+
+        if (header && field == EgmHeader::kSeqnoFieldNumber)
+        {
+          *p_seqno_offset = start;
+          *p_seqno_length = position - start;
+        }
+      }
+      break;
+
+      case 1: // Fixed 64 bits (i.e. doubles).
+      {
+        if (end - position < sizeof(double))
+        {
+          return false;
+        }
+
+        p_offsets->push_back(position);
+        position += sizeof(double);
+      }
+      break;
+
+      case 2: // Length delimited (i.e. sub-messages).
+      {
+        if (!readVarint(data, end, &position, &value) || value > end - position ||
+            !scanReply(data, position, position + value, depth + 1,
+                       depth == 0 && field == EgmSensor::kHeaderFieldNumber,
+                       p_offsets, p_seqno_offset, p_seqno_length))
+        {
+          return false;
+        }
+
+        position += value;
+      }
+      break;
+
+      case 5: // Fixed 32 bits.
+      {
+        if (end - position < 4)
+        {
+          return false;
+        }
+
+        position += 4;
+      }
+      break;
+
+      default:
+        return false;
+    }
+  }
+
+  return position == end;
+}
+
+/**
+ * \brief Append robot joint values, mapped in the same way as in the EGM sensor message's robot joints.
+ *
+ * \param robot containing the robot joint values.
+ * \param axes specifying the robot's axes.
+ * \param p_values for containing the values.
+ */
+void appendRobotJoints(const wrapper::Joints& robot, const RobotAxes axes, std::vector<double>* p_values)
+{
+  for (int i = 0; axes != None && i < robot.values_size(); ++i)
+  {
+    // If using a seven axes robot (e.g. IRB14000): The third axis is sent as the first external axis.
+    if (axes != Seven || i != 2)
+    {
+      p_values->push_back(robot.values(i));
+    }
+  }
+}
+
+/**
+ * \brief Append external joint values, mapped in the same way as in the EGM sensor message's external joints.
+ *
+ * \param robot containing the robot joint values.
+ * \param external containing the external joint values.
+ * \param axes specifying the robot's axes.
+ * \param p_values for containing the values.
+ */
+void appendExternalJoints(const wrapper::Joints& robot,
+                          const wrapper::Joints& external,
+                          const RobotAxes axes,
+                          std::vector<double>* p_values)
+{
+  int limit = Constants::RobotController::DEFAULT_NUMBER_OF_EXTERNAL_JOINTS;
+
+  if (axes == Seven)
+  {
+    p_values->push_back(robot.values(2));
+    --limit;
+  }
+
+  for (int i = 0; i < external.values_size() && i < limit; ++i)
+  {
+    p_values->push_back(external.values(i));
+  }
+}
+} // end anonymous namespace
+
+
+
+
+/***********************************************************************************************************************
+ * Class definitions: InputContainer
+ */
+
+/************************************************************
+ * Primary methods
+ */
+
+InputContainer::InputContainer()
+:
+has_new_data_(false),
+first_call_(true),
+first_message_(false),
+estimated_sample_time_(Constants::RobotController::LOWEST_SAMPLE_TIME),
+measured_sample_time_(0.0)
+{};
+
+bool InputContainer::parseFromArray(const char* data, const int bytes_transferred)
+{
+  has_new_data_ = false;
+
+  if (data)
+  {
+    has_new_data_ = egm_robot_.ParseFromArray(data, bytes_transferred);
+  }
+
+  if (has_new_data_)
+  {
+    first_message_ = (first_call_ || egm_robot_.header().seqno() == 0);
+    first_call_ = false;
+  }
+
+  return has_new_data_;
+}
+
+bool InputContainer::extractParsedInformation(const RobotAxes& axes)
+{
+  bool success = false;
+
+  detectRWAndEGMVersions();
+
+  if (has_new_data_ &&
+      parse(current_.mutable_header(), egm_robot_.header()) &&
+      parse(current_.mutable_feedback(), egm_robot_.feedback(), axes) &&
+      parse(current_.mutable_planned(), egm_robot_.planned(), axes) &&
+      parse(current_.mutable_status(), egm_robot_))
+  {
+    if (first_message_)
+    {
+      initial_.CopyFrom(current_);
+      previous_.CopyFrom(current_);
+    }
+
+    estimated_sample_time_ = estimateSampleTime();
+    success = estimateAllVelocities();
+
+    has_new_data_ = false;
+  }
+
+  return success;
+}
+
+void InputContainer::updatePrevious()
+{
+  previous_.CopyFrom(current_);
+}
+
+bool InputContainer::statesOk() const
+{
+  return (current_.status().motor_state() == wrapper::Status_MotorState_MOTORS_ON &&
+          current_.status().rapid_execution_state() == wrapper::Status_RAPIDExecutionState_RAPID_RUNNING &&
+          current_.status().egm_state() == wrapper::Status_EGMState_EGM_RUNNING);
+}
+
+void InputContainer::storeSession(wrapper::session::BaseSnapshot* p_snapshot) const
+{
+  if (p_snapshot)
+  {
+    p_snapshot->mutable_initial_inputs()->CopyFrom(initial_);
+    p_snapshot->mutable_previous_inputs()->CopyFrom(previous_);
+    p_snapshot->set_estimated_sample_time(estimated_sample_time_);
+  }
+}
+
+void InputContainer::prewarm() const
+{
+  // Note: Computing the sizes reads through all the messages' fields.
+  egm_robot_.ByteSizeLong();
+  current_.ByteSizeLong();
+  previous_.ByteSizeLong();
+}
+
+void InputContainer::restoreSession(const wrapper::session::BaseSnapshot& snapshot)
+{
+  initial_.CopyFrom(snapshot.initial_inputs());
+  previous_.CopyFrom(snapshot.previous_inputs());
+  current_.CopyFrom(snapshot.previous_inputs());
+  estimated_sample_time_ = snapshot.estimated_sample_time();
+  measured_sample_time_ = 0.0;
+  has_new_data_ = false;
+  first_call_ = false;
+  first_message_ = false;
+}
+
+/************************************************************
+ * Auxiliary methods
+ */
+
+void InputContainer::detectRWAndEGMVersions()
+{
+  if(has_new_data_)
+  {
+    // Time field was added in RobotWare '6.07', as well as fix of inconsistent units (e.g. radians and degrees).
+    if(egm_robot_.feedback().has_time())
+    {
+      // If time field present:
+      // - RW greater than or equal to '6.07'.
+      // - EGM protocol '1.1' (with consistent units).
+      current_.mutable_header()->set_egm_version(wrapper::Header_EGMVersion_EGM_1_1);
+
+      // Utilization field was added in RobotWare '6.10'.
+      if(egm_robot_.has_utilizationrate())
+      {
+        // If utilization field present:
+        // - RW greater than or equal to '6.10'.
+        current_.mutable_header()->set_rw_version(wrapper::Header_RWVersion_RW_6_10_AND_NEWER);
+      }
+      else
+      {
+        // If utilization field absent:
+        // - RW between '6.07' and '6.09.02'.
+        current_.mutable_header()->set_rw_version(wrapper::Header_RWVersion_RW_BETWEEN_6_07_AND_6_09_02);
+      }
+    }
+    else
+    {
+      // If time field absent:
+      // - RW between '6.0' and '6.06.03'.
+      // - EGM protocol '1.0' (with inconsistent units).
+      current_.mutable_header()->set_rw_version(wrapper::Header_RWVersion_RW_BETWEEN_6_AND_6_06_03);
+      current_.mutable_header()->set_egm_version(wrapper::Header_EGMVersion_EGM_1_0);
+    }
+  }
+  else
+  {
+    current_.mutable_header()->set_rw_version(wrapper::Header_RWVersion_RW_UNKNOWN);
+    current_.mutable_header()->set_egm_version(wrapper::Header_EGMVersion_EGM_UNKNOWN);
+  }
+}
+
+double InputContainer::estimateSampleTime()
+{
+  double estimate = 0.0;
+  measured_sample_time_ = 0.0;
+
+  if (current_.has_feedback() && previous_.has_feedback() &&
+      current_.feedback().has_time() && previous_.feedback().has_time() &&
+      current_.feedback().time().has_sec() && previous_.feedback().time().has_sec() &&
+      current_.feedback().time().has_usec() && previous_.feedback().time().has_usec())
+  {
+    google::protobuf::uint64 diff_s = (current_.feedback().time().sec() - previous_.feedback().time().sec());
+    google::protobuf::uint64 diff_us = (current_.feedback().time().usec() - previous_.feedback().time().usec());
+    if (diff_s > 0)
+    {
+      diff_us += diff_s*((google::protobuf::uint64) Constants::Conversion::S_TO_US);
+    }
+
+    measured_sample_time_ = ((double) diff_us) / Constants::Conversion::S_TO_US;
+    estimate = std::floor(((double) diff_us) * Constants::Conversion::MS_TO_S) * Constants::Conversion::MS_TO_S;
+  }
+
+  if (estimate < Constants::RobotController::LOWEST_SAMPLE_TIME)
+  {
+    estimate = Constants::RobotController::LOWEST_SAMPLE_TIME;
+  }
+
+  return estimate;
+}
+
+bool InputContainer::estimateAllVelocities()
+{
+  //---------------------------------------------------------
+  // Feedback
+  //---------------------------------------------------------
+  bool success = estimateVelocities(current_.mutable_feedback()->mutable_robot()->mutable_joints()->mutable_velocity(),
+                                    current_.feedback().robot().joints().position(),
+                                    previous_.feedback().robot().joints().position(),
+                                    estimated_sample_time_);
+
+  if (success)
+  {
+    success = estimateVelocities(current_.mutable_feedback()->mutable_robot()->mutable_cartesian()->mutable_velocity(),
+                                 current_.feedback().robot().cartesian().pose(),
+                                 previous_.feedback().robot().cartesian().pose(),
+                                 estimated_sample_time_);
+  }
+
+  if (success)
+  {
+    success = estimateVelocities(current_.mutable_feedback()->mutable_external()->mutable_joints()->mutable_velocity(),
+                                 current_.feedback().external().joints().position(),
+                                 previous_.feedback().external().joints().position(),
+                                 estimated_sample_time_);
+  }
+
+  //---------------------------------------------------------
+  // Planned
+  //---------------------------------------------------------
+  if (success)
+  {
+    success = estimateVelocities(current_.mutable_planned()->mutable_robot()->mutable_joints()->mutable_velocity(),
+                                 current_.planned().robot().joints().position(),
+                                 previous_.planned().robot().joints().position(),
+                                 estimated_sample_time_);
+  }
+
+  if (success)
+  {
+    success = estimateVelocities(current_.mutable_planned()->mutable_robot()->mutable_cartesian()->mutable_velocity(),
+                                 current_.planned().robot().cartesian().pose(),
+                                 previous_.planned().robot().cartesian().pose(),
+                                 estimated_sample_time_);
+  }
+
+  if (success)
+  {
+    success = estimateVelocities(current_.mutable_planned()->mutable_external()->mutable_joints()->mutable_velocity(),
+                                 current_.planned().external().joints().position(),
+                                 previous_.planned().external().joints().position(),
+                                 estimated_sample_time_);
+  }
+
+  return success;
+}
+
+
+
+
+/***********************************************************************************************************************
+ * Class definitions: OutputContainer
+ */
+
+/************************************************************
+ * Primary methods
+ */
+
+OutputContainer::OutputContainer() : sequence_number_(0) {}
+
+void OutputContainer::prepareOutputs(const InputContainer& inputs)
+{
+  sequence_number_ = (inputs.isFirstMessage() ? 0 : sequence_number_ + 1);
+
+  if (inputs.isFirstMessage())
+  {
+    const wrapper::Feedback& feedback = inputs.current().feedback();
+    wrapper::Robot* p_robot = current.mutable_robot();
+    wrapper::External* p_external = current.mutable_external();
+
+    // Joint positions and Cartesian pose.
+    p_robot->mutable_joints()->mutable_position()->CopyFrom(feedback.robot().joints().position());
+    p_robot->mutable_cartesian()->mutable_pose()->CopyFrom(feedback.robot().cartesian().pose());
+    p_external->mutable_joints()->mutable_position()->CopyFrom(feedback.external().joints().position());
+
+    // Joint velocities.
+    p_robot->mutable_joints()->clear_velocity();
+    for (int i = 0; i < feedback.robot().joints().velocity().values_size(); ++i)
+    {
+      p_robot->mutable_joints()->mutable_velocity()->add_values(0.0);
+    }
+
+    p_external->mutable_joints()->clear_velocity();
+    for (int i = 0; i < feedback.external().joints().velocity().values_size(); ++i)
+    {
+      p_external->mutable_joints()->mutable_velocity()->add_values(0.0);
+    }
+
+    // Cartesian velocities.
+    p_robot->mutable_cartesian()->mutable_velocity()->mutable_linear()->set_x(0.0);
+    p_robot->mutable_cartesian()->mutable_velocity()->mutable_linear()->set_y(0.0);
+    p_robot->mutable_cartesian()->mutable_velocity()->mutable_linear()->set_z(0.0);
+    p_robot->mutable_cartesian()->mutable_velocity()->mutable_angular()->set_x(0.0);
+    p_robot->mutable_cartesian()->mutable_velocity()->mutable_angular()->set_y(0.0);
+    p_robot->mutable_cartesian()->mutable_velocity()->mutable_angular()->set_z(0.0);
+
+    previous_.CopyFrom(current);
+  }
+}
+
+void OutputContainer::generateDemoOutputs(const InputContainer& inputs)
+{
+  unsigned int seqno = sequence_number_;                         // Current sequence number.
+  const double TS = inputs.estimatedSampleTime();                // Estimated sample time [s].
+  const double RAMP_IN = 3.0;                                    // Ramp in time [s].
+  unsigned int seqno_ramp_in_end = (unsigned int)(RAMP_IN / TS); // Sequence number when the ramp in is finished [-].
+
+  const wrapper::Feedback& initial_fdb = inputs.initial().feedback();
+  const wrapper::Feedback& current_fdb = inputs.current().feedback();
+
+  wrapper::Joints* rob_pos = current.mutable_robot()->mutable_joints()->mutable_position();
+  wrapper::Joints* rob_vel = current.mutable_robot()->mutable_joints()->mutable_velocity();
+  wrapper::Joints* ext_pos = current.mutable_external()->mutable_joints()->mutable_position();
+  wrapper::Joints* ext_vel = current.mutable_external()->mutable_joints()->mutable_velocity();
+  wrapper::CartesianPose* rob_pose = current.mutable_robot()->mutable_cartesian()->mutable_pose();
+
+  //---------------------------------------------------------
+  // Joint space
+  //---------------------------------------------------------
+  double amplitude = 2.0;
+  double a = amplitude / 2.0;
+  double b = M_PI*TS / RAMP_IN;
+
+  double freq = 0.5;
+  double dist = a*std::cos(b*seqno) - a;
+  double speed_dist = -(a*b)*std::sin(b*seqno) / TS;
+  if (seqno > seqno_ramp_in_end + 1)
+  {
+    dist = -2.0*a*cos(b*(seqno - seqno_ramp_in_end)*freq);
+    speed_dist = 2.0*(a*b)*freq*std::sin(b*(seqno - seqno_ramp_in_end)*freq) / TS;
+  }
+
+  // Robot joints.
+  for (int i = 0; i < current_fdb.robot().joints().position().values_size(); ++i)
+  {
+    rob_pos->set_values(i, initial_fdb.robot().joints().position().values(i) + dist);
+  }
+
+  for (int i = 0; i < current_fdb.robot().joints().velocity().values_size(); ++i)
+  {
+    rob_vel->set_values(i, speed_dist);
+  }
+
+  // External joints.
+  for (int i = 0; i < current_fdb.external().joints().position().values_size(); ++i)
+  {
+    ext_pos->set_values(i, initial_fdb.external().joints().position().values(i) + dist);
+  }
+
+  for (int i = 0; i < current_fdb.external().joints().velocity().values_size(); ++i)
+  {
+    ext_vel->set_values(i, speed_dist);
+  }
+
+  //---------------------------------------------------------
+  // Cartesian space
+  //---------------------------------------------------------
+  amplitude = 200.0;
+  a = amplitude / 2.0;
+  b = M_PI*TS;
+  freq = 0.2;
+
+  double x_dist = a*(std::cos(0.25*b*seqno*freq + M_PI) + 1);
+  double y_dist = x_dist;
+  double z_dist = a / 2.0*(std::cos(0.5*b*seqno*freq + 1.5*M_PI));
+
+  rob_pose->mutable_position()->set_x(initial_fdb.robot().cartesian().pose().position().x() + x_dist);
+  rob_pose->mutable_position()->set_y(initial_fdb.robot().cartesian().pose().position().y() + y_dist);
+  rob_pose->mutable_position()->set_z(initial_fdb.robot().cartesian().pose().position().z() + z_dist);
+
+  double t = 0.5*(std::cos(0.25*b*seqno*freq + M_PI) + 1);
+  generateDemoQuaternions(inputs, t);
+
+  // Demo references for including velocity control.
+  //rob_pose->mutable_position()->set_x(current_fdb.robot().cartesian().pose().position().x());
+  //current.mutable_robot()->mutable_cartesian()->mutable_velocity()->mutable_linear->set_x(-10.0);
+
+  // Demo references for only velocity control.
+  // Note: Need to set PosCorrGain to zero in the RAPID instruction.
+  //current.mutable_robot()->mutable_cartesian()->mutable_velocity()->mutable_linear->set_x(-10.0);
+  //current.mutable_robot()->mutable_cartesian()->mutable_velocity()->mutable_linear->set_y(-10.0);
+  //current.mutable_robot()->mutable_cartesian()->mutable_velocity()->mutable_linear->set_z(-10.0);
+  //current.mutable_robot()->mutable_cartesian()->mutable_velocity()->mutable_angular->set_x(4.0);
+}
+
+void OutputContainer::constructReply(const BaseConfiguration& configuration)
+{
+  // Patch the previous reply in place if possible (straight from the outputs, i.e. without constructing the EGM
+  // sensor message). Otherwise, construct and serialize the message (and record a new template).
+  if (configuration.use_reply_patching && reply_template_.patch(current, configuration, sequence_number_, &reply_))
+  {
+    return;
+  }
+
+  // Note: The EGM sensor message isn't updated while the replies are patched, so it is first brought up to date
+  //       with the latest patched reply (i.e. any fields that aren't constructed are kept as they were sent).
+  if (reply_template_.isValid() && !egm_sensor_.ParseFromString(reply_))
+  {
+    egm_sensor_.Clear();
+  }
+
+  constructHeader();
+  bool success = constructJointBody(configuration);
+
+  if (success && configuration.axes != None)
+  {
+    success = constructCartesianBody(configuration);
+  }
+
+  if (success)
+  {
+    success = egm_sensor_.SerializeToString(&reply_);
+
+    if (success && configuration.use_reply_patching)
+    {
+      reply_template_.build(current, configuration, egm_sensor_, reply_);
+    }
+    else
+    {
+      reply_template_.invalidate();
+    }
+  }
+
+  if (!success)
+  {
+    reply_.clear();
+    reply_template_.invalidate();
+  }
+}
+
+void OutputContainer::storeSession(wrapper::session::BaseSnapshot* p_snapshot) const
+{
+  if (p_snapshot)
+  {
+    p_snapshot->mutable_previous_outputs()->CopyFrom(previous_);
+    p_snapshot->set_sequence_number(sequence_number_);
+  }
+}
+
+void OutputContainer::prewarm() const
+{
+  // Note: Computing the sizes reads through all the messages' fields.
+  egm_sensor_.ByteSizeLong();
+  current.ByteSizeLong();
+  previous_.ByteSizeLong();
+  touch(reply_.data(), reply_.capacity());
+}
+
+void OutputContainer::restoreSession(const wrapper::session::BaseSnapshot& snapshot)
+{
+  previous_.CopyFrom(snapshot.previous_outputs());
+  current.CopyFrom(snapshot.previous_outputs());
+  sequence_number_ = snapshot.sequence_number();
+}
+
+void OutputContainer::updatePrevious()
+{
+  previous_.CopyFrom(current);
+}
+
+/************************************************************
+ * Auxiliary methods
+ */
+
+void OutputContainer::generateDemoQuaternions(const InputContainer& inputs, const double t)
+{
+  // Quaternion demo using Slerp (spherical linear interpolation).
+  // See for example https://en.wikipedia.org/wiki/Slerp for the equations.
+
+  const wrapper::Feedback& initial = inputs.initial().feedback();
+
+  //---------------------------------------------------------
+  // Setup the initial data and the target.
+  //---------------------------------------------------------
+  double q1_u0 = initial.robot().cartesian().pose().quaternion().u0();
+  double q1_u1 = initial.robot().cartesian().pose().quaternion().u1();
+  double q1_u2 = initial.robot().cartesian().pose().quaternion().u2();
+  double q1_u3 = initial.robot().cartesian().pose().quaternion().u3();
+
+  wrapper::Quaternion q;
+  wrapper::Euler e;
+  e.set_x(-90.0);
+  e.set_y(0.0);
+  e.set_z(180);
+  convert(&q, e);
+
+  if (dotProduct(q, initial.robot().cartesian().pose().quaternion()) < 0.0)
+  {
+    q.set_u0(-q.u0());
+    q.set_u1(-q.u1());
+    q.set_u2(-q.u2());
+    q.set_u3(-q.u3());
+  }
+
+  double q2_u0 = q.u0();
+  double q2_u1 = q.u1();
+  double q2_u2 = q.u2();
+  double q2_u3 = q.u3();
+
+  //---------------------------------------------------------
+  // Calculate the Slerp.
+  //---------------------------------------------------------
+  double dot_prod = q1_u0*q2_u0 + q1_u1*q2_u1 + q1_u2*q2_u2 + q1_u3*q2_u3;
+
+  double omega = acos(dot_prod);
+  double k = 1.0 / sin(omega);
+
+  double a = sin((1 - t)*omega)*k;
+  double b = sin(t*omega)*k;
+
+  double q3_u0 = a*q1_u0 + b*q2_u0;
+  double q3_u1 = a*q1_u1 + b*q2_u1;
+  double q3_u2 = a*q1_u2 + b*q2_u2;
+  double q3_u3 = a*q1_u3 + b*q2_u3;
+
+  //---------------------------------------------------------
+  // Normalize and set the references.
+  //---------------------------------------------------------
+  double norm = sqrt(q3_u0*q3_u0 + q3_u1*q3_u1 + q3_u2*q3_u2 + q3_u3*q3_u3);
+
+  current.mutable_robot()->mutable_cartesian()->mutable_pose()->mutable_quaternion()->set_u0(q3_u0 / norm);
+  current.mutable_robot()->mutable_cartesian()->mutable_pose()->mutable_quaternion()->set_u1(q3_u1 / norm);
+  current.mutable_robot()->mutable_cartesian()->mutable_pose()->mutable_quaternion()->set_u2(q3_u2 / norm);
+  current.mutable_robot()->mutable_cartesian()->mutable_pose()->mutable_quaternion()->set_u3(q3_u3 / norm);
+
+  convert(current.mutable_robot()->mutable_cartesian()->mutable_pose()->mutable_euler(),
+          current.robot().cartesian().pose().quaternion());
+}
+
+void OutputContainer::constructHeader()
+{
+  egm_sensor_.mutable_header()->set_seqno((google::protobuf::uint32) sequence_number_);
+  egm_sensor_.mutable_header()->set_tm((google::protobuf::uint32) 0);
+  egm_sensor_.mutable_header()->set_mtype(EgmHeader_MessageType_MSGTYPE_CORRECTION);
+}
+
+bool OutputContainer::constructJointBody(const BaseConfiguration& configuration)
+{
+  bool position_ok = false;
+  bool speed_ok = !configuration.use_velocity_outputs;
+
+  int rob_condition = Constants::RobotController::DEFAULT_NUMBER_OF_ROBOT_JOINTS;
+  int ext_condition = Constants::RobotController::DEFAULT_NUMBER_OF_EXTERNAL_JOINTS;
+
+  if (current.robot().joints().has_position())
+  {
+    // Outputs.
+    const wrapper::Joints& robot_position = current.robot().joints().position();
+    const wrapper::Joints& external_position = current.external().joints().position();
+
+    // Verify that there are no NaN or infinity values.
+    if(!verify(robot_position) || !verify(external_position))
+    {
+      return false;
+    }
+
+    // EGM sensor message.
+    EgmPlanned* planned = egm_sensor_.mutable_planned();
+    planned->clear_joints();
+    planned->clear_externaljoints();
+
+    switch (configuration.axes)
+    {
+      case None:
+      {
+        if (robot_position.values_size() == 0)
+        {
+          for (int i = 0; i < external_position.values_size() && i < ext_condition; ++i)
+          {
+            planned->mutable_externaljoints()->add_joints(external_position.values(i));
+          }
+
+          position_ok = true;
+        }
+      }
+      break;
+
+      case Six:
+      {
+        if (robot_position.values_size() == rob_condition)
+        {
+          for (int i = 0; i < robot_position.values_size(); ++i)
+          {
+            planned->mutable_joints()->add_joints(robot_position.values(i));
+          }
+
+          for (int i = 0; i < external_position.values_size() && i < ext_condition; ++i)
+          {
+            planned->mutable_externaljoints()->add_joints(external_position.values(i));
+          }
+
+          position_ok = true;
+        }
+      }
+      break;
+
+      case Seven:
+      {
+        // If using a seven axes robot (e.g. IRB14000): Map to special case.
+        if (robot_position.values_size() == rob_condition + 1)
+        {
+          planned->mutable_joints()->add_joints(robot_position.values(0));
+          planned->mutable_joints()->add_joints(robot_position.values(1));
+          planned->mutable_joints()->add_joints(robot_position.values(3));
+          planned->mutable_joints()->add_joints(robot_position.values(4));
+          planned->mutable_joints()->add_joints(robot_position.values(5));
+          planned->mutable_joints()->add_joints(robot_position.values(6));
+          planned->mutable_externaljoints()->add_joints(robot_position.values(2));
+
+          for (int i = 0; i < external_position.values_size() && i < ext_condition - 1; ++i)
+          {
+            planned->mutable_externaljoints()->add_joints(external_position.values(i));
+          }
+
+          position_ok = true;
+        }
+      }
+      break;
+    }
+  }
+
+  if (configuration.use_velocity_outputs && current.robot().joints().has_velocity())
+  {
+    // Outputs.
+    const wrapper::Joints& robot_velocity = current.robot().joints().velocity();
+    const wrapper::Joints& external_velocity = current.external().joints().velocity();
+
+    // Verify that there are no NaN or infinity values.
+    if(!verify(robot_velocity) || !verify(external_velocity))
+    {
+      return false;
+    }
+
+    // EGM sensor message.
+    EgmSpeedRef* speed_reference = egm_sensor_.mutable_speedref();
+    speed_reference->clear_joints();
+    speed_reference->clear_externaljoints();
+
+    switch (configuration.axes)
+    {
+      case Six:
+      {
+        if (robot_velocity.values_size() == rob_condition)
+        {
+          for (int i = 0; i < robot_velocity.values_size(); ++i)
+          {
+            speed_reference->mutable_joints()->add_joints(robot_velocity.values(i));
+          }
+
+          for (int i = 0; i < external_velocity.values_size() && i < ext_condition; ++i)
+          {
+            speed_reference->mutable_externaljoints()->add_joints(external_velocity.values(i));
+          }
+
+          speed_ok = true;
+        }
+      }
+      break;
+
+      case Seven:
+      {
+        // If using a seven axes robot (e.g. IRB14000): Map to special case.
+        if (robot_velocity.values_size() == rob_condition + 1)
+        {
+          speed_reference->mutable_joints()->add_joints(robot_velocity.values(0));
+          speed_reference->mutable_joints()->add_joints(robot_velocity.values(1));
+          speed_reference->mutable_joints()->add_joints(robot_velocity.values(3));
+          speed_reference->mutable_joints()->add_joints(robot_velocity.values(4));
+          speed_reference->mutable_joints()->add_joints(robot_velocity.values(5));
+          speed_reference->mutable_joints()->add_joints(robot_velocity.values(6));
+          speed_reference->mutable_externaljoints()->add_joints(robot_velocity.values(2));
+
+          for (int i = 0; i < external_velocity.values_size() && i < ext_condition - 1; ++i)
+          {
+            speed_reference->mutable_externaljoints()->add_joints(external_velocity.values(i));
+          }
+
+          speed_ok = true;
+        }
+      }
+      break;
+    }
+  }
+
+  return (position_ok && speed_ok);
+}
+
+bool OutputContainer::constructCartesianBody(const BaseConfiguration& configuration)
+{
+  bool position_ok = false;
+  bool speed_ok = !configuration.use_velocity_outputs;
+
+  if (current.robot().cartesian().has_pose())
+  {
+    // Outputs.
+    const wrapper::CartesianPose& pose = current.robot().cartesian().pose();;
+
+    // Verify that there are no NaN or infinity values.
+    if(!verify(pose))
+    {
+      return false;
+    }
+
+    // EGM sensor message.
+    EgmPlanned* planned = egm_sensor_.mutable_planned();
+    planned->clear_cartesian();
+
+    if (pose.has_position())
+    {
+      planned->mutable_cartesian()->mutable_pos()->set_x(pose.position().x());
+      planned->mutable_cartesian()->mutable_pos()->set_y(pose.position().y());
+      planned->mutable_cartesian()->mutable_pos()->set_z(pose.position().z());
+    }
+
+    if (pose.has_euler())
+    {
+      planned->mutable_cartesian()->mutable_euler()->set_x(pose.euler().x());
+      planned->mutable_cartesian()->mutable_euler()->set_y(pose.euler().y());
+      planned->mutable_cartesian()->mutable_euler()->set_z(pose.euler().z());
+    }
+
+    if (pose.has_quaternion())
+    {
+      planned->mutable_cartesian()->mutable_orient()->set_u0(pose.quaternion().u0());
+      planned->mutable_cartesian()->mutable_orient()->set_u1(pose.quaternion().u1());
+      planned->mutable_cartesian()->mutable_orient()->set_u2(pose.quaternion().u2());
+      planned->mutable_cartesian()->mutable_orient()->set_u3(pose.quaternion().u3());
+    }
+
+    position_ok = true;
+  }
+
+  if (configuration.use_velocity_outputs && current.robot().cartesian().has_velocity())
+  {
+    // References.
+    const wrapper::CartesianVelocity& velocity = current.robot().cartesian().velocity();
+
+    // Verify that there are no NaN or infinity values.
+    if(!verify(velocity))
+    {
+      return false;
+    }
+
+    // EGM sensor message.
+    EgmSpeedRef* speed_reference = egm_sensor_.mutable_speedref();
+    speed_reference->clear_cartesians();
+
+    if (velocity.has_linear())
+    {
+      speed_reference->mutable_cartesians()->add_value(velocity.linear().x());
+      speed_reference->mutable_cartesians()->add_value(velocity.linear().y());
+      speed_reference->mutable_cartesians()->add_value(velocity.linear().z());
+    }
+    else
+    {
+      speed_reference->mutable_cartesians()->add_value(0.0);
+      speed_reference->mutable_cartesians()->add_value(0.0);
+      speed_reference->mutable_cartesians()->add_value(0.0);
+    }
+
+    if (velocity.has_angular())
+    {
+      speed_reference->mutable_cartesians()->add_value(velocity.angular().x());
+      speed_reference->mutable_cartesians()->add_value(velocity.angular().y());
+      speed_reference->mutable_cartesians()->add_value(velocity.angular().z());
+    }
+    else
+    {
+      speed_reference->mutable_cartesians()->add_value(0.0);
+      speed_reference->mutable_cartesians()->add_value(0.0);
+      speed_reference->mutable_cartesians()->add_value(0.0);
+    }
+
+    speed_ok = true;
+  }
+
+  return (position_ok && speed_ok);
+}
+
+
+
+
+/***********************************************************************************************************************
+ * Class definitions: OutputContainer::ReplyTemplate
+ */
+
+/************************************************************
+ * Primary methods
+ */
+
+void OutputContainer::ReplyTemplate::build(const wrapper::Output& outputs,
+                                           const BaseConfiguration& configuration,
+                                           const EgmSensor& egm_sensor,
+                                           const std::string& reply)
+{
+  std::vector<double> sensor_values;
+
+  offsets_.clear();
+  seqno_offset_ = 0;
+  seqno_length_ = 0;
+
+  valid_ = gather(outputs, configuration, &shape_, &values_) &&
+           collect(egm_sensor, &sensor_values) &&
+           scanReply(reply, 0, reply.size(), 0, false, &offsets_, &seqno_offset_, &seqno_length_) &&
+           egm_sensor.header().has_seqno() && seqno_length_ > 0 &&
+           offsets_.size() == values_.size() && sensor_values.size() == values_.size();
+
+  // Verify that the gathered values are the message's values (i.e. in the serialization order, and that the message
+  // has no other values), and that the recorded offsets contain them (e.g. fails on big-endian hosts).
+  for (size_t i = 0; valid_ && i < offsets_.size(); ++i)
+  {
+    valid_ = (std::memcmp(&sensor_values[i], &values_[i], sizeof(double)) == 0 &&
+              std::memcmp(reply.data() + offsets_[i], &values_[i], sizeof(double)) == 0);
+  }
+}
+
+bool OutputContainer::ReplyTemplate::patch(const wrapper::Output& outputs,
+                                           const BaseConfiguration& configuration,
+                                           const unsigned int sequence_number,
+                                           std::string* p_reply)
+{
+  if (!valid_ || !p_reply || !gather(outputs, configuration, &new_shape_, &new_values_) || new_shape_ != shape_)
+  {
+    return false;
+  }
+
+  google::protobuf::uint8 seqno[5];
+
+  if (encodeVarint((google::protobuf::uint32) sequence_number, seqno) != seqno_length_)
+  {
+    return false;
+  }
+
+  std::memcpy(&(*p_reply)[seqno_offset_], seqno, seqno_length_);
+
+  // Only overwrite the values that have changed (bitwise, so that e.g. the sign of zeros is kept).
+  for (size_t i = 0; i < new_values_.size(); ++i)
+  {
+    if (std::memcmp(&new_values_[i], &values_[i], sizeof(double)) != 0)
+    {
+      std::memcpy(&(*p_reply)[offsets_[i]], &new_values_[i], sizeof(double));
+      values_[i] = new_values_[i];
+    }
+  }
+
+  return true;
+}
+
+/************************************************************
+ * Auxiliary methods
+ */
+
+bool OutputContainer::ReplyTemplate::gather(const wrapper::Output& outputs,
+                                            const BaseConfiguration& configuration,
+                                            std::vector<int>* p_shape,
+                                            std::vector<double>* p_values)
+{
+  p_shape->clear();
+  p_values->clear();
+
+  const RobotAxes axes = configuration.axes;
+  const bool use_velocity_outputs = configuration.use_velocity_outputs;
+  const int robot_joints = (axes == None ? 0 : (int) axes);
+
+  const wrapper::Joints& robot_position = outputs.robot().joints().position();
+  const wrapper::Joints& external_position = outputs.external().joints().position();
+  const wrapper::Joints& robot_velocity = outputs.robot().joints().velocity();
+  const wrapper::Joints& external_velocity = outputs.external().joints().velocity();
+  const wrapper::CartesianPose& pose = outputs.robot().cartesian().pose();
+  const wrapper::CartesianVelocity& velocity = outputs.robot().cartesian().velocity();
+
+  // Only outputs that the EGM sensor message can be constructed from are gathered (i.e. the same conditions).
+  if (!outputs.robot().joints().has_position() || robot_position.values_size() != robot_joints ||
+      !verify(robot_position) || !verify(external_position))
+  {
+    return false;
+  }
+
+  if (use_velocity_outputs &&
+      (axes == None || !outputs.robot().joints().has_velocity() || robot_velocity.values_size() != robot_joints ||
+       !verify(robot_velocity) || !verify(external_velocity)))
+  {
+    return false;
+  }
+
+  if (axes != None &&
+      (!outputs.robot().cartesian().has_pose() || !verify(pose) ||
+       (use_velocity_outputs && (!outputs.robot().cartesian().has_velocity() || !verify(velocity)))))
+  {
+    return false;
+  }
+
+  // The shape (i.e. everything that decides which fields are constructed, and their number of values).
+  p_shape->push_back((int) axes);
+  p_shape->push_back(use_velocity_outputs);
+  p_shape->push_back(external_position.values_size());
+  p_shape->push_back(use_velocity_outputs ? external_velocity.values_size() : -1);
+  p_shape->push_back(axes != None && pose.has_position());
+  p_shape->push_back(axes != None && pose.has_quaternion());
+  p_shape->push_back(axes != None && pose.has_euler());
+
+  // Planned (in field number order, which is the serialization order).
+  appendRobotJoints(robot_position, axes, p_values);
+
+  if (axes != None && pose.has_position())
+  {
+    p_values->push_back(pose.position().x());
+    p_values->push_back(pose.position().y());
+    p_values->push_back(pose.position().z());
+  }
+
+  if (axes != None && pose.has_quaternion())
+  {
+    p_values->push_back(pose.quaternion().u0());
+    p_values->push_back(pose.quaternion().u1());
+    p_values->push_back(pose.quaternion().u2());
+    p_values->push_back(pose.quaternion().u3());
+  }
+
+  if (axes != None && pose.has_euler())
+  {
+    p_values->push_back(pose.euler().x());
+    p_values->push_back(pose.euler().y());
+    p_values->push_back(pose.euler().z());
+  }
+
+  appendExternalJoints(robot_position, external_position, axes, p_values);
+
+  // Speed references (missing Cartesian velocity components are sent as zeros).
+  if (use_velocity_outputs)
+  {
+    appendRobotJoints(robot_velocity, axes, p_values);
+
+    p_values->push_back(velocity.has_linear() ? velocity.linear().x() : 0.0);
+    p_values->push_back(velocity.has_linear() ? velocity.linear().y() : 0.0);
+    p_values->push_back(velocity.has_linear() ? velocity.linear().z() : 0.0);
+    p_values->push_back(velocity.has_angular() ? velocity.angular().x() : 0.0);
+    p_values->push_back(velocity.has_angular() ? velocity.angular().y() : 0.0);
+    p_values->push_back(velocity.has_angular() ? velocity.angular().z() : 0.0);
+
+    appendExternalJoints(robot_velocity, external_velocity, axes, p_values);
+  }
+
+  return true;
+}
+
+bool OutputContainer::ReplyTemplate::collect(const EgmSensor& egm_sensor, std::vector<double>* p_values)
+{
+  p_values->clear();
+
+  // Planned (in field number order, which is the serialization order).
+  const EgmPlanned& planned = egm_sensor.planned();
+  p_values->insert(p_values->end(), planned.joints().joints().begin(), planned.joints().joints().end());
+
+  const EgmPose& pose = planned.cartesian();
+
+  if (pose.has_pos())
+  {
+    p_values->push_back(pose.pos().x());
+    p_values->push_back(pose.pos().y());
+    p_values->push_back(pose.pos().z());
+  }
+
+  if (pose.has_orient())
+  {
+    p_values->push_back(pose.orient().u0());
+    p_values->push_back(pose.orient().u1());
+    p_values->push_back(pose.orient().u2());
+    p_values->push_back(pose.orient().u3());
+  }
+
+  if (pose.has_euler())
+  {
+    p_values->push_back(pose.euler().x());
+    p_values->push_back(pose.euler().y());
+    p_values->push_back(pose.euler().z());
+  }
+
+  p_values->insert(p_values->end(),
+                   planned.externaljoints().joints().begin(), planned.externaljoints().joints().end());
+
+  // Speed references.
+  const EgmSpeedRef& speed_reference = egm_sensor.speedref();
+  p_values->insert(p_values->end(),
+                   speed_reference.joints().joints().begin(), speed_reference.joints().joints().end());
+  p_values->insert(p_values->end(),
+                   speed_reference.cartesians().value().begin(), speed_reference.cartesians().value().end());
+  p_values->insert(p_values->end(),
+                   speed_reference.externaljoints().joints().begin(),
+                   speed_reference.externaljoints().joints().end());
+
+  // Time stamps (varints) can't be patched.
+  return !planned.has_time();
+}
+
+} // end namespace egm
+} // end namespace abb
@@ -1031,5 +1031,28 @@ bool verify(const wrapper::CartesianVelocity& velocity)
   return true;
 }
 
+/***********************************************************************************************************************
+ * Memory functions
+ */
+
+void touch(const void* p_data, const size_t bytes)
+{
+  const size_t cache_line_size = 64;
+  const volatile char* p_bytes = static_cast<const volatile char*>(p_data);
+
+  if (p_bytes)
+  {
+    for (size_t i = 0; i < bytes; i += cache_line_size)
+    {
+      (void) p_bytes[i];
+    }
+
+    if (bytes > 0)
+    {
+      (void) p_bytes[bytes - 1];
+    }
+  }
+}
+
 } // end namespace egm
 } // end namespace abb
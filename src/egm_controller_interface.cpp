@@ -47,6 +47,8 @@ namespace egm
  * Class definitions: EGMControllerInterface::ControllerMotion
  */
 
+const unsigned int EGMControllerInterface::ControllerMotion::WRITE_TIMEOUT_MS;
+
 /************************************************************
  * Primary methods
  */
@@ -157,44 +159,55 @@ EGMBaseInterface(io_service, port_number, configuration)
 
 const std::string& EGMControllerInterface::callback(const UDPServerData& server_data)
 {
+  MetricsCollector::CallbackScope callback_scope(metrics_);
+
   // Initialize the callback by:
   // - Parsing and extracting data from the recieved message.
   // - Updating any pending configuration changes.
   // - Preparing the outputs.
   if (initializeCallback(server_data))
   {
-    // Additional initialization for direct motion references.
-    controller_motion_.initialize(inputs_.isFirstMessage());
-
-    // Handle demo execution or external controller execution.
-    if (configuration_.active.use_demo_outputs)
-    {
-      outputs_.generateDemoOutputs(inputs_);
-    }
-    else
     {
-      // Make the current inputs available (to the external control loop), and notify that it is available.
-      controller_motion_.writeInputs(inputs_.current());
+      MetricsCollector::StageScope stage_scope(metrics_, Metrics::Generate);
 
-      if (inputs_.isFirstMessage() || inputs_.statesOk())
+      // Additional initialization for direct motion references.
+      controller_motion_.initialize(inputs_.isFirstMessage());
+
+      // Handle demo execution or external controller execution.
+      if (configuration_.active.use_demo_outputs)
+      {
+        outputs_.generateDemoOutputs(inputs_);
+      }
+      else
       {
-        // Wait for new outputs (from the external control loop), or until a timeout occurs.
-        controller_motion_.readOutputs(&outputs_.current);
+        // Make the current inputs available (to the external control loop), and notify that it is available.
+        controller_motion_.writeInputs(inputs_.current());
+
+        if (inputs_.isFirstMessage() || inputs_.statesOk())
+        {
+          // Wait for new outputs (from the external control loop), or until a timeout occurs.
+          controller_motion_.readOutputs(&outputs_.current);
+        }
       }
     }
 
     // Log inputs and outputs, if set to do so.
     if (configuration_.active.use_logging && p_logger_)
     {
+      MetricsCollector::StageScope stage_scope(metrics_, Metrics::Log);
       logData(inputs_, outputs_, configuration_.active.max_logging_duration);
     }
 
-    // Constuct the reply message.
-    outputs_.constructReply(configuration_.active);
+    {
+      MetricsCollector::StageScope stage_scope(metrics_, Metrics::Reply);
+
+      // Constuct the reply message.
+      outputs_.constructReply(configuration_.active);
 
-    // Prepare for the next callback.
-    inputs_.updatePrevious();
-    outputs_.updatePrevious();
+      // Prepare for the next callback.
+      inputs_.updatePrevious();
+      outputs_.updatePrevious();
+    }
   }
 
   // Return the reply.
@@ -45,6 +45,33 @@ namespace abb
 {
 namespace egm
 {
+namespace
+{
+/**
+ * \brief Integrate the product of two cubic polynomials, from zero to a duration.
+ *
+ * \param p specifying the first polynomial's coefficients (in ascending order).
+ * \param q specifying the second polynomial's coefficients (in ascending order).
+ * \param duration specifying the upper integration limit.
+ *
+ * \return double containing the integral.
+ */
+double integrateProduct(const double* p, const double* q, const double duration)
+{
+  double result = 0.0;
+
+  for (int i = 0; i < 4; ++i)
+  {
+    for (int j = 0; j < 4; ++j)
+    {
+      result += p[i]*q[j]*std::pow(duration, i + j + 1) / (i + j + 1);
+    }
+  }
+
+  return result;
+}
+} // end anonymous namespace
+
 /***********************************************************************************************************************
  * Class definitions: EGMInterpolator::SplineConditions
  */
@@ -63,6 +90,10 @@ void EGMInterpolator::SplineConditions::setConditions(const int index,
   beta    = goal.position().values(index);
   d_beta  = goal.velocity().values(index);
   dd_beta = goal.acceleration().values(index);
+
+  // Note: Jerk values are optional, and assumed to be zero if they are missing.
+  ddd_alfa = (index < start.jerk().values_size() ? start.jerk().values(index) : 0.0);
+  ddd_beta = (index < goal.jerk().values_size() ? goal.jerk().values(index) : 0.0);
 }
 
 void EGMInterpolator::SplineConditions::setConditions(const EGMInterpolator::Axis axis,
@@ -79,6 +110,8 @@ void EGMInterpolator::SplineConditions::setConditions(const EGMInterpolator::Axi
       beta    = goal.pose().position().x();
       d_beta  = goal.velocity().x();
       dd_beta = goal.acceleration().x();
+      ddd_alfa = start.jerk().x();
+      ddd_beta = goal.jerk().x();
     }
     break;
 
@@ -90,6 +123,8 @@ void EGMInterpolator::SplineConditions::setConditions(const EGMInterpolator::Axi
       beta = goal.pose().position().y();
       d_beta = goal.velocity().y();
       dd_beta = goal.acceleration().y();
+      ddd_alfa = start.jerk().y();
+      ddd_beta = goal.jerk().y();
     }
     break;
 
@@ -101,6 +136,8 @@ void EGMInterpolator::SplineConditions::setConditions(const EGMInterpolator::Axi
       beta = goal.pose().position().z();
       d_beta = goal.velocity().z();
       dd_beta = goal.acceleration().z();
+      ddd_alfa = start.jerk().z();
+      ddd_beta = goal.jerk().z();
     }
     break;
   }
@@ -126,12 +163,15 @@ void EGMInterpolator::SplinePolynomial::update(const SplineConditions& condition
   double c1 = 0.0;
   double c2 = 0.0;
   double c3 = 0.0;
-  double alfa    = conditions.alfa;
-  double d_alfa  = conditions.d_alfa;
-  double dd_alfa = conditions.dd_alfa;
-  double beta    = conditions.beta;
-  double d_beta  = conditions.d_beta;
-  double dd_beta = conditions.dd_beta;
+  double c4 = 0.0;
+  double alfa     = conditions.alfa;
+  double d_alfa   = conditions.d_alfa;
+  double dd_alfa  = conditions.dd_alfa;
+  double ddd_alfa = conditions.ddd_alfa;
+  double beta     = conditions.beta;
+  double d_beta   = conditions.d_beta;
+  double dd_beta  = conditions.dd_beta;
+  double ddd_beta = conditions.ddd_beta;
 
   if (conditions.do_ramp_down)
   {
@@ -159,6 +199,8 @@ void EGMInterpolator::SplinePolynomial::update(const SplineConditions& condition
     d_ = (-c_)/(3.0*T);
     e_ = 0.0;
     f_ = 0.0;
+    g_ = 0.0;
+    h_ = 0.0;
   }
   else
   {
@@ -184,6 +226,8 @@ void EGMInterpolator::SplinePolynomial::update(const SplineConditions& condition
         d_ = 0.0;
         e_ = 0.0;
         f_ = 0.0;
+        g_ = 0.0;
+        h_ = 0.0;
       }
       break;
 
@@ -209,6 +253,8 @@ void EGMInterpolator::SplinePolynomial::update(const SplineConditions& condition
         d_ = 0.0;
         e_ = 0.0;
         f_ = 0.0;
+        g_ = 0.0;
+        h_ = 0.0;
       }
       break;
 
@@ -239,6 +285,8 @@ void EGMInterpolator::SplinePolynomial::update(const SplineConditions& condition
         d_ = c1 / std::pow(T, 3) - c_ / T;
         e_ = 0.0;
         f_ = 0.0;
+        g_ = 0.0;
+        h_ = 0.0;
       }
       break;
 
@@ -272,6 +320,51 @@ void EGMInterpolator::SplinePolynomial::update(const SplineConditions& condition
         d_ = 10.0*c1 / std::pow(T, 3) - 4.0 * c2 / std::pow(T, 2) + c3 / (2.0*T);
         e_ = 5.0*c1 / std::pow(T, 4) - c2 / std::pow(T, 3) - 2.0*d_ / T;
         f_ = c1 / std::pow(T, 5) - d_ / std::pow(T, 2) - e_ / T;
+        g_ = 0.0;
+        h_ = 0.0;
+      }
+      break;
+
+      case TrajectoryConfiguration::Septic:
+      {
+        //---------------------------------------------------------------
+        // Calculate the spline polynomial coefficients for:
+        // S(t) = A + B*t + C*t^2 + D*t^3 + E*t^4 + F*t^5 + G*t^6 + H*t^7
+        //
+        //---------------------
+        // Conditions:
+        //---------------------
+        // 0 <= t <= T
+        //
+        // S(0) = alfa
+        // d_S(0) = d_alfa
+        // dd_S(0) = dd_alfa
+        // ddd_S(0) = ddd_alfa
+        //
+        // S(T) = beta
+        // d_S(T) = d_beta
+        // dd_S(T) = dd_beta
+        // ddd_S(T) = ddd_beta
+        //---------------------------------------------------------------
+        const double T2 = T*T;
+        const double T3 = T2*T;
+        const double T4 = T3*T;
+
+        a_ = alfa;
+        b_ = d_alfa;
+        c_ = dd_alfa / 2.0;
+        d_ = ddd_alfa / 6.0;
+
+        // Differences between the goal conditions and the start conditions' Taylor expansions (scaled with T).
+        c1 = beta - alfa - d_alfa*T - (dd_alfa / 2.0)*T2 - (ddd_alfa / 6.0)*T3;
+        c2 = (d_beta - d_alfa - dd_alfa*T - (ddd_alfa / 2.0)*T2)*T;
+        c3 = (dd_beta - dd_alfa - ddd_alfa*T)*T2;
+        c4 = (ddd_beta - ddd_alfa)*T3;
+
+        e_ = (35.0*c1 - 15.0*c2 + 2.5*c3 - c4 / 6.0) / T4;
+        f_ = (-84.0*c1 + 39.0*c2 - 7.0*c3 + c4 / 2.0) / (T4*T);
+        g_ = (70.0*c1 - 34.0*c2 + 6.5*c3 - c4 / 2.0) / (T4*T2);
+        h_ = (-20.0*c1 + 10.0*c2 - 2.0*c3 + c4 / 6.0) / (T4*T3);
       }
       break;
     }
@@ -284,15 +377,22 @@ void EGMInterpolator::SplinePolynomial::evaluate(wrapper::trajectory::JointGoal*
 {
   //---------------------------------------------------------------
   // Evaluate:
-  //   S(t) = A + B*t + C*t^2 + D*t^3 + E*t^4 + F*t^5
-  //   S_prime(t) = B + 2C*t + 3D*t^2 + 4E*t^3 + 5F*t^4
-  //   S_bis(t) = 2C + 6D*t + 12E*t^2 + 20F*t^3
+  //   S(t) = A + B*t + C*t^2 + D*t^3 + E*t^4 + F*t^5 + G*t^6 + H*t^7
+  //   S_prime(t) = B + 2C*t + 3D*t^2 + 4E*t^3 + 5F*t^4 + 6G*t^5 + 7H*t^6
+  //   S_bis(t) = 2C + 6D*t + 12E*t^2 + 20F*t^3 + 30G*t^4 + 42H*t^5
+  //   S_ter(t) = 6D + 24E*t + 60F*t^2 + 120G*t^3 + 210H*t^4
   //
   // Condition: 0 <= t <= T
   //---------------------------------------------------------------
   p_output->mutable_position()->set_values(index, calculatePosition(t));
   p_output->mutable_velocity()->set_values(index, calculateVelocity(t));
   p_output->mutable_acceleration()->set_values(index, calculateAcceleration(t));
+
+  // Note: The jerk is only evaluated if the output has room for it.
+  if (index < p_output->jerk().values_size())
+  {
+    p_output->mutable_jerk()->set_values(index, calculateJerk(t));
+  }
 }
 
 void EGMInterpolator::SplinePolynomial::evaluate(wrapper::trajectory::CartesianGoal* p_output,
@@ -301,12 +401,15 @@ void EGMInterpolator::SplinePolynomial::evaluate(wrapper::trajectory::CartesianG
 {
   //---------------------------------------------------------------
   // Evaluate:
-  //   S(t) = A + B*t + C*t^2 + D*t^3 + E*t^4 + F*t^5
-  //   S_prime(t) = B + 2C*t + 3D*t^2 + 4E*t^3 + 5F*t^4
-  //   S_bis(t) = 2C + 6D*t + 12E*t^2 + 20F*t^3
+  //   S(t) = A + B*t + C*t^2 + D*t^3 + E*t^4 + F*t^5 + G*t^6 + H*t^7
+  //   S_prime(t) = B + 2C*t + 3D*t^2 + 4E*t^3 + 5F*t^4 + 6G*t^5 + 7H*t^6
+  //   S_bis(t) = 2C + 6D*t + 12E*t^2 + 20F*t^3 + 30G*t^4 + 42H*t^5
+  //   S_ter(t) = 6D + 24E*t + 60F*t^2 + 120G*t^3 + 210H*t^4
   //
   // Condition: 0 <= t <= T
   //---------------------------------------------------------------
+  const bool has_jerk = p_output->has_jerk();
+
   switch (axis)
   {
     case X:
@@ -314,6 +417,10 @@ void EGMInterpolator::SplinePolynomial::evaluate(wrapper::trajectory::CartesianG
       p_output->mutable_pose()->mutable_position()->set_x(calculatePosition(t));
       p_output->mutable_velocity()->set_x(calculateVelocity(t));
       p_output->mutable_acceleration()->set_x(calculateAcceleration(t));
+      if (has_jerk)
+      {
+        p_output->mutable_jerk()->set_x(calculateJerk(t));
+      }
     }
     break;
 
@@ -322,6 +429,10 @@ void EGMInterpolator::SplinePolynomial::evaluate(wrapper::trajectory::CartesianG
       p_output->mutable_pose()->mutable_position()->set_y(calculatePosition(t));
       p_output->mutable_velocity()->set_y(calculateVelocity(t));
       p_output->mutable_acceleration()->set_y(calculateAcceleration(t));
+      if (has_jerk)
+      {
+        p_output->mutable_jerk()->set_y(calculateJerk(t));
+      }
     }
     break;
 
@@ -330,6 +441,10 @@ void EGMInterpolator::SplinePolynomial::evaluate(wrapper::trajectory::CartesianG
       p_output->mutable_pose()->mutable_position()->set_z(calculatePosition(t));
       p_output->mutable_velocity()->set_z(calculateVelocity(t));
       p_output->mutable_acceleration()->set_z(calculateAcceleration(t));
+      if (has_jerk)
+      {
+        p_output->mutable_jerk()->set_z(calculateJerk(t));
+      }
     }
     break;
   }
@@ -691,6 +806,72 @@ void EGMInterpolator::SoftRamp::evaluate(wrapper::trajectory::CartesianGoal* p_o
  * Primary methods
  */
 
+double EGMInterpolator::calculateMinimumSnapJerk(const BoundaryValues& start,
+                                                 const BoundaryValues& middle,
+                                                 const BoundaryValues& goal,
+                                                 const double first_duration,
+                                                 const double second_duration)
+{
+  if (first_duration <= 0.0 || second_duration <= 0.0)
+  {
+    return 0.0;
+  }
+
+  Conditions conditions;
+  conditions.spline_method = TrajectoryConfiguration::Septic;
+
+  conditions.duration = first_duration;
+  SplineConditions first(conditions);
+  first.alfa = start.position;
+  first.d_alfa = start.velocity;
+  first.dd_alfa = start.acceleration;
+  first.ddd_alfa = start.jerk;
+  first.beta = middle.position;
+  first.d_beta = middle.velocity;
+  first.dd_beta = middle.acceleration;
+
+  conditions.duration = second_duration;
+  SplineConditions second(conditions);
+  second.alfa = middle.position;
+  second.d_alfa = middle.velocity;
+  second.dd_alfa = middle.acceleration;
+  second.beta = goal.position;
+  second.d_beta = goal.velocity;
+  second.dd_beta = goal.acceleration;
+  second.ddd_beta = goal.jerk;
+
+  // The snap of each segment is s(t) + jerk*g(t), where s is the snap with zero jerk at the interior point.
+  // I.e. g is found as the difference between the snaps with unit jerk and zero jerk.
+  SplinePolynomial polynomial;
+  double s1[4], g1[4], s2[4], g2[4];
+
+  first.ddd_beta = 0.0;
+  polynomial.update(first);
+  polynomial.getSnapCoefficients(s1);
+  first.ddd_beta = 1.0;
+  polynomial.update(first);
+  polynomial.getSnapCoefficients(g1);
+
+  second.ddd_alfa = 0.0;
+  polynomial.update(second);
+  polynomial.getSnapCoefficients(s2);
+  second.ddd_alfa = 1.0;
+  polynomial.update(second);
+  polynomial.getSnapCoefficients(g2);
+
+  for (int i = 0; i < 4; ++i)
+  {
+    g1[i] -= s1[i];
+    g2[i] -= s2[i];
+  }
+
+  // Minimize the integral of (s1 + jerk*g1)^2 over the first segment, plus (s2 + jerk*g2)^2 over the second segment.
+  double denominator = integrateProduct(g1, g1, first_duration) + integrateProduct(g2, g2, second_duration);
+  double numerator = integrateProduct(s1, g1, first_duration) + integrateProduct(s2, g2, second_duration);
+
+  return (denominator > 0.0 ? -numerator / denominator : 0.0);
+}
+
 void EGMInterpolator::update(const wrapper::trajectory::PointGoal& start,
                              const wrapper::trajectory::PointGoal& goal,
                              const Conditions& conditions)
@@ -856,5 +1037,12 @@ void EGMInterpolator::evaluate(wrapper::trajectory::PointGoal* p_output, const d
   }
 }
 
+void EGMInterpolator::prewarm() const
+{
+  touch(&spline_polynomials_, sizeof(spline_polynomials_));
+  touch(&slerp_, sizeof(slerp_));
+  touch(&soft_ramp_, sizeof(soft_ramp_));
+}
+
 } // end namespace egm
 } // end namespace abb
@@ -0,0 +1,495 @@
+/***********************************************************************************************************************
+ *
+ * Copyright (c) 2015, ABB Schweiz AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that
+ * the following conditions are met:
+ *
+ *    * Redistributions of source code must retain the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer in the documentation
+ *      and/or other materials provided with the
+ *      distribution.
+ *    * Neither the name of ABB nor the names of its
+ *      contributors may be used to endorse or promote
+ *      products derived from this software without
+ *      specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***********************************************************************************************************************
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <thread>
+
+#include "abb_libegm/egm_log_analyzer.h"
+
+namespace abb
+{
+namespace egm
+{
+/***********************************************************************************************************************
+ * Struct definitions: EGMLogAnalyzer::Statistics
+ */
+
+void EGMLogAnalyzer::Statistics::add(const double value)
+{
+  ++count;
+  sum += value;
+  sum_of_squares += value*value;
+  max_absolute = std::max(max_absolute, std::abs(value));
+}
+
+void EGMLogAnalyzer::Statistics::merge(const Statistics& other)
+{
+  count += other.count;
+  sum += other.sum;
+  sum_of_squares += other.sum_of_squares;
+  max_absolute = std::max(max_absolute, other.max_absolute);
+}
+
+double EGMLogAnalyzer::Statistics::mean() const
+{
+  return (count > 0 ? sum/count : 0.0);
+}
+
+double EGMLogAnalyzer::Statistics::rms() const
+{
+  return (count > 0 ? std::sqrt(sum_of_squares/count) : 0.0);
+}
+
+double EGMLogAnalyzer::Statistics::standardDeviation() const
+{
+  double result = 0.0;
+
+  if (count > 1)
+  {
+    // Guard against small negative values, caused by rounding errors.
+    double variance = (sum_of_squares - sum*sum/count)/(count - 1);
+    result = (variance > 0.0 ? std::sqrt(variance) : 0.0);
+  }
+
+  return result;
+}
+
+
+
+
+/***********************************************************************************************************************
+ * Class definitions: EGMLogAnalyzer::TimeIndex
+ */
+
+bool EGMLogAnalyzer::TimeIndex::build(const std::string& filename)
+{
+  number_of_rows_ = 0;
+  entries_.clear();
+
+  std::ifstream file(filename.c_str(), std::ios::binary);
+  std::string line;
+
+  if (!file.is_open() || !std::getline(file, line))
+  {
+    return false;
+  }
+
+  // The position is tracked manually (instead of calling tellg for each row), to keep the indexing fast.
+  std::streamoff position = (std::streamoff)line.size() + 1;
+
+  while (std::getline(file, line))
+  {
+    if (!line.empty())
+    {
+      if (number_of_rows_ % STRIDE == 0)
+      {
+        Entry entry;
+        entry.time_stamp = std::strtod(line.c_str(), 0);
+        entry.position = position;
+        entries_.push_back(entry);
+      }
+
+      ++number_of_rows_;
+    }
+
+    position += (std::streamoff)line.size() + 1;
+  }
+
+  return !entries_.empty();
+}
+
+std::streampos EGMLogAnalyzer::TimeIndex::seek(const double time_stamp) const
+{
+  std::streampos result = -1;
+
+  if (!entries_.empty())
+  {
+    // Find the last entry with a time stamp less than the specified time stamp.
+    std::vector<Entry>::const_iterator i = std::upper_bound(entries_.begin(), entries_.end(), time_stamp, compare);
+    result = (i == entries_.begin() ? entries_.front().position : (i - 1)->position);
+  }
+
+  return result;
+}
+
+
+
+
+/***********************************************************************************************************************
+ * Class definitions: EGMLogAnalyzer
+ */
+
+/************************************************************
+ * Primary methods
+ */
+
+EGMLogAnalyzer::EGMLogAnalyzer(const double nominal_sample_time)
+:
+nominal_sample_time_(nominal_sample_time)
+{}
+
+EGMLogAnalyzer::Summary EGMLogAnalyzer::analyze(const std::string& filename,
+                                                const double start_time,
+                                                const double end_time,
+                                                const TimeIndex* p_index) const
+{
+  Summary summary;
+  summary.filename = filename;
+
+  std::ifstream file(filename.c_str(), std::ios::binary);
+  std::string line;
+
+  if (!file.is_open() || !std::getline(file, line))
+  {
+    return summary;
+  }
+
+  seek(&file, start_time, p_index);
+
+  const double gap_limit = 1.5*nominal_sample_time_*1000.0;
+  std::vector<double> values;
+  values.reserve(NUMBER_OF_COLUMNS);
+
+  while (std::getline(file, line))
+  {
+    if (!parseRow(line, &values))
+    {
+      continue;
+    }
+
+    double time_stamp = values[TIME_STAMP_COLUMN];
+
+    if (time_stamp < start_time)
+    {
+      continue;
+    }
+
+    if (end_time >= 0.0 && time_stamp > end_time)
+    {
+      break;
+    }
+
+    if (summary.number_of_rows == 0)
+    {
+      summary.start_time = time_stamp;
+    }
+    else
+    {
+      double delta = time_stamp - summary.end_time;
+      summary.sample_time.add(delta);
+
+      if (delta > gap_limit)
+      {
+        ++summary.number_of_gaps;
+      }
+    }
+
+    summary.end_time = time_stamp;
+    ++summary.number_of_rows;
+
+    for (size_t i = 0; i < summary.joint_tracking_errors.size(); ++i)
+    {
+      summary.joint_tracking_errors[i].add(values[REFERENCES_COLUMN + i] - values[FEEDBACK_COLUMN + i]);
+      summary.joint_velocities[i].add(values[FEEDBACK_COLUMN + JOINT_VELOCITY_OFFSET + i]);
+    }
+
+    for (size_t i = 0; i < summary.cartesian_tracking_errors.size(); ++i)
+    {
+      summary.cartesian_tracking_errors[i].add(values[REFERENCES_COLUMN + CARTESIAN_POSITION_OFFSET + i] -
+                                               values[FEEDBACK_COLUMN + CARTESIAN_POSITION_OFFSET + i]);
+      summary.cartesian_velocities[i].add(values[FEEDBACK_COLUMN + CARTESIAN_VELOCITY_OFFSET + i]);
+    }
+  }
+
+  summary.success = true;
+
+  return summary;
+}
+
+std::vector<EGMLogAnalyzer::Summary> EGMLogAnalyzer::analyze(const std::vector<std::string>& filenames,
+                                                             unsigned int number_of_threads) const
+{
+  std::vector<Summary> summaries(filenames.size());
+
+  if (number_of_threads == 0)
+  {
+    number_of_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+
+  number_of_threads = std::min(number_of_threads, (unsigned int)filenames.size());
+
+  // Each worker claims the next unanalyzed file, so long and short logs are balanced over the workers.
+  size_t next_index = 0;
+  std::mutex mutex;
+
+  std::vector<std::thread> workers;
+  workers.reserve(number_of_threads);
+
+  for (unsigned int i = 0; i < number_of_threads; ++i)
+  {
+    workers.push_back(std::thread(&EGMLogAnalyzer::analyzeWorker,
+                                  this,
+                                  &filenames,
+                                  &summaries,
+                                  &next_index,
+                                  &mutex));
+  }
+
+  for (size_t i = 0; i < workers.size(); ++i)
+  {
+    workers[i].join();
+  }
+
+  return summaries;
+}
+
+unsigned int EGMLogAnalyzer::extract(const std::string& filename,
+                                     const std::string& output_filename,
+                                     const double start_time,
+                                     const double end_time,
+                                     const TimeIndex* p_index) const
+{
+  unsigned int number_of_rows = 0;
+
+  std::ifstream file(filename.c_str(), std::ios::binary);
+  std::string line;
+
+  if (!file.is_open() || !std::getline(file, line))
+  {
+    return number_of_rows;
+  }
+
+  std::ofstream output(output_filename.c_str(), std::ios::trunc | std::ios::binary);
+
+  if (!output.is_open())
+  {
+    return number_of_rows;
+  }
+
+  output << line << "\n";
+
+  seek(&file, start_time, p_index);
+
+  while (std::getline(file, line))
+  {
+    if (line.empty())
+    {
+      continue;
+    }
+
+    double time_stamp = std::strtod(line.c_str(), 0);
+
+    if (time_stamp > end_time)
+    {
+      break;
+    }
+
+    if (time_stamp >= start_time)
+    {
+      output << line << "\n";
+      ++number_of_rows;
+    }
+  }
+
+  return number_of_rows;
+}
+
+void EGMLogAnalyzer::writeSummaries(std::ostream& stream, const std::vector<Summary>& summaries)
+{
+  std::ios::fmtflags flags = stream.flags();
+  stream << std::fixed << std::setprecision(3);
+
+  for (size_t i = 0; i < summaries.size(); ++i)
+  {
+    const Summary& summary = summaries[i];
+
+    stream << summary.filename << ": ";
+
+    if (!summary.success)
+    {
+      stream << "failed to read\n";
+      continue;
+    }
+
+    // Find the joint with the largest tracking error, and the largest joint velocity.
+    size_t worst_joint = 0;
+    double max_joint_velocity = 0.0;
+    for (size_t j = 0; j < summary.joint_tracking_errors.size(); ++j)
+    {
+      if (summary.joint_tracking_errors[j].max_absolute > summary.joint_tracking_errors[worst_joint].max_absolute)
+      {
+        worst_joint = j;
+      }
+
+      max_joint_velocity = std::max(max_joint_velocity, summary.joint_velocities[j].max_absolute);
+    }
+
+    double max_cartesian_error = 0.0;
+    double max_cartesian_velocity = 0.0;
+    for (size_t j = 0; j < summary.cartesian_tracking_errors.size(); ++j)
+    {
+      max_cartesian_error = std::max(max_cartesian_error, summary.cartesian_tracking_errors[j].max_absolute);
+      max_cartesian_velocity = std::max(max_cartesian_velocity, summary.cartesian_velocities[j].max_absolute);
+    }
+
+    stream << "rows=" << summary.number_of_rows
+           << " span=[" << summary.start_time << "," << summary.end_time << "]ms"
+           << " dt(mean/std/max)=" << summary.sample_time.mean()
+           << "/" << summary.sample_time.standardDeviation()
+           << "/" << summary.sample_time.max_absolute << "ms"
+           << " gaps=" << summary.number_of_gaps
+           << " joint_err(max)=" << summary.joint_tracking_errors[worst_joint].max_absolute
+           << "@J" << worst_joint + 1
+           << " joint_err(rms)=" << summary.joint_tracking_errors[worst_joint].rms()
+           << " cart_err(max)=" << max_cartesian_error << "mm"
+           << " joint_vel(max)=" << max_joint_velocity
+           << " cart_vel(max)=" << max_cartesian_velocity << "mm/s\n";
+  }
+
+  stream.flags(flags);
+}
+
+/************************************************************
+ * Auxiliary methods
+ */
+
+bool EGMLogAnalyzer::parseRow(const std::string& line, std::vector<double>* p_values)
+{
+  bool success = false;
+
+  if (p_values)
+  {
+    p_values->clear();
+
+    const char* p_start = line.c_str();
+    char* p_end = 0;
+
+    while (*p_start != '\0' && *p_start != '\r')
+    {
+      double value = std::strtod(p_start, &p_end);
+
+      if (p_end == p_start)
+      {
+        break;
+      }
+
+      p_values->push_back(value);
+      p_start = (*p_end == ',' ? p_end + 1 : p_end);
+    }
+
+    // Incomplete rows (e.g. the last row of an interrupted log) are rejected.
+    success = (p_values->size() >= NUMBER_OF_COLUMNS);
+  }
+
+  return success;
+}
+
+void EGMLogAnalyzer::seek(std::ifstream* p_file, const double time_stamp, const TimeIndex* p_index)
+{
+  std::streampos position = (p_index ? p_index->seek(time_stamp) : search(p_file, time_stamp));
+
+  if (position >= 0)
+  {
+    p_file->clear();
+    p_file->seekg(position);
+  }
+}
+
+std::streampos EGMLogAnalyzer::search(std::ifstream* p_file, const double time_stamp)
+{
+  // Note: The lower bound is always the start of a row, with a time stamp before the searched time stamp (or the
+  //       first row), while the upper bound can be anywhere after it.
+  std::streamoff lower = (std::streamoff)p_file->tellg();
+  p_file->seekg(0, std::ios::end);
+  std::streamoff upper = (std::streamoff)p_file->tellg();
+  std::string line;
+
+  while (lower >= 0 && upper - lower > SEARCH_RANGE)
+  {
+    std::streamoff middle = lower + (upper - lower)/2;
+
+    // Skip the (partial) row at the middle, and read the next whole row.
+    p_file->clear();
+    p_file->seekg(middle);
+    std::getline(*p_file, line);
+    std::streamoff row = (std::streamoff)p_file->tellg();
+
+    if (row >= 0 && std::getline(*p_file, line) && !line.empty() && std::strtod(line.c_str(), 0) < time_stamp)
+    {
+      lower = row;
+    }
+    else
+    {
+      upper = middle;
+    }
+  }
+
+  return (std::streampos)lower;
+}
+
+void EGMLogAnalyzer::analyzeWorker(const std::vector<std::string>* p_filenames,
+                                   std::vector<Summary>* p_summaries,
+                                   size_t* p_next_index,
+                                   std::mutex* p_mutex) const
+{
+  if (p_filenames && p_summaries && p_next_index && p_mutex)
+  {
+    while (true)
+    {
+      size_t index = 0;
+
+      {
+        std::lock_guard<std::mutex> lock(*p_mutex);
+
+        if (*p_next_index >= p_filenames->size())
+        {
+          break;
+        }
+
+        index = (*p_next_index)++;
+      }
+
+      // Each worker writes to its own element, so no locking is needed for the summaries.
+      (*p_summaries)[index] = analyze((*p_filenames)[index]);
+    }
+  }
+}
+
+} // end namespace egm
+} // end namespace abb
@@ -34,8 +34,11 @@
  ***********************************************************************************************************************
  */
 
+#include <cstdio>
 #include <sstream>
 
+#include <boost/thread/lock_guard.hpp>
+
 #include "abb_libegm/egm_common.h"
 #include "abb_libegm/egm_logger.h"
 
@@ -53,8 +56,15 @@ namespace egm
 
 EGMLogger::EGMLogger(const std::string& filename, const bool use_default_headers)
 :
-number_of_logged_messages_(0)
+number_of_logged_messages_(0),
+number_of_dropped_messages_(0),
+message_length_(0),
+message_truncated_(false)
 {
+  // Note: Reserved up front, so appending (and swapping) the buffers never allocates.
+  pending_buffer_.reserve(MAX_PENDING_BYTES);
+  writing_buffer_.reserve(MAX_PENDING_BYTES);
+
   log_stream_.open(filename.c_str(), std::ios::trunc);
 
   if (use_default_headers)
@@ -99,19 +109,60 @@ number_of_logged_messages_(0)
 
 EGMLogger::~EGMLogger()
 {
+  flush();
+
+  boost::lock_guard<boost::mutex> lock(flush_mutex_);
   log_stream_.close();
 }
 
 void EGMLogger::flush()
 {
-  log_stream_ << "\n";
+  boost::lock_guard<boost::mutex> flush_lock(flush_mutex_);
+
+  {
+    // Note: The buffers keep their capacities, so the swap itself doesn't allocate.
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    pending_buffer_.swap(writing_buffer_);
+  }
+
+  if (!writing_buffer_.empty())
+  {
+    log_stream_.write(writing_buffer_.data(), (std::streamsize) writing_buffer_.size());
+    writing_buffer_.clear();
+  }
+
   log_stream_.flush();
-  ++number_of_logged_messages_;
+}
+
+void EGMLogger::endMessage()
+{
+  message_truncated_ = (message_truncated_ || message_length_ + 1 >= MESSAGE_BUFFER_SIZE);
+  if (!message_truncated_)
+  {
+    message_buffer_[message_length_++] = '\n';
+  }
+
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+
+    if (!message_truncated_ && pending_buffer_.size() + message_length_ <= MAX_PENDING_BYTES)
+    {
+      pending_buffer_.append(message_buffer_, message_length_);
+      ++number_of_logged_messages_;
+    }
+    else
+    {
+      ++number_of_dropped_messages_;
+    }
+  }
+
+  message_length_ = 0;
+  message_truncated_ = false;
 }
 
 void EGMLogger::add(const wrapper::Header& header)
 {
-  log_stream_ << header.time_stamp() << ",";
+  append(header.time_stamp());
 }
 
 void EGMLogger::add(const wrapper::Joints& robot, const wrapper::Joints& external)
@@ -120,42 +171,42 @@ void EGMLogger::add(const wrapper::Joints& robot, const wrapper::Joints& externa
 
   for (i = robot.values().begin(); i != robot.values().end(); ++i)
   {
-    log_stream_ << *i << ",";
+    append(*i);
   }
   addMockJoints(true, robot.values_size(), external.values_size());
 
   for (i = external.values().begin(); i != external.values().end(); ++i)
   {
-    log_stream_ << *i << ",";
+    append(*i);
   }
   addMockJoints(false, robot.values_size(), external.values_size());
 }
 
 void EGMLogger::add(const wrapper::CartesianPose& pose)
 {
-  log_stream_ << pose.position().x() << ","
-              << pose.position().y() << ","
-              << pose.position().z() << ",";
-
-  log_stream_ << pose.euler().x() << ","
-              << pose.euler().y() << ","
-              << pose.euler().z() << ",";
-
-  log_stream_ << pose.quaternion().u0() << ","
-              << pose.quaternion().u1() << ","
-              << pose.quaternion().u2() << ","
-              << pose.quaternion().u3() << ",";
+  append(pose.position().x());
+  append(pose.position().y());
+  append(pose.position().z());
+
+  append(pose.euler().x());
+  append(pose.euler().y());
+  append(pose.euler().z());
+
+  append(pose.quaternion().u0());
+  append(pose.quaternion().u1());
+  append(pose.quaternion().u2());
+  append(pose.quaternion().u3());
 }
 
 void EGMLogger::add(const wrapper::CartesianVelocity& velocity, const bool last)
 {
-  log_stream_ << velocity.linear().x() << ","
-              << velocity.linear().y() << ","
-              << velocity.linear().z() << ",";
+  append(velocity.linear().x());
+  append(velocity.linear().y());
+  append(velocity.linear().z());
 
-  log_stream_ << velocity.angular().x() << ","
-              << velocity.angular().y() << ","
-              << velocity.angular().z() << (last ? "" : ",");
+  append(velocity.angular().x());
+  append(velocity.angular().y());
+  append(velocity.angular().z(), (last ? "" : ","));
 }
 
 /************************************************************
@@ -170,7 +221,7 @@ void EGMLogger::addMockJoints(const bool robot, const size_t robot_size, const s
     size_t condition = Constants::RobotController::DEFAULT_NUMBER_OF_ROBOT_JOINTS;
     for (size_t i = robot_size; i < condition; ++i)
     {
-      log_stream_ << 0.0 << ",";
+      append(0.0);
     }
   }
   else
@@ -179,15 +230,46 @@ void EGMLogger::addMockJoints(const bool robot, const size_t robot_size, const s
     size_t condition = Constants::RobotController::MAX_NUMBER_OF_JOINTS - robot_size;
     for (size_t i = external_size; i < condition; ++i)
     {
-      log_stream_ << 0.0 << ",";
+      append(0.0);
     }
   }
 }
 
+void EGMLogger::append(const double value, const char* separator)
+{
+  if (!message_truncated_)
+  {
+    // Note: Formatted as by a default stream (i.e. with six significant digits).
+    size_t available = MESSAGE_BUFFER_SIZE - message_length_;
+    int length = std::snprintf(message_buffer_ + message_length_, available, "%g%s", value, separator);
+
+    message_truncated_ = (length < 0 || (size_t) length >= available);
+    message_length_ += (message_truncated_ ? 0 : (size_t) length);
+  }
+}
+
+void EGMLogger::append(const unsigned int value, const char* separator)
+{
+  if (!message_truncated_)
+  {
+    size_t available = MESSAGE_BUFFER_SIZE - message_length_;
+    int length = std::snprintf(message_buffer_ + message_length_, available, "%u%s", value, separator);
+
+    message_truncated_ = (length < 0 || (size_t) length >= available);
+    message_length_ += (message_truncated_ ? 0 : (size_t) length);
+  }
+}
+
 double EGMLogger::calculateTimeLogged(const double sample_time)
 {
   return (double)number_of_logged_messages_*sample_time;
 }
 
+unsigned int EGMLogger::droppedMessages()
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+  return number_of_dropped_messages_;
+}
+
 } // end namespace egm
 } // end namespace abb
@@ -0,0 +1,647 @@
+/***********************************************************************************************************************
+ *
+ * Copyright (c) 2015, ABB Schweiz AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that
+ * the following conditions are met:
+ *
+ *    * Redistributions of source code must retain the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer in the documentation
+ *      and/or other materials provided with the
+ *      distribution.
+ *    * Neither the name of ABB nor the names of its
+ *      contributors may be used to endorse or promote
+ *      products derived from this software without
+ *      specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***********************************************************************************************************************
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "abb_libegm/egm_metrics.h"
+
+namespace abb
+{
+namespace egm
+{
+/**
+ * \brief The stage metrics, of the innermost stage scope, on the current thread (null if outside any scope).
+ */
+static thread_local Metrics::StageMetrics* p_active_stage = 0;
+
+/**
+ * \brief The number of allocations counted on the current thread (i.e. inside any stage scope).
+ */
+static thread_local unsigned long long thread_allocations = 0;
+
+/**
+ * \brief The innermost callback scope, on the current thread (null if outside any callback).
+ */
+static thread_local MetricsCollector::CallbackScope* p_active_callback = 0;
+
+/**
+ * \brief Subtract a set of stage metrics from another set (e.g. to remove a baseline).
+ *
+ * \param p_metrics for the metrics to subtract from.
+ * \param other containing the metrics to subtract.
+ */
+static void subtract(Metrics::StageMetrics* p_metrics, const Metrics::StageMetrics& other)
+{
+  p_metrics->calls -= other.calls;
+  p_metrics->allocations -= other.allocations;
+  p_metrics->deallocations -= other.deallocations;
+  p_metrics->allocated_bytes -= other.allocated_bytes;
+  p_metrics->sampled_calls -= other.sampled_calls;
+
+  for (size_t i = 0; i < p_metrics->hardware_counters.size(); ++i)
+  {
+    p_metrics->hardware_counters[i] -= other.hardware_counters[i];
+  }
+}
+
+/**
+ * \brief Read a monotonic clock (without a system call on Linux, since it is served by the vDSO).
+ *
+ * \return unsigned long long containing the time [ns] (zero if hardware counters aren't supported).
+ */
+static unsigned long long monotonicTime()
+{
+#ifdef __linux__
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (unsigned long long) now.tv_sec * 1000000000ULL + (unsigned long long) now.tv_nsec;
+#else
+  return 0;
+#endif
+}
+
+/**
+ * \brief Class for managing a group of hardware counters, for the current thread.
+ */
+class HardwareCounterGroup
+{
+public:
+  /**
+   * \brief Default constructor.
+   */
+  HardwareCounterGroup()
+  :
+  opened_(false),
+  leader_fd_(-1)
+  {
+    fds_.assign(-1);
+    slots_.assign(-1);
+  }
+
+  /**
+   * \brief Destructor (closes the counters).
+   */
+  ~HardwareCounterGroup()
+  {
+#ifdef __linux__
+    for (size_t i = 0; i < fds_.size(); ++i)
+    {
+      if (fds_[i] >= 0)
+      {
+        close(fds_[i]);
+      }
+    }
+#endif
+  }
+
+  /**
+   * \brief Open the counters (only attempted once per thread).
+   *
+   * \param p_available for containing flags for the opened counters.
+   *
+   * \return bool indicating if this was the first attempt or not.
+   */
+  bool open(boost::array<bool, Metrics::NUMBER_OF_HARDWARE_COUNTERS>* p_available)
+  {
+    if (opened_)
+    {
+      return false;
+    }
+
+    opened_ = true;
+    p_available->assign(false);
+
+#ifdef __linux__
+    const unsigned int types[] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+                                  PERF_TYPE_SOFTWARE, PERF_TYPE_SOFTWARE};
+    const unsigned long long configs[] = {PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CPU_CYCLES,
+                                          PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_SW_CONTEXT_SWITCHES,
+                                          PERF_COUNT_SW_PAGE_FAULTS};
+    int number_of_slots = 0;
+
+    for (int i = 0; i < Metrics::NUMBER_OF_HARDWARE_COUNTERS; ++i)
+    {
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = types[i];
+      attr.config = configs[i];
+      attr.read_format = PERF_FORMAT_GROUP;
+      attr.exclude_hv = 1;
+
+      // Note: Only the calling thread is counted (on any CPU). Kernel events are excluded, if the
+      //       kernel's settings (i.e. perf_event_paranoid) does not allow counting them.
+      int fd = (int) syscall(__NR_perf_event_open, &attr, 0, -1, leader_fd_, 0);
+      if (fd < 0)
+      {
+        attr.exclude_kernel = 1;
+        fd = (int) syscall(__NR_perf_event_open, &attr, 0, -1, leader_fd_, 0);
+      }
+
+      if (fd >= 0)
+      {
+        if (leader_fd_ < 0)
+        {
+          leader_fd_ = fd;
+        }
+
+        fds_[i] = fd;
+        slots_[i] = number_of_slots++;
+        (*p_available)[i] = true;
+      }
+    }
+#endif
+
+    return true;
+  }
+
+  /**
+   * \brief Read all counters in the group.
+   *
+   * \param p_counters for containing the counter values (unavailable counters are set to zero).
+   *
+   * \return bool indicating if the counters were read or not.
+   */
+  bool read(boost::array<unsigned long long, Metrics::NUMBER_OF_HARDWARE_COUNTERS>* p_counters)
+  {
+    bool success = false;
+
+#ifdef __linux__
+    // Note: The group read format is the number of counters, followed by each counter's value.
+    unsigned long long buffer[Metrics::NUMBER_OF_HARDWARE_COUNTERS + 1];
+
+    if (leader_fd_ >= 0 && ::read(leader_fd_, buffer, sizeof(buffer)) > 0)
+    {
+      for (size_t i = 0; i < slots_.size(); ++i)
+      {
+        (*p_counters)[i] = (slots_[i] >= 0 && (unsigned long long) slots_[i] < buffer[0] ? buffer[slots_[i] + 1] : 0);
+      }
+
+      success = true;
+    }
+#endif
+
+    return success;
+  }
+
+private:
+  /**
+   * \brief Flag indicating if the counters have been opened (or if it has been attempted).
+   */
+  bool opened_;
+
+  /**
+   * \brief File descriptor for the group's leader.
+   */
+  int leader_fd_;
+
+  /**
+   * \brief File descriptors for each counter (negative if unavailable).
+   */
+  boost::array<int, Metrics::NUMBER_OF_HARDWARE_COUNTERS> fds_;
+
+  /**
+   * \brief Each counter's position in the group's read format (negative if unavailable).
+   */
+  boost::array<int, Metrics::NUMBER_OF_HARDWARE_COUNTERS> slots_;
+};
+
+/**
+ * \brief The hardware counters, for the current thread.
+ */
+static thread_local HardwareCounterGroup thread_counters;
+
+/***********************************************************************************************************************
+ * Class definitions: MetricsCollector::StageScope
+ */
+
+MetricsCollector::StageScope::StageScope(MetricsCollector& collector, const Metrics::Stage stage)
+:
+collector_(collector),
+stage_(stage),
+p_callback_(p_active_callback),
+p_metrics_(0),
+p_previous_(p_active_stage),
+sampled_(false),
+timed_(false),
+start_time_(0)
+{
+  bool sample_counters = false;
+
+  if (p_callback_)
+  {
+    // Note: Inside a callback, the metrics are recorded directly in the callback scope (i.e. without locking),
+    //       and the callback's hardware counts are attributed to the stage afterwards (i.e. no counter reads).
+    if (p_callback_->active_ && stage_ < Metrics::NUMBER_OF_STAGES)
+    {
+      p_metrics_ = &p_callback_->stages_[stage_];
+      timed_ = p_callback_->sampled_;
+    }
+  }
+  else if (collector_.profilingActive())
+  {
+    p_metrics_ = &local_;
+    sample_counters = collector_.hardware_counters_enabled_.load(boost::memory_order_relaxed);
+  }
+
+  if (!p_metrics_)
+  {
+    return;
+  }
+
+  ++p_metrics_->calls;
+  p_active_stage = p_metrics_;
+
+  if (sample_counters)
+  {
+    sampled_ = collector_.sampleCounters(&start_counters_);
+  }
+
+  if (timed_)
+  {
+    start_time_ = monotonicTime();
+  }
+}
+
+MetricsCollector::StageScope::~StageScope()
+{
+  if (!p_metrics_)
+  {
+    return;
+  }
+
+  if (timed_)
+  {
+    ++p_metrics_->sampled_calls;
+    p_callback_->stage_times_[stage_] += monotonicTime() - start_time_;
+  }
+
+  boost::array<unsigned long long, Metrics::NUMBER_OF_HARDWARE_COUNTERS> end_counters;
+
+  if (sampled_ && thread_counters.read(&end_counters))
+  {
+    ++p_metrics_->sampled_calls;
+
+    for (size_t i = 0; i < end_counters.size(); ++i)
+    {
+      p_metrics_->hardware_counters[i] += end_counters[i] - start_counters_[i];
+    }
+  }
+
+  p_active_stage = p_previous_;
+
+  if (p_metrics_ == &local_)
+  {
+    collector_.report(stage_, local_);
+  }
+}
+
+
+
+
+/***********************************************************************************************************************
+ * Class definitions: MetricsCollector::CallbackScope
+ */
+
+MetricsCollector::CallbackScope::CallbackScope(MetricsCollector& collector)
+:
+collector_(collector),
+active_(collector.profilingActive()),
+sample_counters_(collector.hardware_counters_enabled_.load(boost::memory_order_relaxed)),
+p_previous_(p_active_callback),
+start_allocations_(thread_allocations),
+sampled_(false)
+{
+  stage_times_.assign(0);
+
+  if (active_ && sample_counters_)
+  {
+    sampled_ = collector_.sampleCounters(&start_counters_);
+  }
+
+  p_active_callback = this;
+}
+
+MetricsCollector::CallbackScope::~CallbackScope()
+{
+  p_active_callback = p_previous_;
+
+  boost::array<unsigned long long, Metrics::NUMBER_OF_HARDWARE_COUNTERS> end_counters;
+
+  if (sampled_ && thread_counters.read(&end_counters))
+  {
+    attributeCounters(end_counters);
+  }
+
+  if (active_)
+  {
+    collector_.publish(*this, thread_allocations - start_allocations_);
+  }
+}
+
+void MetricsCollector::CallbackScope::attributeCounters(
+  const boost::array<unsigned long long, Metrics::NUMBER_OF_HARDWARE_COUNTERS>& end_counters)
+{
+  unsigned long long total_time = 0;
+
+  for (size_t i = 0; i < stage_times_.size(); ++i)
+  {
+    total_time += stage_times_[i];
+  }
+
+  // Note: Each stage gets the share of the callback's counts that corresponds to its share of the stages' time.
+  for (size_t i = 0; total_time > 0 && i < stage_times_.size(); ++i)
+  {
+    const double share = (double) stage_times_[i] / (double) total_time;
+
+    for (size_t j = 0; share > 0.0 && j < end_counters.size(); ++j)
+    {
+      stages_[i].hardware_counters[j] += (unsigned long long) (share*(end_counters[j] - start_counters_[j]) + 0.5);
+    }
+  }
+}
+
+
+
+
+/***********************************************************************************************************************
+ * Class definitions: MetricsCollector
+ */
+
+/************************************************************
+ * Primary methods
+ */
+
+MetricsCollector::MetricsCollector()
+:
+back_(0),
+front_(1),
+middle_(2),
+hardware_counters_enabled_(false)
+{}
+
+/************************************************************
+ * User interaction methods
+ */
+
+Metrics MetricsCollector::getMetrics()
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+
+  Metrics result = latestPublished();
+  result.callbacks -= baseline_.callbacks;
+  result.allocating_callbacks -= baseline_.allocating_callbacks;
+  result.available_hardware_counters = metrics_.available_hardware_counters;
+
+  for (size_t i = 0; i < result.stages.size(); ++i)
+  {
+    subtract(&result.stages[i], baseline_.stages[i]);
+    result.stages[i].merge(metrics_.stages[i]);
+  }
+
+  return result;
+}
+
+void MetricsCollector::resetMetrics()
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+
+  // Note: The published metrics are only written by the callbacks, so they are reset by storing a baseline.
+  baseline_ = latestPublished();
+
+  // Note: The counters' availability is kept, since each thread only opens its counters once.
+  boost::array<bool, Metrics::NUMBER_OF_HARDWARE_COUNTERS> available = metrics_.available_hardware_counters;
+  metrics_ = Metrics();
+  metrics_.available_hardware_counters = available;
+}
+
+bool MetricsCollector::allocationProfilingEnabled()
+{
+#ifdef ABB_LIBEGM_ALLOCATION_PROFILING
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool MetricsCollector::enableHardwareCounters(const bool enable)
+{
+#ifdef __linux__
+  hardware_counters_enabled_.store(enable);
+  return true;
+#else
+  return false;
+#endif
+}
+
+/************************************************************
+ * Auxiliary methods
+ */
+
+bool MetricsCollector::sampleCounters(
+  boost::array<unsigned long long, Metrics::NUMBER_OF_HARDWARE_COUNTERS>* p_counters)
+{
+  boost::array<bool, Metrics::NUMBER_OF_HARDWARE_COUNTERS> available;
+
+  if (thread_counters.open(&available))
+  {
+    reportAvailableCounters(available);
+  }
+
+  return thread_counters.read(p_counters);
+}
+
+bool MetricsCollector::profilingActive() const
+{
+  return allocationProfilingEnabled() || hardware_counters_enabled_.load(boost::memory_order_relaxed);
+}
+
+void MetricsCollector::publish(const CallbackScope& callback, const unsigned long long allocations)
+{
+  ++totals_.callbacks;
+  totals_.last_callback_allocations = allocations;
+  if (allocations > 0)
+  {
+    ++totals_.allocating_callbacks;
+  }
+
+  for (size_t i = 0; i < totals_.stages.size(); ++i)
+  {
+    totals_.stages[i].merge(callback.stages_[i]);
+  }
+
+  // Write the totals to the back buffer, and swap it with the middle buffer (marking it as fresh).
+  buffers_[back_] = totals_;
+  back_ = middle_.exchange(back_ | FRESH, boost::memory_order_acq_rel) & ~FRESH;
+}
+
+void MetricsCollector::report(const Metrics::Stage stage, const Metrics::StageMetrics& metrics)
+{
+  if (stage < Metrics::NUMBER_OF_STAGES)
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    metrics_.stages[stage].merge(metrics);
+  }
+}
+
+void MetricsCollector::reportAvailableCounters(
+  const boost::array<bool, Metrics::NUMBER_OF_HARDWARE_COUNTERS>& available)
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+
+  for (size_t i = 0; i < available.size(); ++i)
+  {
+    metrics_.available_hardware_counters[i] = metrics_.available_hardware_counters[i] || available[i];
+  }
+}
+
+const Metrics& MetricsCollector::latestPublished()
+{
+  // Swap the front buffer with the middle buffer, if the middle buffer has been published since the last swap.
+  if (middle_.load(boost::memory_order_acquire) & FRESH)
+  {
+    front_ = middle_.exchange(front_, boost::memory_order_acq_rel) & ~FRESH;
+  }
+
+  return buffers_[front_];
+}
+
+} // end namespace egm
+} // end namespace abb
+
+
+
+
+#ifdef ABB_LIBEGM_ALLOCATION_PROFILING
+/***********************************************************************************************************************
+ * Allocation hooks
+ *
+ * Note: The global allocation functions are replaced for the whole process, but allocations are only counted
+ *       on threads that are inside a stage scope (i.e. inside the library's own code paths).
+ */
+
+namespace
+{
+void* profiledAllocate(const std::size_t size)
+{
+  if (abb::egm::p_active_stage)
+  {
+    ++abb::egm::p_active_stage->allocations;
+    abb::egm::p_active_stage->allocated_bytes += size;
+    ++abb::egm::thread_allocations;
+  }
+
+  return std::malloc(size == 0 ? 1 : size);
+}
+
+void profiledDeallocate(void* p)
+{
+  if (p && abb::egm::p_active_stage)
+  {
+    ++abb::egm::p_active_stage->deallocations;
+  }
+
+  std::free(p);
+}
+}
+
+void* operator new(std::size_t size)
+{
+  void* p = profiledAllocate(size);
+
+  if (!p)
+  {
+    throw std::bad_alloc();
+  }
+
+  return p;
+}
+
+void* operator new[](std::size_t size)
+{
+  return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+  return profiledAllocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+  return profiledAllocate(size);
+}
+
+void operator delete(void* p) noexcept
+{
+  profiledDeallocate(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+  profiledDeallocate(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+  profiledDeallocate(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+  profiledDeallocate(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+  profiledDeallocate(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+  profiledDeallocate(p);
+}
+#endif
@@ -0,0 +1,523 @@
+/***********************************************************************************************************************
+ *
+ * Copyright (c) 2015, ABB Schweiz AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that
+ * the following conditions are met:
+ *
+ *    * Redistributions of source code must retain the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer in the documentation
+ *      and/or other materials provided with the
+ *      distribution.
+ *    * Neither the name of ABB nor the names of its
+ *      contributors may be used to endorse or promote
+ *      products derived from this software without
+ *      specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***********************************************************************************************************************
+ */
+
+#ifndef _WIN32
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "abb_libegm/egm_session_handoff.h"
+
+namespace abb
+{
+namespace egm
+{
+#ifndef _WIN32
+/**
+ * \brief Struct for the fixed size part of a handover message (sent together with the file descriptor).
+ */
+struct HandoffHeader
+{
+  /**
+   * \brief Value for identifying the message.
+   */
+  unsigned int magic;
+
+  /**
+   * \brief Size [bytes] of the serialized session state that follows the header.
+   */
+  unsigned int size;
+};
+
+/**
+ * \brief Calculate a deadline, on the monotonic clock.
+ *
+ * \param timeout_ms specifying the time [ms] until the deadline.
+ *
+ * \return timespec containing the deadline.
+ */
+static timespec calculateDeadline(const unsigned int timeout_ms)
+{
+  timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+  deadline.tv_sec += timeout_ms / 1000;
+  deadline.tv_nsec += (long) (timeout_ms % 1000) * 1000000L;
+  if (deadline.tv_nsec >= 1000000000L)
+  {
+    deadline.tv_sec += 1;
+    deadline.tv_nsec -= 1000000000L;
+  }
+
+  return deadline;
+}
+
+/**
+ * \brief Wait until a file descriptor is ready, or until a deadline has passed.
+ *
+ * \param fd for the file descriptor to wait for.
+ * \param events specifying the poll events to wait for.
+ * \param deadline specifying the deadline.
+ *
+ * \return bool indicating if the file descriptor became ready or not.
+ */
+static bool waitUntilReady(const int fd, const short events, const timespec& deadline)
+{
+  while (true)
+  {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    long remaining_ms = (deadline.tv_sec - now.tv_sec) * 1000L + (deadline.tv_nsec - now.tv_nsec) / 1000000L;
+    if (remaining_ms < 0)
+    {
+      remaining_ms = 0;
+    }
+
+    pollfd poll_fd;
+    poll_fd.fd = fd;
+    poll_fd.events = events;
+    poll_fd.revents = 0;
+
+    int result = poll(&poll_fd, 1, (int) remaining_ms);
+
+    if (result > 0)
+    {
+      return (poll_fd.revents & events) != 0;
+    }
+
+    if (result == 0 || errno != EINTR)
+    {
+      return false;
+    }
+  }
+}
+
+/**
+ * \brief Write all bytes to a non-blocking stream socket.
+ *
+ * \param fd for the socket.
+ * \param p_data for the bytes to write.
+ * \param size for the number of bytes to write.
+ * \param deadline specifying the deadline.
+ *
+ * \return bool indicating if all bytes were written or not.
+ */
+static bool writeAll(const int fd, const char* p_data, size_t size, const timespec& deadline)
+{
+  while (size > 0)
+  {
+    ssize_t written = ::send(fd, p_data, size, MSG_NOSIGNAL);
+
+    if (written > 0)
+    {
+      p_data += written;
+      size -= (size_t) written;
+    }
+    else if (written < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    else if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+      if (!waitUntilReady(fd, POLLOUT, deadline))
+      {
+        return false;
+      }
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * \brief Read all bytes from a non-blocking stream socket.
+ *
+ * \param fd for the socket.
+ * \param p_data for storing the bytes.
+ * \param size for the number of bytes to read.
+ * \param deadline specifying the deadline.
+ *
+ * \return bool indicating if all bytes were read or not.
+ */
+static bool readAll(const int fd, char* p_data, size_t size, const timespec& deadline)
+{
+  while (size > 0)
+  {
+    ssize_t received = ::recv(fd, p_data, size, 0);
+
+    if (received > 0)
+    {
+      p_data += received;
+      size -= (size_t) received;
+    }
+    else if (received < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    else if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+      if (!waitUntilReady(fd, POLLIN, deadline))
+      {
+        return false;
+      }
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * \brief Fill in a Unix domain socket address.
+ *
+ * \param path specifying the socket path.
+ * \param p_address for storing the address.
+ *
+ * \return bool indicating if the path fits in the address or not.
+ */
+static bool prepareAddress(const std::string& path, sockaddr_un* p_address)
+{
+  std::memset(p_address, 0, sizeof(sockaddr_un));
+  p_address->sun_family = AF_UNIX;
+
+  if (path.empty() || path.size() >= sizeof(p_address->sun_path))
+  {
+    return false;
+  }
+
+  std::memcpy(p_address->sun_path, path.c_str(), path.size());
+
+  return true;
+}
+
+/**
+ * \brief Check if the peer of a connected Unix domain socket runs as the same user as this process.
+ *
+ * \param fd for the connected socket.
+ *
+ * \return bool indicating if the peer's effective user id matches or not.
+ */
+static bool verifyPeer(const int fd)
+{
+#ifdef __linux__
+  ucred credentials;
+  socklen_t length = sizeof(credentials);
+
+  return (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == 0 && credentials.uid == geteuid());
+#else
+  uid_t uid = 0;
+  gid_t gid = 0;
+
+  return (getpeereid(fd, &uid, &gid) == 0 && uid == geteuid());
+#endif
+}
+#endif
+
+/***********************************************************************************************************************
+ * Class definitions: EGMSessionHandoff
+ */
+
+const unsigned int EGMSessionHandoff::MAGIC;
+const unsigned int EGMSessionHandoff::MAX_STATE_SIZE;
+
+/************************************************************
+ * User interaction methods
+ */
+
+bool EGMSessionHandoff::send(const std::string& path,
+                             const int socket_handle,
+                             const std::string& state,
+                             const unsigned int timeout_ms)
+{
+#ifndef _WIN32
+  sockaddr_un address;
+
+  if (socket_handle < 0 || state.size() > MAX_STATE_SIZE || !prepareAddress(path, &address))
+  {
+    return false;
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+  {
+    return false;
+  }
+
+  timespec deadline = calculateDeadline(timeout_ms);
+  bool success = (connect(fd, (sockaddr*) &address, sizeof(address)) == 0 &&
+                  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == 0);
+
+  // Send the header, together with the UDP socket's file descriptor.
+  if (success)
+  {
+    HandoffHeader header;
+    header.magic = MAGIC;
+    header.size = (unsigned int) state.size();
+
+    iovec io;
+    io.iov_base = &header;
+    io.iov_len = sizeof(header);
+
+    char control[CMSG_SPACE(sizeof(int))];
+    std::memset(control, 0, sizeof(control));
+
+    msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    cmsghdr* p_control_message = CMSG_FIRSTHDR(&message);
+    p_control_message->cmsg_level = SOL_SOCKET;
+    p_control_message->cmsg_type = SCM_RIGHTS;
+    p_control_message->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(p_control_message), &socket_handle, sizeof(int));
+
+    ssize_t sent = -1;
+    do
+    {
+      sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+    }
+    while ((sent < 0 && errno == EINTR) ||
+           (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && waitUntilReady(fd, POLLOUT, deadline)));
+
+    // Send any remaining part of the header (the descriptor is attached to the first byte), and then the state.
+    success = (sent > 0 &&
+               writeAll(fd, ((const char*) &header) + sent, sizeof(header) - (size_t) sent, deadline) &&
+               writeAll(fd, state.data(), state.size(), deadline));
+  }
+
+  // Wait for the receiver's acknowledgement (i.e. it has taken over the session, and it hasn't rejected it).
+  if (success)
+  {
+    char acknowledgement = 0;
+    success = readAll(fd, &acknowledgement, 1, deadline) && acknowledgement == 1;
+  }
+
+  close(fd);
+
+  return success;
+#else
+  return false;
+#endif
+}
+
+bool EGMSessionHandoff::receive(const std::string& path,
+                                int* p_connection,
+                                int* p_socket_handle,
+                                std::string* p_state,
+                                const unsigned int timeout_ms)
+{
+#ifndef _WIN32
+  sockaddr_un address;
+
+  if (!p_connection || !p_socket_handle || !p_state || !prepareAddress(path, &address))
+  {
+    return false;
+  }
+
+  *p_connection = -1;
+  *p_socket_handle = -1;
+
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd < 0)
+  {
+    return false;
+  }
+
+  timespec deadline = calculateDeadline(timeout_ms);
+  int fd = -1;
+
+  // Wait for the sending process to connect.
+  // Note: The socket file is restricted to the owner before listening, i.e. before any connection can be made.
+  //       Connections from other users are dropped (without ending the wait), in case the restriction is bypassed.
+  unlink(path.c_str());
+  if (bind(listen_fd, (sockaddr*) &address, sizeof(address)) == 0 &&
+      chmod(path.c_str(), S_IRUSR | S_IWUSR) == 0 &&
+      listen(listen_fd, 1) == 0)
+  {
+    while (fd < 0 && waitUntilReady(listen_fd, POLLIN, deadline))
+    {
+      fd = ::accept(listen_fd, 0, 0);
+
+      if (fd >= 0 && !verifyPeer(fd))
+      {
+        close(fd);
+        fd = -1;
+      }
+    }
+  }
+  close(listen_fd);
+  unlink(path.c_str());
+
+  if (fd < 0)
+  {
+    return false;
+  }
+
+  bool success = (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == 0);
+  int socket_handle = -1;
+  HandoffHeader header;
+
+  // Receive the header, together with the UDP socket's file descriptor.
+  if (success)
+  {
+    iovec io;
+    io.iov_base = &header;
+    io.iov_len = sizeof(header);
+
+    char control[CMSG_SPACE(sizeof(int))];
+    std::memset(control, 0, sizeof(control));
+
+    msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t received = -1;
+    do
+    {
+      received = recvmsg(fd, &message, 0);
+    }
+    while ((received < 0 && errno == EINTR) ||
+           (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && waitUntilReady(fd, POLLIN, deadline)));
+
+    cmsghdr* p_control_message = (received > 0 ? CMSG_FIRSTHDR(&message) : 0);
+    if (p_control_message &&
+        p_control_message->cmsg_level == SOL_SOCKET &&
+        p_control_message->cmsg_type == SCM_RIGHTS &&
+        p_control_message->cmsg_len == CMSG_LEN(sizeof(int)))
+    {
+      std::memcpy(&socket_handle, CMSG_DATA(p_control_message), sizeof(int));
+    }
+
+    success = (socket_handle >= 0 &&
+               readAll(fd, ((char*) &header) + received, sizeof(header) - (size_t) received, deadline) &&
+               header.magic == MAGIC &&
+               header.size <= MAX_STATE_SIZE);
+  }
+
+  // Verify that the received file descriptor is a datagram socket.
+  if (success)
+  {
+    int type = 0;
+    socklen_t length = sizeof(type);
+    success = (getsockopt(socket_handle, SOL_SOCKET, SO_TYPE, &type, &length) == 0 && type == SOCK_DGRAM);
+  }
+
+  // Receive the state (the transfer is acknowledged later, when the session has been taken over).
+  if (success)
+  {
+    p_state->resize(header.size);
+    success = (header.size == 0 || readAll(fd, &(*p_state)[0], header.size, deadline));
+  }
+
+  if (success)
+  {
+    *p_connection = fd;
+    *p_socket_handle = socket_handle;
+  }
+  else
+  {
+    reject(fd, socket_handle);
+    p_state->clear();
+  }
+
+  return success;
+#else
+  return false;
+#endif
+}
+
+bool EGMSessionHandoff::accept(const int connection, const unsigned int timeout_ms)
+{
+#ifndef _WIN32
+  if (connection < 0)
+  {
+    return false;
+  }
+
+  char acknowledgement = 1;
+  bool success = writeAll(connection, &acknowledgement, 1, calculateDeadline(timeout_ms));
+
+  close(connection);
+
+  return success;
+#else
+  return false;
+#endif
+}
+
+void EGMSessionHandoff::reject(const int connection, const int socket_handle)
+{
+#ifndef _WIN32
+  if (socket_handle >= 0)
+  {
+    close(socket_handle);
+  }
+
+  // Best effort only, since the sending process also gives up when the connection is closed.
+  if (connection >= 0)
+  {
+    char acknowledgement = 0;
+    ::send(connection, &acknowledgement, 1, MSG_NOSIGNAL);
+    close(connection);
+  }
+#endif
+}
+
+} // end namespace egm
+} // end namespace abb
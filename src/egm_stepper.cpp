@@ -0,0 +1,174 @@
+/***********************************************************************************************************************
+ *
+ * Copyright (c) 2015, ABB Schweiz AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that
+ * the following conditions are met:
+ *
+ *    * Redistributions of source code must retain the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer in the documentation
+ *      and/or other materials provided with the
+ *      distribution.
+ *    * Neither the name of ABB nor the names of its
+ *      contributors may be used to endorse or promote
+ *      products derived from this software without
+ *      specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***********************************************************************************************************************
+ */
+
+#include "abb_libegm/egm_common_auxiliary.h"
+#include "abb_libegm/egm_stepper.h"
+
+namespace abb
+{
+namespace egm
+{
+namespace
+{
+/**
+ * \brief Convert a clock message to seconds.
+ *
+ * \param clock containing the clock message.
+ *
+ * \return double containing the time [s].
+ */
+double toSeconds(const wrapper::Clock& clock)
+{
+  return (double) clock.sec() + ((double) clock.usec()) / Constants::Conversion::S_TO_US;
+}
+} // end anonymous namespace
+
+
+
+
+/***********************************************************************************************************************
+ * Class definitions: EGMStepper
+ */
+
+/************************************************************
+ * Primary methods
+ */
+
+EGMStepper::EGMStepper(const TrajectoryConfiguration& configuration)
+:
+active_(configuration),
+update_(configuration),
+has_pending_update_(false),
+trajectory_motion_(configuration)
+{}
+
+const std::string& EGMStepper::step(const char* p_data, const int bytes_transferred)
+{
+  if (initializeStep(p_data, bytes_transferred))
+  {
+    // Handle demo execution or trajectory execution.
+    if (active_.base.use_demo_outputs)
+    {
+      outputs_.generateDemoOutputs(inputs_);
+    }
+    else
+    {
+      // Note: The corrections are timed on the robot controller's clock (i.e. by the message's timestamp).
+      trajectory_motion_.generateOutputs(&outputs_.current, inputs_, toSeconds(inputs_.current().feedback().time()));
+    }
+
+    finalizeStep();
+  }
+
+  return outputs_.reply();
+}
+
+const std::string& EGMStepper::step(const char* p_data, const int bytes_transferred, const wrapper::Output& outputs)
+{
+  if (initializeStep(p_data, bytes_transferred))
+  {
+    // Handle demo execution or external execution.
+    if (active_.base.use_demo_outputs)
+    {
+      outputs_.generateDemoOutputs(inputs_);
+    }
+    else if (inputs_.isFirstMessage() || inputs_.statesOk())
+    {
+      // Note: Only the present outputs are copied, i.e. the others keep their previous values.
+      copyPresent(&outputs_.current, outputs);
+    }
+
+    finalizeStep();
+  }
+
+  return outputs_.reply();
+}
+
+/************************************************************
+ * Auxiliary methods
+ */
+
+bool EGMStepper::initializeStep(const char* p_data, const int bytes_transferred)
+{
+  bool success = (p_data && inputs_.parseFromArray(p_data, bytes_transferred));
+
+  // Update the configuration, if requested to do so.
+  if (success && inputs_.isFirstMessage() && has_pending_update_)
+  {
+    active_ = update_;
+    has_pending_update_ = false;
+
+    trajectory_motion_.updateConfigurations(active_);
+  }
+
+  // Extract information from the parsed message.
+  if (success)
+  {
+    success = inputs_.extractParsedInformation(active_.base.axes);
+  }
+
+  // Prepare the outputs.
+  outputs_.clearReply();
+  if (success)
+  {
+    outputs_.prepareOutputs(inputs_);
+  }
+
+  return success;
+}
+
+void EGMStepper::finalizeStep()
+{
+  // Constuct the reply message.
+  outputs_.constructReply(active_.base);
+
+  // Prepare for the next step.
+  inputs_.updatePrevious();
+  outputs_.updatePrevious();
+}
+
+/************************************************************
+ * User interaction methods
+ */
+
+void EGMStepper::setConfiguration(const TrajectoryConfiguration& configuration)
+{
+  update_ = configuration;
+  has_pending_update_ = true;
+}
+
+} // end namespace egm
+} // end namespace abb
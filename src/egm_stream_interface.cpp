@@ -0,0 +1,689 @@
+/***********************************************************************************************************************
+ *
+ * Copyright (c) 2015, ABB Schweiz AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that
+ * the following conditions are met:
+ *
+ *    * Redistributions of source code must retain the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer in the documentation
+ *      and/or other materials provided with the
+ *      distribution.
+ *    * Neither the name of ABB nor the names of its
+ *      contributors may be used to endorse or promote
+ *      products derived from this software without
+ *      specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***********************************************************************************************************************
+ */
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+
+#include "abb_libegm/egm_background_service.h"
+#include "abb_libegm/egm_common.h"
+#include "abb_libegm/egm_stream_interface.h"
+
+namespace abb
+{
+namespace egm
+{
+namespace
+{
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::internal::WireFormatLite;
+
+/**
+ * \brief Static constants for the field numbers, in the EGM messages, that are parsed.
+ */
+const int HEADER = 1;
+const int HEADER_SEQNO = 1;
+const int HEADER_TM = 2;
+const int ROBOT_FEEDBACK = 2;
+const int ROBOT_PLANNED = 3;
+const int POSITION_JOINTS = 1;
+const int POSITION_CARTESIAN = 2;
+const int POSITION_EXTERNAL_JOINTS = 3;
+const int POSITION_TIME = 4;
+const int POSE_POS = 1;
+const int POSE_ORIENT = 2;
+const int CLOCK_SEC = 1;
+const int CLOCK_USEC = 2;
+
+/**
+ * \brief Start parsing an embedded message (i.e. limit the input to the message's length).
+ *
+ * \param p_input for the input stream.
+ * \param p_limit for containing the previous limit (to restore when the message has been parsed).
+ *
+ * \return bool indicating if the message's length was read or not.
+ */
+bool beginMessage(CodedInputStream* p_input, CodedInputStream::Limit* p_limit)
+{
+  google::protobuf::uint32 length = 0;
+  bool success = p_input->ReadVarint32(&length);
+
+  if (success)
+  {
+    *p_limit = p_input->PushLimit((int) length);
+  }
+
+  return success;
+}
+
+/**
+ * \brief Finish parsing an embedded message.
+ *
+ * \param p_input for the input stream.
+ * \param limit containing the previous limit.
+ *
+ * \return bool indicating if the whole message was parsed or not.
+ */
+bool endMessage(CodedInputStream* p_input, const CodedInputStream::Limit limit)
+{
+  bool success = p_input->ConsumedEntireMessage();
+  p_input->PopLimit(limit);
+  return success;
+}
+
+/**
+ * \brief Read a double value.
+ *
+ * \param p_input for the input stream.
+ * \param p_value for containing the value.
+ *
+ * \return bool indicating if the value was read or not.
+ */
+bool readDouble(CodedInputStream* p_input, double* p_value)
+{
+  return WireFormatLite::ReadPrimitive<double, WireFormatLite::TYPE_DOUBLE>(p_input, p_value);
+}
+
+/**
+ * \brief Parse a message, which only contains double fields numbered from 1 (e.g. EgmCartesian and EgmQuaternion).
+ *
+ * \param p_input for the input stream.
+ * \param p_values for containing the values (fields outside of the container are skipped).
+ * \param size of the value container.
+ *
+ * \return bool indicating if the message was parsed or not.
+ */
+bool parseDoubles(CodedInputStream* p_input, double* p_values, const int size)
+{
+  CodedInputStream::Limit limit = 0;
+  bool success = beginMessage(p_input, &limit);
+
+  for (google::protobuf::uint32 tag = p_input->ReadTag(); success && tag != 0; tag = p_input->ReadTag())
+  {
+    int field = WireFormatLite::GetTagFieldNumber(tag);
+
+    if (field >= 1 && field <= size && WireFormatLite::GetTagWireType(tag) == WireFormatLite::WIRETYPE_FIXED64)
+    {
+      success = readDouble(p_input, &p_values[field - 1]);
+    }
+    else
+    {
+      success = WireFormatLite::SkipField(p_input, tag);
+    }
+  }
+
+  return success && endMessage(p_input, limit);
+}
+
+/**
+ * \brief Parse an EgmJoints message (the values may be either packed or not).
+ *
+ * \param p_input for the input stream.
+ * \param p_values for containing the values.
+ * \param p_size for containing the number of values (further values than the container can hold are dropped).
+ *
+ * \return bool indicating if the message was parsed or not.
+ */
+bool parseJoints(CodedInputStream* p_input,
+                 boost::array<double, StreamPosition::MAX_JOINTS>* p_values,
+                 unsigned int* p_size)
+{
+  CodedInputStream::Limit limit = 0;
+  bool success = beginMessage(p_input, &limit);
+  double value = 0.0;
+
+  *p_size = 0;
+
+  for (google::protobuf::uint32 tag = p_input->ReadTag(); success && tag != 0; tag = p_input->ReadTag())
+  {
+    if (WireFormatLite::GetTagFieldNumber(tag) != 1)
+    {
+      success = WireFormatLite::SkipField(p_input, tag);
+    }
+    else if (WireFormatLite::GetTagWireType(tag) == WireFormatLite::WIRETYPE_FIXED64)
+    {
+      success = readDouble(p_input, &value);
+
+      if (success && *p_size < StreamPosition::MAX_JOINTS)
+      {
+        (*p_values)[(*p_size)++] = value;
+      }
+    }
+    else if (WireFormatLite::GetTagWireType(tag) == WireFormatLite::WIRETYPE_LENGTH_DELIMITED)
+    {
+      CodedInputStream::Limit packed_limit = 0;
+      success = beginMessage(p_input, &packed_limit);
+
+      if (success)
+      {
+        while (success && p_input->BytesUntilLimit() > 0)
+        {
+          success = readDouble(p_input, &value);
+
+          if (success && *p_size < StreamPosition::MAX_JOINTS)
+          {
+            (*p_values)[(*p_size)++] = value;
+          }
+        }
+
+        p_input->PopLimit(packed_limit);
+      }
+    }
+    else
+    {
+      success = false;
+    }
+  }
+
+  return success && endMessage(p_input, limit);
+}
+
+/**
+ * \brief Parse an EgmClock message.
+ *
+ * \param p_input for the input stream.
+ * \param p_time for containing the time [s].
+ *
+ * \return bool indicating if the message was parsed or not.
+ */
+bool parseClock(CodedInputStream* p_input, double* p_time)
+{
+  CodedInputStream::Limit limit = 0;
+  bool success = beginMessage(p_input, &limit);
+  google::protobuf::uint64 sec = 0;
+  google::protobuf::uint64 usec = 0;
+
+  for (google::protobuf::uint32 tag = p_input->ReadTag(); success && tag != 0; tag = p_input->ReadTag())
+  {
+    switch (WireFormatLite::GetTagFieldNumber(tag))
+    {
+      case CLOCK_SEC:  success = p_input->ReadVarint64(&sec);  break;
+      case CLOCK_USEC: success = p_input->ReadVarint64(&usec); break;
+      default:         success = WireFormatLite::SkipField(p_input, tag); break;
+    }
+  }
+
+  *p_time = (double) sec + ((double) usec) / Constants::Conversion::S_TO_US;
+
+  return success && endMessage(p_input, limit);
+}
+
+/**
+ * \brief Parse an EgmPose message.
+ *
+ * \param p_input for the input stream.
+ * \param p_position for containing the pose.
+ *
+ * \return bool indicating if the message was parsed or not.
+ */
+bool parsePose(CodedInputStream* p_input, StreamPosition* p_position)
+{
+  CodedInputStream::Limit limit = 0;
+  bool success = beginMessage(p_input, &limit);
+
+  for (google::protobuf::uint32 tag = p_input->ReadTag(); success && tag != 0; tag = p_input->ReadTag())
+  {
+    switch (WireFormatLite::GetTagFieldNumber(tag))
+    {
+      case POSE_POS:
+        success = parseDoubles(p_input, p_position->position.data(), (int) p_position->position.size());
+      break;
+
+      case POSE_ORIENT:
+        success = parseDoubles(p_input, p_position->quaternion.data(), (int) p_position->quaternion.size());
+      break;
+
+      default:
+        success = WireFormatLite::SkipField(p_input, tag);
+      break;
+    }
+  }
+
+  p_position->has_cartesian = success;
+
+  return success && endMessage(p_input, limit);
+}
+
+/**
+ * \brief Parse an EgmFeedBack, or an EgmPlanned, message (they have the same fields).
+ *
+ * \param p_input for the input stream.
+ * \param p_position for containing the position.
+ *
+ * \return bool indicating if the message was parsed or not.
+ */
+bool parsePosition(CodedInputStream* p_input, StreamPosition* p_position)
+{
+  CodedInputStream::Limit limit = 0;
+  bool success = beginMessage(p_input, &limit);
+
+  for (google::protobuf::uint32 tag = p_input->ReadTag(); success && tag != 0; tag = p_input->ReadTag())
+  {
+    switch (WireFormatLite::GetTagFieldNumber(tag))
+    {
+      case POSITION_JOINTS:
+        success = parseJoints(p_input, &p_position->robot_joints, &p_position->robot_joints_size);
+      break;
+
+      case POSITION_CARTESIAN:
+        success = parsePose(p_input, p_position);
+      break;
+
+      case POSITION_EXTERNAL_JOINTS:
+        success = parseJoints(p_input, &p_position->external_joints, &p_position->external_joints_size);
+      break;
+
+      case POSITION_TIME:
+        success = parseClock(p_input, &p_position->time);
+        p_position->has_time = success;
+      break;
+
+      default:
+        success = WireFormatLite::SkipField(p_input, tag);
+      break;
+    }
+  }
+
+  return success && endMessage(p_input, limit);
+}
+
+/**
+ * \brief Parse an EgmHeader message.
+ *
+ * \param p_input for the input stream.
+ * \param p_sample for containing the header fields.
+ *
+ * \return bool indicating if the message was parsed or not.
+ */
+bool parseHeader(CodedInputStream* p_input, StreamSample* p_sample)
+{
+  CodedInputStream::Limit limit = 0;
+  bool success = beginMessage(p_input, &limit);
+
+  for (google::protobuf::uint32 tag = p_input->ReadTag(); success && tag != 0; tag = p_input->ReadTag())
+  {
+    switch (WireFormatLite::GetTagFieldNumber(tag))
+    {
+      case HEADER_SEQNO: success = p_input->ReadVarint32(&p_sample->sequence_number); break;
+      case HEADER_TM:    success = p_input->ReadVarint32(&p_sample->time_stamp);      break;
+      default:           success = WireFormatLite::SkipField(p_input, tag);          break;
+    }
+  }
+
+  return success && endMessage(p_input, limit);
+}
+
+/**
+ * \brief Parse an EgmRobot message, but only the header, feedback and planned fields (the others are skipped).
+ *
+ * \param p_data for the serialized message.
+ * \param size of the serialized message.
+ * \param p_sample for containing the parsed fields.
+ *
+ * \return bool indicating if the message was parsed or not (it must contain a header).
+ */
+bool parseRobot(const char* p_data, const int size, StreamSample* p_sample)
+{
+  CodedInputStream input(reinterpret_cast<const google::protobuf::uint8*>(p_data), size);
+  bool success = true;
+  bool has_header = false;
+
+  // Note: The samples' storage is reused, so fields from a previous message must not remain (e.g. a missing time stamp).
+  p_sample->reset();
+
+  for (google::protobuf::uint32 tag = input.ReadTag(); success && tag != 0; tag = input.ReadTag())
+  {
+    switch (WireFormatLite::GetTagFieldNumber(tag))
+    {
+      case HEADER:
+        success = parseHeader(&input, p_sample);
+        has_header = success;
+      break;
+
+      case ROBOT_FEEDBACK:
+        success = parsePosition(&input, &p_sample->feedback);
+      break;
+
+      case ROBOT_PLANNED:
+        success = parsePosition(&input, &p_sample->planned);
+      break;
+
+      default:
+        success = WireFormatLite::SkipField(&input, tag);
+      break;
+    }
+  }
+
+  return success && has_header && input.ConsumedEntireMessage();
+}
+} // end anonymous namespace
+
+
+
+
+/***********************************************************************************************************************
+ * Class definitions: StreamFileSink
+ */
+
+/************************************************************
+ * Primary methods
+ */
+
+StreamFileSink::StreamFileSink(const std::string& filename)
+:
+file_stream_(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc)
+{}
+
+StreamFileSink::~StreamFileSink()
+{
+  if (file_stream_.is_open())
+  {
+    file_stream_.close();
+  }
+}
+
+bool StreamFileSink::isOpen()
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+  return file_stream_.is_open();
+}
+
+void StreamFileSink::write(const unsigned short port_number,
+                           const StreamSample* p_samples,
+                           const size_t number_of_samples)
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+
+  if (p_samples && file_stream_.is_open())
+  {
+    // Note: The buffer keeps its capacity, so it is only reallocated while the batches grow.
+    buffer_.clear();
+
+    for (size_t i = 0; i < number_of_samples; ++i)
+    {
+      encode<boost::uint16_t>(port_number);
+      encode<boost::uint32_t>(p_samples[i].sequence_number);
+      encode<boost::uint32_t>(p_samples[i].time_stamp);
+      encode(p_samples[i].feedback);
+      encode(p_samples[i].planned);
+    }
+
+    file_stream_.write(buffer_.data(), (std::streamsize) buffer_.size());
+  }
+}
+
+/************************************************************
+ * Auxiliary methods
+ */
+
+void StreamFileSink::encode(const StreamPosition& position)
+{
+  encode<boost::uint8_t>((boost::uint8_t) position.robot_joints_size);
+  encode<boost::uint8_t>((boost::uint8_t) position.external_joints_size);
+  encode<boost::uint8_t>((boost::uint8_t) ((position.has_cartesian ? 1 : 0) | (position.has_time ? 2 : 0)));
+
+  for (unsigned int i = 0; i < position.robot_joints_size; ++i)
+  {
+    encode<double>(position.robot_joints[i]);
+  }
+
+  for (unsigned int i = 0; i < position.external_joints_size; ++i)
+  {
+    encode<double>(position.external_joints[i]);
+  }
+
+  if (position.has_cartesian)
+  {
+    for (size_t i = 0; i < position.position.size(); ++i)
+    {
+      encode<double>(position.position[i]);
+    }
+
+    for (size_t i = 0; i < position.quaternion.size(); ++i)
+    {
+      encode<double>(position.quaternion[i]);
+    }
+  }
+
+  if (position.has_time)
+  {
+    encode<double>(position.time);
+  }
+}
+
+
+
+
+/***********************************************************************************************************************
+ * Class definitions: EGMStreamInterface::BatchWriter
+ */
+
+/************************************************************
+ * Primary methods
+ */
+
+void EGMStreamInterface::BatchWriter::handOver(std::vector<StreamSample>* p_batch, const size_t number_of_samples)
+{
+  boost::lock_guard<boost::mutex> lock(queue_mutex_);
+
+  const size_t batch_size = p_batch->size();
+
+  pending_.push_back(Batch());
+  pending_.back().samples.swap(*p_batch);
+  pending_.back().number_of_samples = number_of_samples;
+
+  // Note: New storage is only allocated while the background service hasn't caught up with the handed over batches.
+  if (!spares_.empty())
+  {
+    p_batch->swap(spares_.back());
+    spares_.pop_back();
+  }
+
+  p_batch->resize(batch_size);
+}
+
+void EGMStreamInterface::BatchWriter::write()
+{
+  boost::lock_guard<boost::mutex> write_lock(write_mutex_);
+
+  bool has_batch = true;
+
+  while (has_batch)
+  {
+    {
+      boost::lock_guard<boost::mutex> lock(queue_mutex_);
+
+      // Return the previously written batch's storage, and take the next batch.
+      if (!writing_.samples.empty())
+      {
+        written_samples_ += (p_sink_ ? writing_.number_of_samples : 0);
+        spares_.push_back(std::vector<StreamSample>());
+        spares_.back().swap(writing_.samples);
+      }
+
+      has_batch = !pending_.empty();
+
+      if (has_batch)
+      {
+        writing_.samples.swap(pending_.front().samples);
+        writing_.number_of_samples = pending_.front().number_of_samples;
+        pending_.pop_front();
+      }
+    }
+
+    // Note: The sink is written outside of the queue lock, so that the UDP server's thread never waits for the I/O.
+    if (has_batch && p_sink_ && writing_.number_of_samples > 0)
+    {
+      p_sink_->write(port_number_, writing_.samples.data(), writing_.number_of_samples);
+    }
+  }
+}
+
+void EGMStreamInterface::BatchWriter::detach()
+{
+  boost::lock_guard<boost::mutex> write_lock(write_mutex_);
+  p_sink_ = 0;
+}
+
+unsigned long long EGMStreamInterface::BatchWriter::writtenSamples()
+{
+  boost::lock_guard<boost::mutex> lock(queue_mutex_);
+  return written_samples_;
+}
+
+
+
+
+/***********************************************************************************************************************
+ * Class definitions: EGMStreamInterface
+ */
+
+/************************************************************
+ * Primary methods
+ */
+
+EGMStreamInterface::EGMStreamInterface(boost::asio::io_service& io_service,
+                                       const unsigned short port_number,
+                                       AbstractStreamSink* p_sink,
+                                       const size_t batch_size)
+:
+p_writer_(new BatchWriter(port_number, p_sink)),
+batch_(std::max(batch_size, (size_t) 1)),
+number_of_samples_(0),
+has_sequence_number_(false),
+sequence_number_(0),
+udp_server_(io_service, port_number, this)
+{}
+
+EGMStreamInterface::~EGMStreamInterface()
+{
+  flush();
+
+  // Any still pending background jobs only keep the writer alive, i.e. they must not access the sink.
+  p_writer_->detach();
+}
+
+const std::string& EGMStreamInterface::callback(const UDPServerData& server_data)
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+
+  ++statistics_.received_messages;
+
+  // Note: The samples are parsed directly into the batch (i.e. nothing is allocated per message).
+  StreamSample& sample = batch_[number_of_samples_];
+
+  if (server_data.p_data && parseRobot(server_data.p_data, server_data.bytes_transferred, &sample))
+  {
+    // Note: The sequence number wraps around. Backward jumps (e.g. a restarted stream) are not counted as missed.
+    boost::uint32_t gap = sample.sequence_number - sequence_number_ - 1;
+
+    if (has_sequence_number_ && gap < 0x80000000u)
+    {
+      statistics_.missed_messages += gap;
+    }
+
+    has_sequence_number_ = true;
+    sequence_number_ = sample.sequence_number;
+
+    if (++number_of_samples_ >= batch_.size())
+    {
+      handOverBatch();
+    }
+  }
+  else
+  {
+    ++statistics_.invalid_messages;
+  }
+
+  return empty_reply_;
+}
+
+/************************************************************
+ * Auxiliary methods
+ */
+
+void EGMStreamInterface::handOverBatch()
+{
+  if (number_of_samples_ > 0)
+  {
+    p_writer_->handOver(&batch_, number_of_samples_);
+    number_of_samples_ = 0;
+
+    // Fall back to writing directly, if the background service doesn't accept the job.
+    if (!BackgroundService::getShared().submit(boost::bind(&BatchWriter::write, p_writer_)))
+    {
+      p_writer_->write();
+    }
+  }
+}
+
+/************************************************************
+ * User interaction methods
+ */
+
+bool EGMStreamInterface::isInitialized()
+{
+  return udp_server_.isInitialized();
+}
+
+void EGMStreamInterface::flush()
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+
+  if (number_of_samples_ > 0)
+  {
+    p_writer_->handOver(&batch_, number_of_samples_);
+    number_of_samples_ = 0;
+  }
+
+  p_writer_->write();
+}
+
+EGMStreamInterface::Statistics EGMStreamInterface::getStatistics()
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+
+  Statistics statistics = statistics_;
+  statistics.written_samples = p_writer_->writtenSamples();
+
+  return statistics;
+}
+
+} // end namespace egm
+} // end namespace abb
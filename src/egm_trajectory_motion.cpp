@@ -0,0 +1,3372 @@
+/***********************************************************************************************************************
+ *
+ * Copyright (c) 2015, ABB Schweiz AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that
+ * the following conditions are met:
+ *
+ *    * Redistributions of source code must retain the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer in the documentation
+ *      and/or other materials provided with the
+ *      distribution.
+ *    * Neither the name of ABB nor the names of its
+ *      contributors may be used to endorse or promote
+ *      products derived from this software without
+ *      specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***********************************************************************************************************************
+ */
+
+#define _USE_MATH_DEFINES
+
+#include <math.h>
+
+#include <limits>
+
+#include "abb_libegm/egm_common_auxiliary.h"
+#include "abb_libegm/egm_trajectory_motion.h"
+
+namespace abb
+{
+namespace egm
+{
+
+using namespace wrapper;
+using namespace wrapper::trajectory;
+
+namespace
+{
+/**
+ * \brief Enum for the fields of a point in the compact form (i.e. bit positions in the point's flags).
+ *
+ * Note: Each joint field is followed by its position, velocity, acceleration and jerk fields. Each Cartesian
+ *       and Euler field is followed by its x, y and z fields. The quaternion field is followed by its u0-u3 fields.
+ */
+enum CompactField
+{
+  CompactDuration = 0,
+  CompactHasReach = 1,
+  CompactReach = 2,
+  CompactRobot = 3,
+  CompactRobotJoints = 4,
+  CompactRobotCartesian = 9,
+  CompactPose = 10,
+  CompactPosePosition = 11,
+  CompactPoseEuler = 15,
+  CompactPoseQuaternion = 19,
+  CompactVelocity = 24,
+  CompactAcceleration = 28,
+  CompactJerk = 32,
+  CompactExternal = 36,
+  CompactExternalJoints = 37,
+  CompactAngularVelocity = 42
+};
+
+/**
+ * \brief Check if a field is present in a compact point's flags.
+ *
+ * \param flags containing the point's flags.
+ * \param field specifying the field to check.
+ *
+ * \return bool indicating if the field is present or not.
+ */
+bool isPresent(const boost::uint64_t flags, const int field)
+{
+  return (flags & (boost::uint64_t(1) << field)) != 0;
+}
+
+/**
+ * \brief Mark a field as present in a compact point's flags.
+ *
+ * \param present indicating if the field is present or not.
+ * \param field specifying the field to mark.
+ * \param p_flags for containing the point's flags.
+ *
+ * \return bool indicating if the field is present or not.
+ */
+bool setPresent(const bool present, const int field, boost::uint64_t* p_flags)
+{
+  if (present)
+  {
+    *p_flags |= (boost::uint64_t(1) << field);
+  }
+
+  return present;
+}
+
+/**
+ * \brief Encode a value (in single precision, relative to a reference value).
+ *
+ * \param present indicating if the value is present or not.
+ * \param value to encode.
+ * \param reference for the reference value.
+ * \param field specifying the value's field.
+ * \param p_flags for containing the point's flags.
+ * \param p_values for containing the encoded values.
+ */
+void encodeValue(const bool present,
+                 const double value,
+                 const double reference,
+                 const int field,
+                 boost::uint64_t* p_flags,
+                 std::vector<float>* p_values)
+{
+  if (setPresent(present, field, p_flags))
+  {
+    p_values->push_back(static_cast<float>(value - reference));
+  }
+}
+
+/**
+ * \brief Decode a value (and advance to the next encoded value).
+ *
+ * \param reference for the reference value.
+ * \param p_values for the position of the encoded value.
+ *
+ * \return double containing the decoded value.
+ */
+double decodeValue(const double reference, std::deque<float>::const_iterator* p_values)
+{
+  return reference + *((*p_values)++);
+}
+
+/**
+ * \brief Encode joint values.
+ *
+ * \param present indicating if the joint values are present or not.
+ * \param joints containing the joint values to encode.
+ * \param reference for the reference joint values (missing values are treated as zero).
+ * \param field specifying the joint values' field.
+ * \param p_flags for containing the point's flags.
+ * \param p_values for containing the encoded values.
+ *
+ * \return unsigned char containing the number of encoded joint values.
+ */
+unsigned char encodeJoints(const bool present,
+                           const Joints& joints,
+                           const Joints& reference,
+                           const int field,
+                           boost::uint64_t* p_flags,
+                           std::vector<float>* p_values)
+{
+  int count = 0;
+
+  if (setPresent(present, field, p_flags))
+  {
+    count = std::min(joints.values_size(), (int) std::numeric_limits<unsigned char>::max());
+
+    for (int i = 0; i < count; ++i)
+    {
+      p_values->push_back(static_cast<float>(joints.values(i) -
+                                             (i < reference.values_size() ? reference.values(i) : 0.0)));
+    }
+  }
+
+  return (unsigned char) count;
+}
+
+/**
+ * \brief Decode joint values.
+ *
+ * \param count specifying the number of encoded joint values.
+ * \param reference for the reference joint values (missing values are treated as zero).
+ * \param p_values for the position of the first encoded value.
+ * \param p_joints for containing the decoded joint values.
+ */
+void decodeJoints(const unsigned char count,
+                  const Joints& reference,
+                  std::deque<float>::const_iterator* p_values,
+                  Joints* p_joints)
+{
+  for (int i = 0; i < count; ++i)
+  {
+    p_joints->add_values(decodeValue((i < reference.values_size() ? reference.values(i) : 0.0), p_values));
+  }
+}
+
+/**
+ * \brief Encode a joint goal (only the positions are encoded relative to the reference).
+ *
+ * \param present indicating if the joint goal is present or not.
+ * \param goal containing the joint goal to encode.
+ * \param reference for the reference joint goal.
+ * \param field specifying the joint goal's field.
+ * \param p_counts for containing the number of encoded values (for the goal's four joint fields).
+ * \param p_flags for containing the point's flags.
+ * \param p_values for containing the encoded values.
+ */
+void encodeJointGoal(const bool present,
+                     const trajectory::JointGoal& goal,
+                     const trajectory::JointGoal& reference,
+                     const int field,
+                     unsigned char* p_counts,
+                     boost::uint64_t* p_flags,
+                     std::vector<float>* p_values)
+{
+  if (setPresent(present, field, p_flags))
+  {
+    const Joints& zero = Joints::default_instance();
+    p_counts[0] = encodeJoints(goal.has_position(), goal.position(), reference.position(), field + 1,
+                               p_flags, p_values);
+    p_counts[1] = encodeJoints(goal.has_velocity(), goal.velocity(), zero, field + 2, p_flags, p_values);
+    p_counts[2] = encodeJoints(goal.has_acceleration(), goal.acceleration(), zero, field + 3, p_flags, p_values);
+    p_counts[3] = encodeJoints(goal.has_jerk(), goal.jerk(), zero, field + 4, p_flags, p_values);
+  }
+}
+
+/**
+ * \brief Decode a joint goal.
+ *
+ * \param flags containing the point's flags.
+ * \param field specifying the joint goal's field.
+ * \param p_counts containing the number of encoded values (for the goal's four joint fields).
+ * \param reference for the reference joint goal.
+ * \param p_values for the position of the first encoded value.
+ * \param p_goal for containing the decoded joint goal.
+ */
+void decodeJointGoal(const boost::uint64_t flags,
+                     const int field,
+                     const unsigned char* p_counts,
+                     const trajectory::JointGoal& reference,
+                     std::deque<float>::const_iterator* p_values,
+                     trajectory::JointGoal* p_goal)
+{
+  const Joints& zero = Joints::default_instance();
+
+  if (isPresent(flags, field + 1))
+  {
+    decodeJoints(p_counts[0], reference.position(), p_values, p_goal->mutable_position());
+  }
+
+  if (isPresent(flags, field + 2))
+  {
+    decodeJoints(p_counts[1], zero, p_values, p_goal->mutable_velocity());
+  }
+
+  if (isPresent(flags, field + 3))
+  {
+    decodeJoints(p_counts[2], zero, p_values, p_goal->mutable_acceleration());
+  }
+
+  if (isPresent(flags, field + 4))
+  {
+    decodeJoints(p_counts[3], zero, p_values, p_goal->mutable_jerk());
+  }
+}
+
+/**
+ * \brief Encode a message with x, y and z values (e.g. Cartesian or Euler values).
+ *
+ * \param present indicating if the message is present or not.
+ * \param message containing the values to encode.
+ * \param reference for the reference values.
+ * \param field specifying the message's field.
+ * \param p_flags for containing the point's flags.
+ * \param p_values for containing the encoded values.
+ */
+template <typename T>
+void encodeXYZ(const bool present,
+               const T& message,
+               const T& reference,
+               const int field,
+               boost::uint64_t* p_flags,
+               std::vector<float>* p_values)
+{
+  if (setPresent(present, field, p_flags))
+  {
+    encodeValue(message.has_x(), message.x(), reference.x(), field + 1, p_flags, p_values);
+    encodeValue(message.has_y(), message.y(), reference.y(), field + 2, p_flags, p_values);
+    encodeValue(message.has_z(), message.z(), reference.z(), field + 3, p_flags, p_values);
+  }
+}
+
+/**
+ * \brief Decode a message with x, y and z values (e.g. Cartesian or Euler values).
+ *
+ * \param flags containing the point's flags.
+ * \param field specifying the message's field.
+ * \param reference for the reference values.
+ * \param p_values for the position of the first encoded value.
+ * \param p_message for containing the decoded values.
+ */
+template <typename T>
+void decodeXYZ(const boost::uint64_t flags,
+               const int field,
+               const T& reference,
+               std::deque<float>::const_iterator* p_values,
+               T* p_message)
+{
+  if (isPresent(flags, field + 1))
+  {
+    p_message->set_x(decodeValue(reference.x(), p_values));
+  }
+
+  if (isPresent(flags, field + 2))
+  {
+    p_message->set_y(decodeValue(reference.y(), p_values));
+  }
+
+  if (isPresent(flags, field + 3))
+  {
+    p_message->set_z(decodeValue(reference.z(), p_values));
+  }
+}
+
+/**
+ * \brief Convert a clock message to seconds.
+ *
+ * \param clock containing the clock message.
+ *
+ * \return double containing the time [s].
+ */
+double toSeconds(const Clock& clock)
+{
+  return (double) clock.sec() + ((double) clock.usec()) / Constants::Conversion::S_TO_US;
+}
+
+/**
+ * \brief Get a joint value.
+ *
+ * \param joints containing the joint values.
+ * \param index specifying the joint's index.
+ *
+ * \return double containing the value (zero if it is missing).
+ */
+double getValue(const Joints& joints, const int index)
+{
+  return (index < joints.values_size() ? joints.values(index) : 0.0);
+}
+
+/**
+ * \brief Get a Cartesian value.
+ *
+ * \param cartesian containing the Cartesian values.
+ * \param axis specifying the axis (i.e. 0, 1 or 2 for x, y or z).
+ *
+ * \return double containing the value.
+ */
+double getValue(const Cartesian& cartesian, const int axis)
+{
+  switch (axis)
+  {
+    case 0:  return cartesian.x();
+    case 1:  return cartesian.y();
+    default: return cartesian.z();
+  }
+}
+
+/**
+ * \brief Calculate the max change, during a time step, for a rate limit.
+ *
+ * \param rate specifying the max rate of change (zero means no limit).
+ * \param time_step specifying the time step [s].
+ *
+ * \return double containing the max change (negative means no limit).
+ */
+double limitChange(const double rate, const double time_step)
+{
+  return (rate > 0.0 ? rate*time_step : -1.0);
+}
+} // end anonymous namespace
+
+
+
+
+/***********************************************************************************************************************
+ * Class definitions: Trajectory
+ */
+
+const size_t Trajectory::SEGMENT_LENGTH;
+
+/************************************************************
+ * Primary methods
+ */
+
+Trajectory::Trajectory(const bool compact, const size_t seek_history)
+:
+compact_(compact),
+seek_history_(seek_history),
+released_points_(0),
+released_values_(0),
+released_reach_time_(0.0),
+released_bytes_(0),
+cursor_(0),
+has_front_point_(false),
+front_index_(0),
+current_index_(0),
+has_peeked_point_(false),
+has_start_time_(false),
+start_time_(0.0),
+front_point_bytes_(0),
+p_usage_(0),
+reported_points_(0),
+reported_bytes_(0)
+{}
+
+Trajectory::Trajectory(const TrajectoryGoal& trajectory, const bool compact, const size_t seek_history)
+:
+compact_(compact),
+seek_history_(seek_history),
+released_points_(0),
+released_values_(0),
+released_reach_time_(0.0),
+released_bytes_(0),
+cursor_(0),
+has_front_point_(false),
+front_index_(0),
+current_index_(0),
+has_peeked_point_(false),
+has_start_time_(trajectory.has_start_time()),
+start_time_(toSeconds(trajectory.start_time())),
+front_point_bytes_(0),
+p_usage_(0),
+reported_points_(0),
+reported_bytes_(0)
+{
+  for (int i = 0; i < trajectory.points_size(); ++i)
+  {
+    addTrajectoryPointBack(trajectory.points().Get(i));
+  }
+}
+
+void Trajectory::addTrajectoryPointFront(const PointGoal& point)
+{
+  front_point_.CopyFrom(point);
+  front_point_bytes_ = front_point_.SpaceUsedLong();
+  front_index_ = current_index_;
+  has_front_point_ = true;
+
+  updateUsage();
+}
+
+void Trajectory::addTrajectoryPointBack(const PointGoal& point)
+{
+  boost::lock_guard<boost::mutex> lock(storage_mutex_);
+
+  // Note: Each stored point also uses one entry in the reach time and the accumulated memory containers.
+  size_t bytes = sizeof(double) + sizeof(size_t);
+
+  reach_times_.push_back((reach_times_.empty() ? released_reach_time_ : reach_times_.back()) + point.duration());
+
+  if (compact_)
+  {
+    // Note: The first point in each segment is also kept as the segment's start (i.e. in full precision).
+    if (storedEnd() % SEGMENT_LENGTH == 0)
+    {
+      segment_starts_.push_back(point);
+      bytes += segment_starts_.back().SpaceUsedLong();
+    }
+
+    CompactPoint compact;
+    encodePoint(point, segment_starts_.back(), &compact);
+    compact.first_value = released_values_ + compact_values_.size();
+    compact_points_.push_back(compact);
+    compact_values_.insert(compact_values_.end(), encoding_buffer_.begin(), encoding_buffer_.end());
+    bytes += sizeof(CompactPoint) + encoding_buffer_.size()*sizeof(float);
+  }
+  else
+  {
+    points_.push_back(point);
+    bytes += points_.back().SpaceUsedLong();
+  }
+
+  accumulated_bytes_.push_back((accumulated_bytes_.empty() ? released_bytes_ : accumulated_bytes_.back()) + bytes);
+
+  updateUsage();
+}
+
+bool Trajectory::retriveNextTrajectoryPoint(PointGoal* p_point)
+{
+  bool result = false;
+
+  if (p_point && has_front_point_)
+  {
+    p_point->CopyFrom(front_point_);
+    dropNextTrajectoryPoint();
+    result = true;
+  }
+  else if (p_point && compact_ && cursor_ < storedEnd())
+  {
+    decodePoint(cursor_, p_point);
+    dropNextTrajectoryPoint();
+    result = true;
+  }
+  else if (p_point && !compact_ && cursor_ < storedEnd())
+  {
+    p_point->CopyFrom(points_[cursor_ - released_points_]);
+    dropNextTrajectoryPoint();
+    result = true;
+  }
+
+  return result;
+}
+
+void Trajectory::dropNextTrajectoryPoint()
+{
+  if (has_front_point_)
+  {
+    current_index_ = front_index_;
+    has_front_point_ = false;
+  }
+  else if (cursor_ < storedEnd())
+  {
+    current_index_ = cursor_++;
+    has_peeked_point_ = false;
+    releaseExecutedPoints();
+  }
+
+  updateUsage();
+}
+
+const PointGoal* Trajectory::peekNextTrajectoryPoint() const
+{
+  const PointGoal* p_point = 0;
+
+  if (has_front_point_)
+  {
+    p_point = &front_point_;
+  }
+  else if (compact_ && cursor_ < storedEnd())
+  {
+    if (!has_peeked_point_)
+    {
+      decodePoint(cursor_, &peeked_point_);
+      has_peeked_point_ = true;
+    }
+
+    p_point = &peeked_point_;
+  }
+  else if (!compact_ && cursor_ < storedEnd())
+  {
+    p_point = &points_[cursor_ - released_points_];
+  }
+
+  return p_point;
+}
+
+void Trajectory::copyTo(TrajectoryGoal* p_trajectory)
+{
+  copyFrontTo(p_trajectory);
+  copyStoredTo(cursor_, p_trajectory);
+}
+
+void Trajectory::copyFrontTo(TrajectoryGoal* p_trajectory) const
+{
+  if (p_trajectory)
+  {
+    if (has_start_time_)
+    {
+      google::protobuf::uint64 us = (google::protobuf::uint64) (start_time_*Constants::Conversion::S_TO_US + 0.5);
+      p_trajectory->mutable_start_time()->set_sec(us / (google::protobuf::uint64) Constants::Conversion::S_TO_US);
+      p_trajectory->mutable_start_time()->set_usec(us % (google::protobuf::uint64) Constants::Conversion::S_TO_US);
+    }
+
+    if (has_front_point_)
+    {
+      p_trajectory->add_points()->CopyFrom(front_point_);
+    }
+  }
+}
+
+void Trajectory::copyStoredTo(const size_t index, TrajectoryGoal* p_trajectory) const
+{
+  if (p_trajectory)
+  {
+    boost::lock_guard<boost::mutex> lock(storage_mutex_);
+
+    if (compact_)
+    {
+      for (size_t i = std::max(index, released_points_); i < storedEnd(); ++i)
+      {
+        decodePoint(i, p_trajectory->add_points());
+      }
+    }
+    else
+    {
+      for (size_t i = std::max(index, released_points_) - released_points_; i < points_.size(); ++i)
+      {
+        p_trajectory->add_points()->CopyFrom(points_[i]);
+      }
+    }
+  }
+}
+
+bool Trajectory::seek(const size_t index, const double duration)
+{
+  bool result = (index >= released_points_ && index < storedEnd());
+
+  if (result)
+  {
+    // Place the point in the front (with the approach duration), followed by the points after it.
+    cursor_ = index;
+    has_front_point_ = false;
+    has_peeked_point_ = false;
+    addTrajectoryPointFront(*peekNextTrajectoryPoint());
+    front_point_.set_duration(duration);
+    front_index_ = index;
+    cursor_ = index + 1;
+    releaseExecutedPoints();
+
+    updateUsage();
+  }
+
+  return result;
+}
+
+bool Trajectory::findIndex(const double time, size_t* p_index) const
+{
+  // Note: A microsecond tolerance is used, since the reach times are accumulated (i.e. they have rounding errors).
+  std::deque<double>::const_iterator i = std::lower_bound(reach_times_.begin(), reach_times_.end(), time - 1.0e-6);
+
+  // Note: Times up to the last released point's reach time are found among the released points.
+  bool result = (p_index && i != reach_times_.end() && (released_points_ == 0 || time - 1.0e-6 > released_reach_time_));
+
+  if (result)
+  {
+    *p_index = released_points_ + (size_t) (i - reach_times_.begin());
+  }
+
+  return result;
+}
+
+size_t Trajectory::bytes() const
+{
+  // Note: The trajectory itself is owned by a shared pointer, which is stored in a queue.
+  size_t result = sizeof(Trajectory) +
+                  sizeof(boost::detail::sp_counted_impl_p<Trajectory>) +
+                  sizeof(boost::shared_ptr<Trajectory>);
+
+  if (!accumulated_bytes_.empty())
+  {
+    result += accumulated_bytes_.back() -
+              (cursor_ > released_points_ ? accumulated_bytes_[cursor_ - released_points_ - 1] : released_bytes_);
+  }
+
+  if (has_front_point_)
+  {
+    result += front_point_bytes_;
+  }
+
+  return result;
+}
+
+void Trajectory::attach(QueueUsage* p_usage)
+{
+  detach();
+
+  if (p_usage)
+  {
+    p_usage_ = p_usage;
+    reported_points_ = 0;
+    reported_bytes_ = 0;
+    updateUsage();
+  }
+}
+
+void Trajectory::detach()
+{
+  if (p_usage_)
+  {
+    p_usage_->points -= std::min(p_usage_->points, reported_points_);
+    p_usage_->bytes -= std::min(p_usage_->bytes, reported_bytes_);
+    p_usage_ = 0;
+  }
+}
+
+/************************************************************
+ * Auxiliary methods
+ */
+
+void Trajectory::updateUsage()
+{
+  if (p_usage_)
+  {
+    size_t points = size();
+    size_t bytes = this->bytes();
+
+    p_usage_->points = p_usage_->points - std::min(p_usage_->points, reported_points_) + points;
+    p_usage_->bytes = p_usage_->bytes - std::min(p_usage_->bytes, reported_bytes_) + bytes;
+    reported_points_ = points;
+    reported_bytes_ = bytes;
+  }
+}
+
+void Trajectory::encodePoint(const PointGoal& point,
+                             const PointGoal& segment_start,
+                             CompactPoint* p_compact)
+{
+  boost::uint64_t flags = 0;
+  std::vector<float>* p_values = &encoding_buffer_;
+
+  p_values->clear();
+  std::fill(p_compact->joint_counts, p_compact->joint_counts + 8, 0);
+
+  p_compact->duration = (setPresent(point.has_duration(), CompactDuration, &flags) ? point.duration() : 0.0);
+  setPresent(point.has_reach(), CompactHasReach, &flags);
+  setPresent(point.reach(), CompactReach, &flags);
+
+  if (setPresent(point.has_robot(), CompactRobot, &flags))
+  {
+    const RobotGoal& robot = point.robot();
+
+    encodeJointGoal(robot.has_joints(), robot.joints(), segment_start.robot().joints(),
+                    CompactRobotJoints, p_compact->joint_counts, &flags, p_values);
+
+    if (setPresent(robot.has_cartesian(), CompactRobotCartesian, &flags))
+    {
+      const CartesianGoal& cartesian = robot.cartesian();
+      const CartesianPose& reference = segment_start.robot().cartesian().pose();
+
+      if (setPresent(cartesian.has_pose(), CompactPose, &flags))
+      {
+        const CartesianPose& pose = cartesian.pose();
+
+        encodeXYZ(pose.has_position(), pose.position(), reference.position(), CompactPosePosition, &flags, p_values);
+        encodeXYZ(pose.has_euler(), pose.euler(), reference.euler(), CompactPoseEuler, &flags, p_values);
+
+        // Note: Quaternion values are bounded (i.e. they are not encoded relative to the reference).
+        if (setPresent(pose.has_quaternion(), CompactPoseQuaternion, &flags))
+        {
+          const Quaternion& quaternion = pose.quaternion();
+          encodeValue(quaternion.has_u0(), quaternion.u0(), 0.0, CompactPoseQuaternion + 1, &flags, p_values);
+          encodeValue(quaternion.has_u1(), quaternion.u1(), 0.0, CompactPoseQuaternion + 2, &flags, p_values);
+          encodeValue(quaternion.has_u2(), quaternion.u2(), 0.0, CompactPoseQuaternion + 3, &flags, p_values);
+          encodeValue(quaternion.has_u3(), quaternion.u3(), 0.0, CompactPoseQuaternion + 4, &flags, p_values);
+        }
+      }
+
+      const Cartesian& zero = Cartesian::default_instance();
+      encodeXYZ(cartesian.has_velocity(), cartesian.velocity(), zero, CompactVelocity, &flags, p_values);
+      encodeXYZ(cartesian.has_acceleration(), cartesian.acceleration(), zero, CompactAcceleration, &flags, p_values);
+      encodeXYZ(cartesian.has_jerk(), cartesian.jerk(), zero, CompactJerk, &flags, p_values);
+
+      // Note: Its flags follow the external joint fields' flags, but its values are encoded here (after the jerk).
+      encodeXYZ(cartesian.has_angular_velocity(), cartesian.angular_velocity(), Euler::default_instance(),
+                CompactAngularVelocity, &flags, p_values);
+    }
+  }
+
+  if (setPresent(point.has_external(), CompactExternal, &flags))
+  {
+    encodeJointGoal(point.external().has_joints(), point.external().joints(), segment_start.external().joints(),
+                    CompactExternalJoints, p_compact->joint_counts + 4, &flags, p_values);
+  }
+
+  p_compact->flags = flags;
+}
+
+void Trajectory::decodePoint(const size_t index, PointGoal* p_point) const
+{
+  // Note: Points are released in whole segments, so the stored points' segments are still aligned.
+  const CompactPoint& compact = compact_points_[index - released_points_];
+  const PointGoal& segment_start = segment_starts_[(index - released_points_) / SEGMENT_LENGTH];
+  const boost::uint64_t flags = compact.flags;
+  std::deque<float>::const_iterator values = compact_values_.begin() + (compact.first_value - released_values_);
+
+  // Note: Clearing (instead of recreating) the point keeps its already allocated memory.
+  p_point->Clear();
+
+  if (isPresent(flags, CompactDuration))
+  {
+    p_point->set_duration(compact.duration);
+  }
+
+  if (isPresent(flags, CompactHasReach))
+  {
+    p_point->set_reach(isPresent(flags, CompactReach));
+  }
+
+  if (isPresent(flags, CompactRobot))
+  {
+    RobotGoal* p_robot = p_point->mutable_robot();
+
+    if (isPresent(flags, CompactRobotJoints))
+    {
+      decodeJointGoal(flags, CompactRobotJoints, compact.joint_counts, segment_start.robot().joints(),
+                      &values, p_robot->mutable_joints());
+    }
+
+    if (isPresent(flags, CompactRobotCartesian))
+    {
+      CartesianGoal* p_cartesian = p_robot->mutable_cartesian();
+      const CartesianPose& reference = segment_start.robot().cartesian().pose();
+
+      if (isPresent(flags, CompactPose))
+      {
+        CartesianPose* p_pose = p_cartesian->mutable_pose();
+
+        if (isPresent(flags, CompactPosePosition))
+        {
+          decodeXYZ(flags, CompactPosePosition, reference.position(), &values, p_pose->mutable_position());
+        }
+
+        if (isPresent(flags, CompactPoseEuler))
+        {
+          decodeXYZ(flags, CompactPoseEuler, reference.euler(), &values, p_pose->mutable_euler());
+        }
+
+        if (isPresent(flags, CompactPoseQuaternion))
+        {
+          Quaternion* p_quaternion = p_pose->mutable_quaternion();
+
+          if (isPresent(flags, CompactPoseQuaternion + 1))
+          {
+            p_quaternion->set_u0(decodeValue(0.0, &values));
+          }
+
+          if (isPresent(flags, CompactPoseQuaternion + 2))
+          {
+            p_quaternion->set_u1(decodeValue(0.0, &values));
+          }
+
+          if (isPresent(flags, CompactPoseQuaternion + 3))
+          {
+            p_quaternion->set_u2(decodeValue(0.0, &values));
+          }
+
+          if (isPresent(flags, CompactPoseQuaternion + 4))
+          {
+            p_quaternion->set_u3(decodeValue(0.0, &values));
+          }
+        }
+      }
+
+      const Cartesian& zero = Cartesian::default_instance();
+
+      if (isPresent(flags, CompactVelocity))
+      {
+        decodeXYZ(flags, CompactVelocity, zero, &values, p_cartesian->mutable_velocity());
+      }
+
+      if (isPresent(flags, CompactAcceleration))
+      {
+        decodeXYZ(flags, CompactAcceleration, zero, &values, p_cartesian->mutable_acceleration());
+      }
+
+      if (isPresent(flags, CompactJerk))
+      {
+        decodeXYZ(flags, CompactJerk, zero, &values, p_cartesian->mutable_jerk());
+      }
+
+      if (isPresent(flags, CompactAngularVelocity))
+      {
+        decodeXYZ(flags, CompactAngularVelocity, Euler::default_instance(), &values,
+                  p_cartesian->mutable_angular_velocity());
+      }
+    }
+  }
+
+  if (isPresent(flags, CompactExternal))
+  {
+    ExternalGoal* p_external = p_point->mutable_external();
+
+    if (isPresent(flags, CompactExternalJoints))
+    {
+      decodeJointGoal(flags, CompactExternalJoints, compact.joint_counts + 4, segment_start.external().joints(),
+                      &values, p_external->mutable_joints());
+    }
+  }
+}
+
+void Trajectory::releaseExecutedPoints()
+{
+  boost::unique_lock<boost::mutex> lock(storage_mutex_, boost::try_to_lock);
+
+  // Note: A segment is only released once all of its points are outside of the seek history.
+  while (lock.owns_lock() && cursor_ - released_points_ >= seek_history_ + SEGMENT_LENGTH)
+  {
+    if (compact_)
+    {
+      size_t values = (compact_points_.size() > SEGMENT_LENGTH ?
+                       compact_points_[SEGMENT_LENGTH].first_value - released_values_ : compact_values_.size());
+
+      compact_values_.erase(compact_values_.begin(), compact_values_.begin() + values);
+      compact_points_.erase(compact_points_.begin(), compact_points_.begin() + SEGMENT_LENGTH);
+      segment_starts_.pop_front();
+      released_values_ += values;
+    }
+    else
+    {
+      points_.erase(points_.begin(), points_.begin() + SEGMENT_LENGTH);
+    }
+
+    released_reach_time_ = reach_times_[SEGMENT_LENGTH - 1];
+    released_bytes_ = accumulated_bytes_[SEGMENT_LENGTH - 1];
+    reach_times_.erase(reach_times_.begin(), reach_times_.begin() + SEGMENT_LENGTH);
+    accumulated_bytes_.erase(accumulated_bytes_.begin(), accumulated_bytes_.begin() + SEGMENT_LENGTH);
+    released_points_ += SEGMENT_LENGTH;
+  }
+}
+
+
+
+
+/***********************************************************************************************************************
+ * Class definitions: TrajectoryMotion::StateManager
+ */
+
+/************************************************************
+ * Primary methods
+ */
+
+void TrajectoryMotion::StateManager::setPendingState(const States& desired_state,
+                                                     const SubStates& desired_sub_state)
+{
+  bool accepted = false;
+
+  switch (current_state_)
+  {
+    case Normal:
+    {
+      switch (current_sub_state_)
+      {
+        case None:
+          // Should never occur.
+        break;
+
+        case Running:
+          accepted = (desired_state == RampDown && desired_sub_state == None);
+        break;
+
+        case Finished:
+          // Should never occur.
+        break;
+      }
+    }
+    break;
+
+    case RampDown:
+    {
+      switch (current_sub_state_)
+      {
+        case None:
+          accepted = (desired_state == RampDown && desired_sub_state == Running);
+        break;
+
+        case Running:
+          accepted = (desired_state == RampDown && desired_sub_state == Finished);
+        break;
+
+        case Finished:
+          accepted = (desired_state == Normal && desired_sub_state == Running) ||
+                     (desired_state == StaticGoal && desired_sub_state == None);
+        break;
+      }
+    }
+    break;
+
+    case StaticGoal:
+    {
+      switch (current_sub_state_)
+      {
+        case None:
+          accepted = (desired_state == StaticGoal && desired_sub_state == Running);
+        break;
+
+        case Running:
+          accepted = (desired_state == StaticGoal && desired_sub_state == Finished) ||
+                     (desired_state == RampDown && desired_sub_state == None);
+        break;
+
+        case Finished:
+          accepted = (desired_state == RampDown && desired_sub_state == None);
+        break;
+      }
+    }
+    break;
+  }
+
+  if (accepted)
+  {
+    pending_state_ = desired_state;
+    pending_sub_state_ = desired_sub_state;
+    has_pending_state_ = true;
+  }
+}
+
+/************************************************************
+ * Auxiliary methods
+ */
+
+wrapper::trajectory::ExecutionProgress_State TrajectoryMotion::StateManager::mapState()
+{
+  switch (current_state_)
+  {
+    case Normal:
+      return wrapper::trajectory::ExecutionProgress_State_NORMAL;
+    break;
+
+    case RampDown:
+      return wrapper::trajectory::ExecutionProgress_State_RAMP_DOWN;
+    break;
+
+    case StaticGoal:
+      return wrapper::trajectory::ExecutionProgress_State_STATIC_GOAL;
+    break;
+
+    default:
+      return wrapper::trajectory::ExecutionProgress_State_UNDEFINED;
+  }
+}
+
+wrapper::trajectory::ExecutionProgress_SubState TrajectoryMotion::StateManager::mapSubState()
+{
+  switch (current_sub_state_)
+  {
+    case None:
+      return wrapper::trajectory::ExecutionProgress_SubState_NONE;
+    break;
+
+    case Running:
+      return wrapper::trajectory::ExecutionProgress_SubState_RUNNING;
+    break;
+
+    case Finished:
+      return wrapper::trajectory::ExecutionProgress_SubState_FINISHED;
+    break;
+
+    default:
+      return wrapper::trajectory::ExecutionProgress_SubState_NONE;
+  }
+}
+
+
+
+
+/***********************************************************************************************************************
+ * Class definitions: TrajectoryMotion::MotionStep
+ */
+
+/************************************************************
+ * Primary methods
+ */
+
+void TrajectoryMotion::MotionStep::resetMotionStep()
+{
+  unsigned int robot_joints = data.feedback.robot().joints().position().values_size();
+  unsigned int external_joints = data.feedback.external().joints().position().values_size();
+
+  internal_goal.Clear();
+  external_goal.Clear();
+
+  //---------------------------------------------------------
+  // Internal goal field
+  //---------------------------------------------------------
+  const wrapper::Feedback& feedback = data.feedback;
+  wrapper::trajectory::JointGoal* p_robot_joints = internal_goal.mutable_robot()->mutable_joints();
+  wrapper::trajectory::CartesianGoal* p_robot_cartesian = internal_goal.mutable_robot()->mutable_cartesian();
+  wrapper::trajectory::ExternalGoal* p_external = internal_goal.mutable_external();
+
+  //-----------------------------
+  // Positions
+  //-----------------------------
+  // Copy joint values.
+  p_robot_joints->mutable_position()->CopyFrom(feedback.robot().joints().position());
+  p_external->mutable_joints()->mutable_position()->CopyFrom(feedback.external().joints().position());
+
+  // Copy Cartesian values. Note: The internal goal's Euler field is used to contain angular velocities.
+  p_robot_cartesian->mutable_pose()->mutable_position()->CopyFrom(feedback.robot().cartesian().pose().position());
+  p_robot_cartesian->mutable_pose()->mutable_quaternion()->CopyFrom(feedback.robot().cartesian().pose().quaternion());
+
+  //-----------------------------
+  // Velocities and accelerations
+  //-----------------------------
+  // Reset joint values.
+  reset(p_robot_joints->mutable_velocity(), robot_joints);
+  reset(p_robot_joints->mutable_acceleration(), robot_joints);
+  reset(p_external->mutable_joints()->mutable_velocity(), external_joints);
+  reset(p_external->mutable_joints()->mutable_acceleration(), external_joints);
+
+  // Reset Cartesian values. Note: The internal goal's Euler field is used to contain angular velocities.
+  reset(p_robot_cartesian->mutable_velocity());
+  reset(p_robot_cartesian->mutable_acceleration());
+  reset(p_robot_cartesian->mutable_pose()->mutable_euler());
+
+  // Reset jerk values (only used by the septic spline method).
+  resetJerks(&internal_goal);
+
+  //---------------------------------------------------------
+  // The remaining fields
+  //---------------------------------------------------------
+  data.time_passed = 0.0;
+  data.mode = EGMJoint;
+  interpolation.CopyFrom(internal_goal);
+}
+
+void TrajectoryMotion::MotionStep::prepareNormalGoal(const bool last_point,
+                                                     const PointGoal* p_next_point)
+{
+  unsigned int robot_joints = data.feedback.robot().joints().position().values_size();
+  unsigned int external_joints = data.feedback.external().joints().position().values_size();
+
+  data.mode = (external_goal.robot().has_cartesian() ? EGMPose : EGMJoint);
+
+  // Reset the internal goal's velocity and acceleration values.
+  // Note: The Euler field is internally used to contain angular velocities.
+  reset(internal_goal.mutable_robot()->mutable_joints()->mutable_velocity(), robot_joints);
+  reset(internal_goal.mutable_robot()->mutable_joints()->mutable_acceleration(), robot_joints);
+  reset(internal_goal.mutable_robot()->mutable_cartesian()->mutable_velocity());
+  reset(internal_goal.mutable_robot()->mutable_cartesian()->mutable_acceleration());
+  reset(internal_goal.mutable_robot()->mutable_cartesian()->mutable_pose()->mutable_euler());
+  reset(internal_goal.mutable_external()->mutable_joints()->mutable_velocity(), external_joints);
+  reset(internal_goal.mutable_external()->mutable_joints()->mutable_acceleration(), external_joints);
+  resetJerks(&internal_goal);
+
+  // Set up the internal goal's reach condition.
+  internal_goal.set_reach(external_goal.has_reach() ? external_goal.reach() : false);
+
+  // Transfer external goal values to the internal goal.
+  transfer(external_goal.robot());
+  transfer(external_goal.external());
+
+  // Reset velocity and acceleration values, if it is the last point in the current trajectory.
+  if (last_point)
+  {
+    internal_goal.set_reach(true);
+
+    // Reset robot joint values.
+    reset(internal_goal.mutable_robot()->mutable_joints()->mutable_velocity(), robot_joints);
+    reset(internal_goal.mutable_robot()->mutable_joints()->mutable_acceleration(), robot_joints);
+
+    // Reset Cartesian values. Note: The Euler field is internally used to contain angular velocities.
+    reset(internal_goal.mutable_robot()->mutable_cartesian()->mutable_velocity());
+    reset(internal_goal.mutable_robot()->mutable_cartesian()->mutable_acceleration());
+    reset(internal_goal.mutable_robot()->mutable_cartesian()->mutable_pose()->mutable_euler());
+
+    // Reset external joint values.
+    reset(internal_goal.mutable_external()->mutable_joints()->mutable_velocity(), external_joints);
+    reset(internal_goal.mutable_external()->mutable_joints()->mutable_acceleration(), external_joints);
+
+    // Reset jerk values.
+    resetJerks(&internal_goal);
+  }
+
+  // Set up the internal goal's duration.
+  double duration = (external_goal.has_duration() ? external_goal.duration() : estimateDuration());
+  internal_goal.set_duration(data.duration_factor*duration);
+
+  // Estimate any unspecified goal jerks, if it is requested and the goal is followed by another point.
+  if (configurations_.spline_method == TrajectoryConfiguration::Septic && configurations_.estimate_jerk &&
+      !last_point && external_goal.has_duration() && p_next_point)
+  {
+    estimateJerks(*p_next_point);
+  }
+
+  // Prepare the interpolation conditions.
+  interpolator_conditions_.mode = data.mode;
+  interpolator_conditions_.duration = internal_goal.duration();
+  interpolator_conditions_.operation = EGMInterpolator::Normal;
+  interpolator_conditions_.spline_method = configurations_.spline_method;
+}
+
+void TrajectoryMotion::MotionStep::prepareRampDownGoal(const bool do_stop)
+{
+  // Prepare the interpolation conditions.
+  interpolator_conditions_.mode = data.mode;
+  interpolator_conditions_.operation = EGMInterpolator::RampDown;
+
+  // Prepare for a complete stop, or a ramp down to half of the current velocity.
+  if (do_stop)
+  {
+    interpolator_conditions_.duration = RAMP_DOWN_STOP_DURATION;
+    interpolator_conditions_.ramp_down_factor = 0.0;
+  }
+  else
+  {
+    interpolator_conditions_.duration = RAMP_DOWN_STOP_DURATION / 2.0;
+    interpolator_conditions_.ramp_down_factor = 0.5;
+  }
+}
+
+void TrajectoryMotion::MotionStep::prepareStaticGoal(const StaticPositionGoal& position_goal,
+                                                     const bool fast_transition)
+{
+  data.mode = (position_goal.robot().has_cartesian() ? EGMPose : EGMJoint);
+
+  // Note: Static goals are ramped in without any jerk.
+  resetJerks(&interpolation);
+  internal_goal.CopyFrom(interpolation);
+
+  // Transfer the static position goal values to the internal goal.
+  transfer(position_goal);
+
+  // Prepare the interpolation conditions.
+  interpolator_conditions_.mode = data.mode;
+  interpolator_conditions_.duration = (fast_transition ? STATIC_GOAL_DURATION_SHORT : STATIC_GOAL_DURATION);
+  interpolator_conditions_.operation = EGMInterpolator::RampInPosition;
+}
+
+void TrajectoryMotion::MotionStep::prepareStaticGoal(const StaticVelocityGoal& velocity_goal,
+                                                     const bool fast_transition)
+{
+  data.mode = (velocity_goal.robot().has_cartesian() ? EGMPose : EGMJoint);
+
+  // Note: Static goals are ramped in without any jerk.
+  resetJerks(&interpolation);
+  internal_goal.CopyFrom(interpolation);
+
+  // Transfer the static velocity goal values to the internal goal.
+  transfer(velocity_goal);
+
+  // Prepare the interpolation conditions.
+  interpolator_conditions_.mode = data.mode;
+  interpolator_conditions_.duration = (fast_transition ? STATIC_GOAL_DURATION_SHORT : STATIC_GOAL_DURATION);
+  interpolator_conditions_.operation = EGMInterpolator::RampInVelocity;
+}
+
+void TrajectoryMotion::MotionStep::scaleVelocities(const double factor)
+{
+  // Note: The Euler field is internally used to contain angular velocities.
+  multiply(interpolation.mutable_robot()->mutable_joints()->mutable_velocity(), factor);
+  multiply(interpolation.mutable_robot()->mutable_cartesian()->mutable_velocity(), factor);
+  multiply(interpolation.mutable_robot()->mutable_cartesian()->mutable_pose()->mutable_euler(), factor);
+  multiply(interpolation.mutable_external()->mutable_joints()->mutable_velocity(), factor);
+}
+
+void TrajectoryMotion::MotionStep::storeNextGoal(const PointGoal& point)
+{
+  next_goal_.internal_goal.CopyFrom(internal_goal);
+  next_goal_.external_goal.CopyFrom(point);
+  next_goal_.interpolation.CopyFrom(interpolation);
+  next_goal_.interpolator_conditions = interpolator_conditions_;
+  next_goal_.mode = data.mode;
+}
+
+void TrajectoryMotion::MotionStep::swapNextGoal()
+{
+  // Note: Swapping the messages only exchanges their internal pointers (i.e. no copying).
+  internal_goal.Swap(&next_goal_.internal_goal);
+  external_goal.Swap(&next_goal_.external_goal);
+  interpolation.Swap(&next_goal_.interpolation);
+  std::swap(interpolator_conditions_, next_goal_.interpolator_conditions);
+  std::swap(data.mode, next_goal_.mode);
+  std::swap(p_interpolator_, p_next_interpolator_);
+}
+
+void TrajectoryMotion::MotionStep::activateNextGoal()
+{
+  // Note: The time is carried over from the current interpolation, before it is swapped out.
+  double time_passed = carryOverTime();
+  swapNextGoal();
+  data.time_passed = time_passed;
+}
+
+void TrajectoryMotion::MotionStep::prewarm() const
+{
+  // Note: Computing the sizes reads through all the messages' fields.
+  internal_goal.ByteSizeLong();
+  external_goal.ByteSizeLong();
+  interpolation.ByteSizeLong();
+  data.feedback.ByteSizeLong();
+  p_interpolator_->prewarm();
+}
+
+bool TrajectoryMotion::MotionStep::conditionMet()
+{
+  condition_met_ = true;
+
+  switch (data.mode)
+  {
+    case EGMJoint:
+    {
+      // Robot joints.
+      checkConditions(internal_goal.robot().joints().position(), data.feedback.robot().joints().position());
+
+      // External joints.
+      checkConditions(internal_goal.external().joints().position(), data.feedback.external().joints().position());
+    }
+    break;
+
+    case EGMPose:
+    {
+      // Position.
+      checkConditions(internal_goal.robot().cartesian().pose().position(),
+                      data.feedback.robot().cartesian().pose().position());
+
+      // Orientation.
+      checkConditions(internal_goal.robot().cartesian().pose().quaternion(),
+                      data.feedback.robot().cartesian().pose().quaternion());
+
+      // External joints.
+      checkConditions(internal_goal.external().joints().position(), data.feedback.external().joints().position());
+    }
+    break;
+  }
+
+  return condition_met_;
+}
+
+/************************************************************
+ * Auxiliary methods
+ */
+
+double TrajectoryMotion::MotionStep::estimateDuration()
+{
+  // Note: The duration estimation should only be used if no duration has been specified externally, and it includes:
+  //       * Resetting any velocity and acceleration goals.
+  //       * Estimation of the duration based on the goal and feedback position differences,
+  //         and it assumes 1 degree/s and 1 mm/s as desired velocities.
+
+  double estimate = 0.0;
+
+  unsigned int robot_joints = data.feedback.robot().joints().position().values_size();
+  unsigned int external_joints = data.feedback.external().joints().position().values_size();
+
+  // Reset robot joint values.
+  reset(internal_goal.mutable_robot()->mutable_joints()->mutable_velocity(), robot_joints);
+  reset(internal_goal.mutable_robot()->mutable_joints()->mutable_acceleration(), robot_joints);
+
+  // Reset Cartesian values. Note: The Euler field is internally used to contain angular velocities.
+  reset(internal_goal.mutable_robot()->mutable_cartesian()->mutable_velocity());
+  reset(internal_goal.mutable_robot()->mutable_cartesian()->mutable_acceleration());
+  reset(internal_goal.mutable_robot()->mutable_cartesian()->mutable_pose()->mutable_euler());
+
+  // Reset external joint values.
+  reset(internal_goal.mutable_external()->mutable_joints()->mutable_velocity(), external_joints);
+  reset(internal_goal.mutable_external()->mutable_joints()->mutable_acceleration(), external_joints);
+
+  // Reset jerk values.
+  resetJerks(&internal_goal);
+
+  // Estimate the duration.
+  switch (data.mode)
+  {
+    case EGMJoint:
+    {
+      estimate = std::max(estimate, findMaxDifference(internal_goal.robot().joints().position(),
+                                                      data.feedback.robot().joints().position()));
+
+      estimate = std::max(estimate, findMaxDifference(internal_goal.external().joints().position(),
+                                                      data.feedback.external().joints().position()));
+    }
+    break;
+
+    case EGMPose:
+    {
+      estimate = findMaxDifference(internal_goal.robot().cartesian().pose().position(),
+                                   data.feedback.robot().cartesian().pose().position());
+
+      Euler temp;
+      convert(&temp, internal_goal.robot().cartesian().pose().quaternion());
+      estimate = std::max(estimate, findMaxDifference(temp, data.feedback.robot().cartesian().pose().euler()));
+
+      estimate = std::max(estimate, findMaxDifference(internal_goal.external().joints().position(),
+                                                      data.feedback.external().joints().position()));
+    }
+    break;
+  }
+
+  return estimate;
+}
+
+double TrajectoryMotion::MotionStep::carryOverTime()
+{
+  double result = 0.0;
+
+  if (configurations_.time_base == TrajectoryConfiguration::ControllerClock &&
+      p_interpolator_->getOperation() == EGMInterpolator::Normal &&
+      interpolator_conditions_.operation == EGMInterpolator::Normal)
+  {
+    // Note: The previous session can be considered finished up to half a sample time early.
+    double overshoot = data.time_passed - p_interpolator_->getDuration();
+
+    if (overshoot > -0.5*Constants::RobotController::LOWEST_SAMPLE_TIME && overshoot < data.time_step)
+    {
+      result = overshoot;
+    }
+  }
+
+  return result;
+}
+
+void TrajectoryMotion::MotionStep::resetJerks(PointGoal* p_point)
+{
+  if (p_point)
+  {
+    unsigned int robot_joints = data.feedback.robot().joints().position().values_size();
+    unsigned int external_joints = data.feedback.external().joints().position().values_size();
+
+    reset(p_point->mutable_robot()->mutable_joints()->mutable_jerk(), robot_joints);
+    reset(p_point->mutable_robot()->mutable_cartesian()->mutable_jerk());
+    reset(p_point->mutable_external()->mutable_joints()->mutable_jerk(), external_joints);
+  }
+}
+
+void TrajectoryMotion::MotionStep::estimateJerks(const PointGoal& next_point)
+{
+  // The next segment's duration is scaled in the same way as the current segment's duration.
+  double first_duration = internal_goal.duration();
+  double second_duration = data.duration_factor*next_point.duration();
+
+  if (!next_point.has_duration() || first_duration <= 0.0 || second_duration <= 0.0)
+  {
+    return;
+  }
+
+  if (external_goal.robot().joints().jerk().values_size() == 0)
+  {
+    estimateJerks(internal_goal.mutable_robot()->mutable_joints(),
+                  interpolation.robot().joints(),
+                  next_point.robot().joints(),
+                  first_duration,
+                  second_duration);
+  }
+
+  if (!external_goal.robot().cartesian().has_jerk())
+  {
+    estimateJerks(internal_goal.mutable_robot()->mutable_cartesian(),
+                  interpolation.robot().cartesian(),
+                  next_point.robot().cartesian(),
+                  first_duration,
+                  second_duration);
+  }
+
+  if (external_goal.external().joints().jerk().values_size() == 0)
+  {
+    estimateJerks(internal_goal.mutable_external()->mutable_joints(),
+                  interpolation.external().joints(),
+                  next_point.external().joints(),
+                  first_duration,
+                  second_duration);
+  }
+}
+
+void TrajectoryMotion::MotionStep::estimateJerks(JointGoal* p_goal,
+                                                 const JointGoal& start,
+                                                 const JointGoal& next,
+                                                 const double first_duration,
+                                                 const double second_duration)
+{
+  // Note: Missing values are assumed to be zero (i.e. the same as for the interpolation).
+  for (int i = 0; i < p_goal->jerk().values_size(); ++i)
+  {
+    EGMInterpolator::BoundaryValues start_values(getValue(start.position(), i),
+                                                 getValue(start.velocity(), i),
+                                                 getValue(start.acceleration(), i),
+                                                 getValue(start.jerk(), i));
+
+    EGMInterpolator::BoundaryValues middle_values(getValue(p_goal->position(), i),
+                                                  getValue(p_goal->velocity(), i),
+                                                  getValue(p_goal->acceleration(), i));
+
+    EGMInterpolator::BoundaryValues goal_values(getValue(next.position(), i),
+                                                getValue(next.velocity(), i),
+                                                getValue(next.acceleration(), i),
+                                                getValue(next.jerk(), i));
+
+    p_goal->mutable_jerk()->set_values(i, EGMInterpolator::calculateMinimumSnapJerk(start_values,
+                                                                                    middle_values,
+                                                                                    goal_values,
+                                                                                    first_duration,
+                                                                                    second_duration));
+  }
+}
+
+void TrajectoryMotion::MotionStep::estimateJerks(CartesianGoal* p_goal,
+                                                 const CartesianGoal& start,
+                                                 const CartesianGoal& next,
+                                                 const double first_duration,
+                                                 const double second_duration)
+{
+  // Note: Missing values are assumed to be zero (i.e. the same as for the interpolation).
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    EGMInterpolator::BoundaryValues start_values(getValue(start.pose().position(), axis),
+                                                 getValue(start.velocity(), axis),
+                                                 getValue(start.acceleration(), axis),
+                                                 getValue(start.jerk(), axis));
+
+    EGMInterpolator::BoundaryValues middle_values(getValue(p_goal->pose().position(), axis),
+                                                  getValue(p_goal->velocity(), axis),
+                                                  getValue(p_goal->acceleration(), axis));
+
+    EGMInterpolator::BoundaryValues goal_values(getValue(next.pose().position(), axis),
+                                                getValue(next.velocity(), axis),
+                                                getValue(next.acceleration(), axis),
+                                                getValue(next.jerk(), axis));
+
+    double jerk = EGMInterpolator::calculateMinimumSnapJerk(start_values,
+                                                            middle_values,
+                                                            goal_values,
+                                                            first_duration,
+                                                            second_duration);
+
+    switch (axis)
+    {
+      case 0: p_goal->mutable_jerk()->set_x(jerk); break;
+      case 1: p_goal->mutable_jerk()->set_y(jerk); break;
+      case 2: p_goal->mutable_jerk()->set_z(jerk); break;
+    }
+  }
+}
+
+void TrajectoryMotion::MotionStep::checkConditions(const Joints& feedback, const Joints& goal)
+{
+  for (int i = 0; condition_met_ && i < feedback.values_size() && i < goal.values_size(); ++i)
+  {
+    condition_met_ = (std::abs(feedback.values(i) - goal.values(i)) < CONDITION);
+  }
+}
+
+void TrajectoryMotion::MotionStep::checkConditions(const Cartesian& feedback,
+                                                   const Cartesian& goal)
+{
+  double delta_x = std::abs(feedback.x() - goal.x());
+  double delta_y = std::abs(feedback.y() - goal.y());
+  double delta_z = std::abs(feedback.z() - goal.z());
+
+  condition_met_ = (delta_x < CONDITION && delta_y < CONDITION && delta_z < CONDITION);
+}
+
+void TrajectoryMotion::MotionStep::checkConditions(const Quaternion& feedback,
+                                                   const Quaternion& goal)
+{
+  condition_met_ = (condition_met_ && std::abs(dotProduct(feedback, goal)) >= 1.0);
+}
+
+void TrajectoryMotion::MotionStep::transfer(const RobotGoal& source)
+{
+  JointGoal* p_joints = internal_goal.mutable_robot()->mutable_joints();
+  CartesianGoal* p_cartesian = internal_goal.mutable_robot()->mutable_cartesian();
+
+  // Set up the internal robot joint goal.
+  copyPresent(p_joints->mutable_position(), source.joints().position());
+  copyPresent(p_joints->mutable_velocity(), source.joints().velocity());
+  copyPresent(p_joints->mutable_acceleration(), source.joints().acceleration());
+  copyPresent(p_joints->mutable_jerk(), source.joints().jerk());
+
+  // Set up the internal robot Cartesian goal.
+  copyPresent(p_cartesian->mutable_pose()->mutable_position(), source.cartesian().pose().position());
+  copyPresent(p_cartesian->mutable_velocity(), source.cartesian().velocity());
+  copyPresent(p_cartesian->mutable_acceleration(), source.cartesian().acceleration());
+  copyPresent(p_cartesian->mutable_jerk(), source.cartesian().jerk());
+
+  // Note: The internal goal's Euler field is used to contain angular velocities.
+  copyPresent(p_cartesian->mutable_pose()->mutable_euler(), source.cartesian().angular_velocity());
+
+  // Convert any Euler goal to quaternions (since the internal goal's Euler field is used for angular velocities).
+  if (source.cartesian().pose().has_euler())
+  {
+    Euler temp;
+    convert(&temp, p_cartesian->mutable_pose()->quaternion());
+    copyPresent(&temp, source.cartesian().pose().euler());
+    convert(p_cartesian->mutable_pose()->mutable_quaternion(), temp);
+    normalize(p_cartesian->mutable_pose()->mutable_quaternion());
+  }
+  else if (source.cartesian().pose().has_quaternion())
+  {
+    copyPresent(p_cartesian->mutable_pose()->mutable_quaternion(), source.cartesian().pose().quaternion());
+  }
+}
+
+void TrajectoryMotion::MotionStep::transfer(const ExternalGoal& source)
+{
+  JointGoal* p_joints = internal_goal.mutable_external()->mutable_joints();
+
+  // Set up the internal external joint goal.
+  copyPresent(p_joints->mutable_position(), source.joints().position());
+  copyPresent(p_joints->mutable_velocity(), source.joints().velocity());
+  copyPresent(p_joints->mutable_acceleration(), source.joints().acceleration());
+  copyPresent(p_joints->mutable_jerk(), source.joints().jerk());
+}
+
+void TrajectoryMotion::MotionStep::transfer(const StaticPositionGoal& source)
+{
+  JointGoal* p_robot_joints = internal_goal.mutable_robot()->mutable_joints();
+  CartesianGoal* p_cartesian = internal_goal.mutable_robot()->mutable_cartesian();
+  JointGoal* p_external_joints = internal_goal.mutable_external()->mutable_joints();
+
+  // Set up the internal goal.
+  copyPresent(p_robot_joints->mutable_position(), source.robot().joints());
+  copyPresent(p_cartesian->mutable_pose()->mutable_position(), source.robot().cartesian().position());
+  copyPresent(p_external_joints->mutable_position(), source.external());
+
+  // Note: The internal goal's Euler field is used to contain angular velocities.
+  //       Therefore, convert any Euler goal to quaternions.
+  if (source.robot().cartesian().has_euler())
+  {
+    Euler temp;
+    convert(&temp, p_cartesian->pose().quaternion());
+    copyPresent(&temp, source.robot().cartesian().euler());
+    convert(p_cartesian->mutable_pose()->mutable_quaternion(), temp);
+    normalize(p_cartesian->mutable_pose()->mutable_quaternion());
+  }
+  else if (source.robot().cartesian().has_quaternion())
+  {
+    copyPresent(p_cartesian->mutable_pose()->mutable_quaternion(), source.robot().cartesian().quaternion());
+  }
+}
+
+void TrajectoryMotion::MotionStep::transfer(const StaticVelocityGoal& source)
+{
+  JointGoal* p_robot_joints = internal_goal.mutable_robot()->mutable_joints();
+  CartesianGoal* p_cartesian = internal_goal.mutable_robot()->mutable_cartesian();
+  JointGoal* p_external_joints = internal_goal.mutable_external()->mutable_joints();
+
+  // Set up the internal goal.
+  copyPresent(p_robot_joints->mutable_velocity(), source.robot().joints());
+  copyPresent(p_cartesian->mutable_velocity(), source.robot().cartesian().linear());
+  copyPresent(p_external_joints->mutable_velocity(), source.external());
+
+  // Note: The internal goal's Euler field is used to contain angular velocities.
+  copyPresent(p_cartesian->mutable_pose()->mutable_euler(), source.robot().cartesian().angular());
+}
+
+
+
+
+/***********************************************************************************************************************
+ * Class definitions: TrajectoryMotion::Controller
+ */
+
+/************************************************************
+ * Primary methods
+ */
+
+void TrajectoryMotion::Controller::update(const States state,
+                                          const MotionStep& motion_step,
+                                          const TrajectoryConfiguration& configurations)
+{
+  is_normal_state_ = (state == Normal);
+  is_linear_ = (configurations.spline_method == TrajectoryConfiguration::Linear);
+
+  egm_mode_ = motion_step.data.mode;
+  initial_references_.CopyFrom(motion_step.interpolation);
+}
+
+void TrajectoryMotion::Controller::calculate(Output* p_outputs, MotionStep* p_motion_step)
+{
+  do_velocity_transition_ = false;
+
+  if (p_outputs && p_motion_step)
+  {
+    p_outputs->mutable_robot()->mutable_cartesian()->mutable_pose()->clear_euler();
+
+    double t = saturate(p_motion_step->data.time_passed / p_motion_step->interpolation.duration(), 0.0, 1.0);
+
+    // Calculate the scale factors.
+    a_ = (p_motion_step->interpolation.reach() ? 0.5*std::cos(M_PI*t) + 0.5 : 1.0);
+    b_ = 0.5*std::cos(M_PI*t + M_PI) + 0.5;
+
+    switch (egm_mode_)
+    {
+      case EGMJoint:
+      {
+        // Robot and external joint positions.
+        calculate(p_outputs->mutable_robot()->mutable_joints()->mutable_position(),
+                  p_motion_step->interpolation.mutable_robot()->mutable_joints()->mutable_position(),
+                  p_motion_step->data.feedback.robot().joints().position(),
+                  initial_references_.robot().joints().position());
+
+        calculate(p_outputs->mutable_external()->mutable_joints()->mutable_position(),
+                  p_motion_step->interpolation.mutable_external()->mutable_joints()->mutable_position(),
+                  p_motion_step->data.feedback.external().joints().position(),
+                  initial_references_.external().joints().position());
+
+        // Check if velocity values should be transitioned.
+        checkForVelocityTransition(&(p_motion_step->interpolation));
+
+        // Robot and external joint velocities.
+        calculate(p_outputs->mutable_robot()->mutable_joints()->mutable_velocity(),
+                  p_motion_step->interpolation.mutable_robot()->mutable_joints()->mutable_velocity(),
+                  p_motion_step->data.feedback.robot().joints().velocity(),
+                  initial_references_.robot().joints().velocity());
+
+        calculate(p_outputs->mutable_external()->mutable_joints()->mutable_velocity(),
+                  p_motion_step->interpolation.mutable_external()->mutable_joints()->mutable_velocity(),
+                  p_motion_step->data.feedback.external().joints().velocity(),
+                  initial_references_.external().joints().velocity());
+      }
+      break;
+
+      case EGMPose:
+      {
+        // Cartesian pose and orientation.
+        calculate(p_outputs->mutable_robot()->mutable_cartesian()->mutable_pose()->mutable_position(),
+                  p_motion_step->interpolation.mutable_robot()->mutable_cartesian()->mutable_pose()->mutable_position(),
+                  p_motion_step->data.feedback.robot().cartesian().pose().position(),
+                  initial_references_.robot().cartesian().pose().position());
+
+        calculate(p_outputs->mutable_robot()->mutable_cartesian()->mutable_pose()->mutable_quaternion(),
+                  p_motion_step->interpolation.robot().cartesian().pose().quaternion(),
+                  p_motion_step->data.feedback.robot().cartesian().pose().quaternion());
+
+        // External joint positions.
+        calculate(p_outputs->mutable_external()->mutable_joints()->mutable_position(),
+                  p_motion_step->interpolation.mutable_external()->mutable_joints()->mutable_position(),
+                  p_motion_step->data.feedback.external().joints().position(),
+                  initial_references_.external().joints().position());
+
+        // Check if velocity values should be transitioned.
+        checkForVelocityTransition(&(p_motion_step->interpolation));
+
+        // Cartesian linear and external joint velocities.
+        calculate(p_outputs->mutable_robot()->mutable_cartesian()->mutable_velocity()->mutable_linear(),
+                  p_motion_step->interpolation.mutable_robot()->mutable_cartesian()->mutable_velocity(),
+                  p_motion_step->data.feedback.robot().cartesian().velocity().linear(),
+                  initial_references_.robot().cartesian().velocity());
+
+        calculate(p_outputs->mutable_external()->mutable_joints()->mutable_velocity(),
+                  p_motion_step->interpolation.mutable_external()->mutable_joints()->mutable_velocity(),
+                  p_motion_step->data.feedback.external().joints().velocity(),
+                  initial_references_.external().joints().velocity());
+
+        // Cartesian angular velocities. Note: The Euler field is internally used to contain angular velocities.
+        calculate(p_outputs->mutable_robot()->mutable_cartesian()->mutable_velocity()->mutable_angular(),
+                  p_motion_step->interpolation.mutable_robot()->mutable_cartesian()->mutable_pose()->mutable_euler(),
+                  p_motion_step->data.feedback.robot().cartesian().velocity().angular(),
+                  initial_references_.robot().cartesian().pose().euler());
+      }
+      break;
+    }
+  }
+}
+
+/************************************************************
+ * Auxiliary methods
+ */
+
+void TrajectoryMotion::Controller::checkForVelocityTransition(PointGoal* p_references)
+{
+  if (is_normal_state_)
+  {
+    do_velocity_transition_ = (p_references->reach() ? true : is_linear_);
+  }
+
+  if (do_velocity_transition_)
+  {
+    // Ramp out acceleration references.
+    multiply(p_references->mutable_robot()->mutable_joints()->mutable_acceleration(), a_);
+    multiply(p_references->mutable_robot()->mutable_cartesian()->mutable_acceleration(), a_);
+    multiply(p_references->mutable_external()->mutable_joints()->mutable_acceleration(), a_);
+  }
+}
+
+void TrajectoryMotion::Controller::calculate(Joints* p_out,
+                                             Joints* p_ref,
+                                             const Joints& fdb,
+                                             const Joints& start)
+{
+  for (int i = 0;
+       i < p_out->values_size() && i < p_ref->values_size() && i < fdb.values_size() && i < start.values_size();
+       ++i)
+  {
+    if (do_velocity_transition_)
+    {
+      if (is_linear_)
+      {
+        p_ref->set_values(i, a_*(start.values(i) + b_*(p_ref->values(i) - start.values(i))));
+      }
+      else
+      {
+        p_ref->set_values(i, a_*p_ref->values(i));
+      }
+    }
+
+    p_out->set_values(i, fdb.values(i) + k_*(p_ref->values(i) - fdb.values(i)));
+  }
+}
+
+void TrajectoryMotion::Controller::calculate(wrapper::Cartesian* p_out,
+                                             wrapper::Cartesian* p_ref,
+                                             const wrapper::Cartesian& fdb,
+                                             const wrapper::Cartesian& start)
+{
+  if (do_velocity_transition_)
+  {
+    if (is_linear_)
+    {
+      p_ref->set_x(a_*(start.x() + b_*(p_ref->x() - start.x())));
+      p_ref->set_y(a_*(start.y() + b_*(p_ref->y() - start.y())));
+      p_ref->set_z(a_*(start.z() + b_*(p_ref->z() - start.z())));
+    }
+    else
+    {
+      multiply(p_ref, a_);
+    }
+  }
+
+  p_out->set_x(fdb.x() + k_*(p_ref->x() - fdb.x()));
+  p_out->set_y(fdb.y() + k_*(p_ref->y() - fdb.y()));
+  p_out->set_z(fdb.z() + k_*(p_ref->z() - fdb.z()));
+}
+
+void TrajectoryMotion::Controller::calculate(wrapper::Euler* p_out,
+                                             wrapper::Euler* p_ref,
+                                             const wrapper::Euler& fdb,
+                                             const wrapper::Euler& start)
+{
+  if (is_normal_state_)
+  {
+    p_ref->set_x(a_*(start.x() + b_*(p_ref->x() - start.x())));
+    p_ref->set_y(a_*(start.y() + b_*(p_ref->y() - start.y())));
+    p_ref->set_z(a_*(start.z() + b_*(p_ref->z() - start.z())));
+  }
+
+  p_out->set_x(fdb.x() + k_*(p_ref->x() - fdb.x()));
+  p_out->set_y(fdb.y() + k_*(p_ref->y() - fdb.y()));
+  p_out->set_z(fdb.z() + k_*(p_ref->z() - fdb.z()));
+}
+
+void TrajectoryMotion::Controller::calculate(wrapper::Quaternion* p_out,
+                                             const wrapper::Quaternion& ref,
+                                             const wrapper::Quaternion& fdb)
+{
+  p_out->set_u0(fdb.u0() + k_*(ref.u0() - fdb.u0()));
+  p_out->set_u1(fdb.u1() + k_*(ref.u1() - fdb.u1()));
+  p_out->set_u2(fdb.u2() + k_*(ref.u2() - fdb.u2()));
+  p_out->set_u3(fdb.u3() + k_*(ref.u3() - fdb.u3()));
+
+  normalize(p_out);
+}
+
+
+
+
+/***********************************************************************************************************************
+ * Class definitions: TrajectoryMotion::Corrector
+ */
+
+/************************************************************
+ * Primary methods
+ */
+
+void TrajectoryMotion::Corrector::write(const Correction& correction, const double time)
+{
+  boost::lock_guard<boost::mutex> lock(write_mutex_);
+
+  slots_[back_].correction.CopyFrom(correction);
+  slots_[back_].time = time;
+
+  // Publish the written slot, and take over the previously published (or already read) slot.
+  back_ = middle_.exchange(back_ | FRESH) & INDEX_MASK;
+}
+
+void TrajectoryMotion::Corrector::apply(Output* p_outputs,
+                                        const EGMModes mode,
+                                        const double time,
+                                        const double time_step,
+                                        const TrajectoryConfiguration& configurations)
+{
+  // Take over any newly written slot.
+  if (middle_.load() & FRESH)
+  {
+    front_ = middle_.exchange(front_) & INDEX_MASK;
+    has_front_ = true;
+  }
+
+  // Hold the correction for a while, and then fade it out.
+  Correction empty;
+  const Correction& target = (has_front_ ? slots_[front_].correction : empty);
+  double age = (has_front_ ? time - slots_[front_].time : 0.0);
+  double factor = 0.0;
+
+  if (age <= configurations.correction_hold_time)
+  {
+    factor = 1.0;
+  }
+  else if (age < configurations.correction_hold_time + configurations.correction_fade_time)
+  {
+    factor = 1.0 - (age - configurations.correction_hold_time) / configurations.correction_fade_time;
+  }
+
+  // Move the applied offsets towards the target (with rate limits, so that jumps in the corrections are smoothed).
+  double max_joint_change = limitChange(configurations.correction_joint_rate, time_step);
+  double max_position_change = limitChange(configurations.correction_position_rate, time_step);
+  double max_joint_velocity_change = limitChange(configurations.correction_joint_velocity_rate, time_step);
+  double max_linear_velocity_change = limitChange(configurations.correction_linear_velocity_rate, time_step);
+
+  approach(applied_.mutable_robot_joints()->mutable_position(),
+           target.robot_joints().position(), factor, max_joint_change);
+  approach(applied_.mutable_robot_joints()->mutable_velocity(),
+           target.robot_joints().velocity(), factor, max_joint_velocity_change);
+  approach(applied_.mutable_cartesian_position(), target.cartesian_position(), factor, max_position_change);
+  approach(applied_.mutable_cartesian_velocity(), target.cartesian_velocity(), factor, max_linear_velocity_change);
+  approach(applied_.mutable_external_joints()->mutable_position(),
+           target.external_joints().position(), factor, max_joint_change);
+  approach(applied_.mutable_external_joints()->mutable_velocity(),
+           target.external_joints().velocity(), factor, max_joint_velocity_change);
+
+  // Superimpose the applied offsets on the outputs (without adding any outputs).
+  if (p_outputs && p_outputs->has_robot())
+  {
+    Robot* p_robot = p_outputs->mutable_robot();
+
+    if (mode == EGMJoint && p_robot->has_joints())
+    {
+      add(p_robot->mutable_joints()->mutable_position(), applied_.robot_joints().position());
+      add(p_robot->mutable_joints()->mutable_velocity(), applied_.robot_joints().velocity());
+    }
+    else if (mode == EGMPose && p_robot->has_cartesian())
+    {
+      add(p_robot->mutable_cartesian()->mutable_pose()->mutable_position(), applied_.cartesian_position());
+      add(p_robot->mutable_cartesian()->mutable_velocity()->mutable_linear(), applied_.cartesian_velocity());
+    }
+  }
+
+  if (p_outputs && p_outputs->has_external() && p_outputs->external().has_joints())
+  {
+    add(p_outputs->mutable_external()->mutable_joints()->mutable_position(), applied_.external_joints().position());
+    add(p_outputs->mutable_external()->mutable_joints()->mutable_velocity(), applied_.external_joints().velocity());
+  }
+}
+
+void TrajectoryMotion::Corrector::remove(Output* p_outputs, const EGMModes mode) const
+{
+  if (p_outputs->has_robot())
+  {
+    Robot* p_robot = p_outputs->mutable_robot();
+
+    if (mode == EGMJoint && p_robot->has_joints())
+    {
+      subtract(p_robot->mutable_joints()->mutable_position(), applied_.robot_joints().position());
+      subtract(p_robot->mutable_joints()->mutable_velocity(), applied_.robot_joints().velocity());
+    }
+    else if (mode == EGMPose && p_robot->has_cartesian())
+    {
+      subtract(p_robot->mutable_cartesian()->mutable_pose()->mutable_position(), applied_.cartesian_position());
+      subtract(p_robot->mutable_cartesian()->mutable_velocity()->mutable_linear(), applied_.cartesian_velocity());
+    }
+  }
+
+  if (p_outputs->has_external() && p_outputs->external().has_joints())
+  {
+    subtract(p_outputs->mutable_external()->mutable_joints()->mutable_position(),
+             applied_.external_joints().position());
+    subtract(p_outputs->mutable_external()->mutable_joints()->mutable_velocity(),
+             applied_.external_joints().velocity());
+  }
+}
+
+void TrajectoryMotion::Corrector::remove(Feedback* p_feedback, const EGMModes mode) const
+{
+  if (mode == EGMJoint)
+  {
+    subtract(p_feedback->mutable_robot()->mutable_joints()->mutable_position(), applied_.robot_joints().position());
+  }
+  else
+  {
+    subtract(p_feedback->mutable_robot()->mutable_cartesian()->mutable_pose()->mutable_position(),
+             applied_.cartesian_position());
+  }
+
+  subtract(p_feedback->mutable_external()->mutable_joints()->mutable_position(), applied_.external_joints().position());
+}
+
+void TrajectoryMotion::Corrector::reset()
+{
+  applied_.Clear();
+  has_front_ = false;
+}
+
+/************************************************************
+ * Auxiliary methods
+ */
+
+void TrajectoryMotion::Corrector::approach(Joints* p_applied,
+                                           const Joints& target,
+                                           const double factor,
+                                           const double max_change)
+{
+  while (p_applied->values_size() < target.values_size())
+  {
+    p_applied->add_values(0.0);
+  }
+
+  for (int i = 0; i < p_applied->values_size(); ++i)
+  {
+    double change = (i < target.values_size() ? factor*target.values(i) : 0.0) - p_applied->values(i);
+
+    if (max_change >= 0.0)
+    {
+      change = saturate(change, -max_change, max_change);
+    }
+
+    p_applied->set_values(i, p_applied->values(i) + change);
+  }
+}
+
+void TrajectoryMotion::Corrector::approach(wrapper::Cartesian* p_applied,
+                                           const wrapper::Cartesian& target,
+                                           const double factor,
+                                           const double max_change)
+{
+  double change_x = factor*target.x() - p_applied->x();
+  double change_y = factor*target.y() - p_applied->y();
+  double change_z = factor*target.z() - p_applied->z();
+
+  if (max_change >= 0.0)
+  {
+    change_x = saturate(change_x, -max_change, max_change);
+    change_y = saturate(change_y, -max_change, max_change);
+    change_z = saturate(change_z, -max_change, max_change);
+  }
+
+  p_applied->set_x(p_applied->x() + change_x);
+  p_applied->set_y(p_applied->y() + change_y);
+  p_applied->set_z(p_applied->z() + change_z);
+}
+
+void TrajectoryMotion::Corrector::add(Joints* p_out, const Joints& offsets)
+{
+  for (int i = 0; i < p_out->values_size() && i < offsets.values_size(); ++i)
+  {
+    p_out->set_values(i, p_out->values(i) + offsets.values(i));
+  }
+}
+
+void TrajectoryMotion::Corrector::add(wrapper::Cartesian* p_out,
+                                      const wrapper::Cartesian& offsets)
+{
+  if (p_out->has_x() && p_out->has_y() && p_out->has_z())
+  {
+    p_out->set_x(p_out->x() + offsets.x());
+    p_out->set_y(p_out->y() + offsets.y());
+    p_out->set_z(p_out->z() + offsets.z());
+  }
+}
+
+void TrajectoryMotion::Corrector::subtract(Joints* p_values, const Joints& offsets)
+{
+  for (int i = 0; i < p_values->values_size() && i < offsets.values_size(); ++i)
+  {
+    p_values->set_values(i, p_values->values(i) - offsets.values(i));
+  }
+}
+
+void TrajectoryMotion::Corrector::subtract(wrapper::Cartesian* p_values, const wrapper::Cartesian& offsets)
+{
+  if (p_values->has_x() && p_values->has_y() && p_values->has_z())
+  {
+    p_values->set_x(p_values->x() - offsets.x());
+    p_values->set_y(p_values->y() - offsets.y());
+    p_values->set_z(p_values->z() - offsets.z());
+  }
+}
+
+
+
+
+/***********************************************************************************************************************
+ * Class definitions: TrajectoryMotion::ProgressPublisher
+ */
+
+/************************************************************
+ * Primary methods
+ */
+
+void TrajectoryMotion::ProgressPublisher::publish(const boost::shared_ptr<Trajectory>& p_trajectory)
+{
+  slots_[back_].p_trajectory = p_trajectory;
+  slots_[back_].next_index = (p_trajectory ? p_trajectory->nextIndex() : 0);
+
+  // Publish the written slot, and take over the previously published (or already read) slot.
+  back_ = middle_.exchange(back_ | FRESH) & INDEX_MASK;
+}
+
+void TrajectoryMotion::ProgressPublisher::reset()
+{
+  slots_[back_].progress.Clear();
+  publish(boost::shared_ptr<Trajectory>());
+}
+
+bool TrajectoryMotion::ProgressPublisher::read(ExecutionProgress* p_progress)
+{
+  boost::lock_guard<boost::mutex> lock(read_mutex_);
+
+  // Take over any newly published slot.
+  bool fresh = false;
+  if (middle_.load() & FRESH)
+  {
+    front_ = middle_.exchange(front_) & INDEX_MASK;
+    fresh = true;
+  }
+
+  const Slot& slot = slots_[front_];
+  bool result = false;
+
+  if (p_progress && slot.progress.has_inputs())
+  {
+    p_progress->CopyFrom(slot.progress);
+    result = fresh;
+
+    // Add the active trajectory's remaining points (i.e. the data that scales with the trajectory's length).
+    boost::shared_ptr<Trajectory> p_trajectory = slot.p_trajectory.lock();
+    if (p_trajectory)
+    {
+      p_trajectory->copyStoredTo(slot.next_index, p_progress->mutable_active_trajectory());
+    }
+  }
+
+  return result;
+}
+
+
+
+
+/***********************************************************************************************************************
+ * Class definitions: TrajectoryMotion
+ */
+
+/************************************************************
+ * Primary methods
+ */
+
+void TrajectoryMotion::generateOutputs(Output* p_outputs, const InputContainer& inputs, const double time)
+{
+  boost::lock_guard<boost::mutex> data_lock(data_.mutex);
+  boost::lock_guard<boost::mutex> trajectory_lock(trajectories_.mutex);
+
+  // Prepare for trajectory motion.
+  prepare(inputs, time);
+
+  // Only generate outputs, if the EGM session states are ok.
+  if(inputs.statesOk())
+  {
+    // Update the current state.
+    state_manager_.updateState();
+
+    // Update, and apply, the speed governor's time scale.
+    updateSpeedScale(inputs.current());
+
+    // Process the current state.
+    switch (state_manager_.getState())
+    {
+      case Normal:     processNormalState();     break;
+      case RampDown:   processRampDownState();   break;
+      case StaticGoal: processStaticGoalState(); break;
+    }
+
+    // Prepare for any new goal.
+    if (data_.has_new_goal)
+    {
+      // Update the interpolator.
+      motion_step_.updateInterpolator();
+
+      // Align a scheduled start within the cycle (i.e. the first outputs are interpolated at the actual start offset).
+      if (data_.has_start_offset)
+      {
+        motion_step_.data.time_passed = data_.start_offset;
+      }
+
+      // Update the controller.
+      controller_.update(state_manager_.getState(), motion_step_, configurations_);
+    }
+
+    // Generate the outputs.
+    if (p_outputs && data_.has_active_goal)
+    {
+      // Evaluate the interpolator.
+      motion_step_.evaluateInterpolator();
+
+      // Calculate the outputs to the robot controller (with velocities in real time, if the time is scaled).
+      if (speed_scale_ != 1.0)
+      {
+        motion_step_.scaleVelocities(1.0 / speed_scale_);
+        controller_.calculate(p_outputs, &motion_step_);
+        motion_step_.scaleVelocities(speed_scale_);
+      }
+      else
+      {
+        controller_.calculate(p_outputs, &motion_step_);
+      }
+
+      // Superimpose any user correction.
+      corrector_.apply(p_outputs, motion_step_.data.mode, time_, motion_step_.data.time_step, configurations_);
+
+      // Keep track of the time spent executing normal goals (used when retracting).
+      if (state_manager_.getState() == Normal && !data_.is_retracting)
+      {
+        motion_time_ += motion_step_.data.time_step;
+      }
+    }
+    else if (p_outputs)
+    {
+      // Keep superimposing any user correction on the held outputs (i.e. the previously applied offsets are replaced).
+      corrector_.remove(p_outputs, motion_step_.data.mode);
+      corrector_.apply(p_outputs, motion_step_.data.mode, time_, motion_step_.data.time_step, configurations_);
+    }
+  }
+
+  // Update, and publish, the execution progress (i.e. without the remaining points, which are added by the reader).
+  if(p_outputs)
+  {
+    ExecutionProgress* p_progress = progress_publisher_.progress();
+    size_t queued_points = 0;
+    size_t queued_bytes = 0;
+    calculateQueueUsage(&queued_points, &queued_bytes);
+
+    p_progress->set_state(state_manager_.mapState());
+    p_progress->set_sub_state(state_manager_.mapSubState());
+    p_progress->mutable_inputs()->CopyFrom(inputs.current());
+    p_progress->mutable_outputs()->CopyFrom(*p_outputs);
+    p_progress->set_goal_active(data_.has_active_goal);
+    p_progress->set_retracting(data_.is_retracting);
+    p_progress->set_speed_scale(speed_scale_);
+    p_progress->mutable_correction()->CopyFrom(corrector_.applied());
+    p_progress->mutable_goal()->CopyFrom(motion_step_.internal_goal);
+    p_progress->set_time_passed(motion_step_.data.time_passed);
+    p_progress->clear_active_trajectory();
+    p_progress->mutable_active_trajectory()->add_points()->CopyFrom(motion_step_.external_goal);
+    p_progress->clear_point_index();
+    if (trajectories_.p_current)
+    {
+      trajectories_.p_current->copyFrontTo(p_progress->mutable_active_trajectory());
+
+      if (!data_.is_retracting)
+      {
+        p_progress->set_point_index((unsigned int) trajectories_.p_current->currentIndex());
+      }
+    }
+    if (trajectories_.temporary_queue.size() > 0)
+    {
+      p_progress->set_pending_trajectories((unsigned int) trajectories_.temporary_queue.size());
+    }
+    else
+    {
+      p_progress->set_pending_trajectories((unsigned int) trajectories_.primary_queue.size());
+    }
+    p_progress->set_queued_points((unsigned int) queued_points);
+    p_progress->set_queued_bytes(queued_bytes);
+    p_progress->set_rejected_trajectories(data_.rejected_trajectories);
+
+    progress_publisher_.publish(trajectories_.p_current);
+  }
+
+  // Any prefetched segment is only valid for the cycle it was prefetched for.
+  has_prefetched_goal_ = false;
+}
+
+/************************************************************
+ * Auxiliary methods
+ */
+
+void TrajectoryMotion::prepare(const InputContainer& inputs, const double time)
+{
+  // Pre-prepare the auxiliary data.
+  motion_step_.data.estimated_sample_time = inputs.estimatedSampleTime();
+  motion_step_.data.time_step = inputs.estimatedSampleTime();
+  if (configurations_.time_base == TrajectoryConfiguration::ControllerClock && inputs.measuredSampleTime() > 0.0)
+  {
+    // Clamp the step, so a single late message (or a clock jump) can't skip large parts of the trajectory.
+    motion_step_.data.time_step = std::min(inputs.measuredSampleTime(),
+                                           MAX_TIME_STEP_FACTOR*inputs.estimatedSampleTime());
+  }
+  motion_step_.data.feedback.CopyFrom(inputs.current().feedback());
+  time_ = time;
+
+  // Reset internal components, if a new EGM session has started.
+  if (inputs.isFirstMessage())
+  {
+    resetTrajectoryMotion();
+    motion_step_.resetMotionStep();
+    state_manager_.resetStateManager();
+  }
+
+  // Activate the state manager if a new EGM session's states are ok. Otherwise,
+  // reset the internal components if an active EGM session's states has become not ok.
+  if (inputs.statesOk())
+  {
+    if (state_manager_.verifyState(Normal, None))
+    {
+      state_manager_.activateStateManager();
+    }
+  }
+  else
+  {
+    if (!state_manager_.verifyState(Normal, None))
+    {
+      resetTrajectoryMotion();
+      motion_step_.resetMotionStep();
+      state_manager_.resetStateManager();
+
+      retireQueue(&trajectories_.primary_queue);
+      retireQueue(&trajectories_.temporary_queue);
+    }
+  }
+
+  // Remove the applied correction (if any, after the resets above) from the feedback, so that the motion is followed
+  // (and the reach conditions, the speed governor and the controller are evaluated) relative to the uncorrected
+  // references. Note: The mode is the previous cycle's mode (i.e. the mode that the correction was applied in).
+  corrector_.remove(&motion_step_.data.feedback, motion_step_.data.mode);
+
+  // Assume no new goal.
+  data_.has_new_goal = false;
+  data_.has_start_offset = false;
+}
+
+void TrajectoryMotion::resetTrajectoryMotion()
+{
+  if (trajectories_.p_current)
+  {
+    storeNormalGoal();
+    trajectories_.primary_queue.push_front(trajectories_.p_current);
+    trajectories_.p_current.reset();
+  }
+
+  data_.has_active_goal = false;
+  data_.has_new_goal = false;
+  data_.has_pending_reached_points = false;
+  data_.is_retracting = false;
+  data_.pending_events.do_retract = false;
+  progress_publisher_.reset();
+
+  executed_segments_.clear();
+  motion_time_ = 0.0;
+  speed_scale_ = 1.0;
+  has_prefetched_goal_ = false;
+  corrector_.reset();
+}
+
+void TrajectoryMotion::processNormalState()
+{
+  switch (state_manager_.getSubState())
+  {
+    case None:
+      // Should never occur.
+    break;
+
+    case Running:
+    {
+      if (data_.pending_events.do_ramp_down)
+      {
+        state_manager_.setPendingState(RampDown, None);
+      }
+      else if (data_.pending_events.do_retract)
+      {
+        data_.pending_events.do_retract = false;
+        startRetract();
+      }
+      else if (data_.pending_events.do_seek)
+      {
+        // Replace the current goal directly (the seeked point is approached from the current state).
+        data_.pending_events.do_seek = false;
+        has_prefetched_goal_ = false;
+        if (trajectories_.p_current)
+        {
+          updateNormalGoal();
+        }
+      }
+      else
+      {
+        if (trajectories_.p_current)
+        {
+          if (motion_step_.interpolationDurationReached())
+          {
+            if (motion_step_.internal_goal.reach() && !data_.has_pending_reached_points)
+            {
+              if (motion_step_.conditionMet())
+              {
+                updateNormalGoal();
+              }
+            }
+            else
+            {
+              updateNormalGoal();
+            }
+          }
+        }
+        else
+        {
+          if (!trajectories_.primary_queue.empty() && checkScheduledStart(trajectories_.primary_queue.front().get()))
+          {
+            trajectories_.p_current = trajectories_.primary_queue.front();
+            trajectories_.primary_queue.pop_front();
+            data_.is_retracting = false;
+            updateNormalGoal();
+          }
+        }
+      }
+    }
+    break;
+
+    case Finished:
+      // Should never occur.
+    break;
+  }
+}
+
+void TrajectoryMotion::processRampDownState()
+{
+  switch (state_manager_.getSubState())
+  {
+    case None:
+    {
+      motion_step_.prepareRampDownGoal(data_.pending_events.do_stop);
+
+      // Store any active goal.
+      if (data_.has_active_goal)
+      {
+        storeNormalGoal();
+      }
+
+      data_.has_new_goal = true;
+      data_.has_active_goal = true;
+      state_manager_.setPendingState(RampDown, Running);
+    }
+    break;
+
+    case Running:
+    {
+      if (motion_step_.interpolationDurationReached())
+      {
+        state_manager_.setPendingState(RampDown, Finished);
+      }
+    }
+    break;
+
+    case Finished:
+    {
+      // Handle the duration scale factor update event.
+      if (data_.pending_events.do_duration_factor_update)
+      {
+        motion_step_.data.duration_factor = data_.pending_events.duration_factor;
+        data_.pending_events.do_duration_factor_update = false;
+      }
+
+      // Handle the discard event.
+      if (data_.pending_events.do_discard)
+      {
+        if (trajectories_.p_current)
+        {
+          trajectories_.primary_queue.push_front(trajectories_.p_current);
+          trajectories_.p_current.reset();
+        }
+        retireQueue(&trajectories_.primary_queue);
+        trajectories_.primary_queue.swap(trajectories_.temporary_queue);
+        data_.pending_events.do_discard = false;
+        data_.is_retracting = false;
+      }
+
+      if (data_.pending_events.do_stop)
+      {
+        // If a complete stop has been ordered, then wait for a resume (or a retract) order.
+        if (data_.pending_events.do_retract)
+        {
+          data_.pending_events.do_retract = false;
+
+          if (startRetract())
+          {
+            data_.pending_events.do_ramp_down = false;
+            data_.pending_events.do_stop = false;
+            data_.pending_events.do_resume = false;
+            state_manager_.setPendingState(Normal, Running);
+          }
+        }
+        else if (data_.pending_events.do_resume)
+        {
+          data_.pending_events.do_ramp_down = false;
+          data_.pending_events.do_stop = false;
+          data_.pending_events.do_resume = false;
+
+          if (data_.pending_events.do_static_goal_start)
+          {
+            state_manager_.setPendingState(StaticGoal, None);
+          }
+          else
+          {
+            updateNormalGoal();
+            state_manager_.setPendingState(Normal, Running);
+          }
+        }
+      }
+      else
+      {
+        data_.pending_events.do_ramp_down = false;
+        updateNormalGoal();
+        state_manager_.setPendingState(Normal, Running);
+      }
+    }
+    break;
+  }
+}
+
+void TrajectoryMotion::processStaticGoalState()
+{
+  switch (state_manager_.getSubState())
+  {
+    case None:
+    {
+      // Store any currently executing trajectory into the queue.
+      if (trajectories_.p_current)
+      {
+        trajectories_.primary_queue.push_front(trajectories_.p_current);
+        trajectories_.p_current.reset();
+      }
+
+      // The static goal motion is not recorded, so it can't be retracted along.
+      executed_segments_.clear();
+      data_.is_retracting = false;
+
+      data_.has_active_goal = false;
+      state_manager_.setPendingState(StaticGoal, Running);
+    }
+    break;
+
+    case Running:
+    {
+      // Update the internal goal, with the new static goal.
+      if (data_.pending_events.do_static_position_goal_update && !data_.pending_events.do_ramp_down)
+      {
+        motion_step_.prepareStaticGoal(data_.pending_events.static_position_goal,
+                                       data_.pending_events.do_static_goal_fast_update);
+        data_.pending_events.static_position_goal.Clear();
+        data_.pending_events.do_static_position_goal_update = false;
+        data_.has_new_goal = true;
+        data_.has_active_goal = true;
+      }
+      else if (data_.pending_events.do_static_velocity_goal_update && !data_.pending_events.do_ramp_down)
+      {
+        motion_step_.prepareStaticGoal(data_.pending_events.static_velocity_goal,
+                                       data_.pending_events.do_static_goal_fast_update);
+        data_.pending_events.static_velocity_goal.Clear();
+        data_.pending_events.do_static_velocity_goal_update = false;
+        data_.has_new_goal = true;
+        data_.has_active_goal = true;
+      }
+
+      if (data_.pending_events.do_static_goal_finish)
+      {
+        state_manager_.setPendingState(StaticGoal, Finished);
+      }
+      else if (data_.pending_events.do_ramp_down)
+      {
+        state_manager_.setPendingState(RampDown, None);
+      }
+    }
+    break;
+
+    case Finished:
+    {
+      // Clear the static goal event flags.
+      data_.pending_events.do_static_goal_start = false;
+      data_.pending_events.do_static_goal_finish = false;
+      data_.pending_events.do_static_position_goal_update = false;
+      data_.pending_events.do_static_velocity_goal_update = false;
+
+      // Perform a ramp down stop.
+      data_.pending_events.do_ramp_down = true;
+      data_.pending_events.do_stop = true;
+      state_manager_.setPendingState(RampDown, None);
+    }
+    break;
+  }
+}
+
+void TrajectoryMotion::updateNormalGoal()
+{
+  bool success = false;
+
+  bool limit_reached = false;
+
+  // Swap in the prefetched segment, if it is still valid (i.e. nothing has changed since it was prepared).
+  if (has_prefetched_goal_ && trajectories_.p_current &&
+      trajectories_.p_current.get() == p_prefetched_trajectory_ &&
+      trajectories_.p_current->size() == prefetched_points_ &&
+      motion_step_.data.duration_factor == prefetched_duration_factor_)
+  {
+    has_prefetched_goal_ = false;
+    trajectories_.p_current->dropNextTrajectoryPoint();
+    motion_step_.activateNextGoal();
+    std::swap(controller_, next_controller_);
+    recordExecutedSegment();
+
+    // Note: The interpolator and controller have already been updated.
+    data_.has_pending_reached_points = false;
+    data_.has_new_goal = false;
+    data_.has_active_goal = true;
+    return;
+  }
+
+  if (trajectories_.p_current)
+  {
+    if (trajectories_.p_current->retriveNextTrajectoryPoint(&motion_step_.external_goal))
+    {
+      if (motion_step_.external_goal.reach())
+      {
+        // Check if the conditions are already fulfilled. If so, retrive another goal.
+        // Note: The number of skipped points is limited, to keep the cycle's execution time bounded.
+        unsigned int skipped_points = 0;
+
+        do
+        {
+          motion_step_.prepareNormalGoal(trajectories_.p_current->size() == 0,
+                                         trajectories_.p_current->peekNextTrajectoryPoint());
+          success = !motion_step_.conditionMet();
+          limit_reached = (!success && ++skipped_points >= MAX_REACHED_POINTS_PER_CYCLE);
+        }
+        while (!success && !limit_reached &&
+               trajectories_.p_current->retriveNextTrajectoryPoint(&motion_step_.external_goal));
+      }
+      else
+      {
+        motion_step_.prepareNormalGoal(trajectories_.p_current->size() == 0,
+                                       trajectories_.p_current->peekNextTrajectoryPoint());
+        success = true;
+      }
+    }
+
+    if (success)
+    {
+      recordExecutedSegment();
+    }
+
+    if (!success && trajectories_.p_current->size() == 0)
+    {
+      trajectories_.p_current->detach();
+      trajectories_.p_current.reset();
+      data_.is_retracting = false;
+      limit_reached = false;
+    }
+  }
+
+  // If the limit was reached, then keep holding the previous goal and skip the remaining points in later cycles.
+  data_.has_pending_reached_points = limit_reached;
+  data_.has_new_goal = success;
+  if (!limit_reached)
+  {
+    data_.has_active_goal = success;
+  }
+}
+
+void TrajectoryMotion::storeNormalGoal()
+{
+  // Note: A pending seek has already placed the seeked point in the front (i.e. the current goal is abandoned).
+  if (data_.pending_events.do_seek)
+  {
+    data_.pending_events.do_seek = false;
+  }
+  else if (trajectories_.p_current)
+  {
+    motion_step_.external_goal.set_duration(std::max(Constants::RobotController::LOWEST_SAMPLE_TIME,
+                                            motion_step_.internal_goal.duration() - motion_step_.data.time_passed));
+
+    trajectories_.p_current->addTrajectoryPointFront(motion_step_.external_goal);
+  }
+}
+
+void TrajectoryMotion::retireQueue(std::deque<boost::shared_ptr<Trajectory> >* p_queue)
+{
+  std::vector<std::deque<boost::shared_ptr<Trajectory> > >& slots = trajectories_.retired_queues;
+
+  if (p_queue && !p_queue->empty())
+  {
+    if (trajectories_.retired_count < slots.size())
+    {
+      slots[trajectories_.retired_count++].swap(*p_queue);
+    }
+    else if (!slots.empty())
+    {
+      slots.back().insert(slots.back().end(), p_queue->begin(), p_queue->end());
+      p_queue->clear();
+    }
+  }
+}
+
+void TrajectoryMotion::takeRetiredQueues(
+  std::vector<std::deque<boost::shared_ptr<Trajectory> > >* p_retired_queues)
+{
+  if (p_retired_queues)
+  {
+    std::vector<std::deque<boost::shared_ptr<Trajectory> > >& slots = trajectories_.retired_queues;
+    p_retired_queues->resize(trajectories_.retired_count);
+
+    for (size_t i = 0; i < trajectories_.retired_count; ++i)
+    {
+      for (size_t j = 0; j < slots[i].size(); ++j)
+      {
+        slots[i][j]->detach();
+      }
+
+      slots[i].swap((*p_retired_queues)[i]);
+    }
+
+    trajectories_.retired_count = 0;
+  }
+}
+
+void TrajectoryMotion::recordExecutedSegment()
+{
+  if (data_.is_retracting || executed_segments_.capacity() == 0)
+  {
+    return;
+  }
+
+  // Note: If the history is full, then the oldest entry is rotated to the back and cleared (i.e. its allocated
+  //       storage is kept). Assigning a new entry would instead swap in the new entry's (empty) storage.
+  if (executed_segments_.full())
+  {
+    executed_segments_.rotate(executed_segments_.begin() + 1);
+    executed_segments_.back().start.Clear();
+  }
+  else
+  {
+    executed_segments_.push_back(ExecutedSegment());
+  }
+
+  ExecutedSegment& segment = executed_segments_.back();
+  const PointGoal& state = motion_step_.interpolation;
+  PointGoal& start = segment.start;
+
+  segment.start_time = motion_time_;
+  segment.duration = motion_step_.internal_goal.duration();
+
+  // Store the current state (i.e. the segment's start), with negated velocities for the reversed motion.
+  if (motion_step_.data.mode == EGMJoint)
+  {
+    JointGoal* p_joints = start.mutable_robot()->mutable_joints();
+    p_joints->mutable_position()->CopyFrom(state.robot().joints().position());
+    p_joints->mutable_velocity()->CopyFrom(state.robot().joints().velocity());
+    p_joints->mutable_acceleration()->CopyFrom(state.robot().joints().acceleration());
+    multiply(p_joints->mutable_velocity(), -1.0);
+  }
+  else
+  {
+    // Note: The state's Euler field contains the angular velocities (while the goal's Euler field is an orientation).
+    CartesianGoal* p_cartesian = start.mutable_robot()->mutable_cartesian();
+    p_cartesian->mutable_pose()->mutable_position()->CopyFrom(state.robot().cartesian().pose().position());
+    p_cartesian->mutable_pose()->mutable_quaternion()->CopyFrom(state.robot().cartesian().pose().quaternion());
+    p_cartesian->mutable_velocity()->CopyFrom(state.robot().cartesian().velocity());
+    p_cartesian->mutable_angular_velocity()->CopyFrom(state.robot().cartesian().pose().euler());
+    p_cartesian->mutable_acceleration()->CopyFrom(state.robot().cartesian().acceleration());
+    multiply(p_cartesian->mutable_velocity(), -1.0);
+    multiply(p_cartesian->mutable_angular_velocity(), -1.0);
+  }
+
+  JointGoal* p_external = start.mutable_external()->mutable_joints();
+  p_external->mutable_position()->CopyFrom(state.external().joints().position());
+  p_external->mutable_velocity()->CopyFrom(state.external().joints().velocity());
+  p_external->mutable_acceleration()->CopyFrom(state.external().joints().acceleration());
+  multiply(p_external->mutable_velocity(), -1.0);
+}
+
+bool TrajectoryMotion::checkScheduledStart(Trajectory* p_trajectory)
+{
+  bool result = true;
+
+  // Note: A trajectory without any points is started directly (i.e. it is just passed through).
+  if (p_trajectory && p_trajectory->hasStartTime() && p_trajectory->size() > 0 &&
+      motion_step_.data.feedback.has_time())
+  {
+    // The outputs are interpolated one time step ahead, so start if the scheduled start is within that step.
+    double remaining = p_trajectory->startTime() - toSeconds(motion_step_.data.feedback.time());
+    result = (remaining < motion_step_.data.time_step);
+
+    if (result)
+    {
+      // Note: Starting directly if the scheduled start has already passed.
+      data_.has_start_offset = true;
+      data_.start_offset = -std::max(remaining, 0.0);
+      p_trajectory->clearStartTime();
+    }
+  }
+
+  return result;
+}
+
+bool TrajectoryMotion::startRetract()
+{
+  if (executed_segments_.empty() || !data_.pending_events.p_retract)
+  {
+    return false;
+  }
+
+  boost::shared_ptr<Trajectory> p_retract;
+  p_retract.swap(data_.pending_events.p_retract);
+  double end_time = motion_time_;
+  double retracted = 0.0;
+
+  // Reverse whole segments (newest first), until the requested duration has been covered.
+  while (!executed_segments_.empty() && retracted < data_.pending_events.retract_duration)
+  {
+    ExecutedSegment& segment = executed_segments_.back();
+    double duration = std::max(Constants::RobotController::LOWEST_SAMPLE_TIME,
+                               std::min(segment.duration, end_time - segment.start_time));
+
+    // Note: The executed durations already include the duration factor.
+    segment.start.set_duration(duration / motion_step_.data.duration_factor);
+    p_retract->addTrajectoryPointBack(segment.start);
+
+    retracted += duration;
+    end_time = segment.start_time;
+    executed_segments_.pop_back();
+  }
+
+  // Discard any current and queued trajectories.
+  if (trajectories_.p_current)
+  {
+    trajectories_.primary_queue.push_front(trajectories_.p_current);
+    trajectories_.p_current.reset();
+  }
+  retireQueue(&trajectories_.primary_queue);
+  retireQueue(&trajectories_.temporary_queue);
+
+  // Continue the motion time from the retract's end, so the remaining segments keep their timing.
+  motion_time_ = end_time;
+
+  trajectories_.p_current = p_retract;
+  trajectories_.p_current->attach(&trajectories_.usage);
+  data_.is_retracting = true;
+  data_.has_pending_reached_points = false;
+  updateNormalGoal();
+
+  return true;
+}
+
+Trajectory* TrajectoryMotion::findSeekTarget()
+{
+  Trajectory* p_trajectory = 0;
+
+  if (!data_.is_retracting && !data_.pending_events.do_retract)
+  {
+    if (trajectories_.p_current)
+    {
+      p_trajectory = trajectories_.p_current.get();
+    }
+    else if (!trajectories_.primary_queue.empty())
+    {
+      p_trajectory = trajectories_.primary_queue.front().get();
+    }
+  }
+
+  return p_trajectory;
+}
+
+bool TrajectoryMotion::seek(Trajectory* p_trajectory, const size_t index, const double duration)
+{
+  bool result = (duration > 0.0 && p_trajectory && p_trajectory->seek(index, duration));
+
+  if (result)
+  {
+    // A running goal is replaced in the next cycle, otherwise the seeked point is simply the next point.
+    data_.pending_events.do_seek = (p_trajectory == trajectories_.p_current.get() &&
+                                    state_manager_.verifyState(Normal, Running));
+    has_prefetched_goal_ = false;
+  }
+
+  return result;
+}
+
+void TrajectoryMotion::updateSpeedScale(const Input& input)
+{
+  if (state_manager_.getState() == Normal && configurations_.use_speed_governor)
+  {
+    double error = 0.0;
+    double tolerance = 0.0;
+    const Planned& planned = input.planned();
+    const Feedback& feedback = input.feedback();
+
+    if (data_.has_active_goal)
+    {
+      if (motion_step_.data.mode == EGMJoint)
+      {
+        error = std::max(findMaxDifference(planned.robot().joints().position(),
+                                           feedback.robot().joints().position()),
+                         findMaxDifference(planned.external().joints().position(),
+                                           feedback.external().joints().position()));
+        tolerance = configurations_.speed_governor_joint_tolerance;
+      }
+      else
+      {
+        error = std::max(findMaxDifference(planned.robot().cartesian().pose().position(),
+                                           feedback.robot().cartesian().pose().position()),
+                         findMaxDifference(planned.external().joints().position(),
+                                           feedback.external().joints().position()));
+        tolerance = configurations_.speed_governor_position_tolerance;
+      }
+    }
+
+    // Slow down (in proportion to the excess error) if the tolerance is exceeded,
+    // and speed up again when the error is well within the tolerance.
+    double max_change = configurations_.speed_governor_rate*motion_step_.data.time_step;
+    double ratio = (tolerance > 0.0 ? error / tolerance : 0.0);
+
+    if (ratio > 1.0)
+    {
+      speed_scale_ += max_change*std::min(ratio - 1.0, 1.0);
+    }
+    else if (ratio < SPEED_GOVERNOR_RELEASE_RATIO)
+    {
+      speed_scale_ -= max_change;
+    }
+
+    speed_scale_ = saturate(speed_scale_, DURATION_FACTOR_MIN, DURATION_FACTOR_MAX);
+  }
+  else if (speed_scale_ != 1.0)
+  {
+    // Release the time scale, with the interpolation's velocities converted to real time (i.e. no velocity jump).
+    // Note: Any prefetched segment was prepared from the unconverted velocities.
+    motion_step_.scaleVelocities(1.0 / speed_scale_);
+    speed_scale_ = 1.0;
+    has_prefetched_goal_ = false;
+  }
+
+  // Advance the trajectory time slower, according to the time scale.
+  motion_step_.data.time_step /= speed_scale_;
+}
+
+void TrajectoryMotion::calculateQueueUsage(size_t* p_points, size_t* p_bytes)
+{
+  if (p_points)
+  {
+    *p_points = trajectories_.usage.points;
+  }
+
+  if (p_bytes)
+  {
+    *p_bytes = trajectories_.usage.bytes;
+  }
+}
+
+/************************************************************
+ * User interaction methods
+ */
+
+bool TrajectoryMotion::addTrajectory(const trajectory::TrajectoryGoal& trajectory,
+                                     const bool override_trajectories)
+{
+  bool compact = false;
+  size_t seek_history = 0;
+
+  {
+    boost::lock_guard<boost::mutex> lock(data_.mutex);
+    compact = configurations_.compact_storage;
+    seek_history = configurations_.seek_history_size;
+  }
+
+  // Note: The trajectory is parsed (and possibly encoded) outside the locks.
+  boost::shared_ptr<Trajectory> p_traj(new Trajectory(trajectory, compact, seek_history));
+
+  // Note: Declared before the locks, so any retired queues are released after the locks have been released.
+  std::vector<std::deque<boost::shared_ptr<Trajectory> > > retired_queues;
+
+  boost::lock_guard<boost::mutex> data_lock(data_.mutex);
+  boost::lock_guard<boost::mutex> trajectory_lock(trajectories_.mutex);
+
+  takeRetiredQueues(&retired_queues);
+
+  bool accepted = state_manager_.verifyState(Normal, Running);
+
+  // Admission control: Reject the trajectory if it would exceed the queue limits.
+  // Note: Overriding trajectories replaces everything that is queued, so then only the new trajectory counts.
+  if (accepted && (configurations_.max_queued_points > 0 || configurations_.max_queued_bytes > 0))
+  {
+    size_t points = 0;
+    size_t bytes = 0;
+
+    if (!override_trajectories)
+    {
+      calculateQueueUsage(&points, &bytes);
+    }
+
+    points += p_traj->size();
+    bytes += p_traj->bytes();
+
+    if ((configurations_.max_queued_points > 0 && points > configurations_.max_queued_points) ||
+        (configurations_.max_queued_bytes > 0 && bytes > configurations_.max_queued_bytes))
+    {
+      accepted = false;
+      ++data_.rejected_trajectories;
+    }
+  }
+
+  if (accepted)
+  {
+    p_traj->attach(&trajectories_.usage);
+
+    if (override_trajectories)
+    {
+      retireQueue(&trajectories_.temporary_queue);
+      trajectories_.temporary_queue.push_back(p_traj);
+      data_.pending_events.do_ramp_down = true;
+      data_.pending_events.do_stop = true;
+      data_.pending_events.do_discard = true;
+      data_.pending_events.do_resume = true;
+    }
+    else
+    {
+      if (data_.pending_events.do_discard)
+      {
+        trajectories_.temporary_queue.push_back(p_traj);
+      }
+      else
+      {
+        trajectories_.primary_queue.push_back(p_traj);
+      }
+    }
+  }
+
+  return accepted;
+}
+
+bool TrajectoryMotion::stopTrajectory(const bool discard_trajectories)
+{
+  boost::lock_guard<boost::mutex> lock(data_.mutex);
+
+  bool accepted = state_manager_.verifyState(Normal, Running);
+
+  if (accepted)
+  {
+    data_.pending_events.do_ramp_down = true;
+    data_.pending_events.do_stop = true;
+    data_.pending_events.do_discard = discard_trajectories;
+  }
+
+  return accepted;
+}
+
+bool TrajectoryMotion::resumeTrajectory()
+{
+  boost::lock_guard<boost::mutex> lock(data_.mutex);
+
+  bool accepted = state_manager_.verifyState(RampDown, Finished);
+
+  if (accepted)
+  {
+    data_.pending_events.do_resume = true;
+  }
+
+  return accepted;
+}
+
+bool TrajectoryMotion::retractTrajectory(const double duration)
+{
+  bool compact = false;
+
+  {
+    boost::lock_guard<boost::mutex> lock(data_.mutex);
+    compact = configurations_.compact_storage;
+  }
+
+  // Note: The retract trajectory is allocated outside the lock (i.e. not by the EGM communication loop), and it
+  //       is declared before the lock, so any replaced pending retract is released after the lock has been released.
+  boost::shared_ptr<Trajectory> p_retract(new Trajectory(compact));
+
+  boost::lock_guard<boost::mutex> lock(data_.mutex);
+
+  bool accepted = (duration > 0.0 && !data_.pending_events.do_static_goal_start &&
+                   (state_manager_.verifyState(Normal, Running) || state_manager_.getState() == RampDown));
+
+  if (accepted)
+  {
+    data_.pending_events.do_retract = true;
+    data_.pending_events.retract_duration = duration;
+    data_.pending_events.p_retract.swap(p_retract);
+  }
+
+  return accepted;
+}
+
+bool TrajectoryMotion::seekTrajectory(const size_t index, const double duration)
+{
+  boost::lock_guard<boost::mutex> data_lock(data_.mutex);
+  boost::lock_guard<boost::mutex> trajectory_lock(trajectories_.mutex);
+
+  return seek(findSeekTarget(), index, duration);
+}
+
+bool TrajectoryMotion::seekTrajectoryTime(const double time, const double duration)
+{
+  boost::lock_guard<boost::mutex> data_lock(data_.mutex);
+  boost::lock_guard<boost::mutex> trajectory_lock(trajectories_.mutex);
+
+  Trajectory* p_trajectory = findSeekTarget();
+  size_t index = 0;
+
+  return (p_trajectory && p_trajectory->findIndex(time, &index) && seek(p_trajectory, index, duration));
+}
+
+bool TrajectoryMotion::updateDurationFactor(double factor)
+{
+  boost::lock_guard<boost::mutex> lock(data_.mutex);
+
+  bool accepted = state_manager_.verifyState(Normal, Running);
+
+  if (accepted)
+  {
+    data_.pending_events.do_ramp_down = true;
+    data_.pending_events.do_duration_factor_update = true;
+    data_.pending_events.duration_factor = saturate(factor, DURATION_FACTOR_MIN, DURATION_FACTOR_MAX);
+  }
+
+  return accepted;
+}
+
+bool TrajectoryMotion::setCorrection(const Correction& correction, const double time)
+{
+  bool accepted = (verify(correction.robot_joints().position()) &&
+                   verify(correction.robot_joints().velocity()) &&
+                   verify(correction.cartesian_position()) &&
+                   verify(correction.cartesian_velocity()) &&
+                   verify(correction.external_joints().position()) &&
+                   verify(correction.external_joints().velocity()));
+
+  if (accepted)
+  {
+    corrector_.write(correction, time);
+  }
+
+  return accepted;
+}
+
+bool TrajectoryMotion::startStaticGoal(const bool discard_trajectories)
+{
+  boost::lock_guard<boost::mutex> lock(data_.mutex);
+
+  bool accepted = state_manager_.verifyState(Normal, Running);
+
+  if (accepted)
+  {
+    data_.pending_events.do_ramp_down = true;
+    data_.pending_events.do_stop = true;
+    data_.pending_events.do_discard = discard_trajectories;
+    data_.pending_events.do_resume = true;
+    data_.pending_events.do_static_goal_start = true;
+  }
+
+  return accepted;
+}
+
+bool TrajectoryMotion::setStaticGoal(const StaticPositionGoal& position_goal, const bool fast_transition)
+{
+  boost::lock_guard<boost::mutex> lock(data_.mutex);
+
+  bool accepted = state_manager_.verifyState(StaticGoal, Running);
+
+  if (accepted)
+  {
+    data_.pending_events.do_ramp_down = !fast_transition;
+    data_.pending_events.do_stop = !fast_transition;
+    data_.pending_events.do_resume = true;
+    data_.pending_events.do_static_goal_fast_update = fast_transition;
+    data_.pending_events.do_static_position_goal_update = true;
+    data_.pending_events.do_static_velocity_goal_update = false;
+    data_.pending_events.static_position_goal.CopyFrom(position_goal);
+  }
+
+  return accepted;
+}
+
+bool TrajectoryMotion::setStaticGoal(const StaticVelocityGoal& velocity_goal, const bool fast_transition)
+{
+  boost::lock_guard<boost::mutex> lock(data_.mutex);
+
+  bool accepted = state_manager_.verifyState(StaticGoal, Running);
+
+  if (accepted)
+  {
+    data_.pending_events.do_ramp_down = !fast_transition;
+    data_.pending_events.do_stop = !fast_transition;
+    data_.pending_events.do_resume = true;
+    data_.pending_events.do_static_goal_fast_update = fast_transition;
+    data_.pending_events.do_static_velocity_goal_update = true;
+    data_.pending_events.do_static_position_goal_update = false;
+    data_.pending_events.static_velocity_goal.CopyFrom(velocity_goal);
+  }
+
+  return accepted;
+}
+
+bool TrajectoryMotion::finishStaticGoal(const bool resume)
+{
+  boost::lock_guard<boost::mutex> lock(data_.mutex);
+
+  bool accepted = state_manager_.verifyState(StaticGoal, Running);
+
+  if (accepted)
+  {
+    data_.pending_events.do_static_goal_finish = true;
+    data_.pending_events.do_resume = resume;
+  }
+
+  return accepted;
+}
+
+bool TrajectoryMotion::retrieveExecutionProgress(trajectory::ExecutionProgress* p_progress)
+{
+  // Note: The EGM communication loop's locks are not taken, so the loop is never delayed by the copying.
+  return progress_publisher_.read(p_progress);
+}
+
+void TrajectoryMotion::reclaimRetiredQueues()
+{
+  // Note: Declared before the lock, so the retired queues are released after the lock has been released.
+  std::vector<std::deque<boost::shared_ptr<Trajectory> > > retired_queues;
+
+  boost::lock_guard<boost::mutex> lock(trajectories_.mutex);
+  takeRetiredQueues(&retired_queues);
+}
+
+void TrajectoryMotion::storeSession(session::TrajectorySnapshot* p_snapshot)
+{
+  std::deque<boost::shared_ptr<Trajectory> >::const_iterator i;
+
+  boost::lock_guard<boost::mutex> data_lock(data_.mutex);
+  boost::lock_guard<boost::mutex> trajectory_lock(trajectories_.mutex);
+
+  if (p_snapshot)
+  {
+    p_snapshot->Clear();
+
+    if (trajectories_.p_current)
+    {
+      trajectory::TrajectoryGoal* p_trajectory = p_snapshot->add_primary_queue();
+
+      // Store the remaining part of the active goal (in the same way as when the motion is reset).
+      if (state_manager_.getState() == Normal && data_.has_active_goal)
+      {
+        trajectory::PointGoal* p_point = p_trajectory->add_points();
+        p_point->CopyFrom(motion_step_.external_goal);
+        p_point->set_duration(std::max(Constants::RobotController::LOWEST_SAMPLE_TIME,
+                                       motion_step_.internal_goal.duration() - motion_step_.data.time_passed));
+      }
+
+      trajectories_.p_current->copyTo(p_trajectory);
+    }
+
+    for (i = trajectories_.primary_queue.begin(); i != trajectories_.primary_queue.end(); ++i)
+    {
+      (*i)->copyTo(p_snapshot->add_primary_queue());
+    }
+
+    for (i = trajectories_.temporary_queue.begin(); i != trajectories_.temporary_queue.end(); ++i)
+    {
+      (*i)->copyTo(p_snapshot->add_temporary_queue());
+    }
+  }
+}
+
+void TrajectoryMotion::restoreSession(const session::TrajectorySnapshot& snapshot)
+{
+  // Note: Declared before the locks, so any retired queues are released after the locks have been released.
+  std::vector<std::deque<boost::shared_ptr<Trajectory> > > retired_queues;
+
+  boost::lock_guard<boost::mutex> data_lock(data_.mutex);
+  boost::lock_guard<boost::mutex> trajectory_lock(trajectories_.mutex);
+
+  resetTrajectoryMotion();
+  retireQueue(&trajectories_.primary_queue);
+  retireQueue(&trajectories_.temporary_queue);
+
+  for (int i = 0; i < snapshot.primary_queue_size(); ++i)
+  {
+    trajectories_.primary_queue.push_back(
+      boost::shared_ptr<Trajectory>(new Trajectory(snapshot.primary_queue(i),
+                                                   configurations_.compact_storage,
+                                                   configurations_.seek_history_size)));
+    trajectories_.primary_queue.back()->attach(&trajectories_.usage);
+  }
+
+  for (int i = 0; i < snapshot.temporary_queue_size(); ++i)
+  {
+    trajectories_.temporary_queue.push_back(
+      boost::shared_ptr<Trajectory>(new Trajectory(snapshot.temporary_queue(i),
+                                                   configurations_.compact_storage,
+                                                   configurations_.seek_history_size)));
+    trajectories_.temporary_queue.back()->attach(&trajectories_.usage);
+  }
+
+  takeRetiredQueues(&retired_queues);
+}
+
+void TrajectoryMotion::prewarm()
+{
+  // Note: Only try to lock, so that the pre-warming never delays anything else.
+  boost::unique_lock<boost::mutex> data_lock(data_.mutex, boost::try_to_lock);
+
+  if (data_lock.owns_lock())
+  {
+    motion_step_.prewarm();
+
+    boost::unique_lock<boost::mutex> trajectory_lock(trajectories_.mutex, boost::try_to_lock);
+
+    if (trajectory_lock.owns_lock() && trajectories_.p_current)
+    {
+      // Note: Peeking also decodes the next point, if the trajectory uses the compact storage form.
+      const PointGoal* p_next_point = trajectories_.p_current->peekNextTrajectoryPoint();
+
+      if (p_next_point)
+      {
+        p_next_point->ByteSizeLong();
+      }
+    }
+  }
+}
+
+void TrajectoryMotion::prefetchNextGoal()
+{
+  // Note: Only try to lock, so that the prefetching never delays anything else.
+  boost::unique_lock<boost::mutex> data_lock(data_.mutex, boost::try_to_lock);
+
+  if (!data_lock.owns_lock())
+  {
+    return;
+  }
+
+  boost::unique_lock<boost::mutex> trajectory_lock(trajectories_.mutex, boost::try_to_lock);
+
+  if (!trajectory_lock.owns_lock())
+  {
+    return;
+  }
+
+  has_prefetched_goal_ = false;
+
+  // Only prefetch if the current segment ends in the next cycle, without any pending events.
+  if (!state_manager_.verifyState(Normal, Running) || !data_.has_active_goal || data_.has_pending_reached_points ||
+      data_.pending_events.do_ramp_down || data_.pending_events.do_retract || data_.pending_events.do_seek ||
+      !trajectories_.p_current || !motion_step_.interpolationDurationReached())
+  {
+    return;
+  }
+
+  const PointGoal* p_next_point = trajectories_.p_current->peekNextTrajectoryPoint();
+  bool last_point = (trajectories_.p_current->size() == 1);
+
+  // Points with reach conditions, or estimated durations, depend on the next cycle's feedback. And so
+  // does any jerk estimation, which requires the point after the next point.
+  if (!p_next_point || p_next_point->reach() || !p_next_point->has_duration() ||
+      (configurations_.spline_method == TrajectoryConfiguration::Septic && configurations_.estimate_jerk &&
+       !last_point))
+  {
+    return;
+  }
+
+  // Prepare the next goal, with it temporarily swapped in as the current goal.
+  motion_step_.storeNextGoal(*p_next_point);
+  motion_step_.swapNextGoal();
+  motion_step_.prepareNormalGoal(last_point, 0);
+
+  // Note: The time passed is carried over when the next goal is activated instead.
+  double time_passed = motion_step_.data.time_passed;
+  motion_step_.updateInterpolator();
+  motion_step_.data.time_passed = time_passed;
+
+  next_controller_.update(Normal, motion_step_, configurations_);
+  motion_step_.swapNextGoal();
+
+  p_prefetched_trajectory_ = trajectories_.p_current.get();
+  prefetched_points_ = trajectories_.p_current->size();
+  prefetched_duration_factor_ = motion_step_.data.duration_factor;
+  has_prefetched_goal_ = true;
+}
+
+} // end namespace egm
+} // end namespace abb
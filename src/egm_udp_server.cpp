@@ -36,6 +36,7 @@
 
 #include <boost/bind.hpp>
 
+#include "abb_libegm/egm_common_auxiliary.h"
 #include "abb_libegm/egm_udp_server.h"
 
 namespace abb
@@ -51,7 +52,12 @@ UDPServer::UDPServer(boost::asio::io_service& io_service,
                      AbstractUDPServerInterface* p_interface)
 :
 initialized_(false),
-p_interface_(p_interface)
+p_interface_(p_interface),
+io_service_(io_service),
+suspended_(false),
+receive_pending_(false),
+prewarm_timer_(io_service),
+estimated_period_(0.0)
 {
   bool success = true;
 
@@ -61,14 +67,18 @@ p_interface_(p_interface)
     p_socket_.reset(new boost::asio::ip::udp::socket(io_service,
                                                      boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(),
                                                                                     port_number)));
+    p_socket_->non_blocking(true);
   }
   catch (std::exception e)
   {
     success = false;
+    p_socket_.reset();
   }
 
   if (success)
   {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+
     initialized_ = true;
     startAsynchronousReceive();
   }
@@ -76,6 +86,9 @@ p_interface_(p_interface)
 
 UDPServer::~UDPServer()
 {
+  boost::system::error_code error;
+  prewarm_timer_.cancel(error);
+
   if (p_socket_)
   {
     p_socket_->close();
@@ -88,38 +101,158 @@ bool UDPServer::isInitialized() const
   return initialized_;
 }
 
+void UDPServer::suspend()
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+
+  suspended_ = true;
+}
+
+void UDPServer::resume()
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+
+  suspended_ = false;
+  io_service_.post(boost::bind(&UDPServer::restartAsynchronousReceive, this));
+}
+
+int UDPServer::nativeHandle()
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+
+  return (p_socket_ ? (int) p_socket_->native_handle() : -1);
+}
+
+bool UDPServer::adoptSocket(const int native_handle)
+{
+  boost::shared_ptr<boost::asio::ip::udp::socket> p_socket;
+  boost::asio::ip::udp::endpoint local_endpoint;
+  boost::system::error_code error;
+
+  p_socket.reset(new boost::asio::ip::udp::socket(io_service_));
+  p_socket->assign(boost::asio::ip::udp::v4(), native_handle, error);
+
+  if (!error)
+  {
+    p_socket->non_blocking(true, error);
+  }
+
+  if (!error)
+  {
+    local_endpoint = p_socket->local_endpoint(error);
+  }
+
+  if (error)
+  {
+    // Leave the handle open for the caller, if it was assigned.
+    if (p_socket->is_open())
+    {
+      p_socket->release(error);
+    }
+
+    return false;
+  }
+
+  boost::lock_guard<boost::mutex> lock(mutex_);
+
+  // Keep any current socket's messages unprocessed, until the socket has been replaced and resume() called.
+  suspended_ = true;
+  initialized_ = true;
+  server_data_.port_number = local_endpoint.port();
+  io_service_.post(boost::bind(&UDPServer::replaceSocket, this, p_socket));
+
+  return true;
+}
+
 void UDPServer::startAsynchronousReceive()
 {
+  if (p_socket_ && !receive_pending_)
+  {
+    receive_pending_ = true;
+    p_socket_->async_wait(boost::asio::ip::udp::socket::wait_read,
+                          makeHandler(receive_memory_,
+                                      boost::bind(&UDPServer::receiveCallback,
+                                                  this,
+                                                  boost::asio::placeholders::error)));
+  }
+}
+
+void UDPServer::restartAsynchronousReceive()
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+
+  if (!suspended_)
+  {
+    startAsynchronousReceive();
+  }
+}
+
+void UDPServer::replaceSocket(boost::shared_ptr<boost::asio::ip::udp::socket> p_socket)
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+
+  // Note: Closing the previous socket aborts its pending wait, which then completes without any processing.
   if (p_socket_)
   {
-    p_socket_->async_receive_from(boost::asio::buffer(receive_buffer_),
-                                  remote_endpoint_,
-                                  boost::bind(&UDPServer::receiveCallback,
-                                              this,
-                                              boost::asio::placeholders::error,
-                                              boost::asio::placeholders::bytes_transferred));
+    boost::system::error_code error;
+    p_socket_->close(error);
+  }
+
+  p_socket_ = p_socket;
+  receive_pending_ = false;
+
+  if (!suspended_)
+  {
+    startAsynchronousReceive();
   }
 }
 
-void UDPServer::receiveCallback(const boost::system::error_code& error, const std::size_t bytes_transferred)
+void UDPServer::receiveCallback(const boost::system::error_code& error)
 {
-  server_data_.p_data = receive_buffer_;
-  server_data_.bytes_transferred = (int) bytes_transferred;
+  boost::asio::steady_timer::time_point arrival = boost::asio::steady_timer::clock_type::now();
+
+  boost::lock_guard<boost::mutex> lock(mutex_);
 
-  if (error == boost::system::errc::success && p_interface_)
+  receive_pending_ = false;
+
+  // Leave any message in the socket while suspended, and stop if the wait was aborted (e.g. the socket was closed).
+  if (suspended_ || error == boost::asio::error::operation_aborted)
   {
-    // Process the received data via the callback method (creates the reply message).
-    const std::string& reply = p_interface_->callback(server_data_);
+    return;
+  }
+
+  if (!error && p_socket_)
+  {
+    boost::system::error_code receive_error;
+    std::size_t bytes_transferred = p_socket_->receive_from(boost::asio::buffer(receive_buffer_),
+                                                            remote_endpoint_,
+                                                            0,
+                                                            receive_error);
+
+    server_data_.p_data = receive_buffer_;
+    server_data_.bytes_transferred = (int) bytes_transferred;
+    server_data_.arrival = arrival;
 
-    if (!reply.empty() && p_socket_)
+    if (receive_error == boost::system::errc::success && p_interface_)
     {
-      // Send the response message to the robot controller.
-      p_socket_->async_send_to(boost::asio::buffer(reply),
-                               remote_endpoint_,
-                               boost::bind(&UDPServer::sendCallback,
-                                           this,
-                                           boost::asio::placeholders::error,
-                                           boost::asio::placeholders::bytes_transferred));
+      // Process the received data via the callback method (creates the reply message).
+      const std::string& reply = p_interface_->callback(server_data_);
+
+      if (!reply.empty())
+      {
+        // Send the response message to the robot controller.
+        p_socket_->async_send_to(boost::asio::buffer(reply),
+                                 remote_endpoint_,
+                                 makeHandler(send_memory_,
+                                             boost::bind(&UDPServer::sendCallback,
+                                                         this,
+                                                         boost::asio::placeholders::error,
+                                                         boost::asio::placeholders::bytes_transferred)));
+      }
+
+      schedulePrewarm(arrival);
+
+      p_interface_->postReply();
     }
   }
 
@@ -127,6 +260,56 @@ void UDPServer::receiveCallback(const boost::system::error_code& error, const st
   startAsynchronousReceive();
 }
 
+void UDPServer::schedulePrewarm(const boost::asio::steady_timer::time_point& arrival)
+{
+  // Note: Gaps much longer than the estimated period (e.g. between communication sessions) restart the estimation.
+  const double smoothing = 0.1;
+  const double max_period = 1.0e6;
+  const double max_gap_factor = 4.0;
+
+  if (last_arrival_ != boost::asio::steady_timer::time_point())
+  {
+    double interval = (double) boost::asio::chrono::duration_cast<boost::asio::chrono::microseconds>(
+                        arrival - last_arrival_).count();
+
+    if (estimated_period_ > 0.0 && interval < max_gap_factor*estimated_period_)
+    {
+      estimated_period_ += smoothing*(interval - estimated_period_);
+    }
+    else
+    {
+      estimated_period_ = (interval < max_period ? interval : 0.0);
+    }
+  }
+
+  last_arrival_ = arrival;
+
+  unsigned int lead_time = p_interface_->prewarmLeadTime();
+
+  // Note: Re-arming the timer aborts any pending pre-warming (e.g. if the message arrived earlier than predicted).
+  if (lead_time > 0 && estimated_period_ > lead_time)
+  {
+    prewarm_timer_.expires_at(arrival + boost::asio::chrono::microseconds((long) (estimated_period_ - lead_time)));
+    prewarm_timer_.async_wait(makeHandler(prewarm_memory_,
+                                          boost::bind(&UDPServer::prewarmCallback,
+                                                      this,
+                                                      boost::asio::placeholders::error)));
+  }
+}
+
+void UDPServer::prewarmCallback(const boost::system::error_code& error)
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+
+  if (error || suspended_ || !p_interface_)
+  {
+    return;
+  }
+
+  touch(receive_buffer_, sizeof(receive_buffer_));
+  p_interface_->prewarm();
+}
+
 void UDPServer::sendCallback(const boost::system::error_code& error, const std::size_t bytes_transferred) {}
 
 } // end namespace egm
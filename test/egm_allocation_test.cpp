@@ -0,0 +1,322 @@
+/***********************************************************************************************************************
+ *
+ * Copyright (c) 2015, ABB Schweiz AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that
+ * the following conditions are met:
+ *
+ *    * Redistributions of source code must retain the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer in the documentation
+ *      and/or other materials provided with the
+ *      distribution.
+ *    * Neither the name of ABB nor the names of its
+ *      contributors may be used to endorse or promote
+ *      products derived from this software without
+ *      specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***********************************************************************************************************************
+ */
+
+// Regression test: The steady-state callbacks of the EGM interfaces must not allocate any memory.
+//
+// A simulated robot controller exchanges messages with each interface (over the loopback interface), and the
+// allocations made by the thread that executes the callbacks are counted once the session has reached steady state.
+//
+// Note: If the library has been built with allocation profiling, then it replaces the global allocation functions
+//       itself, and the callbacks' allocations are instead read from the interfaces' metrics.
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include <boost/asio.hpp>
+#include <boost/atomic.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <gtest/gtest.h>
+
+#include "abb_libegm/egm_controller_interface.h"
+#include "abb_libegm/egm_trajectory_interface.h"
+
+#include "egm_robot_controller_simulator.h"
+
+using namespace abb::egm;
+using abb::egm::simulation::RobotControllerSimulator;
+
+namespace
+{
+/**
+ * \brief Number of messages exchanged before the allocations are counted (i.e. to reach steady state).
+ */
+const unsigned int WARMUP_MESSAGES = 200;
+
+/**
+ * \brief Number of messages exchanged while the allocations are counted.
+ */
+const unsigned int COUNTED_MESSAGES = 500;
+
+/**
+ * \brief Flag indicating if the current thread executes the callbacks (i.e. if its allocations are counted).
+ */
+thread_local bool counted_thread = false;
+
+/**
+ * \brief Flag indicating if allocations are counted.
+ */
+boost::atomic<bool> counting(false);
+
+/**
+ * \brief The number of counted allocations.
+ */
+boost::atomic<unsigned long long> counted_allocations(0);
+
+/**
+ * \brief Execute an interface's callbacks, and mark the thread as counted.
+ *
+ * \param p_io_service for the interface's IO service.
+ */
+void runCallbacks(boost::asio::io_service* p_io_service)
+{
+  counted_thread = true;
+  p_io_service->run();
+}
+
+/**
+ * \brief Echo the inputs of a controller interface as outputs (i.e. an external control loop that holds still).
+ *
+ * \param p_interface for the interface.
+ * \param p_stop for a flag indicating if the loop should stop.
+ */
+void runControlLoop(EGMControllerInterface* p_interface, boost::atomic<bool>* p_stop)
+{
+  wrapper::Input inputs;
+  wrapper::Output outputs;
+
+  while (!p_stop->load())
+  {
+    if (p_interface->waitForMessage(100))
+    {
+      p_interface->read(&inputs);
+      outputs.mutable_robot()->mutable_joints()->mutable_position()->CopyFrom(
+        inputs.feedback().robot().joints().position());
+      p_interface->write(outputs);
+    }
+  }
+}
+
+/**
+ * \brief Exchange messages with an interface, and count the callbacks' allocations once in steady state.
+ *
+ * \param p_interface for the interface.
+ * \param p_simulator for the simulated robot controller.
+ *
+ * \return unsigned long long containing the number of allocations (or allocating callbacks).
+ */
+unsigned long long countSteadyStateAllocations(EGMBaseInterface* p_interface, RobotControllerSimulator* p_simulator)
+{
+  for (unsigned int i = 0; i < WARMUP_MESSAGES; ++i)
+  {
+    EXPECT_TRUE(p_simulator->exchange());
+  }
+
+  Metrics start = p_interface->getMetrics();
+  counted_allocations = 0;
+  counting = true;
+
+  for (unsigned int i = 0; i < COUNTED_MESSAGES; ++i)
+  {
+    EXPECT_TRUE(p_simulator->exchange());
+  }
+
+  counting = false;
+
+  if (MetricsCollector::allocationProfilingEnabled())
+  {
+    Metrics end = p_interface->getMetrics();
+    EXPECT_EQ(end.callbacks - start.callbacks, COUNTED_MESSAGES);
+    return end.allocating_callbacks - start.allocating_callbacks;
+  }
+
+  return counted_allocations.load();
+}
+} // end anonymous namespace
+
+TEST(AllocationTest, BaseInterfaceSteadyStateCallbacksDoNotAllocate)
+{
+  boost::asio::io_service io_service;
+  EGMBaseInterface interface(io_service, 6620);
+  ASSERT_TRUE(interface.isInitialized());
+
+  boost::thread thread(boost::bind(&runCallbacks, &io_service));
+  RobotControllerSimulator simulator(6620);
+
+  EXPECT_EQ(countSteadyStateAllocations(&interface, &simulator), 0u);
+
+  io_service.stop();
+  thread.join();
+}
+
+TEST(AllocationTest, LoggingBaseInterfaceSteadyStateCallbacksDoNotAllocate)
+{
+  BaseConfiguration configuration;
+  configuration.use_logging = true;
+
+  {
+    boost::asio::io_service io_service;
+    EGMBaseInterface interface(io_service, 6623, configuration);
+    ASSERT_TRUE(interface.isInitialized());
+
+    boost::thread thread(boost::bind(&runCallbacks, &io_service));
+    RobotControllerSimulator simulator(6623);
+
+    EXPECT_EQ(countSteadyStateAllocations(&interface, &simulator), 0u);
+
+    io_service.stop();
+    thread.join();
+  }
+
+  std::remove("port_6623_log.csv");
+}
+
+TEST(AllocationTest, ControllerInterfaceSteadyStateCallbacksDoNotAllocate)
+{
+  boost::asio::io_service io_service;
+  EGMControllerInterface interface(io_service, 6621);
+  ASSERT_TRUE(interface.isInitialized());
+
+  boost::atomic<bool> stop(false);
+  boost::thread thread(boost::bind(&runCallbacks, &io_service));
+  boost::thread control_loop(boost::bind(&runControlLoop, &interface, &stop));
+  RobotControllerSimulator simulator(6621);
+
+  EXPECT_EQ(countSteadyStateAllocations(&interface, &simulator), 0u);
+
+  stop = true;
+  control_loop.join();
+  io_service.stop();
+  thread.join();
+}
+
+TEST(AllocationTest, TrajectoryInterfaceSteadyStateCallbacksDoNotAllocate)
+{
+  // Note: The retract history is filled during the warm-up (its storage is allocated while it fills up).
+  TrajectoryConfiguration configuration;
+  configuration.retract_history_size = 10;
+
+  boost::asio::io_service io_service;
+  EGMTrajectoryInterface interface(io_service, 6622, configuration);
+  ASSERT_TRUE(interface.isInitialized());
+
+  boost::thread thread(boost::bind(&runCallbacks, &io_service));
+  RobotControllerSimulator simulator(6622);
+
+  // Queue a trajectory that lasts longer than the test (i.e. the callbacks interpolate it all the time).
+  wrapper::trajectory::TrajectoryGoal trajectory;
+  for (int i = 0; i < 200; ++i)
+  {
+    wrapper::trajectory::PointGoal* p_point = trajectory.add_points();
+    p_point->set_duration(0.05);
+
+    for (int j = 0; j < 6; ++j)
+    {
+      p_point->mutable_robot()->mutable_joints()->mutable_position()->add_values((i % 2 == 0 ? 1.0 : -1.0)*(j + 1));
+    }
+  }
+
+  ASSERT_TRUE(simulator.exchange());
+  ASSERT_TRUE(interface.addTrajectory(trajectory));
+
+  EXPECT_EQ(countSteadyStateAllocations(&interface, &simulator), 0u);
+
+  io_service.stop();
+  thread.join();
+}
+
+
+
+
+#ifndef ABB_LIBEGM_ALLOCATION_PROFILING
+/***********************************************************************************************************************
+ * Allocation hooks
+ *
+ * Note: Only allocations made by the thread that executes the callbacks are counted, and only while counting.
+ */
+
+namespace
+{
+void* countedAllocate(const std::size_t size)
+{
+  if (counted_thread && counting.load(boost::memory_order_relaxed))
+  {
+    ++counted_allocations;
+  }
+
+  return std::malloc(size == 0 ? 1 : size);
+}
+}
+
+void* operator new(std::size_t size)
+{
+  void* p = countedAllocate(size);
+
+  if (!p)
+  {
+    throw std::bad_alloc();
+  }
+
+  return p;
+}
+
+void* operator new[](std::size_t size)
+{
+  return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+  return countedAllocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+  return countedAllocate(size);
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+  std::free(p);
+}
+#endif
@@ -0,0 +1,209 @@
+/***********************************************************************************************************************
+ *
+ * Copyright (c) 2015, ABB Schweiz AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that
+ * the following conditions are met:
+ *
+ *    * Redistributions of source code must retain the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer in the documentation
+ *      and/or other materials provided with the
+ *      distribution.
+ *    * Neither the name of ABB nor the names of its
+ *      contributors may be used to endorse or promote
+ *      products derived from this software without
+ *      specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***********************************************************************************************************************
+ */
+
+// Tests that patched replies are byte-identical to serialized replies.
+//
+// Two steppers are stepped with the same robot messages and the same outputs, where only one of them patches its
+// replies in place (see the reply patching configuration). The tests only link the core library.
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "abb_libegm/egm_stepper.h"
+
+#include "egm_robot_controller_simulator.h"
+
+using namespace abb::egm;
+using abb::egm::simulation::serializeRobotMessage;
+
+namespace
+{
+/**
+ * \brief The simulated joint positions [degrees] (i.e. the robot stands still at zero).
+ */
+const double POSITIONS[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+
+/**
+ * \brief Class for stepping a patching and a serializing stepper side by side.
+ */
+class ReplyComparison
+{
+public:
+  /**
+   * \brief A constructor.
+   *
+   * \param configuration specifying the configuration to use (the reply patching flag is overridden).
+   */
+  ReplyComparison(const TrajectoryConfiguration& configuration = TrajectoryConfiguration())
+  :
+  patching_(withPatching(configuration, true)),
+  serializing_(withPatching(configuration, false))
+  {}
+
+  /**
+   * \brief Step both steppers once, and expect identical (and non-empty) replies.
+   *
+   * \param sequence_number specifying the robot message's sequence number.
+   * \param outputs containing the outputs to reply with.
+   */
+  void step(const unsigned int sequence_number, const wrapper::Output& outputs)
+  {
+    std::string data = serializeRobotMessage(sequence_number, POSITIONS);
+    const std::string& patched = patching_.step(data.data(), (int) data.size(), outputs);
+    const std::string& serialized = serializing_.step(data.data(), (int) data.size(), outputs);
+
+    ASSERT_FALSE(serialized.empty());
+    EXPECT_EQ(serialized, patched) << "sequence number " << sequence_number;
+  }
+
+private:
+  /**
+   * \brief Copy a configuration, with a specific reply patching flag.
+   *
+   * \param configuration specifying the configuration to copy.
+   * \param use_reply_patching specifying the reply patching flag.
+   *
+   * \return TrajectoryConfiguration containing the copy.
+   */
+  static TrajectoryConfiguration withPatching(const TrajectoryConfiguration& configuration,
+                                              const bool use_reply_patching)
+  {
+    TrajectoryConfiguration result(configuration);
+    result.base.use_reply_patching = use_reply_patching;
+    return result;
+  }
+
+  /**
+   * \brief The stepper that patches its replies.
+   */
+  EGMStepper patching_;
+
+  /**
+   * \brief The stepper that serializes its replies.
+   */
+  EGMStepper serializing_;
+};
+
+/**
+ * \brief Set the robot joint positions, in an output.
+ *
+ * \param p_outputs for the output.
+ * \param value specifying the value of all the positions [degrees].
+ */
+void setPositions(wrapper::Output* p_outputs, const double value)
+{
+  wrapper::Joints* p_position = p_outputs->mutable_robot()->mutable_joints()->mutable_position();
+  p_position->clear_values();
+  for (int i = 0; i < 6; ++i)
+  {
+    p_position->add_values(value);
+  }
+}
+} // end anonymous namespace
+
+TEST(EGMReplyPatching, StaticHoldRepliesAreIdentical)
+{
+  ReplyComparison comparison;
+  wrapper::Output outputs;
+  setPositions(&outputs, 1.0);
+
+  for (unsigned int i = 0; i < 100; ++i)
+  {
+    comparison.step(i, outputs);
+  }
+}
+
+TEST(EGMReplyPatching, ChangingRepliesAreIdentical)
+{
+  ReplyComparison comparison;
+  wrapper::Output outputs;
+
+  for (unsigned int i = 0; i < 300; ++i)
+  {
+    // Values with different encodings (e.g. zeros and negative zeros).
+    setPositions(&outputs, (i % 7 == 0 ? 0.0 : (i % 11 == 0 ? -0.0 : 0.001*i - 0.1)));
+    comparison.step(i, outputs);
+  }
+}
+
+TEST(EGMReplyPatching, ShapeChangesAndNewSessionsAreIdentical)
+{
+  ReplyComparison comparison;
+  wrapper::Output outputs;
+  setPositions(&outputs, 1.0);
+
+  for (unsigned int i = 0; i < 50; ++i)
+  {
+    comparison.step(i, outputs);
+  }
+
+  // Add Cartesian outputs (i.e. the message's shape changes).
+  wrapper::CartesianPose* p_pose = outputs.mutable_robot()->mutable_cartesian()->mutable_pose();
+  for (unsigned int i = 50; i < 100; ++i)
+  {
+    p_pose->mutable_position()->set_x(100.0 + i);
+    p_pose->mutable_quaternion()->set_u0(1.0);
+    comparison.step(i, outputs);
+  }
+
+  // Start a new session (i.e. the sequence numbers restart).
+  for (unsigned int i = 0; i < 50; ++i)
+  {
+    comparison.step(i, outputs);
+  }
+}
+
+TEST(EGMReplyPatching, VelocityRepliesAreIdentical)
+{
+  TrajectoryConfiguration configuration;
+  configuration.base.use_velocity_outputs = true;
+
+  ReplyComparison comparison(configuration);
+  wrapper::Output outputs;
+
+  for (unsigned int i = 0; i < 100; ++i)
+  {
+    setPositions(&outputs, 0.01*i);
+    wrapper::Joints* p_velocity = outputs.mutable_robot()->mutable_joints()->mutable_velocity();
+    p_velocity->clear_values();
+    for (int j = 0; j < 6; ++j)
+    {
+      p_velocity->add_values(i < 50 ? 2.5 : 0.0);
+    }
+    comparison.step(i, outputs);
+  }
+}
@@ -0,0 +1,204 @@
+/***********************************************************************************************************************
+ *
+ * Copyright (c) 2015, ABB Schweiz AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that
+ * the following conditions are met:
+ *
+ *    * Redistributions of source code must retain the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer in the documentation
+ *      and/or other materials provided with the
+ *      distribution.
+ *    * Neither the name of ABB nor the names of its
+ *      contributors may be used to endorse or promote
+ *      products derived from this software without
+ *      specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***********************************************************************************************************************
+ */
+
+
+#ifndef EGM_ROBOT_CONTROLLER_SIMULATOR_H
+#define EGM_ROBOT_CONTROLLER_SIMULATOR_H
+
+#include <string>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <boost/asio.hpp>
+
+#include "egm.pb.h" // Generated by Google Protocol Buffer compiler protoc
+
+namespace abb
+{
+namespace egm
+{
+namespace simulation
+{
+/**
+ * \brief Set a pose to the identity pose.
+ *
+ * \param p_pose for the pose.
+ */
+inline void setPose(EgmPose* p_pose)
+{
+  p_pose->mutable_pos()->set_x(0.0);
+  p_pose->mutable_pos()->set_y(0.0);
+  p_pose->mutable_pos()->set_z(0.0);
+  p_pose->mutable_orient()->set_u0(1.0);
+  p_pose->mutable_orient()->set_u1(0.0);
+  p_pose->mutable_orient()->set_u2(0.0);
+  p_pose->mutable_orient()->set_u3(0.0);
+}
+
+/**
+ * \brief Serialize an EGM robot message (i.e. as sent by a robot controller with six axes, every 4 [ms]).
+ *
+ * \param sequence_number specifying the message's sequence number.
+ * \param positions containing the joint positions [degrees] (used as both feedback and planned values).
+ *
+ * \return std::string containing the serialized message.
+ */
+inline std::string serializeRobotMessage(const unsigned int sequence_number, const double positions[6])
+{
+  EgmRobot robot;
+  robot.mutable_header()->set_seqno(sequence_number);
+  robot.mutable_header()->set_tm(sequence_number*4);
+  robot.mutable_header()->set_mtype(EgmHeader_MessageType_MSGTYPE_DATA);
+
+  unsigned int us = sequence_number*4000;
+  for (int i = 0; i < 6; ++i)
+  {
+    robot.mutable_feedback()->mutable_joints()->add_joints(positions[i]);
+    robot.mutable_planned()->mutable_joints()->add_joints(positions[i]);
+  }
+  robot.mutable_feedback()->mutable_time()->set_sec(1 + us / 1000000);
+  robot.mutable_feedback()->mutable_time()->set_usec(us % 1000000);
+  robot.mutable_planned()->mutable_time()->CopyFrom(robot.feedback().time());
+  setPose(robot.mutable_feedback()->mutable_cartesian());
+  setPose(robot.mutable_planned()->mutable_cartesian());
+  robot.set_mciconvergencemet(true);
+  robot.mutable_motorstate()->set_state(EgmMotorState_MotorStateType_MOTORS_ON);
+  robot.mutable_mcistate()->set_state(EgmMCIState_MCIStateType_MCI_RUNNING);
+  robot.mutable_rapidexecstate()->set_state(EgmRapidCtrlExecState_RapidCtrlExecStateType_RAPID_RUNNING);
+
+  std::string data;
+  robot.SerializeToString(&data);
+
+  return data;
+}
+
+/**
+ * \brief Class for simulating a robot controller (i.e. it sends EGM robot messages, and receives the replies).
+ */
+class RobotControllerSimulator
+{
+public:
+  /**
+   * \brief A constructor.
+   *
+   * \param port_number specifying the interface's port number.
+   */
+  RobotControllerSimulator(const unsigned short port_number)
+  :
+  socket_(io_service_, boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), 0)),
+  endpoint_(boost::asio::ip::address::from_string("127.0.0.1"), port_number),
+  sequence_number_(0)
+  {
+    timeval timeout;
+    timeout.tv_sec = 1;
+    timeout.tv_usec = 0;
+    setsockopt(socket_.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    for (int i = 0; i < 6; ++i)
+    {
+      positions_[i] = 0.0;
+    }
+  }
+
+  /**
+   * \brief Exchange one message with the interface (the feedback follows the received references).
+   *
+   * \return bool indicating if a reply was received or not.
+   */
+  bool exchange()
+  {
+    std::string data = serializeRobotMessage(sequence_number_++, positions_);
+    socket_.send_to(boost::asio::buffer(data), endpoint_);
+
+    char buffer[2048];
+    ssize_t bytes = ::recv(socket_.native_handle(), buffer, sizeof(buffer), 0);
+
+    EgmSensor sensor;
+    bool result = (bytes > 0 && sensor.ParseFromArray(buffer, (int) bytes));
+
+    for (int i = 0; result && i < 6 && i < sensor.planned().joints().joints_size(); ++i)
+    {
+      positions_[i] += 0.5*(sensor.planned().joints().joints(i) - positions_[i]);
+    }
+
+    return result;
+  }
+
+  /**
+   * \brief Retrieve a simulated joint position.
+   *
+   * \param index specifying the joint's index.
+   *
+   * \return double containing the position [degrees].
+   */
+  double position(const int index) const
+  {
+    return positions_[index];
+  }
+
+private:
+  /**
+   * \brief The io service for the simulator's socket.
+   */
+  boost::asio::io_service io_service_;
+
+  /**
+   * \brief The simulator's UDP socket.
+   */
+  boost::asio::ip::udp::socket socket_;
+
+  /**
+   * \brief The interface's address.
+   */
+  boost::asio::ip::udp::endpoint endpoint_;
+
+  /**
+   * \brief The sequence number of the next message.
+   */
+  unsigned int sequence_number_;
+
+  /**
+   * \brief The simulated joint positions [degrees] (i.e. they follow the received references).
+   */
+  double positions_[6];
+};
+
+} // end namespace simulation
+} // end namespace egm
+} // end namespace abb
+
+#endif // EGM_ROBOT_CONTROLLER_SIMULATOR_H
@@ -0,0 +1,227 @@
+/***********************************************************************************************************************
+ *
+ * Copyright (c) 2015, ABB Schweiz AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that
+ * the following conditions are met:
+ *
+ *    * Redistributions of source code must retain the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer in the documentation
+ *      and/or other materials provided with the
+ *      distribution.
+ *    * Neither the name of ABB nor the names of its
+ *      contributors may be used to endorse or promote
+ *      products derived from this software without
+ *      specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***********************************************************************************************************************
+ */
+
+// Tests of the session handover between two interfaces (e.g. in two processes during a hot restart).
+//
+// A simulated robot controller exchanges messages with the sending interface, which then hands over its session
+// to the receiving interface. The handover must only be acknowledged once the receiver has taken over the session,
+// and a rejected handover must leave the sender serving the session.
+
+#include <string>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/asio.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+
+#include <gtest/gtest.h>
+
+#include "abb_libegm/egm_base_interface.h"
+#include "abb_libegm/egm_session_handoff.h"
+
+#include "egm_robot_controller_simulator.h"
+
+using namespace abb::egm;
+using abb::egm::simulation::RobotControllerSimulator;
+
+namespace
+{
+/**
+ * \brief Max time [ms] to wait for a handover.
+ */
+const unsigned int TIMEOUT_MS = 2000;
+
+/**
+ * \brief Adopt a session, and store the result.
+ *
+ * \param p_interface for the receiving interface.
+ * \param path specifying the Unix domain socket path to listen on.
+ * \param p_result for storing the result.
+ */
+void adoptSession(EGMBaseInterface* p_interface, const std::string& path, bool* p_result)
+{
+  *p_result = p_interface->adoptSession(path, TIMEOUT_MS);
+}
+
+/**
+ * \brief Wait for a session (which is never sent), and store the result.
+ *
+ * \param path specifying the Unix domain socket path to listen on.
+ * \param p_result for storing the result.
+ */
+void receiveSession(const std::string& path, bool* p_result)
+{
+  int connection = -1;
+  int socket_handle = -1;
+  std::string state;
+
+  *p_result = EGMSessionHandoff::receive(path, &connection, &socket_handle, &state, 500);
+}
+
+/**
+ * \brief Hand over a session from one interface to another.
+ *
+ * \param p_sender for the sending interface.
+ * \param p_receiver for the receiving interface.
+ * \param p_adopted for storing if the receiver adopted the session or not.
+ *
+ * \return bool indicating if the sender handed over the session or not.
+ */
+bool handover(EGMBaseInterface* p_sender, EGMBaseInterface* p_receiver, bool* p_adopted)
+{
+  std::string path = "/tmp/egm_session_handoff_test_" + boost::lexical_cast<std::string>(getpid());
+
+  boost::thread receiver(boost::bind(&adoptSession, p_receiver, path, p_adopted));
+
+  // Give the receiver time to start listening.
+  boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+
+  bool handed_over = p_sender->handoffSession(path, TIMEOUT_MS);
+  receiver.join();
+
+  return handed_over;
+}
+
+/**
+ * \brief Exchange messages at the robot controller's sample rate (i.e. 4 [ms]).
+ *
+ * \param p_simulator for the simulated robot controller.
+ */
+void exchangeMessages(RobotControllerSimulator* p_simulator)
+{
+  for (int i = 0; i < 50; ++i)
+  {
+    EXPECT_TRUE(p_simulator->exchange());
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(4));
+  }
+}
+
+/**
+ * \brief Check if an interface is connected, while the simulated robot controller is sending messages.
+ *
+ * \param p_interface for the interface.
+ * \param p_simulator for the simulated robot controller.
+ *
+ * \return bool indicating if the interface is connected or not.
+ */
+bool isConnected(EGMBaseInterface* p_interface, RobotControllerSimulator* p_simulator)
+{
+  boost::thread simulation(boost::bind(&exchangeMessages, p_simulator));
+
+  bool connected = p_interface->isConnected();
+  simulation.join();
+
+  return connected;
+}
+} // end anonymous namespace
+
+TEST(EGMSessionHandoff, AcceptedHandoverMovesTheSession)
+{
+  boost::asio::io_service io_service;
+  EGMBaseInterface sender(io_service, 6640);
+  EGMBaseInterface receiver(io_service, 6641);
+  ASSERT_TRUE(sender.isInitialized());
+  ASSERT_TRUE(receiver.isInitialized());
+
+  boost::thread thread(boost::bind(&boost::asio::io_service::run, &io_service));
+  RobotControllerSimulator simulator(6640);
+
+  for (int i = 0; i < 10; ++i)
+  {
+    EXPECT_TRUE(simulator.exchange());
+  }
+
+  bool adopted = false;
+  EXPECT_TRUE(handover(&sender, &receiver, &adopted));
+  EXPECT_TRUE(adopted);
+
+  // The messages sent to the same port are now replied to by the receiver.
+  EXPECT_TRUE(isConnected(&receiver, &simulator));
+  EXPECT_FALSE(isConnected(&sender, &simulator));
+
+  io_service.stop();
+  thread.join();
+}
+
+TEST(EGMSessionHandoff, RejectedHandoverResumesTheSender)
+{
+  boost::asio::io_service io_service;
+  EGMBaseInterface sender(io_service, 6642);
+  EGMBaseInterface receiver(io_service, 6643);
+  ASSERT_TRUE(sender.isInitialized());
+  ASSERT_TRUE(receiver.isInitialized());
+
+  boost::thread thread(boost::bind(&boost::asio::io_service::run, &io_service));
+  RobotControllerSimulator simulator(6642);
+
+  // Without any received message, there is no session state to restore (i.e. the receiver rejects the handover).
+  bool adopted = true;
+  EXPECT_FALSE(handover(&sender, &receiver, &adopted));
+  EXPECT_FALSE(adopted);
+
+  // The sender still serves the session.
+  for (int i = 0; i < 10; ++i)
+  {
+    EXPECT_TRUE(simulator.exchange());
+  }
+  EXPECT_TRUE(isConnected(&sender, &simulator));
+  EXPECT_FALSE(isConnected(&receiver, &simulator));
+
+  io_service.stop();
+  thread.join();
+}
+
+TEST(EGMSessionHandoff, ListeningSocketIsOnlyAccessibleByTheOwner)
+{
+  std::string path = "/tmp/egm_session_handoff_test_mode_" + boost::lexical_cast<std::string>(getpid());
+
+  bool received = true;
+  boost::thread receiver(boost::bind(&receiveSession, path, &received));
+
+  // Give the receiver time to start listening.
+  boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+
+  struct stat status;
+  EXPECT_EQ(0, stat(path.c_str(), &status));
+  EXPECT_TRUE(S_ISSOCK(status.st_mode));
+  EXPECT_EQ(0u, (unsigned int) (status.st_mode & (S_IRWXG | S_IRWXO)));
+
+  receiver.join();
+  EXPECT_FALSE(received);
+}
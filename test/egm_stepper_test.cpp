@@ -0,0 +1,409 @@
+/***********************************************************************************************************************
+ *
+ * Copyright (c) 2015, ABB Schweiz AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that
+ * the following conditions are met:
+ *
+ *    * Redistributions of source code must retain the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer in the documentation
+ *      and/or other materials provided with the
+ *      distribution.
+ *    * Neither the name of ABB nor the names of its
+ *      contributors may be used to endorse or promote
+ *      products derived from this software without
+ *      specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***********************************************************************************************************************
+ */
+
+// Tests of the socket-free stepper (i.e. the core library's message processing, without any UDP server).
+//
+// The tests only link the core library. A simulated robot controller is stepped directly, where the feedback
+// follows the references in the stepper's replies.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+#include <gtest/gtest.h>
+
+#include "abb_libegm/egm_stepper.h"
+
+#include "egm_robot_controller_simulator.h"
+
+using namespace abb::egm;
+using abb::egm::simulation::serializeRobotMessage;
+
+namespace
+{
+/**
+ * \brief Step a stepper once, and let the simulated joint positions follow the reply's references.
+ *
+ * \param p_stepper for the stepper.
+ * \param sequence_number specifying the message's sequence number.
+ * \param positions for the simulated joint positions [degrees].
+ *
+ * \return bool indicating if a valid reply was constructed or not.
+ */
+bool stepOnce(EGMStepper* p_stepper, const unsigned int sequence_number, double positions[6])
+{
+  std::string data = serializeRobotMessage(sequence_number, positions);
+  const std::string& reply = p_stepper->step(data.data(), (int) data.size());
+
+  EgmSensor sensor;
+  bool result = (!reply.empty() && sensor.ParseFromString(reply));
+
+  for (int i = 0; result && i < 6 && i < sensor.planned().joints().joints_size(); ++i)
+  {
+    positions[i] = sensor.planned().joints().joints(i);
+  }
+
+  return result;
+}
+
+/**
+ * \brief Step a stepper through a short trajectory, where a joint correction is set after a few steps.
+ *
+ * \param correct indicating if the correction should be set or not.
+ * \param pause indicating if the host should pause (i.e. longer than the correction lasts) after the correction.
+ * \param p_replies for containing the replies.
+ */
+void stepCorrected(const bool correct, const bool pause, std::vector<std::string>* p_replies)
+{
+  EGMStepper stepper;
+  double positions[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+  ASSERT_TRUE(stepOnce(&stepper, 0, positions));
+
+  wrapper::trajectory::TrajectoryGoal trajectory;
+  wrapper::trajectory::PointGoal* p_point = trajectory.add_points();
+  p_point->set_duration(0.1);
+  for (int i = 0; i < 6; ++i)
+  {
+    p_point->mutable_robot()->mutable_joints()->mutable_position()->add_values(1.0);
+  }
+  ASSERT_TRUE(stepper.trajectoryMotion().addTrajectory(trajectory, false));
+
+  for (unsigned int i = 1; i < 150; ++i)
+  {
+    ASSERT_TRUE(stepOnce(&stepper, i, positions));
+    p_replies->push_back(stepper.outputs().reply());
+
+    if (correct && i == 10)
+    {
+      // Note: The correction's time is on the robot controller's clock (i.e. the message's feedback time).
+      wrapper::trajectory::Correction correction;
+      for (int j = 0; j < 6; ++j)
+      {
+        correction.mutable_robot_joints()->mutable_position()->add_values(1.0);
+      }
+
+      const wrapper::Clock& time = stepper.inputs().current().feedback().time();
+      ASSERT_TRUE(stepper.trajectoryMotion().setCorrection(correction, time.sec() + time.usec()*1.0e-6));
+
+      if (pause)
+      {
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(300));
+      }
+    }
+  }
+}
+} // end anonymous namespace
+
+TEST(EGMStepper, TrajectoryStepsReachTheGoal)
+{
+  EGMStepper stepper;
+  double positions[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+
+  // Trajectories are only accepted once a session has started.
+  ASSERT_TRUE(stepOnce(&stepper, 0, positions));
+
+  wrapper::trajectory::TrajectoryGoal trajectory;
+  wrapper::trajectory::PointGoal* p_point = trajectory.add_points();
+  p_point->set_duration(0.5);
+  for (int i = 0; i < 6; ++i)
+  {
+    p_point->mutable_robot()->mutable_joints()->mutable_position()->add_values(10.0);
+  }
+  ASSERT_TRUE(stepper.trajectoryMotion().addTrajectory(trajectory, false));
+
+  // Step for one second (i.e. twice the trajectory's duration) at the robot controller's sample rate.
+  for (unsigned int i = 1; i <= 250; ++i)
+  {
+    ASSERT_TRUE(stepOnce(&stepper, i, positions));
+  }
+
+  EXPECT_EQ(250u, stepper.outputs().sequenceNumber());
+  for (int i = 0; i < 6; ++i)
+  {
+    EXPECT_NEAR(10.0, positions[i], 0.01);
+  }
+}
+
+TEST(EGMStepper, ExternalOutputsAreReplied)
+{
+  EGMStepper stepper;
+  double positions[6] = {1.0, 2.0, 3.0, 4.0, 5.0, 6.0};
+
+  wrapper::Output outputs;
+  for (int i = 0; i < 6; ++i)
+  {
+    outputs.mutable_robot()->mutable_joints()->mutable_position()->add_values(positions[i] + 0.5);
+  }
+
+  std::string data = serializeRobotMessage(0, positions);
+  const std::string& reply = stepper.step(data.data(), (int) data.size(), outputs);
+
+  EgmSensor sensor;
+  ASSERT_FALSE(reply.empty());
+  ASSERT_TRUE(sensor.ParseFromString(reply));
+  ASSERT_EQ(6, sensor.planned().joints().joints_size());
+  for (int i = 0; i < 6; ++i)
+  {
+    EXPECT_DOUBLE_EQ(positions[i] + 0.5, sensor.planned().joints().joints(i));
+  }
+  EXPECT_TRUE(stepper.inputs().isFirstMessage());
+}
+
+TEST(EGMStepper, InvalidMessagesAreNotReplied)
+{
+  EGMStepper stepper;
+  const char garbage[] = {'\xff', '\xff', '\xff', '\xff'};
+
+  EXPECT_TRUE(stepper.step(garbage, sizeof(garbage)).empty());
+  EXPECT_TRUE(stepper.step(0, 0).empty());
+}
+
+TEST(EGMStepper, ExecutedPointsAreOnlyKeptWithinTheSeekHistory)
+{
+  for (int compact = 0; compact < 2; ++compact)
+  {
+    TrajectoryConfiguration configuration;
+    configuration.compact_storage = (compact == 1);
+    configuration.seek_history_size = 100;
+
+    EGMStepper stepper(configuration);
+    double positions[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    ASSERT_TRUE(stepOnce(&stepper, 0, positions));
+
+    // One point per robot controller sample (i.e. each point is executed during one step).
+    wrapper::trajectory::TrajectoryGoal trajectory;
+    for (int i = 0; i < 1000; ++i)
+    {
+      wrapper::trajectory::PointGoal* p_point = trajectory.add_points();
+      p_point->set_duration(0.004);
+      for (int j = 0; j < 6; ++j)
+      {
+        p_point->mutable_robot()->mutable_joints()->mutable_position()->add_values(0.01*i);
+      }
+    }
+    ASSERT_TRUE(stepper.trajectoryMotion().addTrajectory(trajectory, false));
+
+    for (unsigned int i = 1; i <= 600; ++i)
+    {
+      ASSERT_TRUE(stepOnce(&stepper, i, positions));
+    }
+
+    // Points far behind the execution have been released, while the recent ones (and the remaining ones) are kept.
+    EXPECT_FALSE(stepper.trajectoryMotion().seekTrajectory(10, 0.1));
+    EXPECT_FALSE(stepper.trajectoryMotion().seekTrajectoryTime(0.04, 0.1));
+    EXPECT_TRUE(stepper.trajectoryMotion().seekTrajectory(550, 0.1));
+    EXPECT_TRUE(stepper.trajectoryMotion().seekTrajectoryTime(3.0, 0.1));
+    EXPECT_TRUE(stepper.trajectoryMotion().seekTrajectory(900, 0.1));
+  }
+}
+
+TEST(EGMStepper, CorrectionsOnlyDependOnTheMessages)
+{
+  std::vector<std::string> uncorrected;
+  std::vector<std::string> corrected;
+  std::vector<std::string> paused;
+
+  stepCorrected(false, false, &uncorrected);
+  stepCorrected(true, false, &corrected);
+  stepCorrected(true, true, &paused);
+
+  // The correction is applied (and then faded out), in the same way regardless of the host's clock.
+  ASSERT_EQ(uncorrected.size(), corrected.size());
+  EXPECT_TRUE(uncorrected != corrected);
+  EXPECT_TRUE(corrected == paused);
+
+  // The correction has been faded out at the end (i.e. up to rounding in the rate limited offsets).
+  EgmSensor last_uncorrected;
+  EgmSensor last_corrected;
+  ASSERT_TRUE(last_uncorrected.ParseFromString(uncorrected.back()));
+  ASSERT_TRUE(last_corrected.ParseFromString(corrected.back()));
+  ASSERT_EQ(last_uncorrected.planned().joints().joints_size(), last_corrected.planned().joints().joints_size());
+
+  for (int i = 0; i < last_corrected.planned().joints().joints_size(); ++i)
+  {
+    EXPECT_NEAR(last_uncorrected.planned().joints().joints(i), last_corrected.planned().joints().joints(i), 1.0e-9);
+  }
+}
+
+TEST(EGMStepper, ReachConditionsIgnoreTheCorrection)
+{
+  EGMStepper stepper;
+  double positions[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+  ASSERT_TRUE(stepOnce(&stepper, 0, positions));
+
+  wrapper::trajectory::TrajectoryGoal trajectory;
+  for (int p = 1; p <= 2; ++p)
+  {
+    wrapper::trajectory::PointGoal* p_point = trajectory.add_points();
+    p_point->set_duration(0.2);
+    p_point->set_reach(true);
+    for (int i = 0; i < 6; ++i)
+    {
+      p_point->mutable_robot()->mutable_joints()->mutable_position()->add_values(10.0*p);
+    }
+  }
+  ASSERT_TRUE(stepper.trajectoryMotion().addTrajectory(trajectory, false));
+
+  // Step for one second, while a constant correction is held (i.e. the feedback is offset from the references).
+  wrapper::trajectory::Correction correction;
+  for (int i = 0; i < 6; ++i)
+  {
+    correction.mutable_robot_joints()->mutable_position()->add_values(1.0);
+  }
+
+  for (unsigned int i = 1; i <= 250; ++i)
+  {
+    const wrapper::Clock& time = stepper.inputs().current().feedback().time();
+    ASSERT_TRUE(stepper.trajectoryMotion().setCorrection(correction, time.sec() + time.usec()*1.0e-6));
+    ASSERT_TRUE(stepOnce(&stepper, i, positions));
+  }
+
+  // The reach points are passed, and the last point is held with the correction superimposed.
+  for (int i = 0; i < 6; ++i)
+  {
+    EXPECT_NEAR(21.0, positions[i], 0.01);
+  }
+}
+
+TEST(EGMStepper, SpeedGovernorIgnoresTheRoundTrip)
+{
+  TrajectoryConfiguration configuration;
+  configuration.use_speed_governor = true;
+  configuration.speed_governor_joint_tolerance = 0.05;
+
+  EGMStepper stepper(configuration);
+  double positions[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+  ASSERT_TRUE(stepOnce(&stepper, 0, positions));
+
+  wrapper::trajectory::TrajectoryGoal trajectory;
+  wrapper::trajectory::PointGoal* p_point = trajectory.add_points();
+  p_point->set_duration(0.5);
+  for (int i = 0; i < 6; ++i)
+  {
+    p_point->mutable_robot()->mutable_joints()->mutable_position()->add_values(10.0);
+  }
+  ASSERT_TRUE(stepper.trajectoryMotion().addTrajectory(trajectory, false));
+
+  // The simulated robot tracks perfectly, but each reply takes a few steps to reach it (i.e. a round trip delay).
+  // Note: The references move further per step than the governor's tolerance.
+  const unsigned int delay = 3;
+  std::vector<std::vector<double> > replies(delay, std::vector<double>(positions, positions + 6));
+  double max_speed_scale = 1.0;
+
+  for (unsigned int i = 1; i <= 100; ++i)
+  {
+    ASSERT_TRUE(stepOnce(&stepper, i, positions));
+    replies.push_back(std::vector<double>(positions, positions + 6));
+    std::copy(replies[i].begin(), replies[i].end(), positions);
+
+    wrapper::trajectory::ExecutionProgress progress;
+    ASSERT_TRUE(stepper.trajectoryMotion().retrieveExecutionProgress(&progress));
+    max_speed_scale = std::max(max_speed_scale, progress.speed_scale());
+  }
+
+  // The trajectory isn't slowed down (i.e. the delayed feedback matches the robot controller's planned values).
+  EXPECT_DOUBLE_EQ(1.0, max_speed_scale);
+}
+
+TEST(EGMStepper, RetractsReverseTheExecutedPath)
+{
+  EGMStepper stepper;
+  double positions[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+  ASSERT_TRUE(stepOnce(&stepper, 0, positions));
+
+  wrapper::trajectory::TrajectoryGoal trajectory;
+  for (int p = 1; p <= 5; ++p)
+  {
+    wrapper::trajectory::PointGoal* p_point = trajectory.add_points();
+    p_point->set_duration(0.1);
+    for (int i = 0; i < 6; ++i)
+    {
+      p_point->mutable_robot()->mutable_joints()->mutable_position()->add_values(2.0*p);
+    }
+  }
+  ASSERT_TRUE(stepper.trajectoryMotion().addTrajectory(trajectory, false));
+
+  for (unsigned int i = 1; i <= 150; ++i)
+  {
+    ASSERT_TRUE(stepOnce(&stepper, i, positions));
+  }
+  EXPECT_NEAR(10.0, positions[0], 0.01);
+
+  // Retract (more than) the whole executed path, i.e. back to the trajectory's start.
+  ASSERT_TRUE(stepper.trajectoryMotion().retractTrajectory(10.0));
+
+  for (unsigned int i = 151; i <= 400; ++i)
+  {
+    ASSERT_TRUE(stepOnce(&stepper, i, positions));
+  }
+
+  for (int i = 0; i < 6; ++i)
+  {
+    EXPECT_NEAR(0.0, positions[i], 0.01);
+  }
+}
+
+TEST(EGMStepper, CompactTrajectoriesKeepAngularVelocities)
+{
+  wrapper::trajectory::PointGoal point;
+  point.set_duration(0.1);
+  wrapper::trajectory::CartesianGoal* p_cartesian = point.mutable_robot()->mutable_cartesian();
+  p_cartesian->mutable_pose()->mutable_position()->set_x(100.0);
+  p_cartesian->mutable_pose()->mutable_position()->set_y(200.0);
+  p_cartesian->mutable_pose()->mutable_position()->set_z(300.0);
+  p_cartesian->mutable_angular_velocity()->set_x(-1.5);
+  p_cartesian->mutable_angular_velocity()->set_y(2.5);
+  p_cartesian->mutable_angular_velocity()->set_z(-3.5);
+  point.mutable_external()->mutable_joints()->mutable_position()->add_values(4.0);
+
+  for (int compact = 0; compact < 2; ++compact)
+  {
+    Trajectory trajectory(compact == 1);
+    trajectory.addTrajectoryPointBack(point);
+
+    wrapper::trajectory::PointGoal retrieved;
+    ASSERT_TRUE(trajectory.retriveNextTrajectoryPoint(&retrieved));
+    ASSERT_TRUE(retrieved.robot().cartesian().has_angular_velocity());
+    EXPECT_FLOAT_EQ(-1.5, retrieved.robot().cartesian().angular_velocity().x());
+    EXPECT_FLOAT_EQ(2.5, retrieved.robot().cartesian().angular_velocity().y());
+    EXPECT_FLOAT_EQ(-3.5, retrieved.robot().cartesian().angular_velocity().z());
+    EXPECT_FLOAT_EQ(100.0, retrieved.robot().cartesian().pose().position().x());
+    ASSERT_EQ(1, retrieved.external().joints().position().values_size());
+    EXPECT_FLOAT_EQ(4.0, retrieved.external().joints().position().values(0));
+  }
+}
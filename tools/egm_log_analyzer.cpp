@@ -0,0 +1,130 @@
+/***********************************************************************************************************************
+ *
+ * Copyright (c) 2015, ABB Schweiz AG
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with
+ * or without modification, are permitted provided that
+ * the following conditions are met:
+ *
+ *    * Redistributions of source code must retain the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the
+ *      above copyright notice, this list of conditions
+ *      and the following disclaimer in the documentation
+ *      and/or other materials provided with the
+ *      distribution.
+ *    * Neither the name of ABB nor the names of its
+ *      contributors may be used to endorse or promote
+ *      products derived from this software without
+ *      specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***********************************************************************************************************************
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "abb_libegm/egm_log_analyzer.h"
+
+namespace
+{
+void printUsage(const char* program)
+{
+  std::cerr << "Usage:\n"
+            << "  " << program << " [-j <threads>] [-t <sample time [s]>] <log file>...\n"
+            << "  " << program << " -r <log file> <start [ms]> <end [ms]>\n"
+            << "  " << program << " -x <log file> <output file> <start [ms]> <end [ms]>\n";
+}
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 2)
+  {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  if (std::strcmp(argv[1], "-x") == 0)
+  {
+    if (argc != 6)
+    {
+      printUsage(argv[0]);
+      return 1;
+    }
+
+    abb::egm::EGMLogAnalyzer analyzer;
+    abb::egm::EGMLogAnalyzer::TimeIndex index;
+
+    if (!index.build(argv[2]))
+    {
+      std::cerr << "Failed to index " << argv[2] << "\n";
+      return 1;
+    }
+
+    unsigned int rows = analyzer.extract(argv[2], argv[3], std::atof(argv[4]), std::atof(argv[5]), &index);
+    std::cout << "Extracted " << rows << " of " << index.numberOfRows() << " rows\n";
+    return 0;
+  }
+
+  if (std::strcmp(argv[1], "-r") == 0)
+  {
+    if (argc != 5)
+    {
+      printUsage(argv[0]);
+      return 1;
+    }
+
+    // Note: The range's start is binary searched in the file (i.e. without reading the whole file into an index).
+    abb::egm::EGMLogAnalyzer analyzer;
+    std::vector<abb::egm::EGMLogAnalyzer::Summary> summaries;
+    summaries.push_back(analyzer.analyze(argv[2], std::atof(argv[3]), std::atof(argv[4])));
+    abb::egm::EGMLogAnalyzer::writeSummaries(std::cout, summaries);
+    return (summaries.front().success ? 0 : 1);
+  }
+
+  unsigned int number_of_threads = 0;
+  double sample_time = 0.004;
+  std::vector<std::string> filenames;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+    {
+      number_of_threads = (unsigned int)std::atoi(argv[++i]);
+    }
+    else if (std::strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+    {
+      sample_time = std::atof(argv[++i]);
+    }
+    else
+    {
+      filenames.push_back(argv[i]);
+    }
+  }
+
+  if (filenames.empty())
+  {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  abb::egm::EGMLogAnalyzer analyzer(sample_time);
+  abb::egm::EGMLogAnalyzer::writeSummaries(std::cout, analyzer.analyze(filenames, number_of_threads));
+
+  return 0;
+}